@@ -0,0 +1,530 @@
+#include "AudioAnalysis.h"
+#include "JobScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr double kHopSeconds = 0.01;        // 100 analysis frames per second
+constexpr float kSilencePeak = 0.001f;      // -60 dBFS
+constexpr double kAutoTrimPreRoll = 0.01;   // keep a little before the onset
+constexpr double kMinOnsetSpacing = 0.05;   // seconds
+constexpr double kMinBpm = 60.0;
+constexpr double kMaxBpm = 200.0;
+constexpr double kPreferredBpm = 120.0;
+
+// Loudness gating (BS.1770): 400 ms blocks every 100 ms.
+constexpr double kLoudnessStepSeconds = 0.1;
+constexpr int kStepsPerBlock = 4;
+constexpr double kAbsoluteGateLufs = -70.0;
+constexpr double kRelativeGateLu = -10.0;
+// Each task runs the K-weighting filter over this much audio before its own
+// part, so it starts where a single pass would have been.
+constexpr double kFilterRunInSeconds = 0.5;
+constexpr int kTruePeakTaps = 12; // per phase, 48 in all
+constexpr int kTruePeakChunk = 4096;
+
+// Sum of squares with eight independent accumulators, which the compiler can
+// keep in one vector register.
+float sumOfSquares(const float *data, int numSamples) {
+  float acc[8] = {};
+  int i = 0;
+  for (; i + 8 <= numSamples; i += 8)
+    for (int k = 0; k < 8; ++k)
+      acc[k] += data[i + k] * data[i + k];
+
+  float total = 0.0f;
+  for (auto a : acc)
+    total += a;
+  for (; i < numSamples; ++i)
+    total += data[i] * data[i];
+  return total;
+}
+
+struct Envelope {
+  std::vector<float> peak;   // max |x| per frame, across channels
+  std::vector<float> energy; // mean square per frame, across channels
+};
+
+Envelope computeEnvelope(const juce::AudioBuffer<float> &source, int hop,
+                         const std::function<bool()> &shouldStop) {
+  const int numSamples = source.getNumSamples();
+  const int numChannels = source.getNumChannels();
+  const int numFrames = (numSamples + hop - 1) / hop;
+
+  Envelope env;
+  env.peak.assign(static_cast<size_t>(numFrames), 0.0f);
+  env.energy.assign(static_cast<size_t>(numFrames), 0.0f);
+
+  const int numTasks = juce::jlimit(1, 8, juce::SystemStats::getNumCpus());
+  const int framesPerTask = (numFrames + numTasks - 1) / numTasks;
+
+  JobScheduler::runInParallel(numTasks, [&](int task) {
+    const int first = task * framesPerTask;
+    const int last = juce::jmin(numFrames, first + framesPerTask);
+    for (int f = first; f < last; ++f) {
+      if ((f & 1023) == 0 && shouldStop())
+        return;
+
+      const int start = f * hop;
+      const int len = juce::jmin(hop, numSamples - start);
+      float peak = 0.0f, sum = 0.0f;
+      for (int ch = 0; ch < numChannels; ++ch) {
+        const float *d = source.getReadPointer(ch, start);
+        const auto range = juce::FloatVectorOperations::findMinAndMax(d, len);
+        peak = juce::jmax(peak, -range.getStart(), range.getEnd());
+        sum += sumOfSquares(d, len);
+      }
+      env.peak[static_cast<size_t>(f)] = peak;
+      env.energy[static_cast<size_t>(f)] =
+          sum / static_cast<float>(juce::jmax(1, len * numChannels));
+    }
+  });
+  return env;
+}
+
+// Half-wave rectified rise in log-compressed energy, normalised to 0..1.
+std::vector<float> computeNovelty(const Envelope &env) {
+  const size_t numFrames = env.energy.size();
+  std::vector<float> novelty(numFrames, 0.0f);
+
+  float prev = 0.0f, maxVal = 0.0f;
+  for (size_t f = 0; f < numFrames; ++f) {
+    const float compressed = std::log1p(1000.0f * env.energy[f]);
+    novelty[f] = juce::jmax(0.0f, compressed - prev);
+    prev = compressed;
+    maxVal = juce::jmax(maxVal, novelty[f]);
+  }
+
+  if (maxVal > 0.0f)
+    for (auto &n : novelty)
+      n /= maxVal;
+  return novelty;
+}
+
+// Local maxima of the novelty curve that stand out from their surroundings.
+std::vector<int> pickOnsets(const std::vector<float> &novelty,
+                            const Envelope &env, double framesPerSecond) {
+  const int numFrames = static_cast<int>(novelty.size());
+  const int peakRadius = 3;
+  const int meanRadius = 25;
+  const int minSpacing =
+      juce::jmax(1, static_cast<int>(kMinOnsetSpacing * framesPerSecond));
+
+  std::vector<double> prefix(static_cast<size_t>(numFrames) + 1, 0.0);
+  for (int f = 0; f < numFrames; ++f)
+    prefix[static_cast<size_t>(f) + 1] =
+        prefix[static_cast<size_t>(f)] + novelty[static_cast<size_t>(f)];
+
+  std::vector<int> onsets;
+  int lastOnset = -minSpacing;
+  for (int f = 0; f < numFrames; ++f) {
+    const float n = novelty[static_cast<size_t>(f)];
+    if (n < 0.05f || env.peak[static_cast<size_t>(f)] < kSilencePeak ||
+        f - lastOnset < minSpacing)
+      continue;
+
+    bool isPeak = true;
+    for (int k = juce::jmax(0, f - peakRadius);
+         k <= juce::jmin(numFrames - 1, f + peakRadius) && isPeak; ++k)
+      isPeak = novelty[static_cast<size_t>(k)] <= n;
+    if (!isPeak)
+      continue;
+
+    const int lo = juce::jmax(0, f - meanRadius);
+    const int hi = juce::jmin(numFrames, f + meanRadius + 1);
+    const double localMean =
+        (prefix[static_cast<size_t>(hi)] - prefix[static_cast<size_t>(lo)]) /
+        (hi - lo);
+    if (n > localMean + 0.1) {
+      onsets.push_back(f);
+      lastOnset = f;
+    }
+  }
+  return onsets;
+}
+
+// Tempo from the autocorrelation of the novelty curve, weighted towards
+// moderate tempi to avoid octave errors. Returns the beat period in frames
+// (0 if nothing periodic was found) and the best-fitting phase.
+std::pair<double, int> estimateBeat(const std::vector<float> &novelty,
+                                    double framesPerSecond) {
+  const int numFrames = static_cast<int>(novelty.size());
+  const int minLag = static_cast<int>(framesPerSecond * 60.0 / kMaxBpm);
+  const int maxLag = static_cast<int>(framesPerSecond * 60.0 / kMinBpm) + 1;
+  if (numFrames < 2 * maxLag)
+    return {0.0, 0};
+
+  auto autocorrelation = [&](int lag) {
+    double sum = 0.0;
+    for (int f = lag; f < numFrames; ++f)
+      sum += static_cast<double>(novelty[static_cast<size_t>(f)]) *
+             novelty[static_cast<size_t>(f - lag)];
+    return sum / (numFrames - lag);
+  };
+
+  const double zeroLag = autocorrelation(0);
+  if (zeroLag <= 0.0)
+    return {0.0, 0};
+
+  const double preferredLag = framesPerSecond * 60.0 / kPreferredBpm;
+  std::vector<double> acf(static_cast<size_t>(maxLag) + 2, 0.0);
+  int bestLag = 0;
+  double bestScore = 0.0;
+  for (int lag = minLag - 1; lag <= maxLag + 1; ++lag) {
+    acf[static_cast<size_t>(lag - minLag + 1)] = autocorrelation(lag);
+    if (lag < minLag || lag > maxLag)
+      continue;
+    const double octaves = std::log2(lag / preferredLag);
+    const double score = acf[static_cast<size_t>(lag - minLag + 1)] *
+                         std::exp(-0.5 * octaves * octaves);
+    if (score > bestScore) {
+      bestScore = score;
+      bestLag = lag;
+    }
+  }
+
+  const double peak = acf[static_cast<size_t>(bestLag - minLag + 1)];
+  if (bestLag == 0 || peak / zeroLag < 0.1)
+    return {0.0, 0};
+
+  // Parabolic refinement for a fractional period.
+  const double l = acf[static_cast<size_t>(bestLag - minLag)];
+  const double r = acf[static_cast<size_t>(bestLag - minLag + 2)];
+  const double denom = l - 2.0 * peak + r;
+  const double period =
+      bestLag + (std::abs(denom) > 1e-12 ? 0.5 * (l - r) / denom : 0.0);
+
+  // Phase: the offset whose comb of beats collects the most novelty.
+  int bestPhase = 0;
+  double bestPhaseScore = -1.0;
+  for (int phase = 0; phase < static_cast<int>(std::ceil(period)); ++phase) {
+    double sum = 0.0;
+    for (double t = phase; t < numFrames; t += period)
+      sum += novelty[static_cast<size_t>(t)];
+    if (sum > bestPhaseScore) {
+      bestPhaseScore = sum;
+      bestPhase = phase;
+    }
+  }
+  return {period, bestPhase};
+}
+
+// One section of the K-weighting filter, transposed direct form II.
+struct Biquad {
+  double b0 = 1.0, b1 = 0.0, b2 = 0.0, a1 = 0.0, a2 = 0.0;
+  double z1 = 0.0, z2 = 0.0;
+
+  double process(double x) noexcept {
+    const double y = b0 * x + z1;
+    z1 = b1 * x - a1 * y + z2;
+    z2 = b2 * x - a2 * y;
+    return y;
+  }
+};
+
+// BS.1770's pre-filter (a high shelf for the head, then a high-pass),
+// designed for any sample rate from the standard's analogue prototype.
+struct KWeighting {
+  explicit KWeighting(double sampleRate) {
+    const double pi = juce::MathConstants<double>::pi;
+    {
+      const double f0 = 1681.974450955533, gainDb = 3.999843853973347,
+                   q = 0.7071752369554196;
+      const double k = std::tan(pi * f0 / sampleRate);
+      const double vh = std::pow(10.0, gainDb / 20.0);
+      const double vb = std::pow(vh, 0.4996667741545416);
+      const double a0 = 1.0 + k / q + k * k;
+      shelf.b0 = (vh + vb * k / q + k * k) / a0;
+      shelf.b1 = 2.0 * (k * k - vh) / a0;
+      shelf.b2 = (vh - vb * k / q + k * k) / a0;
+      shelf.a1 = 2.0 * (k * k - 1.0) / a0;
+      shelf.a2 = (1.0 - k / q + k * k) / a0;
+    }
+    {
+      const double f0 = 38.13547087602444, q = 0.5003270373238773;
+      const double k = std::tan(pi * f0 / sampleRate);
+      const double a0 = 1.0 + k / q + k * k;
+      highPass.b1 = -2.0;
+      highPass.b2 = 1.0;
+      highPass.a1 = 2.0 * (k * k - 1.0) / a0;
+      highPass.a2 = (1.0 - k / q + k * k) / a0;
+    }
+  }
+
+  float process(float x) noexcept {
+    return static_cast<float>(highPass.process(shelf.process(x)));
+  }
+
+  Biquad shelf, highPass;
+};
+
+// The three in-between phases of a 4x windowed-sinc interpolator, for the
+// true peak. Each phase's taps sum to one.
+struct TruePeakFilter {
+  TruePeakFilter() {
+    const double half = kTruePeakTaps / 2;
+    for (int p = 0; p < 3; ++p) {
+      const double frac = (p + 1) / 4.0;
+      double sum = 0.0;
+      for (int k = 0; k < kTruePeakTaps; ++k) {
+        const double t = k - (half - 1.0) - frac;
+        const double x = juce::MathConstants<double>::pi * t;
+        const double window =
+            0.5 + 0.5 * std::cos(juce::MathConstants<double>::pi * t / half);
+        taps[p][k] = std::sin(x) / x * window;
+        sum += taps[p][k];
+      }
+      for (auto &tap : taps[p])
+        tap /= sum;
+    }
+  }
+
+  double taps[3][kTruePeakTaps];
+};
+
+struct Loudness {
+  double lufs = SampleAnalysis::kNoLoudness;
+  double truePeakDb = SampleAnalysis::kNoLoudness;
+  double dcOffset = 0.0;
+};
+
+// K-weighted mean square (summed over channels) to LUFS, and back.
+double energyToLufs(double energy) {
+  return -0.691 + 10.0 * std::log10(energy);
+}
+double lufsToEnergy(double lufs) {
+  return std::pow(10.0, (lufs + 0.691) / 10.0);
+}
+
+// Integrated loudness, true peak and DC offset in one pass, split into
+// sub-jobs by time. The filter is recursive, so each task runs it in from a
+// little before its own part; the interpolation and the sums are plain
+// multiply-adds over blocks, which vectorise.
+Loudness measureLoudness(const juce::AudioBuffer<float> &source,
+                         double sampleRate,
+                         const std::function<bool()> &shouldStop) {
+  const int numSamples = source.getNumSamples();
+  const int numChannels = source.getNumChannels();
+  const int step =
+      juce::jmax(1, juce::roundToInt(sampleRate * kLoudnessStepSeconds));
+  const int numSteps = numSamples / step;
+  const int runIn = static_cast<int>(sampleRate * kFilterRunInSeconds);
+
+  const int numTasks = juce::jlimit(1, 8, juce::SystemStats::getNumCpus());
+  const int stepsPerTask = (numSteps + numTasks - 1) / numTasks;
+  std::vector<double> stepEnergy(static_cast<size_t>(numSteps), 0.0);
+  std::vector<float> taskPeak(static_cast<size_t>(numTasks), 0.0f);
+  std::vector<double> channelSum(
+      static_cast<size_t>(numTasks * numChannels), 0.0);
+  const TruePeakFilter interpolator;
+
+  JobScheduler::runInParallel(numTasks, [&](int task) {
+    const int firstStep = juce::jmin(numSteps, task * stepsPerTask);
+    const int lastStep = juce::jmin(numSteps, firstStep + stepsPerTask);
+    const int begin = firstStep * step;
+    const int end = task == numTasks - 1 ? numSamples : lastStep * step;
+    std::vector<float> weighted(static_cast<size_t>(step));
+    std::vector<float> padded(kTruePeakChunk + kTruePeakTaps);
+    std::vector<float> between(kTruePeakChunk);
+    float peak = 0.0f;
+
+    for (int ch = 0; ch < numChannels; ++ch) {
+      const float *d = source.getReadPointer(ch);
+
+      // Loudness: K-weighted energy per 100 ms step.
+      KWeighting filter(sampleRate);
+      for (int i = juce::jmax(0, begin - runIn); i < begin; ++i)
+        filter.process(d[i]);
+      for (int s = firstStep; s < lastStep; ++s) {
+        if ((s & 63) == 0 && shouldStop())
+          return;
+        const float *x = d + static_cast<size_t>(s) * static_cast<size_t>(step);
+        for (int i = 0; i < step; ++i)
+          weighted[static_cast<size_t>(i)] = filter.process(x[i]);
+        stepEnergy[static_cast<size_t>(s)] +=
+            static_cast<double>(sumOfSquares(weighted.data(), step)) / step;
+      }
+
+      // True peak and DC, a chunk at a time with the interpolator's margin
+      // (zeros beyond the ends of the track).
+      double sum = 0.0;
+      for (int start = begin; start < end; start += kTruePeakChunk) {
+        if (shouldStop())
+          return;
+        const int len = juce::jmin(kTruePeakChunk, end - start);
+        const int from = start - (kTruePeakTaps / 2 - 1);
+        for (int i = 0; i < len + kTruePeakTaps - 1; ++i) {
+          const int at = from + i;
+          padded[static_cast<size_t>(i)] =
+              at >= 0 && at < numSamples ? d[at] : 0.0f;
+        }
+        const float *x = d + start;
+        const auto range = juce::FloatVectorOperations::findMinAndMax(x, len);
+        peak = juce::jmax(peak, -range.getStart(), range.getEnd());
+        for (int i = 0; i < len; ++i)
+          sum += x[i];
+
+        for (const auto &taps : interpolator.taps) {
+          juce::FloatVectorOperations::clear(between.data(), len);
+          for (int k = 0; k < kTruePeakTaps; ++k)
+            juce::FloatVectorOperations::addWithMultiply(
+                between.data(), padded.data() + k,
+                static_cast<float>(taps[k]), len);
+          const auto r =
+              juce::FloatVectorOperations::findMinAndMax(between.data(), len);
+          peak = juce::jmax(peak, -r.getStart(), r.getEnd());
+        }
+      }
+      channelSum[static_cast<size_t>(task * numChannels + ch)] = sum;
+    }
+    taskPeak[static_cast<size_t>(task)] = peak;
+  });
+
+  Loudness result;
+  if (shouldStop() || numSamples == 0)
+    return result;
+
+  float peak = 0.0f;
+  for (auto p : taskPeak)
+    peak = juce::jmax(peak, p);
+  if (peak > 0.0f)
+    result.truePeakDb =
+        juce::jmax(SampleAnalysis::kNoLoudness,
+                   20.0 * std::log10(static_cast<double>(peak)));
+  for (int ch = 0; ch < numChannels; ++ch) {
+    double sum = 0.0;
+    for (int task = 0; task < numTasks; ++task)
+      sum += channelSum[static_cast<size_t>(task * numChannels + ch)];
+    result.dcOffset =
+        juce::jmax(result.dcOffset, std::abs(sum / numSamples));
+  }
+
+  // Gating: blocks above the absolute gate, then those within 10 LU of
+  // their mean.
+  std::vector<double> blocks;
+  const double absoluteGate = lufsToEnergy(kAbsoluteGateLufs);
+  for (int s = 0; s + kStepsPerBlock <= numSteps; ++s) {
+    double energy = 0.0;
+    for (int k = 0; k < kStepsPerBlock; ++k)
+      energy += stepEnergy[static_cast<size_t>(s + k)];
+    energy /= kStepsPerBlock;
+    if (energy > absoluteGate)
+      blocks.push_back(energy);
+  }
+  if (blocks.empty())
+    return result;
+  double total = 0.0;
+  for (auto b : blocks)
+    total += b;
+  const double relativeGate = lufsToEnergy(
+      energyToLufs(total / static_cast<double>(blocks.size())) +
+      kRelativeGateLu);
+  double gated = 0.0;
+  int numGated = 0;
+  for (auto b : blocks)
+    if (b > relativeGate) {
+      gated += b;
+      ++numGated;
+    }
+  if (numGated > 0)
+    result.lufs = energyToLufs(gated / numGated);
+  return result;
+}
+} // namespace
+
+//==============================================================================
+bool SampleAnalysis::analyse(const juce::AudioBuffer<float> &source,
+                             double sampleRate,
+                             const std::function<bool()> &shouldStop) {
+  const int hop = juce::jmax(1, juce::roundToInt(sampleRate * kHopSeconds));
+  const double framesPerSecond = sampleRate / hop;
+
+  const auto env = computeEnvelope(source, hop, shouldStop);
+  if (shouldStop())
+    return false;
+
+  const int numFrames = static_cast<int>(env.peak.size());
+  int firstSound = 0, lastSound = 0;
+  while (firstSound < numFrames &&
+         env.peak[static_cast<size_t>(firstSound)] < kSilencePeak)
+    ++firstSound;
+  for (int f = numFrames; --f >= firstSound;)
+    if (env.peak[static_cast<size_t>(f)] >= kSilencePeak) {
+      lastSound = f + 1;
+      break;
+    }
+
+  const auto novelty = computeNovelty(env);
+  const auto onsetFrames = pickOnsets(novelty, env, framesPerSecond);
+  if (shouldStop())
+    return false;
+  const auto beat = estimateBeat(novelty, framesPerSecond);
+  const auto loudness = measureLoudness(source, sampleRate, shouldStop);
+  if (shouldStop())
+    return false;
+
+  const double lengthSeconds = source.getNumSamples() / sampleRate;
+  results.firstSoundSeconds =
+      juce::jmin(lengthSeconds, firstSound / framesPerSecond);
+  results.lastSoundSeconds =
+      juce::jmin(lengthSeconds, lastSound / framesPerSecond);
+  results.onsets.reserve(onsetFrames.size());
+  for (auto f : onsetFrames)
+    results.onsets.push_back(f / framesPerSecond);
+  results.firstOnsetSeconds =
+      results.onsets.empty() ? -1.0 : results.onsets.front();
+  if (beat.first > 0.0) {
+    results.bpm = 60.0 * framesPerSecond / beat.first;
+    results.beatPhaseSeconds = beat.second / framesPerSecond;
+  }
+  results.loudnessLufs = loudness.lufs;
+  results.truePeakDb = loudness.truePeakDb;
+  results.dcOffset = loudness.dcOffset;
+
+  ready.store(true, std::memory_order_release);
+  readyEvent.signal();
+  return true;
+}
+
+double SampleAnalysis::findNearestSnapPoint(double seconds,
+                                            double toleranceSeconds) const {
+  if (!isReady())
+    return -1.0;
+
+  double best = -1.0;
+  double bestDistance = toleranceSeconds;
+  auto consider = [&](double t) {
+    const double d = std::abs(t - seconds);
+    if (t >= 0.0 && d <= bestDistance) {
+      best = t;
+      bestDistance = d;
+    }
+  };
+
+  consider(results.firstSoundSeconds);
+  consider(results.lastSoundSeconds);
+
+  const auto &onsets = results.onsets;
+  const auto it = std::lower_bound(onsets.begin(), onsets.end(), seconds);
+  if (it != onsets.end())
+    consider(*it);
+  if (it != onsets.begin())
+    consider(*std::prev(it));
+
+  if (results.bpm > 0.0) {
+    const double period = 60.0 / results.bpm;
+    const double k =
+        std::round((seconds - results.beatPhaseSeconds) / period);
+    consider(results.beatPhaseSeconds + k * period);
+  }
+  return best;
+}
+
+double SampleAnalysis::getAutoTrimSeconds() const {
+  if (!isReady())
+    return 0.0;
+  const double start = results.firstOnsetSeconds >= 0.0
+                           ? results.firstOnsetSeconds
+                           : results.firstSoundSeconds;
+  return juce::jmax(0.0, start - kAutoTrimPreRoll);
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <vector>
+
+//==============================================================================
+/**
+ * What the post-load analysis pass found in a sample: where the sound starts
+ * and ends, the onsets, a tempo / beat-grid estimate, and its loudness. Used
+ * for snapping the start offset, auto-trim and loudness normalization.
+ *
+ * One instance hangs off each SampleBuffer. A background job fills it in once
+ * after loading; until isReady() returns true the results must not be read.
+ * All times are in seconds from the start of the track, so they don't depend
+ * on the host sample rate.
+ */
+class SampleAnalysis : public juce::ReferenceCountedObject {
+public:
+  using Ptr = juce::ReferenceCountedObjectPtr<SampleAnalysis>;
+
+  // Loudness and true peak of silence, or of a track too short to gate.
+  static constexpr double kNoLoudness = -100.0;
+
+  struct Results {
+    double firstSoundSeconds = 0.0; // first audio above the silence floor
+    double lastSoundSeconds = 0.0;  // end of the last audio above it
+    double firstOnsetSeconds = -1.0; // -1 if no onset was found
+    std::vector<double> onsets;
+
+    double bpm = 0.0;              // 0 = no confident tempo estimate
+    double beatPhaseSeconds = 0.0; // time of one beat of the grid
+
+    // ITU-R BS.1770 / EBU R128, every channel weighted alike.
+    double loudnessLufs = kNoLoudness; // integrated, gated
+    double truePeakDb = kNoLoudness;   // dBTP, 4x oversampled
+    double dcOffset = 0.0;             // largest channel mean
+  };
+
+  SampleAnalysis() = default;
+
+  bool isReady() const noexcept { return ready.load(std::memory_order_acquire); }
+  bool waitUntilReady(int timeoutMs) const { return readyEvent.wait(timeoutMs); }
+  const Results &getResults() const noexcept { return results; }
+
+  // Runs the whole analysis over `source`. Returns false (and stays not
+  // ready) if `shouldStop` asked it to give up.
+  bool analyse(const juce::AudioBuffer<float> &source, double sampleRate,
+               const std::function<bool()> &shouldStop);
+
+  // The onset, beat or sound boundary closest to `seconds`, or -1 if none is
+  // within `toleranceSeconds`.
+  double findNearestSnapPoint(double seconds, double toleranceSeconds) const;
+
+  // Where auto-trim puts the start offset: just before the first onset (or the
+  // first non-silent audio if there are no clear onsets).
+  double getAutoTrimSeconds() const;
+
+private:
+  Results results;
+  std::atomic<bool> ready{false};
+  juce::WaitableEvent readyEvent{true};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(SampleAnalysis)
+};
@@ -0,0 +1,99 @@
+#include "CompressedAudio.h"
+#include <cmath>
+#include <cstring>
+
+namespace {
+std::atomic<juce::uint32> nextId{1};
+
+bool isOggStream(const EmbeddedAudio::Stream &stream) {
+  return stream.second >= 4 && std::memcmp(stream.first, "OggS", 4) == 0;
+}
+} // namespace
+
+//==============================================================================
+CompressedAudio::Ptr CompressedAudio::fromFlac(EmbeddedAudio::Blob blob,
+                                               int numChannels, int numFrames,
+                                               double sampleRate) {
+  std::vector<EmbeddedAudio::Stream> streams;
+  if (blob == nullptr ||
+      !EmbeddedAudio::findStreams(blob->getData(), blob->getSize(), streams))
+    return nullptr;
+
+  Ptr c(new CompressedAudio());
+  c->blob = std::move(blob);
+  juce::int64 total = 0;
+  for (const auto &stream : streams) {
+    if (isOggStream(stream)) // lossy: not the same audio
+      return nullptr;
+    Segment segment;
+    segment.data = stream.first;
+    segment.size = stream.second;
+    segment.start = total;
+    auto reader = openSegment(segment);
+    if (reader == nullptr ||
+        static_cast<int>(reader->numChannels) != numChannels ||
+        std::abs(reader->sampleRate - sampleRate) > 0.5)
+      return nullptr;
+    segment.length = reader->lengthInSamples;
+    total += segment.length;
+    c->segments.push_back(segment);
+  }
+  if (total != numFrames || c->segments.empty())
+    return nullptr;
+
+  c->numChannels = numChannels;
+  c->numFrames = numFrames;
+  c->sampleRate = sampleRate;
+  c->id = nextId++;
+  return c;
+}
+
+CompressedAudio::Ptr
+CompressedAudio::encode(const juce::AudioBuffer<float> &audio,
+                        double sampleRate, int bitsPerSample,
+                        const std::function<bool()> &shouldStop) {
+  // Never saved, so segments are fine and decode in parallel.
+  EmbeddedAudio::Settings settings;
+  settings.numThreads = 0;
+  auto block = EmbeddedAudio::encode(audio, sampleRate, bitsPerSample,
+                                     settings, shouldStop);
+  if (block.getSize() == 0)
+    return nullptr;
+  return fromFlac(std::make_shared<const juce::MemoryBlock>(std::move(block)),
+                  audio.getNumChannels(), audio.getNumSamples(), sampleRate);
+}
+
+std::unique_ptr<juce::AudioFormatReader>
+CompressedAudio::openSegment(const Segment &s) {
+  juce::FlacAudioFormat flac;
+  return std::unique_ptr<juce::AudioFormatReader>(flac.createReaderFor(
+      new juce::MemoryInputStream(s.data, s.size, false), true));
+}
+
+//==============================================================================
+CompressedAudio::Reader::Reader(const CompressedAudio &a)
+    : audio(a), decoders(a.segments.size()) {}
+
+CompressedAudio::Reader::~Reader() = default;
+
+bool CompressedAudio::Reader::read(juce::AudioBuffer<float> &dest,
+                                   int destStart, juce::int64 start,
+                                   int numFrames) {
+  for (size_t i = 0; i < audio.segments.size() && numFrames > 0; ++i) {
+    const auto &segment = audio.segments[i];
+    if (start >= segment.start + segment.length)
+      continue;
+    auto &decoder = decoders[i];
+    if (decoder == nullptr && (decoder = openSegment(segment)) == nullptr)
+      return false;
+
+    const int n = static_cast<int>(juce::jmin<juce::int64>(
+        numFrames, segment.start + segment.length - start));
+    if (!decoder->read(&dest, destStart, n, start - segment.start, true, true))
+      return false;
+    destStart += n;
+    start += n;
+    numFrames -= n;
+  }
+  return numFrames == 0;
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "EmbeddedAudio.h"
+#include <atomic>
+#include <functional>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+ * A track's playback audio kept as FLAC instead of float, for the memory
+ * budget's compressed storage mode. 16-bit material takes about a third of
+ * the space of the decoded copy.
+ *
+ * The data is a blob in EmbeddedAudio's format, so a FLAC copy of the track
+ * that is already in memory (the embed, or the lossless copy kept for
+ * eviction), or the bytes of the FLAC file it came from, is used as it is.
+ * Any range decodes on its own: the reader seeks within the segment that
+ * holds it, so only the part about to play ever needs to be in float (see
+ * StreamBuffer).
+ *
+ * Immutable once made, and shared between threads like SampleBuffer. Never
+ * decoded on the audio thread.
+ */
+class CompressedAudio : public juce::ReferenceCountedObject {
+public:
+  using Ptr = juce::ReferenceCountedObjectPtr<CompressedAudio>;
+
+  // Wraps a FLAC blob, provided it holds exactly `numFrames` frames of
+  // `numChannels` channels at `sampleRate`; otherwise returns nullptr.
+  static Ptr fromFlac(EmbeddedAudio::Blob blob, int numChannels,
+                      int numFrames, double sampleRate);
+  // Encodes `audio` as FLAC at `bitsPerSample`, in parallel segments.
+  // Returns nullptr if `shouldStop` cancelled it.
+  static Ptr encode(const juce::AudioBuffer<float> &audio, double sampleRate,
+                    int bitsPerSample,
+                    const std::function<bool()> &shouldStop);
+
+  int getNumChannels() const noexcept { return numChannels; }
+  int getNumFrames() const noexcept { return numFrames; }
+  double getSampleRate() const noexcept { return sampleRate; }
+  const EmbeddedAudio::Blob &getBlob() const noexcept { return blob; }
+  juce::int64 getCompressedBytes() const noexcept {
+    return static_cast<juce::int64>(blob->getSize());
+  }
+  // Unique to this object for the life of the process (never reused, unlike
+  // its address), so decoded audio can say which track it came from.
+  juce::uint32 getId() const noexcept { return id; }
+
+  // Decodes ranges of one CompressedAudio, which the caller keeps alive. It
+  // keeps a decoder open per segment, so reading on from where the last read
+  // ended costs no seek. One thread at a time.
+  class Reader {
+  public:
+    explicit Reader(const CompressedAudio &audio);
+    ~Reader();
+
+    const CompressedAudio &getAudio() const noexcept { return audio; }
+
+    // Decodes frames [start, start + numFrames) into `dest` from `destStart`
+    // (`dest` has getNumChannels() channels). False on a decoder error.
+    bool read(juce::AudioBuffer<float> &dest, int destStart, juce::int64 start,
+              int numFrames);
+
+  private:
+    const CompressedAudio &audio;
+    std::vector<std::unique_ptr<juce::AudioFormatReader>> decoders;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Reader)
+  };
+
+private:
+  struct Segment {
+    const char *data = nullptr;
+    size_t size = 0;
+    juce::int64 start = 0; // first frame
+    juce::int64 length = 0;
+  };
+
+  CompressedAudio() = default;
+  static std::unique_ptr<juce::AudioFormatReader> openSegment(const Segment &s);
+
+  EmbeddedAudio::Blob blob;
+  std::vector<Segment> segments; // point into blob
+  int numChannels = 0;
+  int numFrames = 0;
+  double sampleRate = 44100.0;
+  juce::uint32 id = 0;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CompressedAudio)
+};
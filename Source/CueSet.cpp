@@ -0,0 +1,88 @@
+#include "CueSet.h"
+#include <cmath>
+
+CueSet::CueSet(const std::vector<Cue> &cues, double startOffsetSeconds,
+               const juce::AudioBuffer<float> *audio, double rate,
+               const CueSet *previous, CompressedAudio::Reader *compressed)
+    : sampleRate(rate) {
+  index.fill(-1);
+  startEntry = makeEntry(startOffsetSeconds, audio, previous, compressed);
+
+  entries.reserve(cues.size());
+  for (const auto &cue : cues) {
+    if (cue.note < 0 || cue.note > 127 ||
+        index[static_cast<size_t>(cue.note)] >= 0 ||
+        static_cast<int>(entries.size()) >= kMaxCues)
+      continue;
+    index[static_cast<size_t>(cue.note)] = static_cast<int>(entries.size());
+    entries.push_back(
+        makeEntry(cue.offsetSeconds, audio, previous, compressed));
+  }
+}
+
+CueSet::Entry CueSet::makeEntry(double offsetSeconds,
+                                const juce::AudioBuffer<float> *audio,
+                                const CueSet *previous,
+                                CompressedAudio::Reader *compressed) const {
+  Entry entry;
+  entry.offsetSeconds = offsetSeconds;
+  entry.start = static_cast<int64_t>(offsetSeconds * sampleRate);
+
+  if (audio != nullptr) {
+    const auto length = juce::jmin<int64_t>(
+        static_cast<int64_t>(kHeadSeconds * sampleRate),
+        audio->getNumSamples() - entry.start);
+    if (length > 0) {
+      const int n = static_cast<int>(length);
+      entry.head.setSize(audio->getNumChannels(), n);
+      for (int ch = 0; ch < audio->getNumChannels(); ++ch)
+        entry.head.copyFrom(ch, 0, *audio, ch, static_cast<int>(entry.start),
+                            n);
+    }
+  } else if (previous != nullptr &&
+             std::abs(previous->sampleRate - sampleRate) < 0.5) {
+    // Same audio, still evicted (or now compressed): an unmoved entry keeps
+    // its head.
+    auto reuse = [&](const Entry &old) {
+      if (old.start == entry.start && old.head.getNumSamples() > 0)
+        entry.head.makeCopyOf(old.head);
+    };
+    reuse(previous->startEntry);
+    for (const auto &old : previous->entries)
+      if (entry.head.getNumSamples() == 0)
+        reuse(old);
+  }
+
+  if (audio == nullptr && compressed != nullptr &&
+      entry.head.getNumSamples() == 0) {
+    const auto &track = compressed->getAudio();
+    const auto length = juce::jmin<int64_t>(
+        static_cast<int64_t>(kHeadSeconds * sampleRate),
+        track.getNumFrames() - entry.start);
+    if (length > 0) {
+      const int n = static_cast<int>(length);
+      entry.head.setSize(track.getNumChannels(), n);
+      if (!compressed->read(entry.head, 0, entry.start, n))
+        entry.head.setSize(0, 0);
+    }
+  }
+  return entry;
+}
+
+const CueSet::Entry *CueSet::find(int note) const noexcept {
+  if (note < 0 || note > 127)
+    return nullptr;
+  const int i = index[static_cast<size_t>(note)];
+  return i >= 0 ? &entries[static_cast<size_t>(i)] : nullptr;
+}
+
+juce::int64 CueSet::getHeadBytes() const noexcept {
+  auto bytes = [](const Entry &e) {
+    return static_cast<juce::int64>(e.head.getNumChannels()) *
+           e.head.getNumSamples() * static_cast<juce::int64>(sizeof(float));
+  };
+  juce::int64 total = bytes(startEntry);
+  for (const auto &e : entries)
+    total += bytes(e);
+  return total;
+}
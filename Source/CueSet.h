@@ -0,0 +1,73 @@
+#pragma once
+
+#include "CompressedAudio.h"
+#include <array>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <vector>
+
+//==============================================================================
+/**
+ * The cue list as the audio thread sees it: the entry points into the track,
+ * each fired by its own MIDI note, plus the start offset (fired by the
+ * trigger note).
+ *
+ * Every entry keeps a copy of the first couple of seconds of audio from its
+ * start, its "head". Heads are copied out of the decoded track when the set is
+ * built, so their pages are already faulted in. While the track itself is
+ * evicted, a note plays from its head at once, and the voice carries on into
+ * the full track when it is back. A compressed track's heads are decoded when
+ * the set is built, and a note plays from its head while the stream (see
+ * StreamBuffer) catches up.
+ *
+ * Immutable once built. The processor publishes sets to the audio thread and
+ * reclaims old ones the same way it does samples (see SampleBuffer).
+ */
+class CueSet : public juce::ReferenceCountedObject {
+public:
+  using Ptr = juce::ReferenceCountedObjectPtr<CueSet>;
+
+  struct Cue {
+    int note = 60;              // MIDI note that fires it
+    double offsetSeconds = 0.0; // into the track
+    juce::String name;          // e.g. "Verse 2"; may be empty
+  };
+
+  struct Entry {
+    double offsetSeconds = 0.0;
+    int64_t start = 0;             // in playback samples
+    juce::AudioBuffer<float> head; // audio from `start`; empty if unknown
+  };
+
+  static constexpr int kMaxCues = 32;
+  static constexpr double kHeadSeconds = 2.0;
+
+  // Builds the set against the playback audio (at `sampleRate`). Without
+  // `audio` (evicted or compressed), heads for offsets that haven't moved are
+  // carried over from `previous`, the rest are decoded from `compressed` if
+  // given, and otherwise have none.
+  CueSet(const std::vector<Cue> &cues, double startOffsetSeconds,
+         const juce::AudioBuffer<float> *audio, double sampleRate,
+         const CueSet *previous = nullptr,
+         CompressedAudio::Reader *compressed = nullptr);
+
+  // The entry for a cue note, or nullptr if the note has no cue.
+  const Entry *find(int note) const noexcept;
+  // The start offset's entry.
+  const Entry &getStartEntry() const noexcept { return startEntry; }
+
+  double getSampleRate() const noexcept { return sampleRate; }
+  juce::int64 getHeadBytes() const noexcept;
+
+private:
+  Entry makeEntry(double offsetSeconds, const juce::AudioBuffer<float> *audio,
+                  const CueSet *previous,
+                  CompressedAudio::Reader *compressed) const;
+
+  double sampleRate;
+  Entry startEntry;
+  std::vector<Entry> entries;
+  std::array<int, 128> index; // note -> entries, -1 = no cue
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(CueSet)
+};
@@ -0,0 +1,240 @@
+#include "EmbeddedAudio.h"
+#include "JobScheduler.h"
+#include <atomic>
+#include <cstring>
+#include <limits>
+
+namespace {
+constexpr char kContainerMagic[4] = {'B', 'T', 'T', 'C'};
+constexpr char kOggMagic[4] = {'O', 'g', 'g', 'S'};
+constexpr int kContainerVersion = 1;
+constexpr int kMaxSegments = 16;
+constexpr double kMinSegmentSeconds = 10.0; // shorter isn't worth splitting
+constexpr int kWriteChunk = 65536; // samples between cancel / progress checks
+
+bool isStopped(const std::function<bool()> &shouldStop) {
+  return shouldStop && shouldStop();
+}
+
+// Encodes source[start, start + numSamples) as one complete FLAC or Ogg
+// Vorbis stream.
+bool encodeStream(const juce::AudioBuffer<float> &source, int start,
+                  int numSamples, double sampleRate, int bits,
+                  const EmbeddedAudio::Settings &settings,
+                  juce::MemoryBlock &dest,
+                  const std::function<bool()> &shouldStop) {
+  juce::FlacAudioFormat flac;
+  juce::OggVorbisAudioFormat vorbis;
+  const bool lossy = settings.codec == EmbeddedAudio::Codec::oggVorbis;
+  juce::AudioFormat &format = lossy ? static_cast<juce::AudioFormat &>(vorbis)
+                                    : static_cast<juce::AudioFormat &>(flac);
+  const int quality = lossy ? juce::jlimit(0, 10, settings.vorbisQuality)
+                            : juce::jlimit(0, 8, settings.compressionLevel);
+
+  auto stream = std::make_unique<juce::MemoryOutputStream>(dest, false);
+  std::unique_ptr<juce::AudioFormatWriter> writer(format.createWriterFor(
+      stream.get(), sampleRate,
+      static_cast<unsigned int>(source.getNumChannels()), bits, {}, quality));
+  if (writer == nullptr)
+    return false;
+  stream.release(); // writer now owns the stream
+
+  for (int pos = 0; pos < numSamples; pos += kWriteChunk) {
+    if (isStopped(shouldStop))
+      return false;
+    const int len = juce::jmin(kWriteChunk, numSamples - pos);
+    if (!writer->writeFromAudioSampleBuffer(source, start + pos, len))
+      return false;
+  }
+  writer.reset(); // finishes the stream (FLAC rewrites its STREAMINFO)
+  return true;
+}
+
+bool isOggStream(const char *data, size_t size) {
+  return size >= 4 && std::memcmp(data, kOggMagic, 4) == 0;
+}
+} // namespace
+
+//==============================================================================
+EmbeddedAudio::Blob EmbeddedAudio::getOrEncode(
+    const juce::AudioBuffer<float> &source, double sampleRate,
+    int bitsPerSample, const Settings &settings,
+    const std::function<bool()> &shouldStop) {
+  const juce::ScopedLock sl(lock);
+  if (encoded != nullptr && encodedWith == settings)
+    return encoded;
+
+  auto blob = encode(source, sampleRate, bitsPerSample, settings, shouldStop);
+  if (blob.getSize() == 0)
+    return nullptr;
+
+  encoded = std::make_shared<const juce::MemoryBlock>(std::move(blob));
+  encodedWith = settings;
+  return encoded;
+}
+
+bool EmbeddedAudio::hasEncoded(const Settings &settings) const {
+  const juce::ScopedLock sl(lock);
+  return encoded != nullptr && encodedWith == settings;
+}
+
+EmbeddedAudio::Blob EmbeddedAudio::getEncoded(Settings *settingsUsed) const {
+  const juce::ScopedLock sl(lock);
+  if (settingsUsed != nullptr)
+    *settingsUsed = encodedWith;
+  return encoded;
+}
+
+void EmbeddedAudio::adopt(Blob blob, const Settings &settings) {
+  const juce::ScopedLock sl(lock);
+  encoded = blob != nullptr && blob->getSize() > 0 ? std::move(blob) : nullptr;
+  encodedWith = settings;
+}
+
+//==============================================================================
+juce::MemoryBlock EmbeddedAudio::encode(const juce::AudioBuffer<float> &source,
+                                        double sampleRate, int bitsPerSample,
+                                        const Settings &settings,
+                                        const std::function<bool()> &shouldStop) {
+  const int numSamples = source.getNumSamples();
+  if (numSamples == 0)
+    return {};
+
+  const int bits = juce::jlimit(16, 24, bitsPerSample);
+  const int threads =
+      settings.numThreads > 0
+          ? juce::jmin(settings.numThreads, kMaxSegments)
+          : juce::jlimit(1, 8, juce::SystemStats::getNumCpus());
+  const int minSegment =
+      juce::jmax(1, static_cast<int>(sampleRate * kMinSegmentSeconds));
+  const int numSegments = juce::jlimit(1, threads, numSamples / minSegment);
+
+  if (numSegments == 1) {
+    juce::MemoryBlock block;
+    if (!encodeStream(source, 0, numSamples, sampleRate, bits, settings, block,
+                      shouldStop))
+      return {};
+    return block;
+  }
+
+  const int segmentLen = (numSamples + numSegments - 1) / numSegments;
+  std::vector<juce::MemoryBlock> segments(static_cast<size_t>(numSegments));
+  std::atomic<bool> failed{false};
+
+  JobScheduler::runInParallel(numSegments, [&](int i) {
+    const int start = i * segmentLen;
+    const int len = juce::jmin(segmentLen, numSamples - start);
+    if (!encodeStream(source, start, len, sampleRate, bits, settings,
+                      segments[static_cast<size_t>(i)],
+                      [&] { return failed.load() || isStopped(shouldStop); }))
+      failed = true;
+  });
+  if (failed)
+    return {};
+
+  juce::MemoryBlock block;
+  {
+    juce::MemoryOutputStream out(block, false);
+    out.write(kContainerMagic, 4);
+    out.writeInt(kContainerVersion);
+    out.writeInt(numSegments);
+    for (const auto &segment : segments) {
+      out.writeInt64(static_cast<juce::int64>(segment.getSize()));
+      out.write(segment.getData(), segment.getSize());
+    }
+  }
+  return block;
+}
+
+bool EmbeddedAudio::decode(const void *data, size_t size,
+                           juce::AudioBuffer<float> &dest, double &sampleRate,
+                           int &bitsPerSample,
+                           const std::function<bool()> &shouldStop,
+                           const std::function<void(float)> &progress) {
+  std::vector<Stream> streams;
+  if (!findStreams(data, size, streams))
+    return false;
+
+  // Open every stream up front: that validates them and gives the total
+  // length, so each segment can then be decoded straight into place.
+  juce::FlacAudioFormat flac;
+  juce::OggVorbisAudioFormat vorbis;
+  std::vector<std::unique_ptr<juce::AudioFormatReader>> readers;
+  std::vector<int> starts;
+  juce::int64 total = 0;
+  for (const auto &s : streams) {
+    juce::AudioFormat &format =
+        isOggStream(s.first, s.second)
+            ? static_cast<juce::AudioFormat &>(vorbis)
+            : static_cast<juce::AudioFormat &>(flac);
+    std::unique_ptr<juce::AudioFormatReader> reader(format.createReaderFor(
+        new juce::MemoryInputStream(s.first, s.second, false), true));
+    if (reader == nullptr ||
+        (!readers.empty() &&
+         (reader->numChannels != readers.front()->numChannels ||
+          reader->sampleRate != readers.front()->sampleRate)))
+      return false;
+
+    starts.push_back(static_cast<int>(total));
+    total += reader->lengthInSamples;
+    if (total > std::numeric_limits<int>::max())
+      return false;
+    readers.push_back(std::move(reader));
+  }
+
+  dest.setSize(static_cast<int>(readers.front()->numChannels),
+               static_cast<int>(total));
+  std::atomic<bool> failed{false};
+  std::atomic<juce::int64> done{0};
+  JobScheduler::runInParallel(static_cast<int>(readers.size()), [&](int i) {
+    auto &reader = *readers[static_cast<size_t>(i)];
+    const int start = starts[static_cast<size_t>(i)];
+    const int length = static_cast<int>(reader.lengthInSamples);
+    for (int pos = 0; pos < length && !failed; pos += kWriteChunk) {
+      const int len = juce::jmin(kWriteChunk, length - pos);
+      if (isStopped(shouldStop) ||
+          !reader.read(&dest, start + pos, len, pos, true, true)) {
+        failed = true;
+        return;
+      }
+      const auto decoded = done += len;
+      if (progress)
+        progress(static_cast<float>(decoded) /
+                 static_cast<float>(dest.getNumSamples()));
+    }
+  });
+  if (failed)
+    return false;
+
+  sampleRate = readers.front()->sampleRate;
+  bitsPerSample = static_cast<int>(readers.front()->bitsPerSample);
+  return true;
+}
+
+bool EmbeddedAudio::findStreams(const void *data, size_t size,
+                                std::vector<Stream> &streams) {
+  streams.clear();
+  const auto *bytes = static_cast<const char *>(data);
+  if (size < 4 || std::memcmp(bytes, kContainerMagic, 4) != 0) {
+    streams.emplace_back(bytes, size);
+    return true;
+  }
+
+  juce::MemoryInputStream in(data, size, false);
+  in.skipNextBytes(4);
+  const int version = in.readInt();
+  const int numSegments = in.readInt();
+  if (version != kContainerVersion || numSegments < 1 ||
+      numSegments > kMaxSegments)
+    return false;
+
+  for (int i = 0; i < numSegments; ++i) {
+    const auto segmentSize = in.readInt64();
+    const auto pos = static_cast<size_t>(in.getPosition());
+    if (segmentSize <= 0 || static_cast<juce::uint64>(segmentSize) > size - pos)
+      return false;
+    streams.emplace_back(bytes + pos, static_cast<size_t>(segmentSize));
+    in.skipNextBytes(segmentSize);
+  }
+  return true;
+}
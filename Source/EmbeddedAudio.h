@@ -0,0 +1,99 @@
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <utility>
+#include <vector>
+#include <juce_audio_formats/juce_audio_formats.h>
+
+//==============================================================================
+/**
+ * The compressed copy of a sample that "Embed in project" writes into the
+ * plugin state.
+ *
+ * Encoding a long track takes seconds, and hosts ask for the state on every
+ * autosave and undo snapshot, so the encoded blob is made once (normally by a
+ * background job right after loading) and kept here for reuse.
+ *
+ * Blob formats:
+ *  - a plain FLAC or Ogg Vorbis stream when encoding on one thread, the
+ *    default (FLAC is readable by every version of the plugin);
+ *  - with more threads, opted into in Settings, a small container of
+ *    independent streams, one per segment of the track, so the segments can
+ *    be encoded and decoded in parallel. 2.0.x and earlier can't read it:
+ *      "BTTC" | int32 version | int32 numSegments |
+ *      numSegments x (int64 size | FLAC or Ogg stream)
+ * The codec of each stream is recognised by its magic bytes, so decoding
+ * never needs to be told which one was used.
+ */
+class EmbeddedAudio : public juce::ReferenceCountedObject {
+public:
+  using Ptr = juce::ReferenceCountedObjectPtr<EmbeddedAudio>;
+  // Encoded data is immutable once made, so callers share it, not copy it.
+  using Blob = std::shared_ptr<const juce::MemoryBlock>;
+
+  enum class Codec { flac, oggVorbis };
+
+  struct Settings {
+    int compressionLevel = 5; // FLAC 0 (fastest) .. 8 (smallest)
+    int numThreads = 1;       // 1 = one stream; 0 = one per core (up to 8)
+    Codec codec = Codec::flac;
+    int vorbisQuality = 6; // 0 (~64 kbps) .. 10 (~500 kbps), lossy only
+
+    bool operator==(const Settings &other) const noexcept {
+      return compressionLevel == other.compressionLevel &&
+             numThreads == other.numThreads && codec == other.codec &&
+             vorbisQuality == other.vorbisQuality;
+    }
+    bool operator!=(const Settings &other) const noexcept {
+      return !operator==(other);
+    }
+  };
+
+  EmbeddedAudio() = default;
+
+  // Returns the blob for `source` with the given settings, encoding it first
+  // if needed. Only one encode runs at a time: a caller that arrives while the
+  // background job is encoding waits for that result instead of starting
+  // another. Returns nullptr if `shouldStop` cancelled the encode.
+  Blob getOrEncode(const juce::AudioBuffer<float> &source, double sampleRate,
+                   int bitsPerSample, const Settings &settings,
+                   const std::function<bool()> &shouldStop);
+
+  bool hasEncoded(const Settings &settings) const;
+  // Whatever blob is cached, whatever it was encoded with (nullptr if none).
+  Blob getEncoded(Settings *settingsUsed = nullptr) const;
+
+  // Takes over a blob that was read back from a saved state, so saving the
+  // project again doesn't re-encode audio that hasn't changed.
+  void adopt(Blob blob, const Settings &settings);
+
+  //==============================================================================
+  static juce::MemoryBlock encode(const juce::AudioBuffer<float> &source,
+                                  double sampleRate, int bitsPerSample,
+                                  const Settings &settings,
+                                  const std::function<bool()> &shouldStop);
+
+  // Decodes any blob written by encode() into `dest`. Fails on anything else,
+  // or if `shouldStop` cancelled it. `progress` (0..1) may be called from
+  // several threads at once.
+  static bool decode(const void *data, size_t size,
+                     juce::AudioBuffer<float> &dest, double &sampleRate,
+                     int &bitsPerSample,
+                     const std::function<bool()> &shouldStop = nullptr,
+                     const std::function<void(float)> &progress = nullptr);
+
+  // The FLAC / Ogg streams a blob written by encode() is made of, in track
+  // order: the segments of a container, or the whole blob. False if it is a
+  // malformed container.
+  using Stream = std::pair<const char *, size_t>;
+  static bool findStreams(const void *data, size_t size,
+                          std::vector<Stream> &streams);
+
+private:
+  juce::CriticalSection lock;
+  Blob encoded; // guarded by lock
+  Settings encodedWith;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(EmbeddedAudio)
+};
@@ -0,0 +1,30 @@
+#include "FormatRegistry.h"
+
+std::unique_ptr<juce::AudioFormatReader>
+FormatRegistry::createReaderFor(std::unique_ptr<juce::InputStream> stream,
+                                const juce::String &fileExtension) {
+  if (stream == nullptr)
+    return nullptr;
+  auto &formats = getManager();
+  if (auto *format = formats.findFormatForFileExtension(fileExtension)) {
+    const auto start = stream->getPosition();
+    if (auto *reader = format->createReaderFor(stream.get(), false)) {
+      stream.release(); // the reader has it now
+      return std::unique_ptr<juce::AudioFormatReader>(reader);
+    }
+    stream->setPosition(start);
+  }
+  return std::unique_ptr<juce::AudioFormatReader>(
+      formats.createReaderFor(std::move(stream)));
+}
+
+juce::AudioFormatManager &FormatRegistry::getManager() {
+  if (!registered.load()) {
+    const juce::ScopedLock sl(lock);
+    if (!registered.load()) {
+      manager.registerBasicFormats();
+      registered = true;
+    }
+  }
+  return manager;
+}
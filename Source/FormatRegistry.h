@@ -0,0 +1,37 @@
+#pragma once
+
+#include <atomic>
+#include <juce_audio_formats/juce_audio_formats.h>
+#include <memory>
+
+//==============================================================================
+/**
+ * The audio file formats the plugin reads, shared by every instance.
+ *
+ * Registering the formats creates an object per codec, which added up when a
+ * project opened with hundreds of instances each owning its own manager. The
+ * registry is a juce::SharedResourcePointer, so a process has one, and it
+ * registers the formats on the first read rather than when the first instance
+ * is constructed. Once registered the list never changes, so any thread may
+ * open files through it at the same time.
+ */
+class FormatRegistry {
+public:
+  FormatRegistry() = default;
+
+  // A reader for `stream`, which it takes over. The format for
+  // `fileExtension` (e.g. ".wav") is tried first, then the rest. nullptr if
+  // no format can read it.
+  std::unique_ptr<juce::AudioFormatReader>
+  createReaderFor(std::unique_ptr<juce::InputStream> stream,
+                  const juce::String &fileExtension);
+
+private:
+  juce::AudioFormatManager &getManager();
+
+  juce::CriticalSection lock;
+  juce::AudioFormatManager manager; // written once, under lock
+  std::atomic<bool> registered{false};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(FormatRegistry)
+};
@@ -0,0 +1,299 @@
+#include "IoScheduler.h"
+#include <algorithm>
+#include <cstring>
+
+namespace {
+constexpr int kIdleCloseMs = 1000; // idle this long, the open files are closed
+constexpr size_t kMaxOpenFiles = 8;
+constexpr int kMaxShrink = 4; // readahead down to a sixteenth after seeks
+constexpr double kThroughputWeight = 0.25; // of the newest read, in the mean
+
+double now() { return juce::Time::getMillisecondCounterHiRes(); }
+} // namespace
+
+//==============================================================================
+struct IoScheduler::Request {
+  juce::File file;
+  juce::int64 position = 0;
+  char *dest = nullptr;
+  int numBytes = 0;
+  double deadlineMs = 0.0;
+  juce::uint64 sequence = 0; // submission order, for ties
+  int result = -1;
+  juce::WaitableEvent done;
+};
+
+class IoScheduler::IoThread : public juce::Thread {
+public:
+  explicit IoThread(IoScheduler &s)
+      : juce::Thread("BTT disk reader"), owner(s) {}
+
+  void run() override {
+    while (!threadShouldExit()) {
+      if (owner.serveNext())
+        continue;
+      // Closing files nobody is reading lets them be replaced or deleted.
+      if (!owner.wakeUp.wait(kIdleCloseMs))
+        owner.files.clear();
+    }
+  }
+
+private:
+  IoScheduler &owner;
+};
+
+//==============================================================================
+IoScheduler::IoScheduler() = default;
+
+IoScheduler::~IoScheduler() {
+  std::unique_ptr<IoThread> t;
+  {
+    const juce::ScopedLock sl(lock);
+    t = std::move(thread);
+  }
+  if (t != nullptr) {
+    t->signalThreadShouldExit();
+    wakeUp.signal();
+    t->stopThread(-1);
+  }
+}
+
+int IoScheduler::read(const juce::File &file, juce::int64 position,
+                      void *dest, int numBytes, double deadlineMs) {
+  if (numBytes <= 0)
+    return 0;
+  Request request;
+  request.file = file;
+  request.position = position;
+  request.dest = static_cast<char *>(dest);
+  request.numBytes = numBytes;
+  request.deadlineMs = deadlineMs;
+  {
+    const juce::ScopedLock sl(lock);
+    request.sequence = nextSequence++;
+    queue.push_back(&request);
+    if (thread == nullptr) {
+      thread = std::make_unique<IoThread>(*this);
+      thread->startThread();
+    }
+  }
+  wakeUp.signal();
+  request.done.wait();
+  return request.result;
+}
+
+int IoScheduler::getReadaheadBytes(double deadlineMs) const {
+  const double rate = bytesPerMs.load();
+  double bytes = rate > 0.0 ? rate * kSliceMs : 4.0 * kMinReadahead;
+  bool moreUrgent = false;
+  {
+    const juce::ScopedLock sl(lock);
+    for (const auto *r : queue)
+      moreUrgent = moreUrgent || r->deadlineMs < deadlineMs;
+  }
+  if (!moreUrgent) // nobody to hold up: read further while it's our turn
+    bytes *= 4.0;
+  return static_cast<int>(juce::jlimit(static_cast<double>(kMinReadahead),
+                                       static_cast<double>(kMaxReadahead),
+                                       bytes));
+}
+
+void IoScheduler::setPaused(bool shouldPause) {
+  {
+    const juce::ScopedLock sl(lock);
+    paused = shouldPause;
+  }
+  wakeUp.signal();
+}
+
+int IoScheduler::getNumQueued() const {
+  const juce::ScopedLock sl(lock);
+  return static_cast<int>(queue.size());
+}
+
+IoScheduler::Stats IoScheduler::getStats() const {
+  Stats stats;
+  stats.bytesRead = bytesRead.load();
+  stats.reads = reads.load();
+  stats.coalesced = coalesced.load();
+  stats.bytesPerMs = bytesPerMs.load();
+  return stats;
+}
+
+//==============================================================================
+bool IoScheduler::serveNext() {
+  std::vector<Request *> batch;
+  juce::int64 start = 0, end = 0;
+  {
+    const juce::ScopedLock sl(lock);
+    if (paused || queue.empty())
+      return false;
+    const auto best = std::min_element(
+        queue.begin(), queue.end(), [](const Request *a, const Request *b) {
+          return a->deadlineMs < b->deadlineMs ||
+                 (a->deadlineMs == b->deadlineMs && a->sequence < b->sequence);
+        });
+    batch.push_back(*best);
+    queue.erase(best);
+    start = batch[0]->position;
+    end = start + batch[0]->numBytes;
+
+    // Take along every queued read of the same file that touches the span,
+    // as long as it stays within a readahead. Each one taken can bring
+    // another within reach, so go round until none is.
+    for (bool grew = true; grew;) {
+      grew = false;
+      for (auto it = queue.begin(); it != queue.end();) {
+        auto *r = *it;
+        const auto from = juce::jmin(start, r->position);
+        const auto to = juce::jmax(end, r->position + r->numBytes);
+        if (r->file == batch[0]->file && r->position <= end &&
+            r->position + r->numBytes >= start && to - from <= kMaxReadahead) {
+          start = from;
+          end = to;
+          batch.push_back(r);
+          it = queue.erase(it);
+          grew = true;
+        } else {
+          ++it;
+        }
+      }
+    }
+    // The event is auto-reset and may have swallowed several signals, so
+    // pass the wake-up on while there is more to do.
+    if (!queue.empty())
+      wakeUp.signal();
+  }
+
+  const int span = static_cast<int>(end - start);
+  char *target = batch[0]->dest;
+  if (batch.size() > 1) {
+    if (scratchSize < static_cast<size_t>(span)) {
+      scratch.malloc(static_cast<size_t>(span));
+      scratchSize = static_cast<size_t>(span);
+    }
+    target = scratch.get();
+  }
+
+  const double started = now();
+  int got = -1;
+  if (auto *in = openFile(batch[0]->file))
+    got = in->setPosition(start) ? juce::jmax(0, in->read(target, span)) : 0;
+  const double elapsed = now() - started;
+
+  for (auto *r : batch) {
+    if (got >= 0) {
+      const auto offset = r->position - start;
+      r->result = static_cast<int>(
+          juce::jlimit<juce::int64>(0, r->numBytes, got - offset));
+      if (target != r->dest && r->result > 0)
+        std::memcpy(r->dest, target + offset,
+                    static_cast<size_t>(r->result));
+    }
+  }
+
+  if (got > 0) {
+    bytesRead += got;
+    ++reads;
+    coalesced += static_cast<int>(batch.size()) - 1;
+    if (elapsed > 0.0) {
+      const double rate = got / elapsed;
+      const double mean = bytesPerMs.load();
+      bytesPerMs = mean > 0.0 ? mean + kThroughputWeight * (rate - mean) : rate;
+    }
+  }
+  for (auto *r : batch) // after this, the requests are gone
+    r->done.signal();
+  return true;
+}
+
+juce::FileInputStream *IoScheduler::openFile(const juce::File &file) {
+  const auto modified = file.getLastModificationTime();
+  const auto it =
+      std::find_if(files.begin(), files.end(),
+                   [&](const OpenFile &f) { return f.file == file; });
+  if (it != files.end()) {
+    if (it->modified == modified) {
+      std::rotate(it, std::next(it), files.end()); // now the most recent
+      return files.back().in.get();
+    }
+    files.erase(it); // replaced since: the handle may be on the old one
+  }
+
+  auto in = std::make_unique<juce::FileInputStream>(file);
+  if (!in->openedOk())
+    return nullptr;
+  if (files.size() >= kMaxOpenFiles)
+    files.erase(files.begin());
+  files.push_back({file, modified, std::move(in)});
+  return files.back().in.get();
+}
+
+//==============================================================================
+IoScheduler::Stream::Stream(IoScheduler &scheduler, const juce::File &f,
+                            Deadline d)
+    : owner(scheduler), file(f), deadline(std::move(d)) {
+  if (file.existsAsFile())
+    length = file.getSize();
+}
+
+int IoScheduler::Stream::read(void *destBuffer, int maxBytesToRead) {
+  auto *out = static_cast<char *>(destBuffer);
+  int total = 0;
+  while (maxBytesToRead > 0 && position < length) {
+    const auto at = position - bufferStart;
+    if (at >= 0 && at < bufferSize) {
+      const int n = static_cast<int>(
+          juce::jmin<juce::int64>(maxBytesToRead, bufferSize - at));
+      std::memcpy(out, buffer.get() + at, static_cast<size_t>(n));
+      out += n;
+      total += n;
+      maxBytesToRead -= n;
+      position += n;
+      continue;
+    }
+
+    const double due = deadline != nullptr ? deadline() : now();
+    const int readahead =
+        juce::jmax(kMinReadahead, owner.getReadaheadBytes(due) >> shrink);
+    if (maxBytesToRead >= readahead) {
+      // Big reads skip the buffer, a readahead at a time so that more urgent
+      // reads get their turns in between.
+      const int got = owner.read(file, position, out, readahead, due);
+      if (got <= 0)
+        break;
+      out += got;
+      total += got;
+      maxBytesToRead -= got;
+      position += got;
+      continue;
+    }
+
+    // The last buffer was read to the end: the readahead paid off.
+    if (bufferSize > 0 && position == bufferStart + bufferSize)
+      shrink = juce::jmax(0, shrink - 1);
+    if (capacity < readahead) {
+      buffer.malloc(static_cast<size_t>(readahead));
+      capacity = readahead;
+    }
+    const int n = static_cast<int>(
+        juce::jmin<juce::int64>(readahead, length - position));
+    bufferStart = position;
+    bufferSize = juce::jmax(0, owner.read(file, position, buffer, n, due));
+    if (bufferSize == 0)
+      break;
+  }
+  return total;
+}
+
+bool IoScheduler::Stream::setPosition(juce::int64 newPosition) {
+  newPosition = juce::jlimit<juce::int64>(0, juce::jmax<juce::int64>(0, length),
+                                          newPosition);
+  // Leaving a buffer mostly unread wasted the readahead: read less next time.
+  const auto at = newPosition - bufferStart;
+  if (bufferSize > 0 && (at < 0 || at >= bufferSize) &&
+      position - bufferStart < bufferSize / 2)
+    shrink = juce::jmin(kMaxShrink, shrink + 1);
+  position = newPosition;
+  return true;
+}
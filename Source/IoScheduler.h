@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+ * One thread, shared by every plugin instance in the process, that does all
+ * their file reads, so instances opening or reloading tracks at once take
+ * turns at the disk instead of fighting over it.
+ *
+ * Each read carries a deadline: when its data is wanted. The most urgent read
+ * goes next. Audio a voice is waiting for is due now, the track an open editor
+ * shows a second from now, and preloads, caches and other background reads
+ * much later (see BackingTrackTriggerProcessor::getReadDeadlineMs()). Queued
+ * reads of the same file that touch or overlap the one being served are
+ * coalesced into a single read.
+ *
+ * Readahead follows the measured throughput: a read is sized to keep the disk
+ * busy for about kSliceMs, so a more urgent read never waits long for its
+ * turn, and is larger while nothing more urgent is queued.
+ *
+ * Callers use a Stream, which buffers what it reads ahead and asks for its
+ * deadline again before each read, so a read becomes more urgent as soon as
+ * its audio does. The thread starts on the first read.
+ */
+class IoScheduler {
+public:
+  // When data is wanted, on juce::Time::getMillisecondCounterHiRes()'s clock.
+  using Deadline = std::function<double()>;
+
+  static constexpr double kSliceMs = 20.0;
+  static constexpr int kMinReadahead = 64 * 1024;
+  static constexpr int kMaxReadahead = 4 * 1024 * 1024;
+
+  IoScheduler();
+  ~IoScheduler();
+
+  // Reads `numBytes` of `file` from `position` into `dest` on the I/O thread,
+  // after every read that is due sooner, and blocks until done. Returns the
+  // bytes read: fewer at the end of the file, -1 if it can't be opened.
+  int read(const juce::File &file, juce::int64 position, void *dest,
+           int numBytes, double deadlineMs);
+
+  // How many bytes to read ahead for a read due at `deadlineMs`.
+  int getReadaheadBytes(double deadlineMs) const;
+
+  // Holds queued reads until unpaused. For tests, to queue several at once.
+  void setPaused(bool shouldPause);
+  int getNumQueued() const;
+
+  struct Stats {
+    juce::int64 bytesRead = 0;
+    int reads = 0;           // from the disk
+    int coalesced = 0;       // requests served by another's read
+    double bytesPerMs = 0.0; // measured throughput, 0 = none yet
+  };
+  Stats getStats() const;
+
+  //============================================================================
+  // A file read through the scheduler. One thread at a time, like any
+  // juce::InputStream.
+  class Stream : public juce::InputStream {
+  public:
+    Stream(IoScheduler &scheduler, const juce::File &file, Deadline deadline);
+
+    bool openedOk() const noexcept { return length >= 0; }
+
+    juce::int64 getTotalLength() override { return length; }
+    bool isExhausted() override { return position >= length; }
+    int read(void *destBuffer, int maxBytesToRead) override;
+    juce::int64 getPosition() override { return position; }
+    bool setPosition(juce::int64 newPosition) override;
+
+  private:
+    IoScheduler &owner;
+    const juce::File file;
+    const Deadline deadline;
+    juce::int64 length = -1; // -1 = couldn't be opened
+    juce::int64 position = 0;
+    juce::HeapBlock<char> buffer;
+    int capacity = 0;
+    juce::int64 bufferStart = 0;
+    int bufferSize = 0;
+    // Readahead is shifted down by this after seeks that wasted it.
+    int shrink = 0;
+
+    JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(Stream)
+  };
+
+private:
+  class IoThread;
+  struct Request;
+
+  bool serveNext(); // I/O thread; false if there was nothing to do
+  juce::FileInputStream *openFile(const juce::File &file);
+
+  mutable juce::CriticalSection lock;
+  std::vector<Request *> queue;  // guarded by lock
+  juce::uint64 nextSequence = 0; // ditto
+  bool paused = false;           // ditto
+  std::unique_ptr<IoThread> thread; // ditto; created by the first read
+  juce::WaitableEvent wakeUp;
+
+  struct OpenFile {
+    juce::File file;
+    juce::Time modified; // reopened if the file changes
+    std::unique_ptr<juce::FileInputStream> in;
+  };
+  // I/O thread only: the files read recently, most recent last.
+  std::vector<OpenFile> files;
+  juce::HeapBlock<char> scratch; // for coalesced reads
+  size_t scratchSize = 0;
+
+  std::atomic<juce::int64> bytesRead{0};
+  std::atomic<int> reads{0};
+  std::atomic<int> coalesced{0};
+  std::atomic<double> bytesPerMs{0.0};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(IoScheduler)
+};
@@ -0,0 +1,255 @@
+#include "JobScheduler.h"
+#include <algorithm>
+
+namespace {
+constexpr int kIdleWaitMs = 250; // how often an idle worker checks for exit
+
+// The job this thread is running, for the sub-jobs it forks.
+thread_local const JobScheduler::Job *currentJob = nullptr;
+} // namespace
+
+//==============================================================================
+JobScheduler::Job::Job(const juce::String &jobName, Priority jobPriority,
+                       Work jobWork, juce::uint64 jobSequence)
+    : name(jobName), priority(jobPriority), sequence(jobSequence),
+      work(std::move(jobWork)) {}
+
+void JobScheduler::Job::setProgress(float newProgress) noexcept {
+  progress.store(juce::jlimit(0.0f, 1.0f, newProgress));
+}
+
+bool JobScheduler::Job::waitUntilFinished(int timeoutMs) const {
+  return finishedEvent.wait(timeoutMs);
+}
+
+void JobScheduler::Job::run() {
+  const auto *outer = currentJob; // a sub-job may run inside its parent
+  currentJob = this;
+  if (!isCancelled() && work)
+    work(*this);
+  currentJob = outer;
+  markFinished();
+}
+
+void JobScheduler::Job::markFinished() {
+  // Release whatever the work captured before anyone waiting is woken.
+  work = nullptr;
+  finished.store(true);
+  finishedEvent.signal();
+}
+
+//==============================================================================
+class JobScheduler::Worker : public juce::Thread {
+public:
+  Worker(JobScheduler &s, int index)
+      : juce::Thread("BTT worker " + juce::String(index)), owner(s) {}
+
+  void run() override {
+    while (!threadShouldExit())
+      if (auto job = owner.popNext())
+        job->run();
+  }
+
+private:
+  JobScheduler &owner;
+};
+
+//==============================================================================
+JobScheduler::JobScheduler()
+    : JobScheduler(juce::jlimit(2, 4, juce::SystemStats::getNumCpus() / 2)) {}
+
+JobScheduler::JobScheduler(int numThreads) {
+  for (int i = 0; i < juce::jmax(1, numThreads); ++i) {
+    workers.push_back(std::make_unique<Worker>(*this, i));
+    workers.back()->startThread();
+  }
+}
+
+JobScheduler::~JobScheduler() {
+  for (auto &w : workers)
+    w->signalThreadShouldExit();
+  for (auto &w : workers) {
+    wakeUp.signal();
+    w->stopThread(-1);
+  }
+
+  // Anything still queued never runs; don't leave a waiter hanging.
+  const juce::ScopedLock sl(lock);
+  for (auto &job : queue)
+    job->markFinished();
+  queue.clear();
+}
+
+JobScheduler::Job::Ptr JobScheduler::schedule(const juce::String &name,
+                                              Priority priority,
+                                              Job::Work work) {
+  Job::Ptr job;
+  {
+    const juce::ScopedLock sl(lock);
+    job = new Job(name, priority, std::move(work), nextSequence++);
+    queue.push_back(job);
+  }
+  wakeUp.signal();
+  return job;
+}
+
+void JobScheduler::cancel(const Job::Ptr &job) {
+  if (job == nullptr)
+    return;
+  job->cancel();
+
+  const juce::ScopedLock sl(lock);
+  const auto it = std::find(queue.begin(), queue.end(), job);
+  if (it != queue.end()) {
+    queue.erase(it);
+    job->markFinished();
+  }
+}
+
+void JobScheduler::runInParallel(int numTasks,
+                                 const std::function<void(int)> &task) {
+  if (numTasks <= 1) {
+    if (numTasks == 1)
+      task(0);
+    return;
+  }
+  const juce::SharedResourcePointer<JobScheduler> scheduler;
+  scheduler->fork(numTasks, task);
+}
+
+void JobScheduler::fork(int numTasks, const std::function<void(int)> &task) {
+  const auto *parent = currentJob;
+  const auto priority = parent != nullptr ? parent->priority : Priority::normal;
+  const juce::String name = parent != nullptr ? parent->name : "Parallel";
+
+  std::vector<Job::Ptr> parts;
+  {
+    const juce::ScopedLock sl(lock);
+    // The parent's sequence puts the parts level with it, ahead of what was
+    // queued after it.
+    const auto sequence = parent != nullptr ? parent->sequence : nextSequence++;
+    for (int i = 1; i < numTasks; ++i) {
+      parts.push_back(new Job(name, priority, [&task, i](Job &) { task(i); },
+                              sequence));
+      queue.push_back(parts.back());
+    }
+  }
+  wakeUp.signal();
+
+  task(0);
+  // Whatever no worker has taken yet runs here; then wait for the rest.
+  for (auto &part : parts)
+    if (unqueue(part))
+      part->run();
+  for (auto &part : parts)
+    part->waitUntilFinished();
+}
+
+bool JobScheduler::unqueue(const Job::Ptr &job) {
+  const juce::ScopedLock sl(lock);
+  const auto it = std::find(queue.begin(), queue.end(), job);
+  if (it == queue.end())
+    return false;
+  queue.erase(it);
+  return true;
+}
+
+int JobScheduler::getNumQueued() const {
+  const juce::ScopedLock sl(lock);
+  return static_cast<int>(queue.size());
+}
+
+JobScheduler::Job::Ptr JobScheduler::popNext() {
+  {
+    const juce::ScopedLock sl(lock);
+    if (!queue.empty()) {
+      auto best = queue.begin();
+      for (auto it = std::next(best); it != queue.end(); ++it)
+        if ((*it)->priority > (*best)->priority ||
+            ((*it)->priority == (*best)->priority &&
+             (*it)->sequence < (*best)->sequence))
+          best = it;
+
+      Job::Ptr job = *best;
+      queue.erase(best);
+      // The event is auto-reset and may have swallowed several signals, so
+      // pass the wake-up on while there is more to do.
+      if (!queue.empty())
+        wakeUp.signal();
+      return job;
+    }
+  }
+  wakeUp.wait(kIdleWaitMs);
+  return nullptr;
+}
+
+//==============================================================================
+JobGroup::~JobGroup() { cancelAllAndWait(); }
+
+JobScheduler::Job::Ptr JobGroup::schedule(const juce::String &name,
+                                          JobScheduler::Priority priority,
+                                          JobScheduler::Job::Work work) {
+  const juce::ScopedLock sl(lock);
+  if (scheduler == nullptr) // the first group to get here starts the workers
+    scheduler = std::make_unique<juce::SharedResourcePointer<JobScheduler>>();
+  auto job = (*scheduler)->schedule(name, priority, std::move(work));
+  removeFinished();
+  jobs.add(job);
+  return job;
+}
+
+void JobGroup::cancel(const JobScheduler::Job::Ptr &job) {
+  if (auto *s = getScheduler())
+    s->cancel(job);
+}
+
+void JobGroup::cancelAll() {
+  juce::ReferenceCountedArray<JobScheduler::Job> toCancel;
+  {
+    const juce::ScopedLock sl(lock);
+    removeFinished();
+    toCancel = jobs;
+  }
+  if (toCancel.isEmpty())
+    return;
+  auto *s = getScheduler(); // there are jobs, so there is one
+  for (auto *job : toCancel)
+    s->cancel(job);
+}
+
+void JobGroup::cancelAllAndWait() {
+  // A running job may schedule follow-up work (a load starts its peak and
+  // analysis jobs), so repeat until nothing is left.
+  for (;;) {
+    cancelAll();
+    juce::ReferenceCountedArray<JobScheduler::Job> toWait;
+    {
+      const juce::ScopedLock sl(lock);
+      removeFinished();
+      toWait = jobs;
+    }
+    if (toWait.isEmpty())
+      return;
+    for (auto *job : toWait)
+      job->waitUntilFinished();
+  }
+}
+
+int JobGroup::getNumActive() const {
+  const juce::ScopedLock sl(lock);
+  int n = 0;
+  for (auto *job : jobs)
+    n += job->isFinished() ? 0 : 1;
+  return n;
+}
+
+JobScheduler *JobGroup::getScheduler() const {
+  const juce::ScopedLock sl(lock);
+  return scheduler != nullptr ? &scheduler->get() : nullptr;
+}
+
+void JobGroup::removeFinished() {
+  for (int i = jobs.size(); --i >= 0;)
+    if (jobs.getUnchecked(i)->isFinished())
+      jobs.remove(i);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <juce_core/juce_core.h>
+#include <memory>
+#include <vector>
+
+//==============================================================================
+/**
+ * A small pool of worker threads, shared by every plugin instance in the
+ * process, that runs the heavy per-sample work: loading, decoding, resampling,
+ * waveform peaks, analysis and embed encoding.
+ *
+ * Queued jobs run highest priority first, then in the order they were
+ * scheduled. Each job gets a Job handle that carries its cancellation flag and
+ * progress. The work polls isCancelled() and calls setProgress() as it goes,
+ * and whoever started it can cancel it, read its progress or wait for it.
+ * Cancelling a job that hasn't started yet drops it from the queue.
+ *
+ * A job can split its work into pieces that run side by side with
+ * runInParallel(). The pieces are queued as sub-jobs with the job's own
+ * priority, so they never jump ahead of more urgent work, and the calling
+ * thread runs any piece no worker has picked up yet. That is also why a
+ * job that waits for its pieces can't starve the pool.
+ *
+ * Plugin code doesn't use the scheduler directly but goes through a JobGroup
+ * (see below).
+ */
+class JobScheduler {
+public:
+  enum class Priority { background, normal, interactive };
+
+  class Job : public juce::ReferenceCountedObject {
+  public:
+    using Ptr = juce::ReferenceCountedObjectPtr<Job>;
+    using Work = std::function<void(Job &)>;
+
+    const juce::String &getName() const noexcept { return name; }
+    Priority getPriority() const noexcept { return priority; }
+
+    // Asks the work to stop at its next check. Use JobScheduler::cancel() to
+    // also drop a job that hasn't started.
+    void cancel() noexcept { cancelled.store(true); }
+    bool isCancelled() const noexcept { return cancelled.load(); }
+    // For work that takes a `shouldStop` callback. Only valid while the
+    // caller holds a reference to this job.
+    std::function<bool()> getStopCheck() {
+      return [this] { return isCancelled(); };
+    }
+
+    // 0..1. Safe to call from any thread, including several at once.
+    void setProgress(float newProgress) noexcept;
+    float getProgress() const noexcept { return progress.load(); }
+
+    // True once the work has returned (or the job was dropped unstarted).
+    bool isFinished() const noexcept { return finished.load(); }
+    bool waitUntilFinished(int timeoutMs = -1) const;
+
+  private:
+    friend class JobScheduler;
+    Job(const juce::String &jobName, Priority jobPriority, Work jobWork,
+        juce::uint64 jobSequence);
+    void run();
+    void markFinished();
+
+    const juce::String name;
+    const Priority priority;
+    const juce::uint64 sequence; // scheduling order, for FIFO within a priority
+    Work work;
+    std::atomic<bool> cancelled{false};
+    std::atomic<float> progress{0.0f};
+    std::atomic<bool> finished{false};
+    juce::WaitableEvent finishedEvent{true};
+
+    JUCE_DECLARE_NON_COPYABLE(Job)
+  };
+
+  JobScheduler();
+  explicit JobScheduler(int numThreads);
+  ~JobScheduler();
+
+  Job::Ptr schedule(const juce::String &name, Priority priority,
+                    Job::Work work);
+
+  // Cancels `job`, dropping it from the queue if it hasn't started.
+  void cancel(const Job::Ptr &job);
+
+  int getNumThreads() const noexcept {
+    return static_cast<int>(workers.size());
+  }
+  int getNumQueued() const;
+
+  // Runs `task(0) .. task(numTasks - 1)` on the process-wide scheduler and
+  // returns once all are done. Called from a job, the pieces take its
+  // priority and place in the queue; from anywhere else they are normal.
+  // Never from the audio thread.
+  static void runInParallel(int numTasks,
+                            const std::function<void(int)> &task);
+
+private:
+  class Worker;
+  Job::Ptr popNext();
+  void fork(int numTasks, const std::function<void(int)> &task);
+  bool unqueue(const Job::Ptr &job); // true if it hadn't started
+
+  juce::CriticalSection lock;
+  std::vector<Job::Ptr> queue; // guarded by lock
+  juce::uint64 nextSequence = 0; // guarded by lock
+  juce::WaitableEvent wakeUp;
+  std::vector<std::unique_ptr<Worker>> workers;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(JobScheduler)
+};
+
+//==============================================================================
+/**
+ * One owner's jobs on the process-wide JobScheduler.
+ *
+ * The group keeps a handle to everything it has scheduled. On destruction it
+ * cancels them all and waits until none is running, so jobs may safely
+ * capture the object that owns the group.
+ *
+ * The scheduler is only acquired on the first schedule(), so a group that
+ * never runs anything costs no threads (a host scanning plugins, or a project
+ * opening with hundreds of empty instances).
+ */
+class JobGroup {
+public:
+  JobGroup() = default;
+  ~JobGroup();
+
+  JobScheduler::Job::Ptr schedule(const juce::String &name,
+                                  JobScheduler::Priority priority,
+                                  JobScheduler::Job::Work work);
+  void cancel(const JobScheduler::Job::Ptr &job);
+
+  void cancelAll();
+  // Cancels everything and blocks until no job of this group is running.
+  void cancelAllAndWait();
+
+  // Jobs scheduled by this group that haven't finished yet.
+  int getNumActive() const;
+
+private:
+  JobScheduler *getScheduler() const; // nullptr until the first schedule()
+  void removeFinished();              // caller holds lock
+
+  juce::CriticalSection lock;
+  // guarded by lock; set once, then kept for the life of the group
+  std::unique_ptr<juce::SharedResourcePointer<JobScheduler>> scheduler;
+  juce::ReferenceCountedArray<JobScheduler::Job> jobs; // guarded by lock
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(JobGroup)
+};
@@ -0,0 +1,201 @@
+#include "MemoryBudget.h"
+#include <algorithm>
+#include <utility>
+
+namespace {
+constexpr int kTickMs = 200;
+constexpr int kReleaseWaitMs = 5;
+constexpr juce::int64 kMegabyte = 1024 * 1024;
+constexpr juce::int64 kMinAutoLimit = 512 * kMegabyte;
+constexpr juce::int64 kMaxAutoLimit = 8192 * kMegabyte;
+constexpr int kDefaultLockWindowMB = 256;
+const char *const kLimitKey = "memoryBudgetMB";
+const char *const kLockKey = "lockPlayback";
+const char *const kLockWindowKey = "lockWindowMB";
+const char *const kCompressedKey = "compressedStorage";
+
+std::atomic<bool> settingsFileEnabled{true};
+} // namespace
+
+//==============================================================================
+class MemoryBudget::TickThread : public juce::Thread {
+public:
+  explicit TickThread(MemoryBudget &b)
+      : juce::Thread("BTT memory budget"), owner(b) {}
+
+  void run() override {
+    while (!threadShouldExit()) {
+      owner.tick();
+      owner.wakeUp.wait(kTickMs);
+    }
+  }
+
+private:
+  MemoryBudget &owner;
+};
+
+//==============================================================================
+MemoryBudget::MemoryBudget() {
+  if (auto settings = openSettings()) {
+    limitSetting = juce::jmax<juce::int64>(
+        0, static_cast<juce::int64>(settings->getIntValue(kLimitKey, 0)) *
+               kMegabyte);
+    lockPlayback = settings->getBoolValue(kLockKey, false);
+    lockWindow =
+        juce::jmax<juce::int64>(1, settings->getIntValue(
+                                       kLockWindowKey, kDefaultLockWindowMB)) *
+        kMegabyte;
+    compressedStorage = settings->getBoolValue(kCompressedKey, false);
+  } else {
+    lockWindow = kDefaultLockWindowMB * kMegabyte;
+  }
+}
+
+MemoryBudget::~MemoryBudget() {
+  const juce::ScopedLock sl(threadLock);
+  if (thread == nullptr)
+    return;
+  thread->signalThreadShouldExit();
+  wakeUp.signal();
+  thread->stopThread(-1);
+}
+
+void MemoryBudget::poke() {
+  if (!ticking.load()) {
+    const juce::ScopedLock sl(threadLock);
+    if (thread == nullptr) {
+      thread = std::make_unique<TickThread>(*this);
+      thread->startThread(juce::Thread::Priority::low);
+      ticking = true;
+    }
+  }
+  wakeUp.signal();
+}
+
+void MemoryBudget::add(Client *client) {
+  const juce::ScopedLock sl(clientsLock);
+  clients.push_back(client);
+}
+
+void MemoryBudget::remove(Client *client) {
+  for (;;) {
+    {
+      const juce::ScopedLock sl(clientsLock);
+      clients.erase(std::remove(clients.begin(), clients.end(), client),
+                    clients.end());
+      if (inUse != client)
+        return;
+    }
+    // Timed: another remove() may have taken the signal.
+    released.wait(kReleaseWaitMs);
+  }
+}
+
+bool MemoryBudget::withClient(Client *client,
+                              const std::function<void(Client &)> &fn) {
+  {
+    const juce::ScopedLock sl(clientsLock);
+    if (std::find(clients.begin(), clients.end(), client) == clients.end())
+      return false;
+    inUse = client;
+  }
+  fn(*client);
+  {
+    const juce::ScopedLock sl(clientsLock);
+    inUse = nullptr;
+  }
+  released.signal();
+  return true;
+}
+
+juce::int64 MemoryBudget::getLimitBytes() const {
+  const auto setting = limitSetting.load();
+  return setting > 0 ? setting : getAutomaticLimitBytes();
+}
+
+void MemoryBudget::setLimitSetting(juce::int64 bytes) {
+  limitSetting = juce::jmax<juce::int64>(0, bytes);
+  if (auto settings = openSettings()) {
+    // Rounded up, so a small limit isn't saved as 0 (automatic).
+    const auto mb = (limitSetting.load() + kMegabyte - 1) / kMegabyte;
+    settings->setValue(kLimitKey, static_cast<int>(mb));
+    settings->save();
+  }
+  poke();
+}
+
+void MemoryBudget::setPlaybackLockEnabled(bool shouldLock) {
+  lockPlayback = shouldLock;
+  if (auto settings = openSettings()) {
+    settings->setValue(kLockKey, shouldLock);
+    settings->save();
+  }
+  poke();
+}
+
+void MemoryBudget::setCompressedStorageEnabled(bool shouldCompress) {
+  compressedStorage = shouldCompress;
+  if (auto settings = openSettings()) {
+    settings->setValue(kCompressedKey, shouldCompress);
+    settings->save();
+  }
+  poke();
+}
+
+juce::int64 MemoryBudget::getAutomaticLimitBytes() {
+  const auto physical =
+      static_cast<juce::int64>(juce::SystemStats::getMemorySizeInMegabytes()) *
+      kMegabyte;
+  return juce::jlimit(kMinAutoLimit, kMaxAutoLimit, physical / 4);
+}
+
+void MemoryBudget::setSettingsFileEnabled(bool shouldUse) {
+  settingsFileEnabled = shouldUse;
+}
+
+std::unique_ptr<juce::PropertiesFile> MemoryBudget::openSettings() const {
+  if (!settingsFileEnabled.load())
+    return nullptr;
+  juce::PropertiesFile::Options options;
+  options.applicationName = "BackingTrackTrigger";
+  options.filenameSuffix = "settings";
+  options.folderName = "BackingTrackTrigger";
+  options.osxLibrarySubFolder = "Application Support";
+  return std::make_unique<juce::PropertiesFile>(options);
+}
+
+void MemoryBudget::tick() {
+  std::vector<Client *> snapshot;
+  {
+    const juce::ScopedLock sl(clientsLock);
+    snapshot = clients;
+  }
+
+  juce::int64 used = 0;
+  for (auto *client : snapshot)
+    withClient(client, [&](Client &c) {
+      c.updateResidency();
+      used += c.getResidentBytes();
+    });
+
+  const auto limit = getLimitBytes();
+  if (used > limit) {
+    // Least recently active first.
+    std::vector<std::pair<double, Client *>> idle;
+    for (auto *client : snapshot)
+      withClient(client, [&](Client &c) {
+        if (c.canEvict())
+          idle.emplace_back(c.getLastActiveTimeMs(), &c);
+      });
+    std::sort(idle.begin(), idle.end(),
+              [](const auto &a, const auto &b) { return a.first < b.first; });
+
+    for (const auto &candidate : idle) {
+      if (used <= limit)
+        break;
+      withClient(candidate.second,
+                 [&](Client &c) { used -= c.evict(); });
+    }
+  }
+  usedBytes = used;
+}
@@ -0,0 +1,105 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <juce_data_structures/juce_data_structures.h>
+#include <vector>
+
+//==============================================================================
+/**
+ * A process-wide cap on decoded audio, shared by every plugin instance.
+ *
+ * A big score can hold dozens of instances, each with a track decoded to
+ * float. Each instance registers itself as a Client. A background thread adds
+ * up what the clients hold a few times a second. While the total is over the
+ * limit, it asks idle clients to evict their audio, least recently active
+ * first. It also gives every client a chance to bring its audio back
+ * (rehydrate) before it's needed.
+ *
+ * The limit is a per-user setting shared by all instances and saved in the
+ * plugin's settings file. 0 means automatic: a quarter of physical memory,
+ * between 512 MB and 8 GB. The same file holds the playback-lock option (see
+ * PageLock), the size of each instance's locked window, and the compressed
+ * storage mode (see CompressedAudio).
+ *
+ * The thread starts on the first poke(), which a client makes once it holds
+ * audio: until then there is nothing to add up. It calls the clients outside
+ * the lock on the list, so adding or removing one never waits for a tick.
+ */
+class MemoryBudget {
+public:
+  class Client {
+  public:
+    virtual ~Client() = default;
+
+    // Bytes of audio currently held, decoded or compressed.
+    virtual juce::int64 getResidentBytes() const = 0;
+    // When the client was last playing, visible or about to play.
+    virtual double getLastActiveTimeMs() const = 0;
+    // True if the audio could go now without being missed soon.
+    virtual bool canEvict() const = 0;
+    // Drops the decoded audio, keeping a way to get it back. Returns the
+    // bytes freed, which is 0 if the client first has to prepare something.
+    virtual juce::int64 evict() = 0;
+    // Called every tick: rehydrate evicted audio that will be needed soon.
+    virtual void updateResidency() = 0;
+  };
+
+  MemoryBudget();
+  ~MemoryBudget();
+
+  // Called from the client's constructor / destructor. remove() waits while
+  // a tick is calling the client.
+  void add(Client *client);
+  void remove(Client *client);
+
+  juce::int64 getLimitBytes() const;
+  juce::int64 getUsedBytes() const noexcept { return usedBytes.load(); }
+  // 0 = automatic. Saved for future sessions.
+  juce::int64 getLimitSetting() const noexcept { return limitSetting.load(); }
+  void setLimitSetting(juce::int64 bytes);
+  static juce::int64 getAutomaticLimitBytes();
+
+  // For tests: while off, budgets created from then on start from the
+  // defaults and the setters below leave the user's settings file alone.
+  static void setSettingsFileEnabled(bool shouldUse);
+
+  // Keep the audio about to play locked in RAM (saved for future sessions).
+  bool isPlaybackLockEnabled() const noexcept { return lockPlayback.load(); }
+  void setPlaybackLockEnabled(bool shouldLock);
+  juce::int64 getLockWindowBytes() const noexcept { return lockWindow.load(); }
+
+  // Keep idle tracks compressed (FLAC) in RAM, decoding just ahead of
+  // playback (saved for future sessions).
+  bool isCompressedStorageEnabled() const noexcept {
+    return compressedStorage.load();
+  }
+  void setCompressedStorageEnabled(bool shouldCompress);
+
+  // Runs a tick now instead of waiting for the next one. Not on the audio
+  // thread: the first call starts the budget's thread.
+  void poke();
+
+private:
+  class TickThread;
+  void tick();
+  // Calls `fn` outside clientsLock, unless the client has been removed.
+  bool withClient(Client *client, const std::function<void(Client &)> &fn);
+  std::unique_ptr<juce::PropertiesFile> openSettings() const;
+
+  juce::CriticalSection clientsLock;
+  std::vector<Client *> clients; // guarded by clientsLock
+  Client *inUse = nullptr;       // ditto; the client a tick is calling
+  juce::WaitableEvent released;  // a tick is done with inUse
+  std::atomic<juce::int64> usedBytes{0};
+  std::atomic<juce::int64> limitSetting{0};
+  std::atomic<bool> lockPlayback{false};
+  std::atomic<juce::int64> lockWindow{0};
+  std::atomic<bool> compressedStorage{false};
+  juce::WaitableEvent wakeUp;
+  juce::CriticalSection threadLock;
+  std::unique_ptr<TickThread> thread; // guarded by threadLock
+  std::atomic<bool> ticking{false};   // thread has started
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(MemoryBudget)
+};
@@ -0,0 +1,227 @@
+#include "PageLock.h"
+#include <algorithm>
+
+#if JUCE_WINDOWS
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/resource.h> // getrusage
+#endif
+
+namespace {
+std::uintptr_t getPageSize() {
+  static const auto size = static_cast<std::uintptr_t>(
+      juce::jmax(4096, juce::SystemStats::getPageSize()));
+  return size;
+}
+
+juce::int64 getMajorFaultCount() {
+#if JUCE_WINDOWS
+  return -1; // the process counters lump soft and hard faults together
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return -1;
+  return static_cast<juce::int64>(usage.ru_majflt);
+#endif
+}
+
+bool lockPages(const void *start, size_t size) {
+#if JUCE_WINDOWS
+  if (VirtualLock(const_cast<void *>(start), size))
+    return true;
+  // The lock counts against the minimum working set; grow it and retry.
+  SIZE_T minimum = 0, maximum = 0;
+  auto *process = GetCurrentProcess();
+  if (!GetProcessWorkingSetSize(process, &minimum, &maximum) ||
+      !SetProcessWorkingSetSize(process, minimum + size,
+                                juce::jmax(maximum, minimum + size)))
+    return false;
+  return VirtualLock(const_cast<void *>(start), size) != 0;
+#else
+  // The soft RLIMIT_MEMLOCK is left as the user set it: if it is too small
+  // the lock is refused and the pages stay prefaulted only.
+  return mlock(start, size) == 0;
+#endif
+}
+
+void unlockPages(const void *start, size_t size) {
+#if JUCE_WINDOWS
+  VirtualUnlock(const_cast<void *>(start), size);
+#else
+  munlock(start, size);
+#endif
+}
+
+// Reads one sample per page, so each is mapped before the audio thread gets
+// there even if locking is refused.
+void touchPages(const float *begin, const float *end) {
+  const auto stride =
+      static_cast<std::ptrdiff_t>(getPageSize() / sizeof(float));
+  volatile float sink = 0.0f;
+  for (auto *p = begin; p < end; p += stride)
+    sink = *p;
+  if (end > begin)
+    sink = end[-1];
+  juce::ignoreUnused(sink);
+}
+} // namespace
+
+//==============================================================================
+void PageLock::update(const juce::AudioBuffer<float> &audio,
+                      juce::ReferenceCountedObject *newOwner,
+                      juce::int64 position, juce::int64 loopStart,
+                      juce::int64 maxBytes) {
+  if (newOwner != owner.get())
+    release();
+
+  const juce::int64 length = audio.getNumSamples();
+  const int numChannels = audio.getNumChannels();
+  if (newOwner == nullptr || length == 0 || numChannels == 0 ||
+      maxBytes <= 0) {
+    release();
+    return;
+  }
+  owner = newOwner;
+
+  const auto current = getMajorFaultCount();
+  if (faultsAtStart < 0)
+    faultsAtStart = current;
+  majorFaults = current >= 0 ? current - faultsAtStart : -1;
+
+  position = juce::jlimit<juce::int64>(0, length - 1, position);
+  const juce::int64 frames = juce::jmax<juce::int64>(
+      1, maxBytes / (numChannels * static_cast<juce::int64>(sizeof(float))));
+
+  // Leave the window alone until the playhead is a quarter of the way in.
+  if (windowStart >= 0 && loopStart == windowLoopStart &&
+      maxBytes == windowMaxBytes && position >= windowStart &&
+      position <= windowStart + frames / 4)
+    return;
+  windowStart = position;
+  windowLoopStart = loopStart;
+  windowMaxBytes = maxBytes;
+
+  // The window in samples: from the playhead on, wrapping when looping.
+  std::vector<std::pair<juce::int64, juce::int64>> spans{
+      {position, juce::jmin(length, position + frames)}};
+  if (loopStart >= 0 && position + frames > length)
+    spans.emplace_back(loopStart,
+                       juce::jmin(position, loopStart + position + frames -
+                                                length));
+
+  std::vector<PageRange> wanted;
+  for (const auto &span : spans) {
+    const auto ranges = getPageRanges(audio, span.first, span.second);
+    wanted.insert(wanted.end(), ranges.begin(), ranges.end());
+  }
+
+  // Sort and merge: channels may share a page at their boundaries, and
+  // munlock isn't counted, so every page must appear in exactly one range.
+  std::sort(wanted.begin(), wanted.end());
+  std::vector<PageRange> merged;
+  for (const auto &r : wanted) {
+    if (!merged.empty() && r.first <= merged.back().second)
+      merged.back().second = juce::jmax(merged.back().second, r.second);
+    else
+      merged.push_back(r);
+  }
+
+  // Unlock what the new window no longer covers, then fault in and lock it.
+  for (const auto &old : locked) {
+    auto begin = old.first;
+    for (const auto &r : merged) {
+      if (r.second <= begin || r.first >= old.second)
+        continue;
+      if (r.first > begin)
+        unlockPages(reinterpret_cast<const void *>(begin), r.first - begin);
+      begin = juce::jmax(begin, r.second);
+    }
+    if (begin < old.second)
+      unlockPages(reinterpret_cast<const void *>(begin), old.second - begin);
+  }
+
+  for (const auto &span : spans)
+    for (int ch = 0; ch < numChannels && span.second > span.first; ++ch)
+      touchPages(audio.getReadPointer(ch) + span.first,
+                 audio.getReadPointer(ch) + span.second);
+
+  juce::int64 bytes = 0, lockedTotal = 0;
+  bool refused = false;
+  for (const auto &r : merged) {
+    const auto size = r.second - r.first;
+    bytes += static_cast<juce::int64>(size);
+    if (lockPages(reinterpret_cast<const void *>(r.first), size))
+      lockedTotal += static_cast<juce::int64>(size);
+    else
+      refused = true;
+  }
+  locked = std::move(merged);
+  windowBytes = bytes;
+  lockedBytes = lockedTotal;
+  lockRefused = refused;
+}
+
+void PageLock::release() {
+  for (const auto &r : locked)
+    unlockPages(reinterpret_cast<const void *>(r.first), r.second - r.first);
+  locked.clear();
+  owner = nullptr;
+  windowStart = windowLoopStart = -1;
+  windowMaxBytes = 0;
+  faultsAtStart = -1;
+  lockedBytes = 0;
+  windowBytes = 0;
+  majorFaults = -1;
+  lockRefused = false;
+}
+
+PageLock::Stats PageLock::getStats() const {
+  Stats stats;
+  stats.lockedBytes = lockedBytes.load();
+  stats.windowBytes = windowBytes.load();
+  stats.majorFaults = majorFaults.load();
+  stats.lockRefused = lockRefused.load();
+  return stats;
+}
+
+std::vector<PageLock::PageRange>
+PageLock::getPageRanges(const juce::AudioBuffer<float> &audio,
+                        juce::int64 start, juce::int64 end) const {
+  const auto page = getPageSize();
+  start = juce::jlimit<juce::int64>(0, audio.getNumSamples(), start);
+  end = juce::jlimit<juce::int64>(start, audio.getNumSamples(), end);
+
+  std::vector<PageRange> ranges;
+  if (end <= start)
+    return ranges;
+  for (int ch = 0; ch < audio.getNumChannels(); ++ch) {
+    const auto *data = audio.getReadPointer(ch);
+    const auto begin = reinterpret_cast<std::uintptr_t>(data + start);
+    const auto finish = reinterpret_cast<std::uintptr_t>(data + end);
+    ranges.emplace_back(begin & ~(page - 1),
+                        (finish + page - 1) & ~(page - 1));
+  }
+  return ranges;
+}
+
+void PageLock::adviseHugePages(juce::AudioBuffer<float> &buffer) {
+#if JUCE_LINUX && defined(MADV_HUGEPAGE)
+  const auto page = getPageSize();
+  for (int ch = 0; ch < buffer.getNumChannels(); ++ch) {
+    auto *data = buffer.getWritePointer(ch);
+    const auto begin = reinterpret_cast<std::uintptr_t>(data);
+    const auto end = reinterpret_cast<std::uintptr_t>(
+        data + buffer.getNumSamples());
+    const auto alignedBegin = (begin + page - 1) & ~(page - 1);
+    if (end > alignedBegin)
+      madvise(reinterpret_cast<void *>(alignedBegin), end - alignedBegin,
+              MADV_HUGEPAGE);
+  }
+#else
+  juce::ignoreUnused(buffer);
+#endif
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <juce_audio_basics/juce_audio_basics.h>
+#include <utility>
+#include <vector>
+
+//==============================================================================
+/**
+ * Keeps the part of a sample that is about to play in physical memory, so the
+ * audio thread never waits on a page fault.
+ *
+ * The window runs from the playhead (or the start offset while idle) forward,
+ * up to a byte limit, and wraps to the loop start when looping. Its pages are
+ * touched and then locked (mlock / VirtualLock). A track longer than the
+ * window gets a rolling window that moves once the playhead has gone a
+ * quarter of the way through it. If the OS refuses the lock (RLIMIT_MEMLOCK,
+ * working-set limits), the pages are still prefaulted, and the refusal shows
+ * up in the stats.
+ *
+ * Not thread-safe: one thread calls update() / release(). getStats() may be
+ * called from anywhere.
+ */
+class PageLock {
+public:
+  struct Stats {
+    juce::int64 lockedBytes = 0;
+    juce::int64 windowBytes = 0; // prefaulted, whether or not locked
+    juce::int64 majorFaults = -1; // in the process since locking began;
+                                  // -1 where the OS doesn't say
+    bool lockRefused = false;
+  };
+
+  PageLock() = default;
+  ~PageLock() { release(); }
+
+  // Locks the window of `audio`, which `owner` keeps alive (it's held until
+  // the next update with another owner, or release()). `position` and
+  // `loopStart` (-1 = not looping) are in samples.
+  void update(const juce::AudioBuffer<float> &audio,
+              juce::ReferenceCountedObject *owner, juce::int64 position,
+              juce::int64 loopStart, juce::int64 maxBytes);
+  // Unlocks everything and lets go of the owner.
+  void release();
+
+  Stats getStats() const;
+
+  // Asks for transparent huge pages on a freshly sized buffer, before it's
+  // written (Linux only; elsewhere this does nothing).
+  static void adviseHugePages(juce::AudioBuffer<float> &buffer);
+
+private:
+  using PageRange = std::pair<std::uintptr_t, std::uintptr_t>; // [begin, end)
+
+  std::vector<PageRange> getPageRanges(const juce::AudioBuffer<float> &audio,
+                                       juce::int64 start,
+                                       juce::int64 end) const;
+
+  juce::ReferenceCountedObjectPtr<juce::ReferenceCountedObject> owner;
+  std::vector<PageRange> locked; // sorted, disjoint
+  juce::int64 windowStart = -1;
+  juce::int64 windowLoopStart = -1;
+  juce::int64 windowMaxBytes = 0;
+  juce::int64 faultsAtStart = -1;
+
+  std::atomic<juce::int64> lockedBytes{0};
+  std::atomic<juce::int64> windowBytes{0};
+  std::atomic<juce::int64> majorFaults{-1};
+  std::atomic<bool> lockRefused{false};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(PageLock)
+};
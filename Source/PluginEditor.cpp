@@ -4,12 +4,81 @@ namespace {
 constexpr float kCornerRadius = 8.0f;
 const juce::Colour kAccent{0xff00d9ff};
 const juce::Colour kOffsetGreen{0xff00ff66};
+const juce::Colour kCueOrange{0xffffa040};
+constexpr int kPlayheadHalfWidth = 2;     // overlay repaint, in pixels
+constexpr int kOffsetMarkerHalfWidth = 7; // line + triangle
+constexpr double kProgressiveRedrawMs = 100.0;
+constexpr float kSnapTolerancePx = 6.0f; // click-to-onset/beat snapping
 } // namespace
 
 //==============================================================================
 // WaveformDisplay
 //==============================================================================
+juce::Rectangle<float> WaveformDisplay::getWaveformArea() const {
+  return getLocalBounds().toFloat().reduced(10.0f, 15.0f);
+}
+
+WaveformDisplay::ViewRange WaveformDisplay::getViewRange(int numSamples) const {
+  ViewRange view;
+  view.visible = juce::jmax(
+      1, static_cast<int>(static_cast<float>(numSamples) / zoomLevel));
+  view.start = static_cast<int>(
+      viewOffset * static_cast<float>(numSamples - view.visible));
+  view.end = juce::jmin(view.start + view.visible, numSamples);
+  return view;
+}
+
+int WaveformDisplay::sampleToX(double sample, int numSamples) const {
+  const auto view = getViewRange(numSamples);
+  if (sample < view.start || sample >= view.end)
+    return -1;
+  const auto area = getWaveformArea();
+  const double p = (sample - view.start) / static_cast<double>(view.visible);
+  return juce::roundToInt(area.getX() + p * area.getWidth());
+}
+
 void WaveformDisplay::paint(juce::Graphics &g) {
+  const float scale = g.getInternalContext().getPhysicalPixelScaleFactor();
+
+  // By generation, not address: a new sample may reuse a freed one's memory.
+  if (!waveformLayerValid || waveformLayerScale != scale ||
+      waveformLayerSampleGeneration != processor.getSampleGeneration())
+    renderWaveformLayer(scale);
+
+  g.drawImage(waveformLayer, getLocalBounds().toFloat());
+  drawOverlay(g);
+}
+
+void WaveformDisplay::resized() { invalidateWaveform(); }
+
+void WaveformDisplay::renderWaveformLayer(float scale) {
+  const int w = juce::jmax(1, juce::roundToInt(static_cast<float>(getWidth()) * scale));
+  const int h = juce::jmax(1, juce::roundToInt(static_cast<float>(getHeight()) * scale));
+
+  // Read first: if the sample changes while drawing, the next paint redraws.
+  const auto generation = processor.getSampleGeneration();
+  waveformLayer = juce::Image(juce::Image::ARGB, w, h, true);
+  {
+    juce::Graphics lg(waveformLayer);
+    lg.addTransform(juce::AffineTransform::scale(scale));
+    drawWaveform(lg);
+  }
+
+  auto sample = processor.getSample();
+  waveformLayerScale = scale;
+  waveformLayerSampleGeneration = generation;
+  waveformLayerPeaksReady =
+      sample != nullptr && sample->peaks != nullptr ? sample->peaks->getNumReady()
+                                                    : 0;
+  waveformLayerAnalysisReady = sample != nullptr &&
+                               sample->analysis != nullptr &&
+                               sample->analysis->isReady();
+  waveformLayerCueGeneration = processor.getCueGeneration();
+  waveformLayerTimeMs = juce::Time::getMillisecondCounterHiRes();
+  waveformLayerValid = true;
+}
+
+void WaveformDisplay::drawWaveform(juce::Graphics &g) {
   auto bounds = getLocalBounds().toFloat();
 
   g.setColour(juce::Colour(0xff1a1a2e));
@@ -19,30 +88,30 @@ void WaveformDisplay::paint(juce::Graphics &g) {
                          fileBeingDragged ? 3.0f : 2.0f);
 
   auto sample = processor.getSample();
-  if (sample == nullptr || sample->audio.getNumSamples() == 0) {
+  if (sample == nullptr || sample->getNumFrames() == 0) {
     g.setColour(juce::Colours::grey);
     g.setFont(16.0f);
-    g.drawText(fileBeingDragged ? "Drop audio file to load"
-                                : "No sample - click Load or drop an audio file",
-               bounds, juce::Justification::centred);
+    juce::String message = "No sample - click Load or drop an audio file";
+    if (fileBeingDragged)
+      message = "Drop audio file to load";
+    else if (processor.isLoading())
+      message = juce::String::formatted(
+          "Loading audio... %d%%",
+          juce::roundToInt(processor.getLoadProgress() * 100.0f));
+    g.drawText(message, bounds, juce::Justification::centred);
     return;
   }
 
-  const auto &buffer = sample->audio;
-  const int numSamples = buffer.getNumSamples();
+  const auto &buffer = sample->audio; // empty while compressed
+  const int numSamples = sample->getNumFrames();
 
-  auto waveformBounds = bounds.reduced(10.0f, 15.0f);
+  auto waveformBounds = getWaveformArea();
   const float midY = waveformBounds.getCentreY();
   const float height = waveformBounds.getHeight() / 2.0f;
 
-  const int visibleSamples =
-      juce::jmax(1, static_cast<int>(static_cast<float>(numSamples) / zoomLevel));
-  const int startSampleView = static_cast<int>(
-      viewOffset * static_cast<float>(numSamples - visibleSamples));
-  const int endSampleView =
-      juce::jmin(startSampleView + visibleSamples, numSamples);
+  const auto view = getViewRange(numSamples);
   const float samplesPerPixel =
-      static_cast<float>(visibleSamples) / waveformBounds.getWidth();
+      static_cast<float>(view.visible) / waveformBounds.getWidth();
 
   juce::ColourGradient gradient(kAccent, waveformBounds.getX(), midY,
                                 juce::Colour(0xff0099ff),
@@ -52,13 +121,35 @@ void WaveformDisplay::paint(juce::Graphics &g) {
   juce::Path waveformPath;
   waveformPath.startNewSubPath(waveformBounds.getX(), midY);
 
+  // Zoomed out far enough that every pixel covers at least one precomputed
+  // peak: read the overview. Zoomed in: scan the (few) visible samples, or
+  // stretch the overview when they aren't decoded.
+  const auto *peaks = sample->peaks.get();
+  const double peaksPerSample =
+      peaks != nullptr ? static_cast<double>(peaks->getNumPeaks()) / numSamples
+                       : 0.0;
+  const bool usePeaks =
+      peaks != nullptr && (samplesPerPixel * peaksPerSample >= 1.0 ||
+                           buffer.getNumSamples() == 0);
+
   auto peakAt = [&](float x) {
-    int startSample = startSampleView + static_cast<int>(x * samplesPerPixel);
-    int endSample = juce::jmin(
-        startSample + static_cast<int>(samplesPerPixel) + 1, numSamples);
+    const double firstSample =
+        view.start + static_cast<double>(x) * samplesPerPixel;
+    if (usePeaks) {
+      const int first = static_cast<int>(firstSample * peaksPerSample);
+      const int last = static_cast<int>(
+          (firstSample + samplesPerPixel) * peaksPerSample);
+      return peaks->getMaxInRange(first, juce::jmax(first + 1, last));
+    }
+
+    const int startSample = static_cast<int>(firstSample);
+    const int endSample =
+        juce::jmin(startSample + static_cast<int>(samplesPerPixel) + 1,
+                   buffer.getNumSamples());
     float maxVal = 0.0f;
-    for (int s = startSample; s < endSample; ++s)
-      maxVal = juce::jmax(maxVal, std::abs(buffer.getSample(0, s)));
+    for (int ch = 0; ch < buffer.getNumChannels(); ++ch)
+      for (int s = startSample; s < endSample; ++s)
+        maxVal = juce::jmax(maxVal, std::abs(buffer.getSample(ch, s)));
     return maxVal;
   };
 
@@ -70,80 +161,232 @@ void WaveformDisplay::paint(juce::Graphics &g) {
   waveformPath.closeSubPath();
   g.fillPath(waveformPath);
 
-  // Start-offset marker.
-  const double offsetSamples =
-      processor.getStartOffsetSeconds() * sample->playbackSampleRate;
-  if (offsetSamples >= startSampleView && offsetSamples < endSampleView) {
-    const float p = static_cast<float>(offsetSamples - startSampleView) /
-                    static_cast<float>(visibleSamples);
-    const float ox = waveformBounds.getX() + p * waveformBounds.getWidth();
-    g.setColour(kOffsetGreen);
-    g.drawLine(ox, waveformBounds.getY(), ox, waveformBounds.getBottom(), 3.0f);
-    juce::Path tri;
-    tri.addTriangle(ox - 6, waveformBounds.getY(), ox + 6,
-                    waveformBounds.getY(), ox, waveformBounds.getY() + 10);
-    g.fillPath(tri);
+  // Detected onsets (the points clicks snap to) as short ticks along the
+  // bottom edge.
+  if (const auto *analysis = sample->analysis.get();
+      analysis != nullptr && analysis->isReady()) {
+    g.setColour(kOffsetGreen.withAlpha(0.5f));
+    for (const double t : analysis->getResults().onsets) {
+      const int x = sampleToX(t * sample->playbackSampleRate, numSamples);
+      if (x >= 0)
+        g.fillRect(static_cast<float>(x), waveformBounds.getBottom() - 4.0f,
+                   1.0f, 4.0f);
+    }
   }
 
-  // Playback head.
-  if (processor.isPlaying()) {
-    const float playbackSample =
-        processor.getPlaybackProgress() * static_cast<float>(numSamples);
-    if (playbackSample >= static_cast<float>(startSampleView) &&
-        playbackSample < static_cast<float>(endSampleView)) {
-      const float p = (playbackSample - static_cast<float>(startSampleView)) /
-                      static_cast<float>(visibleSamples);
-      const float lx = waveformBounds.getX() + p * waveformBounds.getWidth();
-      g.setColour(juce::Colours::white);
-      g.drawLine(lx, waveformBounds.getY(), lx, waveformBounds.getBottom(),
-                 2.0f);
-    }
+  // Cues, labelled with their name or else the note that fires them.
+  g.setFont(10.0f);
+  for (const auto &cue : processor.getCues()) {
+    const int x = sampleToX(cue.offsetSeconds * sample->playbackSampleRate,
+                            numSamples);
+    if (x < 0)
+      continue;
+    const auto cx = static_cast<float>(x);
+    g.setColour(kCueOrange.withAlpha(0.8f));
+    g.drawLine(cx, waveformBounds.getY(), cx, waveformBounds.getBottom(), 1.0f);
+    g.setColour(kCueOrange);
+    const auto label =
+        cue.name.isNotEmpty()
+            ? cue.name
+            : juce::MidiMessage::getMidiNoteName(cue.note, true, true, 4);
+    g.drawText(label,
+               juce::Rectangle<float>(cx + 3.0f, waveformBounds.getY(), 80.0f,
+                                      12.0f),
+               juce::Justification::centredLeft);
   }
 
   g.setColour(juce::Colour(0xff666666));
   g.setFont(10.0f);
   g.drawText(zoomLevel > 1.01f
-                 ? juce::String::formatted("Zoom %.0fx - click to set start",
-                                           zoomLevel)
-                 : juce::String("Click waveform to set start position"),
+                 ? juce::String::formatted(
+                       "Zoom %.0fx - click to set start, right-click for cues",
+                       zoomLevel)
+                 : juce::String("Click waveform to set start position, "
+                                "right-click to add cues"),
              bounds.removeFromBottom(15), juce::Justification::centred);
 }
 
-void WaveformDisplay::timerCallback() {
-  if (processor.isPlaying())
-    repaint();
+void WaveformDisplay::drawOverlay(juce::Graphics &g) {
+  const auto area = getWaveformArea();
+
+  // Start-offset marker.
+  if (offsetX >= 0) {
+    const auto ox = static_cast<float>(offsetX);
+    g.setColour(kOffsetGreen);
+    g.drawLine(ox, area.getY(), ox, area.getBottom(), 3.0f);
+    juce::Path tri;
+    tri.addTriangle(ox - 6, area.getY(), ox + 6, area.getY(), ox,
+                    area.getY() + 10);
+    g.fillPath(tri);
+  }
+
+  // Playback head.
+  if (playheadX >= 0) {
+    const auto lx = static_cast<float>(playheadX);
+    g.setColour(juce::Colours::white);
+    g.drawLine(lx, area.getY(), lx, area.getBottom(), 2.0f);
+  }
 }
 
-void WaveformDisplay::mouseDown(const juce::MouseEvent &event) {
+void WaveformDisplay::refreshOverlay() {
+  int newOffsetX = -1;
+  int newPlayheadX = -1;
+
   auto sample = processor.getSample();
-  if (sample == nullptr || sample->audio.getNumSamples() == 0)
-    return;
+  if (sample != nullptr && sample->getNumFrames() > 0) {
+    const int numSamples = sample->getNumFrames();
+    newOffsetX = sampleToX(processor.getStartOffsetSeconds() *
+                               sample->playbackSampleRate,
+                           numSamples);
+    if (processor.isPlaying())
+      newPlayheadX = sampleToX(processor.getPlayheadPosition(
+                                   juce::Time::getMillisecondCounterHiRes()),
+                               numSamples);
+  }
+
+  if (newOffsetX != offsetX) {
+    repaintColumn(offsetX, kOffsetMarkerHalfWidth);
+    repaintColumn(newOffsetX, kOffsetMarkerHalfWidth);
+    offsetX = newOffsetX;
+  }
+  if (newPlayheadX != playheadX) {
+    repaintColumn(playheadX, kPlayheadHalfWidth);
+    repaintColumn(newPlayheadX, kPlayheadHalfWidth);
+    playheadX = newPlayheadX;
+  }
+}
+
+void WaveformDisplay::repaintColumn(int x, int halfWidth) {
+  if (x >= 0)
+    repaint(x - halfWidth, 0, 2 * halfWidth + 1, getHeight());
+}
 
-  auto wb = getLocalBounds().toFloat().reduced(10.0f, 15.0f);
+void WaveformDisplay::invalidateWaveform() {
+  waveformLayerValid = false;
+  refreshOverlay();
+  repaint();
+}
+
+void WaveformDisplay::sampleChanged() { invalidateWaveform(); }
+
+void WaveformDisplay::refresh() {
+  // Peaks still being computed in the background: fill the picture in as
+  // they arrive, re-rendering the layer at most every kProgressiveRedrawMs.
+  // Analysis results arriving add the onset ticks.
+  if (waveformLayerValid) {
+    auto sample = processor.getSample();
+    const double now = juce::Time::getMillisecondCounterHiRes();
+    if (sample != nullptr && sample->peaks != nullptr &&
+        sample->peaks->getNumReady() != waveformLayerPeaksReady &&
+        now - waveformLayerTimeMs >= kProgressiveRedrawMs)
+      invalidateWaveform();
+    else if (sample != nullptr && sample->analysis != nullptr &&
+             sample->analysis->isReady() != waveformLayerAnalysisReady)
+      invalidateWaveform();
+    else if (processor.getCueGeneration() != waveformLayerCueGeneration)
+      invalidateWaveform();
+  }
+  refreshOverlay();
+}
+
+double WaveformDisplay::clickToSeconds(const juce::MouseEvent &event,
+                                       const SampleBuffer &sample) const {
+  auto wb = getWaveformArea();
   float clickProgress = (static_cast<float>(event.x) - wb.getX()) / wb.getWidth();
   clickProgress = juce::jlimit(0.0f, 1.0f, clickProgress);
 
-  const int numSamples = sample->audio.getNumSamples();
-  const int visibleSamples =
-      juce::jmax(1, static_cast<int>(static_cast<float>(numSamples) / zoomLevel));
-  const int startSampleView = static_cast<int>(
-      viewOffset * static_cast<float>(numSamples - visibleSamples));
+  const int numSamples = sample.getNumFrames();
+  const auto view = getViewRange(numSamples);
   const int clickedSample =
-      startSampleView +
-      static_cast<int>(clickProgress * static_cast<float>(visibleSamples));
+      view.start +
+      static_cast<int>(clickProgress * static_cast<float>(view.visible));
+
+  // Snap to a nearby onset, beat or sound boundary; hold Alt to place it
+  // freely.
+  if (sample.analysis != nullptr && !event.mods.isAltDown()) {
+    const double secondsPerPixel = static_cast<double>(view.visible) /
+                                   wb.getWidth() / sample.playbackSampleRate;
+    const double snapped = sample.analysis->findNearestSnapPoint(
+        clickedSample / sample.playbackSampleRate,
+        kSnapTolerancePx * secondsPerPixel);
+    if (snapped >= 0.0)
+      return snapped;
+  }
+  return clickedSample / sample.playbackSampleRate;
+}
 
-  processor.setStartOffsetFromProgress(static_cast<float>(clickedSample) /
-                                       static_cast<float>(numSamples));
-  repaint();
+void WaveformDisplay::mouseDown(const juce::MouseEvent &event) {
+  auto sample = processor.getSample();
+  if (sample == nullptr || sample->getNumFrames() == 0)
+    return;
+
+  if (event.mods.isPopupMenu()) {
+    showCueMenu(event, *sample);
+    return;
+  }
+
+  processor.setStartOffsetSeconds(clickToSeconds(event, *sample));
+  refreshOverlay();
   if (onOffsetChanged)
     onOffsetChanged();
 }
 
+void WaveformDisplay::showCueMenu(const juce::MouseEvent &event,
+                                  const SampleBuffer &sample) {
+  const double seconds = clickToSeconds(event, sample);
+  const auto cues = processor.getCues();
+  const bool full = static_cast<int>(cues.size()) >= CueSet::kMaxCues;
+  auto *p = &processor;
+
+  // "Add cue here": a submenu per octave. A note that already has a cue is
+  // ticked, and choosing it moves that cue here.
+  juce::PopupMenu add;
+  for (int octave = 0; octave < 11; ++octave) {
+    juce::PopupMenu notes;
+    const int first = octave * 12, last = juce::jmin(127, first + 11);
+    for (int note = first; note <= last; ++note) {
+      const bool used =
+          std::any_of(cues.begin(), cues.end(),
+                      [note](const auto &c) { return c.note == note; });
+      notes.addItem(juce::MidiMessage::getMidiNoteName(note, true, true, 4),
+                    used || !full, used,
+                    [p, note, seconds] { p->setCue(note, seconds); });
+    }
+    add.addSubMenu(juce::MidiMessage::getMidiNoteName(first, true, true, 4) +
+                       " - " +
+                       juce::MidiMessage::getMidiNoteName(last, true, true, 4),
+                   notes);
+  }
+
+  juce::PopupMenu menu;
+  menu.addSubMenu(full ? "Add cue here (list full)" : "Add cue here", add);
+
+  // Cues within a few pixels of the click can be removed from here.
+  const auto view = getViewRange(sample.getNumFrames());
+  const double secondsPerPixel = static_cast<double>(view.visible) /
+                                 getWaveformArea().getWidth() /
+                                 sample.playbackSampleRate;
+  for (const auto &cue : cues)
+    if (std::abs(cue.offsetSeconds - seconds) <=
+        kSnapTolerancePx * secondsPerPixel) {
+      const auto label =
+          cue.name.isNotEmpty()
+              ? cue.name
+              : juce::MidiMessage::getMidiNoteName(cue.note, true, true, 4);
+      menu.addItem("Remove cue " + label, [p, note = cue.note] {
+        p->removeCue(note);
+      });
+    }
+  menu.addItem("Remove all cues", !cues.empty(), false,
+               [p] { p->clearCues(); });
+  menu.showMenuAsync(juce::PopupMenu::Options().withTargetComponent(this));
+}
+
 void WaveformDisplay::mouseWheelMove(const juce::MouseEvent &,
                                      const juce::MouseWheelDetails &wheel) {
   if (zoomLevel > 1.01f) {
     viewOffset = juce::jlimit(0.0f, 1.0f, viewOffset - wheel.deltaY * 0.1f);
-    repaint();
+    invalidateWaveform();
   }
 }
 
@@ -158,17 +401,17 @@ bool WaveformDisplay::isInterestedInFileDrag(const juce::StringArray &files) {
 
 void WaveformDisplay::fileDragEnter(const juce::StringArray &, int, int) {
   fileBeingDragged = true;
-  repaint();
+  invalidateWaveform();
 }
 
 void WaveformDisplay::fileDragExit(const juce::StringArray &) {
   fileBeingDragged = false;
-  repaint();
+  invalidateWaveform();
 }
 
 void WaveformDisplay::filesDropped(const juce::StringArray &files, int, int) {
   fileBeingDragged = false;
-  repaint();
+  invalidateWaveform();
   for (const auto &f : files) {
     juce::File file(f);
     if (file.existsAsFile() && onFileDropped) {
@@ -180,12 +423,12 @@ void WaveformDisplay::filesDropped(const juce::StringArray &files, int, int) {
 
 void WaveformDisplay::setZoom(float newZoom) {
   zoomLevel = juce::jlimit(1.0f, 200.0f, newZoom);
-  repaint();
+  invalidateWaveform();
 }
 
 void WaveformDisplay::setViewOffset(float offset) {
   viewOffset = juce::jlimit(0.0f, 1.0f, offset);
-  repaint();
+  invalidateWaveform();
 }
 
 //==============================================================================
@@ -196,10 +439,10 @@ void LevelMeter::paint(juce::Graphics &g) {
   g.setColour(juce::Colour(0xff14141f));
   g.fillRoundedRectangle(bounds, 3.0f);
 
-  const float clamped = juce::jlimit(0.0f, 1.0f, level);
-  if (clamped > 0.001f) {
+  const int barHeight = getBarHeight();
+  if (barHeight > 0) {
     auto fill = bounds.reduced(2.0f);
-    fill = fill.removeFromBottom(fill.getHeight() * clamped);
+    fill = fill.removeFromBottom(static_cast<float>(barHeight));
     juce::ColourGradient grad(juce::Colour(0xff00ff66), 0, bounds.getBottom(),
                               juce::Colour(0xffff3030), 0, bounds.getY(), false);
     grad.addColour(0.7, juce::Colour(0xffffcc00));
@@ -208,10 +451,25 @@ void LevelMeter::paint(juce::Graphics &g) {
   }
 }
 
-void LevelMeter::timerCallback() {
+int LevelMeter::getBarHeight() const {
+  const float clamped = juce::jlimit(0.0f, 1.0f, level);
+  if (clamped <= 0.001f)
+    return 0;
+  return juce::roundToInt(static_cast<float>(juce::jmax(0, getHeight() - 4)) *
+                          clamped);
+}
+
+void LevelMeter::refresh(double elapsedMs) {
+  const int before = getBarHeight();
+
+  // Fast attack; release by 0.8 every 1/30 s regardless of frame rate.
   const float target = processor.getOutputLevel();
-  level = target > level ? target : level * 0.8f; // fast attack, slow release
-  repaint();
+  const auto decay =
+      static_cast<float>(std::pow(0.8, elapsedMs * 30.0 / 1000.0));
+  level = target > level ? target : level * decay;
+
+  if (getBarHeight() != before)
+    repaint();
 }
 
 //==============================================================================
@@ -240,7 +498,7 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
   clearButton.onClick = [this] {
     processorRef.clearSample();
     updateSampleInfo();
-    waveformDisplay.repaint();
+    waveformDisplay.sampleChanged();
   };
   clearButton.setTooltip("Unload the current sample");
   addAndMakeVisible(clearButton);
@@ -254,6 +512,12 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
   stopButton.onClick = [this] { processorRef.stopPlayback(); };
   addAndMakeVisible(stopButton);
 
+  styleButton(setlistButton, juce::Colour(0xff4a4a6a));
+  setlistButton.onClick = [this] { showSetlistMenu(); };
+  setlistButton.setTooltip("Step through an ordered list of tracks; the next "
+                           "one is loaded in the background");
+  addAndMakeVisible(setlistButton);
+
   // Zoom + reset.
   styleButton(zoomInButton, juce::Colour(0xff444466));
   zoomInButton.onClick = [this] {
@@ -273,11 +537,22 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
     waveformDisplay.setZoom(1.0f);
     waveformDisplay.setViewOffset(0.0f);
     updateSampleInfo();
-    waveformDisplay.repaint();
   };
   resetOffsetButton.setTooltip("Reset start offset and zoom");
   addAndMakeVisible(resetOffsetButton);
 
+  styleButton(autoTrimButton, juce::Colour(0xff6a5acd));
+  autoTrimButton.onClick = [this] {
+    if (processorRef.autoTrimStartOffset()) {
+      waveformDisplay.refreshOverlay();
+      updateSampleInfo();
+    }
+  };
+  autoTrimButton.setTooltip(
+      "Auto-trim: move the start offset to the first detected onset");
+  autoTrimButton.setEnabled(false);
+  addAndMakeVisible(autoTrimButton);
+
   // Waveform + meter.
   waveformDisplay.onOffsetChanged = [this] { updateSampleInfo(); };
   waveformDisplay.onFileDropped = [this](const juce::File &f) { doLoadFile(f); };
@@ -294,6 +569,21 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
   gainAttach =
       std::make_unique<APVTS::SliderAttachment>(state, "gain", gainSlider);
 
+  normalizeButton.setColour(juce::ToggleButton::textColourId,
+                            juce::Colours::white);
+  normalizeButton.setColour(juce::ToggleButton::tickColourId, kAccent);
+  normalizeButton.setTooltip(
+      "Bring the track to the target loudness (integrated LUFS) on top of the "
+      "gain; a boost stops short of -1 dBTP");
+  addAndMakeVisible(normalizeButton);
+  normalizeAttach = std::make_unique<APVTS::ButtonAttachment>(
+      state, "normalize", normalizeButton);
+
+  styleButton(normalizeOptionsButton, juce::Colour(0xff4a4a6a));
+  normalizeOptionsButton.setTooltip("Target loudness for Normalize");
+  normalizeOptionsButton.onClick = [this] { showNormalizeMenu(); };
+  addAndMakeVisible(normalizeOptionsButton);
+
   gainLabel.setText("Gain", juce::dontSendNotification);
   gainLabel.setColour(juce::Label::textColourId, juce::Colours::white);
   addAndMakeVisible(gainLabel);
@@ -332,6 +622,9 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
   setupToggle(noteOffButton, "Releasing the key fades the sample out");
   setupToggle(followButton,
               "Stop/rewind playback when the host transport stops");
+  setupToggle(varispeedButton,
+              "Play at the host tempo over the track's own (the detected "
+              "tempo, or the Track Tempo parameter); pitch follows speed");
   embedButton.setColour(juce::ToggleButton::textColourId, juce::Colours::white);
   embedButton.setColour(juce::ToggleButton::tickColourId, kOffsetGreen);
   embedButton.setTooltip(
@@ -343,6 +636,19 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
   };
   addAndMakeVisible(embedButton);
 
+  styleButton(embedOptionsButton, juce::Colour(0xff4a4a6a));
+  embedOptionsButton.setTooltip("Embedding options: FLAC compression level "
+                                "and encoder threads");
+  embedOptionsButton.onClick = [this] { showEmbedOptionsMenu(); };
+  addAndMakeVisible(embedOptionsButton);
+
+  styleButton(memoryOptionsButton, juce::Colour(0xff4a4a6a));
+  memoryOptionsButton.setTooltip(
+      "Memory budget for decoded audio, shared by all instances, and locking "
+      "the audio about to play in RAM");
+  memoryOptionsButton.onClick = [this] { showMemoryOptionsMenu(); };
+  addAndMakeVisible(memoryOptionsButton);
+
   loopAttach = std::make_unique<APVTS::ButtonAttachment>(state, "loop",
                                                          loopButton);
   retriggerAttach = std::make_unique<APVTS::ButtonAttachment>(
@@ -351,6 +657,8 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
       state, "noteOffStops", noteOffButton);
   followAttach = std::make_unique<APVTS::ButtonAttachment>(
       state, "followTransport", followButton);
+  varispeedAttach = std::make_unique<APVTS::ButtonAttachment>(
+      state, "varispeed", varispeedButton);
 
   // Labels.
   sampleNameLabel.setFont(juce::Font(juce::FontOptions(16.0f).withStyle("Bold")));
@@ -402,23 +710,315 @@ BackingTrackTriggerEditor::BackingTrackTriggerEditor(
   instructionLabel.setJustificationType(juce::Justification::centred);
   addAndMakeVisible(instructionLabel);
 
-  // Keep the UI in sync when state is restored or a sample is (re)loaded.
-  processorRef.onSampleChanged = [this] {
-    juce::MessageManager::callAsync([safe = juce::Component::SafePointer<
-                                         BackingTrackTriggerEditor>(this)] {
-      if (safe != nullptr) {
-        safe->updateSampleInfo();
-        safe->waveformDisplay.repaint();
-      }
+  memoryLabel.setFont(juce::Font(juce::FontOptions(11.0f)));
+  memoryLabel.setColour(juce::Label::textColourId, juce::Colour(0xffaaaaaa));
+  memoryLabel.setTooltip("Idle instances give up their decoded audio when the "
+                         "total goes over the budget, and reload it before "
+                         "they play");
+  addAndMakeVisible(memoryLabel);
+
+  lastSampleGeneration = processorRef.getSampleGeneration();
+  wasLoading = processorRef.isLoading();
+  updateSampleInfo();
+  updateMemoryInfo();
+  setSize(700, 586);
+}
+
+BackingTrackTriggerEditor::~BackingTrackTriggerEditor() = default;
+
+//==============================================================================
+void BackingTrackTriggerEditor::onDisplayFrame() {
+  const double now = juce::Time::getMillisecondCounterHiRes();
+  const double elapsed = lastFrameMs > 0.0 ? now - lastFrameMs : 0.0;
+  lastFrameMs = now;
+
+  // Keep the UI in sync when state is restored or a sample is (re)loaded,
+  // possibly from a background thread.
+  const auto generation = processorRef.getSampleGeneration();
+  const bool loading = processorRef.isLoading();
+  if (generation != lastSampleGeneration || loading != wasLoading) {
+    lastSampleGeneration = generation;
+    wasLoading = loading;
+    updateSampleInfo();
+    waveformDisplay.sampleChanged();
+  }
+
+  // Load progress, in whole percent so the labels don't churn every frame.
+  const int loadPercent =
+      loading ? juce::roundToInt(processorRef.getLoadProgress() * 100.0f) : -1;
+  if (loadPercent != lastLoadPercent) {
+    lastLoadPercent = loadPercent;
+    updateSampleInfo();
+    if (!processorRef.hasSampleLoaded())
+      waveformDisplay.sampleChanged(); // redraws the "Loading audio" message
+  }
+
+  waveformDisplay.refresh();
+  levelMeter.refresh(elapsed);
+  updateMemoryInfo();
+  updateSyncInfo();
+
+  auto sample = processorRef.getSample();
+  const bool analysed = sample != nullptr && sample->analysis != nullptr &&
+                        sample->analysis->isReady();
+  autoTrimButton.setEnabled(analysed);
+
+  // Loudness, once the analysis has it, and the normalization it gives.
+  juce::String loudness;
+  if (analysed) {
+    const auto &results = sample->analysis->getResults();
+    if (results.loudnessLufs > SampleAnalysis::kNoLoudness)
+      loudness << juce::String::formatted(" | %.1f LUFS, %.1f dBTP",
+                                          results.loudnessLufs,
+                                          results.truePeakDb);
+    if (results.dcOffset >= 0.001)
+      loudness << juce::String::formatted(" | DC %.1f%%",
+                                          results.dcOffset * 100.0);
+    const double normalizeDb = processorRef.getNormalizeGainDb();
+    if (normalizeDb != 0.0)
+      loudness << juce::String::formatted(" (%+.1f dB)", normalizeDb);
+  }
+  if (loudness != lastLoudnessInfo) {
+    lastLoudnessInfo = loudness;
+    updateSampleInfo();
+  }
+}
+
+void BackingTrackTriggerEditor::showEmbedOptionsMenu() {
+  const auto current = processorRef.getEmbedSettings();
+  auto apply = [this](EmbeddedAudio::Settings settings) {
+    processorRef.setEmbedSettings(settings);
+  };
+
+  juce::PopupMenu codec;
+  {
+    auto settings = current;
+    settings.codec = EmbeddedAudio::Codec::flac;
+    codec.addItem("FLAC (lossless)", true,
+                  current.codec == EmbeddedAudio::Codec::flac,
+                  [apply, settings] { apply(settings); });
+    settings.codec = EmbeddedAudio::Codec::oggVorbis;
+    codec.addItem("Ogg Vorbis (compact)", true,
+                  current.codec == EmbeddedAudio::Codec::oggVorbis,
+                  [apply, settings] { apply(settings); });
+  }
+
+  juce::PopupMenu quality;
+  const auto qualityNames = juce::OggVorbisAudioFormat().getQualityOptions();
+  for (int q = 0; q < qualityNames.size() && q <= 10; ++q) {
+    auto settings = current;
+    settings.codec = EmbeddedAudio::Codec::oggVorbis;
+    settings.vorbisQuality = q;
+    quality.addItem(qualityNames[q], true,
+                    current.codec == EmbeddedAudio::Codec::oggVorbis &&
+                        current.vorbisQuality == q,
+                    [apply, settings] { apply(settings); });
+  }
+
+  juce::PopupMenu compression;
+  for (int level = 0; level <= 8; ++level) {
+    auto settings = current;
+    settings.codec = EmbeddedAudio::Codec::flac;
+    settings.compressionLevel = level;
+    juce::String label(level);
+    if (level == 0)
+      label << " (fastest)";
+    else if (level == 8)
+      label << " (smallest)";
+    compression.addItem(label, true,
+                        current.codec == EmbeddedAudio::Codec::flac &&
+                            current.compressionLevel == level,
+                        [apply, settings] { apply(settings); });
+  }
+
+  juce::PopupMenu threads;
+  for (const int n : {0, 1, 2, 4, 8}) {
+    auto settings = current;
+    settings.numThreads = n;
+    const juce::String label = n == 0   ? juce::String("Auto")
+                               : n == 1 ? juce::String("1 (single stream)")
+                                        : juce::String(n);
+    threads.addItem(label, true, current.numThreads == n,
+                    [apply, settings] { apply(settings); });
+  }
+
+  juce::PopupMenu menu;
+  menu.addSubMenu("Codec", codec);
+  menu.addSubMenu("FLAC compression", compression);
+  menu.addSubMenu("Vorbis quality", quality);
+  menu.addSubMenu("Encoder threads", threads);
+  menu.showMenuAsync(
+      juce::PopupMenu::Options().withTargetComponent(&embedOptionsButton));
+}
+
+void BackingTrackTriggerEditor::showMemoryOptionsMenu() {
+  auto &budget = processorRef.getMemoryBudget();
+  constexpr juce::int64 megabyte = 1024 * 1024;
+  const auto current = budget.getLimitSetting();
+
+  juce::PopupMenu menu;
+  menu.addItem("Auto (" +
+                   juce::String(MemoryBudget::getAutomaticLimitBytes() /
+                                megabyte) +
+                   " MB)",
+               true, current == 0, [&budget] { budget.setLimitSetting(0); });
+  for (const juce::int64 mb : {512, 1024, 2048, 4096, 8192}) {
+    const juce::String label = mb < 1024 ? juce::String(mb) + " MB"
+                                         : juce::String(mb / 1024) + " GB";
+    menu.addItem(label, true, current == mb * megabyte,
+                 [&budget, mb] { budget.setLimitSetting(mb * megabyte); });
+  }
+  menu.addSeparator();
+  const bool locking = budget.isPlaybackLockEnabled();
+  menu.addItem("Lock playback audio in RAM (" +
+                   juce::String(budget.getLockWindowBytes() / megabyte) +
+                   " MB ahead)",
+               true, locking,
+               [&budget, locking] { budget.setPlaybackLockEnabled(!locking); });
+  const bool compressing = budget.isCompressedStorageEnabled();
+  menu.addItem("Keep idle tracks compressed in RAM (FLAC)", true, compressing,
+               [&budget, compressing] {
+                 budget.setCompressedStorageEnabled(!compressing);
+               });
+  menu.showMenuAsync(
+      juce::PopupMenu::Options().withTargetComponent(&memoryOptionsButton));
+}
+
+void BackingTrackTriggerEditor::showNormalizeMenu() {
+  auto *param = processorRef.apvts.getParameter("targetLoudness");
+  const auto range = processorRef.apvts.getParameterRange("targetLoudness");
+  const float current = range.convertFrom0to1(param->getValue());
+
+  juce::PopupMenu menu;
+  const std::pair<float, const char *> targets[] = {
+      {-23.0f, "-23 LUFS (EBU R128)"},
+      {-18.0f, "-18 LUFS"},
+      {-16.0f, "-16 LUFS"},
+      {-14.0f, "-14 LUFS (streaming)"},
+      {-11.0f, "-11 LUFS"}};
+  for (const auto &target : targets) {
+    const float lufs = target.first;
+    menu.addItem(target.second, true, std::abs(current - lufs) < 0.05f,
+                 [param, range, lufs] {
+                   param->setValueNotifyingHost(range.convertTo0to1(lufs));
+                 });
+  }
+  menu.showMenuAsync(
+      juce::PopupMenu::Options().withTargetComponent(&normalizeOptionsButton));
+}
+
+void BackingTrackTriggerEditor::showSetlistMenu() {
+  auto *p = &processorRef;
+  const auto setlist = p->getSetlist();
+  const int position = p->getSetlistPosition();
+
+  juce::PopupMenu menu;
+  menu.addItem("Choose tracks...", [this] {
+    fileChooser = std::make_unique<juce::FileChooser>(
+        "Select the tracks, in order...", juce::File{},
+        "*.wav;*.aiff;*.aif;*.mp3;*.flac;*.ogg");
+    const auto flags = juce::FileBrowserComponent::openMode |
+                       juce::FileBrowserComponent::canSelectFiles |
+                       juce::FileBrowserComponent::canSelectMultipleItems;
+    fileChooser->launchAsync(flags, [this](const juce::FileChooser &fc) {
+      const auto files = fc.getResults();
+      if (!files.isEmpty())
+        processorRef.setSetlist(files);
     });
+  });
+
+  if (!setlist.isEmpty()) {
+    menu.addSeparator();
+    for (int i = 0; i < setlist.size(); ++i) {
+      juce::String label(i + 1);
+      label << ". " << setlist[i].getFileName();
+      if (i == position + 1 && p->isNextTrackReady())
+        label << " (ready)";
+      menu.addItem(label, true, i == position,
+                   [p, i] { p->selectSetlistEntry(i); });
+    }
+  }
+
+  // The note that steps to the next track, a submenu per octave.
+  const int nextNote = p->getSetlistNextNote();
+  juce::PopupMenu notes;
+  notes.addItem("Off", true, nextNote < 0,
+                [p] { p->setSetlistNextNote(-1); });
+  const auto name = [](int n) {
+    return juce::MidiMessage::getMidiNoteName(n, true, true, 4);
   };
+  for (int octave = 0; octave < 11; ++octave) {
+    juce::PopupMenu octaveNotes;
+    const int first = octave * 12, last = juce::jmin(127, first + 11);
+    for (int note = first; note <= last; ++note)
+      octaveNotes.addItem(name(note), true, note == nextNote,
+                          [p, note] { p->setSetlistNextNote(note); });
+    notes.addSubMenu(name(first) + " - " + name(last), octaveNotes);
+  }
 
-  updateSampleInfo();
-  setSize(700, 560);
+  menu.addSeparator();
+  menu.addSubMenu("Next-track note", notes);
+  const bool autoAdvance = p->isSetlistAutoAdvance();
+  menu.addItem("Advance at end of track", true, autoAdvance,
+               [p, autoAdvance] { p->setSetlistAutoAdvance(!autoAdvance); });
+  menu.addItem("Clear setlist", !setlist.isEmpty(), false,
+               [p] { p->setSetlist({}); });
+  menu.showMenuAsync(
+      juce::PopupMenu::Options().withTargetComponent(&setlistButton));
+}
+
+void BackingTrackTriggerEditor::updateMemoryInfo() {
+  // The budget thread updates the total a few times a second; only relabel
+  // when the whole-MB figures change.
+  const auto &budget = processorRef.getMemoryBudget();
+  constexpr juce::int64 megabyte = 1024 * 1024;
+  const auto usedMB = budget.getUsedBytes() / megabyte;
+  const auto limitMB = budget.getLimitBytes() / megabyte;
+
+  juce::String lockInfo;
+  if (budget.isPlaybackLockEnabled()) {
+    const auto stats = processorRef.getPageLockStats();
+    lockInfo << "  |  " << (stats.lockRefused ? "prefaulted " : "locked ")
+             << juce::String(stats.windowBytes / megabyte) << " MB";
+    if (stats.majorFaults >= 0)
+      lockInfo << ", " << juce::String(stats.majorFaults) << " major faults";
+  }
+  if (processorRef.isCompressed()) {
+    lockInfo << "  |  compressed";
+    if (const int underruns = processorRef.getStreamUnderruns())
+      lockInfo << ", " << juce::String(underruns) << " underruns";
+  }
+
+  if (usedMB == lastMemoryUsedMB && limitMB == lastMemoryLimitMB &&
+      lockInfo == lastLockInfo)
+    return;
+  lastMemoryUsedMB = usedMB;
+  lastMemoryLimitMB = limitMB;
+  lastLockInfo = lockInfo;
+  memoryLabel.setText("Memory: " + juce::String(usedMB) + " MB of " +
+                          juce::String(limitMB) + " MB (all instances)" +
+                          lockInfo,
+                      juce::dontSendNotification);
 }
 
-BackingTrackTriggerEditor::~BackingTrackTriggerEditor() {
-  processorRef.onSampleChanged = nullptr;
+void BackingTrackTriggerEditor::updateSyncInfo() {
+  // Drift from the host's timeline, to a tenth of a millisecond, while a
+  // voice is following it.
+  const auto sync = processorRef.getSyncStats();
+  juce::String syncInfo;
+  if (sync.tracking)
+    syncInfo = juce::String::formatted("  |  Sync %+.1f ms", sync.driftMs);
+  const double ratio = processorRef.getPlaybackRatio();
+  if (ratio != 1.0)
+    syncInfo << juce::String::formatted("  |  Speed %.3fx", ratio);
+  if (syncInfo == lastSyncInfo)
+    return;
+  lastSyncInfo = syncInfo;
+  hostInfoLabel.setText(hostInfoText + syncInfo, juce::dontSendNotification);
+  hostInfoLabel.setTooltip(juce::String::formatted(
+      "Drift from the host position: at most %.1f ms, %d speed corrections, "
+      "%d crossfaded jumps",
+      sync.maxDriftMs, sync.corrections, sync.jumps));
 }
 
 //==============================================================================
@@ -436,7 +1036,7 @@ void BackingTrackTriggerEditor::paint(juce::Graphics &g) {
 
   g.setColour(kAccent);
   g.setFont(12.0f);
-  g.drawText("One-Shot Sample Player  |  v2.0.0", 20, 40, getWidth() - 40, 18,
+  g.drawText("One-Shot Sample Player  |  v3.0.0", 20, 40, getWidth() - 40, 18,
              juce::Justification::centred);
 }
 
@@ -463,6 +1063,8 @@ void BackingTrackTriggerEditor::resized() {
   zoomOutButton.setBounds(sideCol.removeFromTop(40));
   sideCol.removeFromTop(4);
   resetOffsetButton.setBounds(sideCol.removeFromTop(30));
+  sideCol.removeFromTop(4);
+  autoTrimButton.setBounds(sideCol.removeFromTop(30));
   waveformRow.removeFromRight(6);
   waveformDisplay.setBounds(waveformRow);
 
@@ -474,18 +1076,24 @@ void BackingTrackTriggerEditor::resized() {
 
   area.removeFromTop(8);
   auto transportRow = area.removeFromTop(36);
-  const int bw = (transportRow.getWidth() - 30) / 4;
+  const int bw = (transportRow.getWidth() - 40) / 5;
   loadButton.setBounds(transportRow.removeFromLeft(bw));
   transportRow.removeFromLeft(10);
   clearButton.setBounds(transportRow.removeFromLeft(bw));
   transportRow.removeFromLeft(10);
   playButton.setBounds(transportRow.removeFromLeft(bw));
   transportRow.removeFromLeft(10);
-  stopButton.setBounds(transportRow);
+  stopButton.setBounds(transportRow.removeFromLeft(bw));
+  transportRow.removeFromLeft(10);
+  setlistButton.setBounds(transportRow);
 
   area.removeFromTop(10);
   auto gainRow = area.removeFromTop(28);
   gainLabel.setBounds(gainRow.removeFromLeft(50));
+  normalizeOptionsButton.setBounds(gainRow.removeFromRight(30));
+  gainRow.removeFromRight(4);
+  normalizeButton.setBounds(gainRow.removeFromRight(96));
+  gainRow.removeFromRight(10);
   gainSlider.setBounds(gainRow);
 
   area.removeFromTop(6);
@@ -493,15 +1101,24 @@ void BackingTrackTriggerEditor::resized() {
   triggerNoteLabel.setBounds(noteRow.removeFromLeft(90));
   triggerNoteSlider.setBounds(noteRow.removeFromLeft(150));
   noteRow.removeFromLeft(15);
+  embedOptionsButton.setBounds(noteRow.removeFromRight(30));
+  noteRow.removeFromRight(4);
   embedButton.setBounds(noteRow);
 
   area.removeFromTop(8);
   auto toggleRow = area.removeFromTop(26);
-  const int tw = toggleRow.getWidth() / 4;
+  const int tw = toggleRow.getWidth() / 5;
   loopButton.setBounds(toggleRow.removeFromLeft(tw));
   retriggerButton.setBounds(toggleRow.removeFromLeft(tw));
   noteOffButton.setBounds(toggleRow.removeFromLeft(tw));
-  followButton.setBounds(toggleRow);
+  followButton.setBounds(toggleRow.removeFromLeft(tw));
+  varispeedButton.setBounds(toggleRow);
+
+  area.removeFromTop(6);
+  auto memoryRow = area.removeFromTop(20);
+  memoryOptionsButton.setBounds(memoryRow.removeFromRight(30));
+  memoryRow.removeFromRight(4);
+  memoryLabel.setBounds(memoryRow);
 
   area.removeFromTop(8);
   instructionLabel.setBounds(area.removeFromTop(20));
@@ -528,7 +1145,7 @@ void BackingTrackTriggerEditor::doLoadFile(const juce::File &file) {
   waveformDisplay.setZoom(1.0f);
   waveformDisplay.setViewOffset(0.0f);
   updateSampleInfo();
-  waveformDisplay.repaint();
+  waveformDisplay.sampleChanged();
 }
 
 void BackingTrackTriggerEditor::applyOffsetFromInput() {
@@ -538,7 +1155,7 @@ void BackingTrackTriggerEditor::applyOffsetFromInput() {
     if (ms >= 0) {
       processorRef.setStartOffsetSeconds(ms / 1000.0);
       updateSampleInfo();
-      waveformDisplay.repaint();
+      waveformDisplay.refreshOverlay();
     }
   }
 }
@@ -546,9 +1163,26 @@ void BackingTrackTriggerEditor::applyOffsetFromInput() {
 void BackingTrackTriggerEditor::updateSampleInfo() {
   const bool loaded = processorRef.hasSampleLoaded();
 
-  if (loaded) {
-    sampleNameLabel.setText(processorRef.getSampleName(),
+  if (processorRef.isLoading())
+    sampleNameLabel.setText(
+        juce::String::formatted(
+            "Loading... %d%%",
+            juce::roundToInt(processorRef.getLoadProgress() * 100.0f)),
+        juce::dontSendNotification);
+  else if (loaded) {
+    // In a setlist, which track of how many.
+    juce::String name;
+    const int position = processorRef.getSetlistPosition();
+    if (position >= 0)
+      name << "[" << (position + 1) << "/"
+           << processorRef.getSetlist().size() << "] ";
+    sampleNameLabel.setText(name + processorRef.getSampleName(),
                             juce::dontSendNotification);
+  }
+  else
+    sampleNameLabel.setText("No sample loaded", juce::dontSendNotification);
+
+  if (loaded) {
 
     const double seconds = processorRef.getSampleLengthSeconds();
     durationLabel.setText(
@@ -562,7 +1196,8 @@ void BackingTrackTriggerEditor::updateSampleInfo() {
         juce::String::formatted("File: %.0f Hz | %s | %d-bit",
                                 processorRef.getOriginalSampleRate(),
                                 channels.toRawUTF8(),
-                                processorRef.getOriginalBitsPerSample()),
+                                processorRef.getOriginalBitsPerSample()) +
+            lastLoudnessInfo,
         juce::dontSendNotification);
 
     juce::String host = juce::String::formatted(
@@ -573,7 +1208,8 @@ void BackingTrackTriggerEditor::updateSampleInfo() {
     } else {
       hostInfoLabel.setColour(juce::Label::textColourId, juce::Colour(0xff88ff88));
     }
-    hostInfoLabel.setText(host, juce::dontSendNotification);
+    hostInfoText = host;
+    hostInfoLabel.setText(host + lastSyncInfo, juce::dontSendNotification);
 
     const double offsetSec = processorRef.getStartOffsetSeconds();
     const int offsetMs = static_cast<int>(offsetSec * 1000);
@@ -591,14 +1227,14 @@ void BackingTrackTriggerEditor::updateSampleInfo() {
 
     offsetInput.setText(juce::String(offsetMs), false);
   } else {
-    sampleNameLabel.setText("No sample loaded", juce::dontSendNotification);
     durationLabel.setText("--:--", juce::dontSendNotification);
     fileInfoLabel.setText("", juce::dontSendNotification);
     offsetDisplayLabel.setText("", juce::dontSendNotification);
     offsetInput.setText("", false);
     hostInfoLabel.setColour(juce::Label::textColourId, juce::Colour(0xff88ff88));
-    hostInfoLabel.setText(juce::String::formatted(
-                              "Host: %.0f Hz", processorRef.getHostSampleRate()),
+    hostInfoText = juce::String::formatted("Host: %.0f Hz",
+                                           processorRef.getHostSampleRate());
+    hostInfoLabel.setText(hostInfoText + lastSyncInfo,
                           juce::dontSendNotification);
   }
 }
@@ -6,18 +6,24 @@
 /**
  * Waveform display: draws the loaded sample, lets you click to set the start
  * offset, zoom (+/-) and pan (scroll wheel), and accepts drag-and-dropped
- * audio files.
+ * audio files. Once the sample has been analysed, clicks snap to nearby
+ * onsets and beats (hold Alt to place the offset freely).
+ *
+ * The waveform itself is rendered once into a cached image and only redrawn
+ * when the size, zoom, pan or sample changes. The playhead and start-offset
+ * marker are drawn on top as an overlay, and moving them only repaints the
+ * few pixel columns they cover.
+ *
+ * The display has no timer of its own: the editor calls refresh() once per
+ * display frame.
  */
 class WaveformDisplay : public juce::Component,
-                        public juce::Timer,
                         public juce::FileDragAndDropTarget {
 public:
-  explicit WaveformDisplay(BackingTrackTriggerProcessor &p) : processor(p) {
-    startTimerHz(30);
-  }
+  explicit WaveformDisplay(BackingTrackTriggerProcessor &p) : processor(p) {}
 
   void paint(juce::Graphics &g) override;
-  void timerCallback() override;
+  void resized() override;
   void mouseDown(const juce::MouseEvent &event) override;
   void mouseWheelMove(const juce::MouseEvent &,
                       const juce::MouseWheelDetails &wheel) override;
@@ -33,27 +39,69 @@ public:
   void setViewOffset(float offset);
   float getViewOffset() const { return viewOffset; }
 
+  // Per-frame update: picks up newly computed peaks and moves the overlay.
+  void refresh();
+  // Throws away the cached waveform (call when the loaded sample changes).
+  void sampleChanged();
+  // Moves the playhead / offset marker, repainting only what moved.
+  void refreshOverlay();
+
   std::function<void()> onOffsetChanged;
   std::function<void(const juce::File &)> onFileDropped;
 
 private:
+  struct ViewRange {
+    int start = 0;   // first visible sample
+    int visible = 1; // number of visible samples
+    int end = 0;     // one past the last visible sample
+  };
+
+  juce::Rectangle<float> getWaveformArea() const;
+  ViewRange getViewRange(int numSamples) const;
+  int sampleToX(double sample, int numSamples) const; // -1 when off-screen
+  // Where a click lands, in seconds, snapped as for the start offset.
+  double clickToSeconds(const juce::MouseEvent &event,
+                        const SampleBuffer &sample) const;
+  void showCueMenu(const juce::MouseEvent &event, const SampleBuffer &sample);
+  void invalidateWaveform();
+  void renderWaveformLayer(float scale);
+  void drawWaveform(juce::Graphics &g);
+  void drawOverlay(juce::Graphics &g);
+  void repaintColumn(int x, int halfWidth);
+
   BackingTrackTriggerProcessor &processor;
   float zoomLevel = 1.0f;
   float viewOffset = 0.0f; // 0 = start, 1 = end
   bool fileBeingDragged = false;
+
+  // Cached waveform layer, rendered at the display's physical pixel scale.
+  juce::Image waveformLayer;
+  float waveformLayerScale = 0.0f;
+  juce::uint32 waveformLayerSampleGeneration = 0; // sample last rendered
+  int waveformLayerPeaksReady = 0; // peaks available when last rendered
+  bool waveformLayerAnalysisReady = false;
+  juce::uint32 waveformLayerCueGeneration = 0;
+  double waveformLayerTimeMs = 0.0;
+  bool waveformLayerValid = false;
+
+  // Overlay positions as last painted (x in pixels, -1 = hidden).
+  int playheadX = -1;
+  int offsetX = -1;
 };
 
 //==============================================================================
 /** Simple peak level meter with smooth decay. */
-class LevelMeter : public juce::Component, public juce::Timer {
+class LevelMeter : public juce::Component {
 public:
-  explicit LevelMeter(BackingTrackTriggerProcessor &p) : processor(p) {
-    startTimerHz(30);
-  }
+  explicit LevelMeter(BackingTrackTriggerProcessor &p) : processor(p) {}
   void paint(juce::Graphics &g) override;
-  void timerCallback() override;
+
+  // Per-frame update; repaints only when the bar height actually changes.
+  void refresh(double elapsedMs);
 
 private:
+  int getBarHeight() const;
+
   BackingTrackTriggerProcessor &processor;
   float level = 0.0f;
 };
@@ -74,6 +122,13 @@ private:
   void doLoadFile(const juce::File &file);
   void updateSampleInfo();
   void applyOffsetFromInput();
+  void onDisplayFrame();
+  void showEmbedOptionsMenu();
+  void showMemoryOptionsMenu();
+  void showNormalizeMenu();
+  void showSetlistMenu();
+  void updateMemoryInfo();
+  void updateSyncInfo();
   void styleButton(juce::TextButton &b, juce::Colour colour);
 
   BackingTrackTriggerProcessor &processorRef;
@@ -83,6 +138,7 @@ private:
   juce::TextButton clearButton{"Clear"};
   juce::TextButton playButton{"Play"};
   juce::TextButton stopButton{"Stop"};
+  juce::TextButton setlistButton{"Setlist"};
 
   // Waveform + zoom + meter
   WaveformDisplay waveformDisplay;
@@ -90,6 +146,7 @@ private:
   juce::TextButton zoomInButton{"+"};
   juce::TextButton zoomOutButton{"-"};
   juce::TextButton resetOffsetButton{"Reset"};
+  juce::TextButton autoTrimButton{"Trim"};
 
   // Parameter controls
   juce::Slider gainSlider;
@@ -98,7 +155,12 @@ private:
   juce::ToggleButton retriggerButton{"Retrigger"};
   juce::ToggleButton noteOffButton{"Note-Off Stops"};
   juce::ToggleButton followButton{"Follow Transport"};
+  juce::ToggleButton varispeedButton{"Varispeed"};
   juce::ToggleButton embedButton{"Embed in project"};
+  juce::TextButton embedOptionsButton{"..."};
+  juce::TextButton memoryOptionsButton{"..."};
+  juce::ToggleButton normalizeButton{"Normalize"};
+  juce::TextButton normalizeOptionsButton{"..."};
 
   std::unique_ptr<APVTS::SliderAttachment> gainAttach;
   std::unique_ptr<APVTS::SliderAttachment> triggerNoteAttach;
@@ -106,6 +168,8 @@ private:
   std::unique_ptr<APVTS::ButtonAttachment> retriggerAttach;
   std::unique_ptr<APVTS::ButtonAttachment> noteOffAttach;
   std::unique_ptr<APVTS::ButtonAttachment> followAttach;
+  std::unique_ptr<APVTS::ButtonAttachment> varispeedAttach;
+  std::unique_ptr<APVTS::ButtonAttachment> normalizeAttach;
 
   // Labels
   juce::Label sampleNameLabel;
@@ -118,9 +182,24 @@ private:
   juce::Label triggerNoteLabel;
   juce::TextEditor offsetInput;
   juce::Label instructionLabel;
+  juce::Label memoryLabel;
 
   std::unique_ptr<juce::FileChooser> fileChooser;
   juce::TooltipWindow tooltipWindow{this};
 
+  // The editor's only clock: one update per display refresh drives the
+  // playhead, the meter and progressive waveform drawing.
+  double lastFrameMs = 0.0;
+  juce::uint32 lastSampleGeneration = 0;
+  bool wasLoading = false;
+  int lastLoadPercent = -1;
+  juce::String lastLoudnessInfo; // shown in the file info once analysed
+  juce::int64 lastMemoryUsedMB = -1;
+  juce::int64 lastMemoryLimitMB = -1;
+  juce::String lastLockInfo;
+  juce::String hostInfoText; // set by updateSampleInfo(), before the sync
+  juce::String lastSyncInfo;
+  juce::VBlankAttachment vBlankAttachment{this, [this] { onDisplayFrame(); }};
+
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BackingTrackTriggerEditor)
 };
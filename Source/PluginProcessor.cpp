@@ -1,6 +1,10 @@
 #include "PluginProcessor.h"
 #include "PluginEditor.h"
+#include "SincResampler.h"
+#include "StateFormat.h"
+#include <algorithm>
 #include <cmath>
+#include <cstring>
 
 namespace ids {
 static const juce::String gain{"gain"};
@@ -12,8 +16,32 @@ static const juce::String fadeIn{"fadeIn"};
 static const juce::String fadeOut{"fadeOut"};
 static const juce::String retrigger{"retrigger"};
 static const juce::String followTransport{"followTransport"};
+static const juce::String varispeed{"varispeed"};
+static const juce::String trackTempo{"trackTempo"};
+static const juce::String normalize{"normalize"};
+static const juce::String targetLoudness{"targetLoudness"};
 } // namespace ids
 
+namespace {
+// Voice keys: which entry point a note fires.
+constexpr int kStartOffsetKey = -1; // the trigger note
+constexpr int kNoKey = -2;          // neither a cue nor the trigger note
+
+int keyForNote(const CueSet *cues, int note, int trigNote) {
+  if (cues != nullptr && cues->find(note) != nullptr)
+    return note;
+  return trigNote >= 128 || note == trigNote ? kStartOffsetKey : kNoKey;
+}
+
+juce::uint64 fnv1a(const void *data, size_t size,
+                   juce::uint64 h = 0xcbf29ce484222325ull) {
+  const auto *bytes = static_cast<const juce::uint8 *>(data);
+  for (size_t i = 0; i < size; ++i)
+    h = (h ^ bytes[i]) * 0x100000001b3ull;
+  return h;
+}
+} // namespace
+
 //==============================================================================
 juce::AudioProcessorValueTreeState::ParameterLayout
 BackingTrackTriggerProcessor::createLayout() {
@@ -61,16 +89,140 @@ BackingTrackTriggerProcessor::createLayout() {
   layout.add(std::make_unique<AudioParameterBool>(
       ParameterID{ids::followTransport, 1}, "Follow Transport", true));
 
+  // Varispeed: play at the host's tempo over the track's, pitch following.
+  layout.add(std::make_unique<AudioParameterBool>(
+      ParameterID{ids::varispeed, 1}, "Varispeed", false));
+
+  // The track's own tempo; 0 = the tempo its analysis detected.
+  layout.add(std::make_unique<AudioParameterFloat>(
+      ParameterID{ids::trackTempo, 1}, "Track Tempo",
+      NormalisableRange<float>(0.0f, 300.0f, 0.01f), 0.0f,
+      AudioParameterFloatAttributes()
+          .withLabel("BPM")
+          .withStringFromValueFunction([](float v, int) {
+            return v <= 0.0f ? String("Auto") : String(v, 2);
+          })));
+
+  // Loudness normalization to a target integrated loudness.
+  layout.add(std::make_unique<AudioParameterBool>(
+      ParameterID{ids::normalize, 1}, "Normalize", false));
+
+  layout.add(std::make_unique<AudioParameterFloat>(
+      ParameterID{ids::targetLoudness, 1}, "Target Loudness",
+      NormalisableRange<float>(-36.0f, -6.0f, 0.1f), -16.0f,
+      AudioParameterFloatAttributes().withLabel("LUFS")));
+
   return layout;
 }
 
+//==============================================================================
+juce::uint64 SampleBuffer::getContentHash() const {
+  if (const auto cached = contentHash.load(std::memory_order_acquire))
+    return cached;
+
+  // FNV-1a over 32-bit words in four independent lanes (so the loop isn't
+  // bound by a single multiply chain), finished with a 64-bit avalanche.
+  constexpr juce::uint64 prime = 0x100000001b3ull;
+  juce::uint64 lanes[4] = {0xcbf29ce484222325ull, 0x84222325cbf29ce4ull,
+                           0x9e3779b97f4a7c15ull, 0x7f4a7c159e3779b9ull};
+
+  const int numSamples = source.getNumSamples();
+  for (int ch = 0; ch < source.getNumChannels(); ++ch) {
+    const float *data = source.getReadPointer(ch);
+    int i = 0;
+    for (; i + 4 <= numSamples; i += 4) {
+      for (int k = 0; k < 4; ++k) {
+        juce::uint32 word;
+        std::memcpy(&word, data + i + k, sizeof(word));
+        lanes[k] = (lanes[k] ^ word) * prime;
+      }
+    }
+    for (; i < numSamples; ++i) {
+      juce::uint32 word;
+      std::memcpy(&word, data + i, sizeof(word));
+      lanes[0] = (lanes[0] ^ word) * prime;
+    }
+  }
+
+  juce::uint64 rateBits;
+  std::memcpy(&rateBits, &sourceSampleRate, sizeof(rateBits));
+  juce::uint64 h = rateBits ^ (static_cast<juce::uint64>(numSamples) << 8) ^
+                   static_cast<juce::uint64>(source.getNumChannels());
+  for (auto lane : lanes) {
+    h ^= lane + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2);
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+  }
+  if (h == 0)
+    h = 1; // 0 means "not computed"
+
+  contentHash.store(h, std::memory_order_release);
+  return h;
+}
+
+void SampleBuffer::setContentHash(juce::uint64 hash) noexcept {
+  contentHash.store(hash, std::memory_order_release);
+}
+
+juce::uint64 SampleBuffer::getPeaksKey() const {
+  juce::uint64 h = 0;
+  if (fullPath.isNotEmpty() && fileSize > 0) {
+    const auto path = fullPath.hashCode64();
+    h = fnv1a(&path, sizeof(path));
+    h = fnv1a(&fileSize, sizeof(fileSize), h);
+    h = fnv1a(&fileModTimeMs, sizeof(fileModTimeMs), h);
+  } else if (const auto blob =
+                 embedded != nullptr ? embedded->getEncoded() : nullptr) {
+    h = fnv1a(blob->getData(), blob->getSize());
+  } else {
+    return 0;
+  }
+  return h != 0 ? h : 1;
+}
+
+void SampleBuffer::createDerivedData() {
+  peaks = new WaveformPeaks(source.getNumSamples());
+  analysis = new SampleAnalysis();
+  embedded = new EmbeddedAudio();
+  lossless = new EmbeddedAudio();
+}
+
+int SampleBuffer::getNumFrames() const noexcept {
+  if (compressed != nullptr && audio.getNumSamples() == 0)
+    return compressed->getNumFrames();
+  return audio.getNumSamples();
+}
+
+juce::int64 SampleBuffer::getAudioBytes() const {
+  const auto floats =
+      static_cast<juce::int64>(source.getNumChannels()) *
+          source.getNumSamples() +
+      static_cast<juce::int64>(audio.getNumChannels()) * audio.getNumSamples();
+  return floats * static_cast<juce::int64>(sizeof(float)) +
+         (compressed != nullptr ? compressed->getCompressedBytes() : 0);
+}
+
+void SampleBuffer::copyMetadataFrom(const SampleBuffer &other) {
+  sourceSampleRate = other.sourceSampleRate;
+  sourceNumChannels = other.sourceNumChannels;
+  sourceBitsPerSample = other.sourceBitsPerSample;
+  name = other.name;
+  fullPath = other.fullPath;
+  fileSize = other.fileSize;
+  fileModTimeMs = other.fileModTimeMs;
+  peaks = other.peaks;
+  analysis = other.analysis;
+  embedded = other.embedded;
+  lossless = other.lossless;
+  contentHash.store(other.contentHash.load());
+}
+
 //==============================================================================
 BackingTrackTriggerProcessor::BackingTrackTriggerProcessor()
     : AudioProcessor(BusesProperties().withOutput(
           "Output", juce::AudioChannelSet::stereo(), true)),
       apvts(*this, nullptr, "PARAMETERS", createLayout()) {
-  formatManager.registerBasicFormats();
-
   gainParam = apvts.getRawParameterValue(ids::gain);
   loopParam = apvts.getRawParameterValue(ids::loop);
   noteOffStopsParam = apvts.getRawParameterValue(ids::noteOffStops);
@@ -80,9 +232,21 @@ BackingTrackTriggerProcessor::BackingTrackTriggerProcessor()
   fadeOutParam = apvts.getRawParameterValue(ids::fadeOut);
   retriggerParam = apvts.getRawParameterValue(ids::retrigger);
   followTransportParam = apvts.getRawParameterValue(ids::followTransport);
+  varispeedParam = apvts.getRawParameterValue(ids::varispeed);
+  trackTempoParam = apvts.getRawParameterValue(ids::trackTempo);
+  normalizeParam = apvts.getRawParameterValue(ids::normalize);
+  targetLoudnessParam = apvts.getRawParameterValue(ids::targetLoudness);
+
+  lastActiveMs = juce::Time::getMillisecondCounterHiRes();
+  memoryBudget->add(this);
 }
 
-BackingTrackTriggerProcessor::~BackingTrackTriggerProcessor() {}
+BackingTrackTriggerProcessor::~BackingTrackTriggerProcessor() {
+  memoryBudget->remove(this);
+  cancelPendingUpdate(); // the budget's thread can't post another now
+  // Jobs hold `this`: stop them and wait for any that is part-way through.
+  jobs.cancelAllAndWait();
+}
 
 //==============================================================================
 const juce::String BackingTrackTriggerProcessor::getName() const {
@@ -120,38 +284,81 @@ void BackingTrackTriggerProcessor::prepareToPlay(double sampleRate,
 
   gainSmoothed.reset(sampleRate, 0.02);
   gainSmoothed.setCurrentAndTargetValue(
-      juce::Decibels::decibelsToGain(gainParam->load(), -60.0f));
+      juce::Decibels::decibelsToGain(gainParam->load(), -60.0f) *
+      static_cast<float>(
+          juce::Decibels::decibelsToGain(getNormalizeGainDb())));
 
   playState = PlayState::Idle;
   playingFlag = false;
   playPos = 0;
   fadeGain = 0.0f;
   fadeTarget = 0.0f;
+  playPhase = 0.0;
+  playSpeed = 1.0;
+  tempoRatio = 1.0;
+  playbackRatio = 1.0;
+  jumpRemaining = 0;
+  syncAnchored = false;
   lastHostPosition = 0;
+  hostPositionKnown = false;
   wasHostPlaying = false;
+  lateJoinKey = kStartOffsetKey;
+  voiceKey = kStartOffsetKey;
+  headRanOut = false;
+  renderedSamples = 0;
+  blockStartClock = 0;
+  voiceStartClock = 0;
+  syncTracking = false;
+  syncDriftMs = 0.0;
+  syncMaxDriftMs = 0.0;
+  syncCorrections = 0;
+  syncJumps = 0;
+  streamUnderruns = 0;
 
   // If the host rate changed, rebuild the playback buffer from the pristine
-  // source (never from already-resampled audio).
+  // source (never from already-resampled audio). Holding loadLock keeps a
+  // background restore from publishing in between; it re-prepares for the new
+  // rate itself.
   if (std::abs(oldRate - sampleRate) > 0.5) {
-    if (auto cur = getSample()) {
+    const juce::ScopedLock sl(loadLock);
+    auto cur = getSample();
+    if (cur != nullptr && cur->compressed != nullptr) {
+      // No source to resample from: it comes back in the background as if
+      // evicted, decoded from the compressed copy if nothing else.
+      auto shell = SampleBuffer::Ptr(new SampleBuffer());
+      shell->copyMetadataFrom(*cur);
+      shell->compressed = cur->compressed;
+      cur = nullptr;
+      evictedSample = shell;
+      evictedFlag = true;
+      publishSample(nullptr, true);
+      rehydrate();
+    } else if (cur != nullptr) {
       auto rebuilt = SampleBuffer::Ptr(new SampleBuffer());
       rebuilt->source = cur->source;
-      rebuilt->sourceSampleRate = cur->sourceSampleRate;
-      rebuilt->sourceNumChannels = cur->sourceNumChannels;
-      rebuilt->sourceBitsPerSample = cur->sourceBitsPerSample;
-      rebuilt->name = cur->name;
-      rebuilt->fullPath = cur->fullPath;
-      prepareForRate(*rebuilt, sampleRate);
+      rebuilt->copyMetadataFrom(*cur);
+      prepareForRate(*rebuilt, sampleRate, nullptr, offlineFlag.load());
       publishSample(rebuilt);
     }
+    triggerAsyncUpdate(); // a setlist preload for the old rate is redone
   }
 }
 
+void BackingTrackTriggerProcessor::setNonRealtime(bool isNonRealtime) noexcept {
+  AudioProcessor::setNonRealtime(isNonRealtime);
+  offlineFlag = isNonRealtime;
+}
+
 void BackingTrackTriggerProcessor::releaseResources() {
   playState = PlayState::Idle;
   playingFlag = false;
   playPos = 0;
+  playPhase = 0.0;
+  playSpeed = 1.0;
+  jumpRemaining = 0;
   fadeGain = 0.0f;
+  headRanOut = false;
+  syncTracking = false;
 }
 
 bool BackingTrackTriggerProcessor::isBusesLayoutSupported(
@@ -162,15 +369,84 @@ bool BackingTrackTriggerProcessor::isBusesLayoutSupported(
 }
 
 //==============================================================================
-void BackingTrackTriggerProcessor::startVoice(int64_t offset, int sampleLen) {
-  playPos = juce::jlimit<int64_t>(0, juce::jmax(0, sampleLen - 1), offset);
+namespace {
+constexpr double kJumpFadeMs = 10.0;       // crossfade of a jump or restart
+constexpr double kSyncJumpMs = 20.0;       // drift closed by a jump instead
+constexpr double kSyncMaxSpeedChange = 0.005; // about 9 cents
+constexpr double kSyncResponseMs = 100.0;  // time constant of a correction
+constexpr double kSyncLockedSamples = 0.01; // drift small enough to ignore
+constexpr double kMinTempoRatio = 0.5;     // varispeed limits: an octave
+constexpr double kMaxTempoRatio = 2.0;     // down or up
+constexpr double kTempoGlideMs = 50.0;     // time constant of a tempo change
+constexpr double kMaxNormalizeDb = 24.0;   // normalization limits, either way
+constexpr double kNormalizeCeilingDb = -1.0; // dBTP a boost stops at
+
+// 4-point, 3rd-order Hermite interpolation between src[p] and src[p + 1].
+float interpolate(const float *src, int p, float t, int len) {
+  const auto at = [&](int i) { return src[juce::jlimit(0, len - 1, i)]; };
+  const float xm1 = at(p - 1), x0 = src[p], x1 = at(p + 1), x2 = at(p + 2);
+  const float c1 = 0.5f * (x1 - xm1);
+  const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+  const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+  return ((c3 * t + c2) * t + c1) * t + x0;
+}
+
+// Adds `n` samples of `src` read from `start` at `speed` source samples per
+// output sample, each interpolated as above. Every src index the run touches
+// must be in range. The position is computed from `k` rather than
+// accumulated, so nothing carries from one sample to the next and the
+// compiler can vectorise the loop.
+void addResampled(const float *src, float *dst, int n, double start,
+                  double speed, float gain) {
+  for (int k = 0; k < n; ++k) {
+    const double x = start + k * speed;
+    const int p = static_cast<int>(x);
+    const auto t = static_cast<float>(x - p);
+    const float xm1 = src[p - 1], x0 = src[p], x1 = src[p + 1], x2 = src[p + 2];
+    const float c1 = 0.5f * (x1 - xm1);
+    const float c2 = xm1 - 2.5f * x0 + 2.0f * x1 - 0.5f * x2;
+    const float c3 = 0.5f * (x2 - xm1) + 1.5f * (x0 - x1);
+    dst[k] += gain * (((c3 * t + c2) * t + c1) * t + x0);
+  }
+}
+} // namespace
+
+void BackingTrackTriggerProcessor::startVoice(int64_t position,
+                                              int64_t sampleLen,
+                                              int blockOffset, int key,
+                                              bool crossfade) {
+  // Restarting a voice that is still sounding crossfades from where it was
+  // (when that audio is to hand); otherwise it fades in from silence.
+  if (crossfade && playState != PlayState::Idle) {
+    jumpFromPos = playPos;
+    jumpLength = juce::jmax(
+        1, static_cast<int>(kJumpFadeMs * 0.001 * currentSampleRate.load()));
+    jumpRemaining = jumpLength;
+  } else {
+    jumpRemaining = 0;
+    fadeGain = 0.0f;
+  }
+  playPos = juce::jlimit<int64_t>(0, juce::jmax<int64_t>(0, sampleLen - 1),
+                                  position);
+  playPhase = 0.0;
+  playSpeed = tempoRatio;
   playState = PlayState::Playing;
-  fadeGain = 0.0f;
   fadeTarget = 1.0f;
   playingFlag = true;
+  voiceKey = key;
+  voiceStartClock = blockStartClock + blockOffset;
+  headRanOut = false;
+  lateJoinPending = false;
+
+  // With the host playing, the voice keeps to its timeline from here.
+  syncAnchored = wasHostPlaying && hostPositionKnown;
+  anchorHostPos = lastHostPosition + blockOffset;
+  anchorVoicePos = static_cast<double>(playPos);
+  anchorRatio = tempoRatio;
 }
 
 void BackingTrackTriggerProcessor::beginFadeOut() {
+  headRanOut = false;
   if (playState != PlayState::Idle) {
     playState = PlayState::FadingOut;
     fadeTarget = 0.0f;
@@ -184,26 +460,260 @@ int64_t BackingTrackTriggerProcessor::currentOffsetSamples(double sr,
   return juce::jlimit<int64_t>(0, juce::jmax(0, sampleLen - 1), s);
 }
 
-void BackingTrackTriggerProcessor::renderSegment(juce::AudioBuffer<float> &out,
-                                                 int startSample, int numSamples,
-                                                 const SampleBuffer &data,
-                                                 int64_t offset, bool looping,
-                                                 int fadeOutSamples) {
-  if (numSamples <= 0 || playState == PlayState::Idle)
+int64_t BackingTrackTriggerProcessor::voiceStartFor(const CueSet *cues,
+                                                    int key, int64_t offset,
+                                                    double sr) {
+  if (key >= 0 && cues != nullptr)
+    if (const auto *cue = cues->find(key))
+      return static_cast<int64_t>(cue->offsetSeconds * sr);
+  return offset;
+}
+
+const CueSet::Entry *
+BackingTrackTriggerProcessor::headFor(const CueSet *cues, int key,
+                                      int64_t offset, double sr) {
+  if (cues == nullptr || std::abs(cues->getSampleRate() - sr) > 0.5)
+    return nullptr;
+  const auto *entry = key >= 0 ? cues->find(key) : &cues->getStartEntry();
+  // The start offset's head may lag a moment behind the parameter.
+  if (entry == nullptr || entry->head.getNumSamples() == 0 ||
+      (key < 0 && entry->start != offset))
+    return nullptr;
+  return entry;
+}
+
+void BackingTrackTriggerProcessor::followHost(double sr, int sampleLen,
+                                              int64_t offset, bool looping,
+                                              bool followTransport,
+                                              int numSamples) {
+  if (!followTransport || playState != PlayState::Playing ||
+      !wasHostPlaying || !hostPositionKnown) {
+    // Nothing to follow: carry on at the tempo's speed from wherever we are.
+    syncAnchored = false;
+    playSpeed = tempoRatio;
+    syncTracking = false;
     return;
+  }
+  if (!syncAnchored) { // e.g. the host started under a manual trigger
+    syncAnchored = true;
+    anchorHostPos = lastHostPosition;
+    anchorVoicePos = static_cast<double>(playPos);
+    anchorRatio = tempoRatio;
+  }
+  if (tempoRatio != anchorRatio) {
+    // The track moves at the tempo ratio against the host's clock; re-anchor
+    // where the old ratio has got it to.
+    anchorVoicePos +=
+        static_cast<double>(lastHostPosition - anchorHostPos) * anchorRatio;
+    anchorHostPos = lastHostPosition;
+    anchorRatio = tempoRatio;
+  }
 
-  const int sampleLen = data.audio.getNumSamples();
-  const int srcCh = data.audio.getNumChannels();
-  const int outCh = out.getNumChannels();
+  double expected =
+      anchorVoicePos +
+      static_cast<double>(lastHostPosition - anchorHostPos) * anchorRatio;
+  const int64_t span = sampleLen - offset;
+  if (looping && span > 0 && expected >= sampleLen)
+    expected = static_cast<double>(offset) +
+               std::fmod(expected - static_cast<double>(offset),
+                         static_cast<double>(span));
+  expected = juce::jmax(0.0, expected);
+  const auto expectedPos = static_cast<int64_t>(expected);
+  if (!looping && expectedPos >= sampleLen) {
+    // By the host's clock the track has already finished.
+    beginFadeOut();
+    syncTracking = false;
+    return;
+  }
+
+  double drift = static_cast<double>(playPos) + playPhase - expected;
+  if (looping && span > 0) // the shorter way round the loop
+    drift = std::remainder(drift, static_cast<double>(span));
+
+  if (std::abs(drift) > kSyncJumpMs * 0.001 * sr) {
+    jumpFromPos = playPos;
+    jumpLength = juce::jmax(1, static_cast<int>(kJumpFadeMs * 0.001 * sr));
+    jumpRemaining = jumpLength;
+    playPos = expectedPos;
+    playPhase = expected - static_cast<double>(expectedPos);
+    playSpeed = tempoRatio;
+    ++syncJumps;
+  } else if (std::abs(drift) > kSyncLockedSamples) {
+    // Close the gap over about kSyncResponseMs (at most one block's worth
+    // per block, so it never overshoots), never changing speed audibly.
+    if (playSpeed == tempoRatio)
+      ++syncCorrections;
+    const double horizon = juce::jmax(
+        kSyncResponseMs * 0.001 * sr, static_cast<double>(numSamples));
+    playSpeed = tempoRatio *
+                (1.0 - juce::jlimit(-kSyncMaxSpeedChange, kSyncMaxSpeedChange,
+                                    drift / horizon));
+  } else {
+    // In sync: drop what's left of the last correction, well under a
+    // hundredth of a sample, so the steady-state path applies again.
+    playPos = expectedPos;
+    playPhase = expected - static_cast<double>(expectedPos);
+    playSpeed = tempoRatio;
+  }
+
+  const double driftMs = drift * 1000.0 / sr;
+  syncTracking = true;
+  syncDriftMs = driftMs;
+  if (std::abs(driftMs) > syncMaxDriftMs.load())
+    syncMaxDriftMs = std::abs(driftMs);
+}
+
+void BackingTrackTriggerProcessor::updateTempoRatio(const SampleBuffer *data,
+                                                    double sr, int numSamples) {
+  double target = 1.0;
+  if (varispeedParam->load() > 0.5f && hostBpm > 0.0) {
+    double trackBpm = trackTempoParam->load();
+    if (trackBpm <= 0.0 && data != nullptr && data->analysis != nullptr &&
+        data->analysis->isReady())
+      trackBpm = data->analysis->getResults().bpm;
+    if (trackBpm > 0.0)
+      target = juce::jlimit(kMinTempoRatio, kMaxTempoRatio, hostBpm / trackBpm);
+  }
+
+  // A voice glides to a new tempo, a block at a time; an idle one just
+  // takes it.
+  if (playState == PlayState::Idle) {
+    tempoRatio = target;
+  } else {
+    tempoRatio += (target - tempoRatio) *
+                  juce::jmin(1.0, numSamples / (kTempoGlideMs * 0.001 * sr));
+    if (std::abs(target - tempoRatio) < 1.0e-6)
+      tempoRatio = target;
+  }
+  playbackRatio = tempoRatio;
+}
+
+double BackingTrackTriggerProcessor::normalizeGainDbFor(
+    const SampleBuffer *data) const {
+  if (normalizeParam->load() < 0.5f || data == nullptr ||
+      data->analysis == nullptr || !data->analysis->isReady())
+    return 0.0;
+  const auto &results = data->analysis->getResults();
+  if (results.loudnessLufs <= SampleAnalysis::kNoLoudness)
+    return 0.0; // silence: nothing to bring up
+  const double headroom =
+      juce::jmax(0.0, kNormalizeCeilingDb - results.truePeakDb);
+  return juce::jlimit(
+      -kMaxNormalizeDb, juce::jmin(kMaxNormalizeDb, headroom),
+      static_cast<double>(targetLoudnessParam->load()) - results.loudnessLufs);
+}
+
+double BackingTrackTriggerProcessor::getNormalizeGainDb() const {
+  return normalizeGainDbFor(getSample().get());
+}
+
+BackingTrackTriggerProcessor::SyncStats
+BackingTrackTriggerProcessor::getSyncStats() const {
+  SyncStats stats;
+  stats.tracking = syncTracking.load();
+  stats.driftMs = syncDriftMs.load();
+  stats.maxDriftMs = syncMaxDriftMs.load();
+  stats.corrections = syncCorrections.load();
+  stats.jumps = syncJumps.load();
+  return stats;
+}
 
-  for (int i = 0; i < numSamples; ++i) {
-    if (playState == PlayState::Idle)
+int BackingTrackTriggerProcessor::renderSegment(
+    juce::AudioBuffer<float> &out, int startSample, int numSamples,
+    const juce::AudioBuffer<float> &audio, int64_t base, int64_t trackEnd,
+    int64_t loopStart, bool looping, int fadeOutSamples,
+    const juce::AudioBuffer<float> *jumpAudio, int64_t jumpBase) {
+  if (numSamples <= 0 || playState == PlayState::Idle)
+    return 0;
+  if (jumpAudio == nullptr) {
+    jumpAudio = &audio;
+    jumpBase = base;
+  }
+
+  // Positions below count from the start of `audio`: the track, or a part of
+  // it (a cue head, a stream window) that starts `base` samples in.
+  playPos -= base;
+  jumpFromPos -= jumpBase;
+  const int64_t offset = loopStart - base;
+  const int64_t sampleLen = trackEnd - base; // the end of the track
+  const int available = audio.getNumSamples();
+  // Audio that ends before the track does is left while the interpolator
+  // still has samples either side.
+  const int64_t stop =
+      sampleLen > available ? available - StreamBuffer::kGuard : available;
+  const int64_t jumpLen = trackEnd - jumpBase;
+  const int jumpAvailable = jumpAudio->getNumSamples();
+  const int srcCh = audio.getNumChannels();
+  const int outCh = out.getNumChannels();
+  // The pre-emptive fade starts early enough to finish at any speed.
+  const int64_t fadeStart =
+      sampleLen - static_cast<int64_t>(std::ceil(
+                      fadeOutSamples * juce::jmax(1.0, playSpeed)));
+
+  int i = 0;
+  for (; i < numSamples; ++i) {
+    if (playState == PlayState::Idle || playPos < 0 || playPos >= stop)
       break;
 
+    // Steady state (faded in, gain settled, in sync with the host): the
+    // whole run up to the next thing that changes per sample (the pre-emptive
+    // fade-out, or the loop point) is one scaled copy per channel.
+    if (playState == PlayState::Playing && fadeGain == fadeTarget &&
+        !gainSmoothed.isSmoothing() && playSpeed == 1.0 && playPhase == 0.0 &&
+        jumpRemaining == 0) {
+      const int64_t runEnd =
+          juce::jmin(looping ? sampleLen : fadeStart, stop);
+      const int run = static_cast<int>(
+          juce::jmin<int64_t>(numSamples - i, runEnd - playPos));
+      if (run > 0) {
+        const float g = fadeGain * gainSmoothed.getCurrentValue();
+        for (int ch = 0; ch < outCh; ++ch)
+          out.addFrom(ch, startSample + i, audio,
+                      juce::jmin(ch, srcCh - 1), static_cast<int>(playPos),
+                      run, g);
+        playPos += run;
+        if (playPos >= sampleLen) { // looping, or ending without a fade
+          if (looping)
+            playPos = offset;
+          else
+            playState = PlayState::Idle;
+        }
+        i += run - 1;
+        continue;
+      }
+    }
+
+    // The same at another speed (varispeed, or closing a drift): one
+    // interpolating pass per channel, up to where the interpolator would
+    // read past the end or something changes.
+    if (playState == PlayState::Playing && fadeGain == fadeTarget &&
+        !gainSmoothed.isSmoothing() && jumpRemaining == 0 && playPos >= 1 &&
+        (playSpeed != 1.0 || playPhase != 0.0)) {
+      const auto start = static_cast<double>(playPos) + playPhase;
+      const int64_t limit =
+          juce::jmin<int64_t>(looping ? sampleLen : fadeStart, stop - 2);
+      const double room = static_cast<double>(limit - 1) - start;
+      const int run =
+          room < 0.0 ? 0
+                     : static_cast<int>(juce::jmin<double>(
+                           numSamples - i, std::floor(room / playSpeed) + 1.0));
+      if (run > 0) {
+        const float g = fadeGain * gainSmoothed.getCurrentValue();
+        for (int ch = 0; ch < outCh; ++ch)
+          addResampled(audio.getReadPointer(juce::jmin(ch, srcCh - 1)),
+                       out.getWritePointer(ch, startSample + i), run, start,
+                       playSpeed, g);
+        const double end = start + run * playSpeed;
+        playPos = static_cast<int64_t>(end);
+        playPhase = end - static_cast<double>(playPos);
+        i += run - 1;
+        continue;
+      }
+    }
+
     // Pre-emptive fade-out so a sample that doesn't end on a zero crossing
     // doesn't click when it stops.
-    if (playState == PlayState::Playing && !looping &&
-        playPos >= static_cast<int64_t>(sampleLen - fadeOutSamples)) {
+    if (playState == PlayState::Playing && !looping && playPos >= fadeStart) {
       playState = PlayState::FadingOut;
       fadeTarget = 0.0f;
     }
@@ -215,17 +725,49 @@ void BackingTrackTriggerProcessor::renderSegment(juce::AudioBuffer<float> &out,
 
     const float g = fadeGain * gainSmoothed.getNextValue();
     const int p = static_cast<int>(playPos);
+    const auto t = static_cast<float>(playPhase);
+
+    // During a sync jump, an equal-power crossfade from the old position.
+    float gNew = g, gOld = 0.0f;
+    int from = -1;
+    if (jumpRemaining > 0) {
+      const float w = static_cast<float>(jumpRemaining) /
+                      static_cast<float>(jumpLength);
+      gNew = g * std::sqrt(1.0f - w);
+      gOld = g * std::sqrt(w);
+      from = jumpFromPos >= 0 && jumpFromPos < jumpAvailable
+                 ? static_cast<int>(jumpFromPos)
+                 : -1;
+    }
 
     for (int ch = 0; ch < outCh; ++ch) {
-      const int sc = juce::jmin(ch, srcCh - 1);
-      out.addSample(ch, startSample + i, data.audio.getSample(sc, p) * g);
+      const float *src = audio.getReadPointer(juce::jmin(ch, srcCh - 1));
+      float v = (t == 0.0f ? src[p] : interpolate(src, p, t, available)) * gNew;
+      if (from >= 0)
+        v += jumpAudio->getSample(
+                 juce::jmin(ch, jumpAudio->getNumChannels() - 1), from) *
+             gOld;
+      out.addSample(ch, startSample + i, v);
     }
 
-    ++playPos;
+    if (jumpRemaining > 0) {
+      --jumpRemaining;
+      if (++jumpFromPos >= jumpLen && looping)
+        jumpFromPos = loopStart - jumpBase;
+    }
+
+    if (playSpeed == 1.0) {
+      ++playPos;
+    } else { // varispeed, or following the host a little fast or slow
+      playPhase += playSpeed;
+      const auto whole = static_cast<int64_t>(playPhase);
+      playPos += whole;
+      playPhase -= static_cast<double>(whole);
+    }
 
     if (playPos >= sampleLen) {
       if (looping)
-        playPos = offset;
+        playPos = offset + (playPos - sampleLen);
       else
         playState = PlayState::Idle;
     }
@@ -234,21 +776,86 @@ void BackingTrackTriggerProcessor::renderSegment(juce::AudioBuffer<float> &out,
       playState = PlayState::Idle;
   }
 
+  playPos += base;
+  jumpFromPos += jumpBase;
   if (playState == PlayState::Idle)
     playingFlag = false;
+  return i;
 }
 
+int BackingTrackTriggerProcessor::renderStream(
+    juce::AudioBuffer<float> &out, int startSample, int numSamples,
+    const CueSet *cues, int64_t end, int64_t offset, double sr, bool looping,
+    int fadeOutSamples) {
+  const auto loopStart = voiceStartFor(cues, voiceKey, offset, sr);
+  const auto *head = headFor(cues, voiceKey, offset, sr);
+  const auto inHead = [&] {
+    const auto headEnd = head->start + head->head.getNumSamples();
+    return playPos >= head->start &&
+           (playPos + StreamBuffer::kGuard < headEnd ||
+            (headEnd >= end && playPos < headEnd));
+  };
+
+  int done = 0;
+  while (done < numSamples && playState != PlayState::Idle) {
+    // Wherever the voice is: a decoded window, else its own head.
+    int64_t base = 0;
+    const auto *audio = stream.find(playPos, base);
+    if (audio == nullptr && head != nullptr && inHead()) {
+      audio = &head->head;
+      base = head->start;
+    }
+
+    if (audio == nullptr) {
+      // Not decoded yet: keep time in silence, and fade in once it is.
+      ++streamUnderruns;
+      const double ahead = playPhase + (numSamples - done) * playSpeed;
+      playPos += static_cast<int64_t>(ahead);
+      playPhase = ahead - std::floor(ahead);
+      if (playPos >= end && looping && end > loopStart)
+        playPos = loopStart + (playPos - end) % (end - loopStart);
+      else if (playPos >= end || playState == PlayState::FadingOut)
+        playState = PlayState::Idle;
+      fadeGain = 0.0f;
+      jumpRemaining = 0;
+      if (playState == PlayState::Idle)
+        playingFlag = false;
+      return numSamples;
+    }
+
+    // A crossfade reads its old side from wherever that is decoded.
+    int64_t jumpBase = 0;
+    const auto *jumpAudio =
+        jumpRemaining > 0 ? stream.find(jumpFromPos, jumpBase) : nullptr;
+    const int n = renderSegment(out, startSample + done, numSamples - done,
+                                *audio, base, end, loopStart, looping,
+                                fadeOutSamples, jumpAudio, jumpBase);
+    if (n == 0)
+      break;
+    done += n;
+  }
+  return done;
+}
+
+namespace {
+constexpr double kOfflineLoadTimeoutMs = 60000.0;
+constexpr double kOfflinePollMs = 10.0;
+} // namespace
+
 void BackingTrackTriggerProcessor::processBlock(
     juce::AudioBuffer<float> &buffer, juce::MidiBuffer &midiMessages) {
   juce::ScopedNoDenormals noDenormals;
   buffer.clear();
 
+  const bool offline = offlineFlag.load();
+  if (offline)
+    prepareOfflineBlock();
+
   const double sr = currentSampleRate.load();
   const int numSamples = buffer.getNumSamples();
 
   // --- Snapshot parameters for this block ------------------------------------
-  gainSmoothed.setTargetValue(
-      juce::Decibels::decibelsToGain(gainParam->load(), -60.0f));
+  const float gain = juce::Decibels::decibelsToGain(gainParam->load(), -60.0f);
   const bool looping = loopParam->load() > 0.5f;
   const bool noteOffStops = noteOffStopsParam->load() > 0.5f;
   const int trigNote = static_cast<int>(triggerNoteParam->load());
@@ -264,49 +871,201 @@ void BackingTrackTriggerProcessor::processBlock(
 
   // --- Acquire the current sample without blocking the audio thread ----------
   SampleBuffer::Ptr data;
+  CueSet::Ptr cues;
   {
     const juce::SpinLock::ScopedTryLockType lock(sampleLock);
-    if (lock.isLocked())
+    if (lock.isLocked()) {
       data = currentSample;
+      cues = currentCues;
+    }
   }
-
-  if (data == nullptr || data->audio.getNumSamples() == 0) {
+  blockStartClock = renderedSamples;
+  renderedSamples += numSamples;
+
+  // --- Setlist: a step waits for the voice to stop ---------------------------
+  const int nextNote = setlistNextNote.load();
+  const bool autoAdvance = setlistAutoAdvance.load();
+  if (setlistAdvanceRequest.load() && playState == PlayState::Idle)
+    swapInNextTrack(data, cues);
+
+  // The track in use, which a setlist step can change mid-block. Compressed
+  // audio counts as resident: it streams.
+  bool resident = false;
+  bool streamed = false;
+  int sampleLen = 0;
+  int64_t offset = 0;
+  auto adopt = [&] {
+    // Normalization is per track, so it is part of the gain target: the
+    // render kernel's smoothed gain applies it at no extra cost.
+    gainSmoothed.setTargetValue(
+        gain * static_cast<float>(juce::Decibels::decibelsToGain(
+                   normalizeGainDbFor(data.get()))));
+    sampleLen = data != nullptr ? data->getNumFrames() : 0;
+    resident = sampleLen > 0;
+    streamed = resident && data->audio.getNumSamples() == 0;
+    // A track just stepped to starts at its own offset, which its cue set was
+    // built with; the parameter catches up.
+    if (setlistSwapped.load())
+      offset = cues != nullptr ? juce::jlimit<int64_t>(
+                                     0, juce::jmax(0, sampleLen - 1),
+                                     cues->getStartEntry().start)
+                               : 0;
+    else if (resident)
+      offset = currentOffsetSamples(sr, sampleLen);
+    else
+      offset = static_cast<int64_t>(startOffsetParam->load() / 1000.0 * sr);
+  };
+  adopt();
+
+  // Evicted audio still plays from the cue heads; with neither, notes are
+  // remembered to join late.
+  const bool fromHeads = !resident && evictedFlag.load() && !lateJoinPending &&
+                         cues != nullptr &&
+                         std::abs(cues->getSampleRate() - sr) < 0.5;
+  if (!resident && !fromHeads) {
     playState = PlayState::Idle;
     playingFlag = false;
-    publishedPos = 0;
+    syncTracking = false;
+    const bool transportReset = hostTransportReset() && followTransport;
+    if ((loadingFlag.load() || evictedFlag.load()) && !transportReset)
+      trackLateJoin(midiMessages, numSamples, cues.get(), trigNote,
+                    noteOffStops, retrig, nextNote);
+    else
+      lateJoinPending = false;
+    waitingForAudio = lateJoinPending;
+    if (!offline)
+      publishPlayhead(0, numSamples);
     outputLevel = 0.0f;
     return;
   }
+  waitingForAudio = false; // a late join starts below
 
-  const int sampleLen = data->audio.getNumSamples();
-  const int64_t offset = currentOffsetSamples(sr, sampleLen);
+  // The stream's windows stay put until the block is done.
+  const StreamBuffer::ScopedBlock streamBlock(
+      stream, streamed ? data->compressed.get() : nullptr,
+      playState != PlayState::Idle ? playPos : offset);
 
   // --- Host transport: reset on stop or rewind -------------------------------
-  if (followTransport) {
-    if (auto *playHead = getPlayHead()) {
-      if (auto position = playHead->getPosition()) {
-        const bool hostPlaying = position->getIsPlaying();
-        if (auto hostSamples = position->getTimeInSamples()) {
-          if (*hostSamples < lastHostPosition - 1000) {
-            playState = PlayState::Idle;
-            playingFlag = false;
-          }
-          lastHostPosition = *hostSamples;
-        }
-        if (wasHostPlaying && !hostPlaying) {
-          playState = PlayState::Idle;
-          playingFlag = false;
-        }
-        wasHostPlaying = hostPlaying;
+  if (hostTransportReset() && followTransport) {
+    playState = PlayState::Idle;
+    playingFlag = false;
+  }
+  updateTempoRatio(data.get(), sr, numSamples);
+
+  // --- Late join: a note arrived while the audio was still loading -----------
+  if (lateJoinPending) { // only ever resident here
+    lateJoinPending = false;
+    const auto start = voiceStartFor(cues.get(), lateJoinKey, offset, sr);
+    const auto elapsed = static_cast<int64_t>(
+        static_cast<double>(lateJoinElapsed) * tempoRatio);
+    if (looping)
+      startVoice(start + elapsed % juce::jmax<int64_t>(1, sampleLen - start),
+                 sampleLen, 0, lateJoinKey);
+    else if (start + elapsed < sampleLen)
+      startVoice(start + elapsed, sampleLen, 0, lateJoinKey);
+  }
+
+  // A voice that faded at the end of its head carries on if the track is back.
+  if (resident && headRanOut && playState == PlayState::FadingOut) {
+    playState = PlayState::Playing;
+    fadeTarget = 1.0f;
+  }
+  headRanOut = headRanOut && !resident;
+
+  // Starts the voice for `key` at block offset `t`: from the track, from the
+  // entry's head while the track is evicted, or failing both by joining late.
+  auto fire = [&](int key, int t) {
+    if (playState != PlayState::Idle && !retrig && key == voiceKey)
+      return;
+    const auto start = voiceStartFor(cues.get(), key, offset, sr);
+    if (resident) {
+      startVoice(start, sampleLen, t, key, true);
+    } else if (const auto *head = headFor(cues.get(), key, offset, sr)) {
+      startVoice(head->start, head->start + head->head.getNumSamples(), t,
+                 key);
+      rehydrateRequest = true;
+    } else {
+      playState = PlayState::Idle;
+      if (!lateJoinPending || retrig || key != lateJoinKey) {
+        lateJoinPending = true;
+        lateJoinKey = key;
+        lateJoinElapsed = -t;
       }
+      rehydrateRequest = true;
     }
-  }
+  };
+
+  // The next-track note: the setlist moves on once the voice has faded out.
+  auto advance = [&] {
+    setlistAdvanceRequest = true;
+    beginFadeOut();
+    lateJoinPending = false;
+    if (playState == PlayState::Idle && swapInNextTrack(data, cues))
+      adopt();
+  };
+
+  // Renders the voice over [from, from + n) from wherever it reads.
+  auto render = [&](int from, int n) {
+    if (n <= 0 || playState == PlayState::Idle)
+      return;
+    const auto loopStart = voiceStartFor(cues.get(), voiceKey, offset, sr);
+    if (resident) {
+      while (n > 0) {
+        // With auto-advance and the next track ready, a track plays to its
+        // last sample without the pre-emptive fade, and the next follows on.
+        const bool gapless = autoAdvance && !looping && nextTrackReady.load();
+        const int tail = gapless ? 0 : fadeOutSamples;
+        const bool wasActive = playState != PlayState::Idle;
+        const int done =
+            streamed
+                ? renderStream(buffer, from, n, cues.get(), sampleLen, offset,
+                               sr, looping, tail)
+                : renderSegment(
+                      buffer, from, n, data->audio, 0, sampleLen,
+                      voiceStartFor(cues.get(), voiceKey, offset, sr), looping,
+                      tail);
+        const bool ended = wasActive && playState == PlayState::Idle &&
+                           !looping && playPos >= sampleLen - tail;
+        if (!ended || !autoAdvance)
+          return;
+        setlistAdvanceRequest = true;
+        if (!gapless || !swapInNextTrack(data, cues))
+          return;
+        adopt();
+        from += done;
+        n -= done;
+        startVoice(offset, sampleLen, from, kStartOffsetKey);
+        fadeGain = 1.0f; // no fade-in either: the tracks join seamlessly
+      }
+      return;
+    }
+    const auto *head = headFor(cues.get(), voiceKey, offset, sr);
+    if (head == nullptr) { // the cue went away under it
+      playState = PlayState::Idle;
+      return;
+    }
+    const bool wasPlaying = playState == PlayState::Playing;
+    renderSegment(buffer, from, n, head->head, head->start,
+                  head->start + head->head.getNumSamples(), loopStart, false,
+                  fadeOutSamples);
+    if (wasPlaying && playState != PlayState::Playing)
+      headRanOut = true; // the pre-emptive fade at the end of the head
+  };
 
   // --- Manual transport requests (block-aligned) -----------------------------
-  if (stopRequest.exchange(false))
+  if (stopRequest.exchange(false)) {
     beginFadeOut();
+    lateJoinPending = false;
+  }
   if (triggerRequest.exchange(false))
-    startVoice(offset, sampleLen);
+    fire(kStartOffsetKey, 0);
+
+  // --- Keep to the host's timeline (once the whole track is there) -----------
+  if (resident)
+    followHost(sr, sampleLen, voiceStartFor(cues.get(), voiceKey, offset, sr),
+               looping, followTransport, numSamples);
+  else
+    playSpeed = tempoRatio; // a cue head just keeps to the tempo
 
   // --- Sample-accurate MIDI handling -----------------------------------------
   int cursor = 0;
@@ -314,82 +1073,286 @@ void BackingTrackTriggerProcessor::processBlock(
     const auto msg = metadata.getMessage();
     const int t = juce::jlimit(0, numSamples, metadata.samplePosition);
 
-    renderSegment(buffer, cursor, t - cursor, *data, offset, looping,
-                  fadeOutSamples);
+    render(cursor, t - cursor);
     cursor = t;
 
-    const bool matchesNote =
-        (trigNote >= 128) || (msg.getNoteNumber() == trigNote);
+    if (msg.getNoteNumber() == nextNote) {
+      if (msg.isNoteOn() && msg.getVelocity() > 0)
+        advance();
+      continue;
+    }
+
+    const int key = keyForNote(cues.get(), msg.getNoteNumber(), trigNote);
+    if (key == kNoKey)
+      continue;
 
     if (msg.isNoteOn() && msg.getVelocity() > 0) {
-      if (matchesNote && (playState == PlayState::Idle || retrig))
-        startVoice(offset, sampleLen);
+      if (wasHostPlaying)
+        lastTriggerHostPosition = lastHostPosition + t;
+      fire(key, t);
     } else if (msg.isNoteOff() ||
                (msg.isNoteOn() && msg.getVelocity() == 0)) {
-      if (matchesNote && noteOffStops)
+      if (noteOffStops && (playState != PlayState::Idle || lateJoinPending) &&
+          key == (lateJoinPending ? lateJoinKey : voiceKey)) {
         beginFadeOut();
+        lateJoinPending = false;
+      }
+    }
+  }
+  render(cursor, numSamples - cursor);
+
+  // A voice that ran off the end of its head joins late, where it would be.
+  if (!resident) {
+    if (playState == PlayState::Idle && headRanOut) {
+      headRanOut = false;
+      lateJoinPending = true;
+      lateJoinKey = voiceKey;
+      lateJoinElapsed = renderedSamples - voiceStartClock;
+    } else if (lateJoinPending) {
+      lateJoinElapsed += numSamples;
     }
   }
-  renderSegment(buffer, cursor, numSamples - cursor, *data, offset, looping,
-                fadeOutSamples);
 
-  // --- Publish state for the editor ------------------------------------------
-  publishedPos = playPos;
+  // --- Publish state for the editor (not while bouncing) ---------------------
   playingFlag = (playState != PlayState::Idle);
+  if (offline) {
+    outputLevel = 0.0f;
+    return;
+  }
+  publishPlayhead(playPos, numSamples);
   outputLevel = buffer.getMagnitude(0, numSamples);
 }
 
+void BackingTrackTriggerProcessor::prepareOfflineBlock() {
+  // Nothing waits on this thread offline, so rather than start the bounce
+  // without audio that is on its way (and join late), wait for it. A failed
+  // rehydration ends the wait; so does the timeout.
+  const double deadline =
+      juce::Time::getMillisecondCounterHiRes() + kOfflineLoadTimeoutMs;
+  const double failedBefore = lastRehydrateFailMs.load();
+  while ((loadingFlag.load() || evictedFlag.load() || isCompressed()) &&
+         juce::Time::getMillisecondCounterHiRes() < deadline) {
+    if ((evictedFlag.load() || isCompressed()) && !loadingFlag.load() &&
+        lastRehydrateFailMs.load() != failedBefore)
+      break;
+    requestResident();
+    loadFinished.wait(kOfflinePollMs);
+  }
+
+  // A normalized bounce waits for the loudness too, to be level from the
+  // first sample.
+  auto cur = getSample();
+  if (cur != nullptr && cur->analysis != nullptr &&
+      cur->analysis != offlineAnalysis && normalizeParam->load() > 0.5f) {
+    offlineAnalysis = cur->analysis;
+    offlineAnalysis->waitUntilReady(juce::jmax(
+        0, static_cast<int>(deadline -
+                            juce::Time::getMillisecondCounterHiRes())));
+  }
+
+  // Bring resampled audio up to the best quality before it's rendered. The
+  // length is the same, so a voice already playing carries on seamlessly.
+  if (cur == nullptr || cur->compressed != nullptr || !cur->wasResampled ||
+      cur->bestQuality)
+    return;
+  const juce::ScopedLock sl(loadLock);
+  if (loadingFlag.load() || getSample() != cur)
+    return;
+  auto rebuilt = SampleBuffer::Ptr(new SampleBuffer());
+  rebuilt->source = cur->source;
+  rebuilt->copyMetadataFrom(*cur);
+  prepareForRate(*rebuilt, currentSampleRate.load(), nullptr, true);
+  publishSample(rebuilt);
+}
+
+bool BackingTrackTriggerProcessor::hostTransportReset() {
+  hostPositionKnown = false;
+  hostBpm = 0.0;
+  auto *playHead = getPlayHead();
+  if (playHead == nullptr)
+    return false;
+  auto position = playHead->getPosition();
+  if (!position)
+    return false;
+
+  bool reset = false;
+  const bool hostPlaying = position->getIsPlaying();
+  const auto ppq = position->getPpqPosition();
+  const auto bpm = position->getBpm();
+  hostBpm = bpm ? *bpm : 0.0;
+  int64_t hostSamples = 0;
+  hostPositionKnown = true;
+  if (auto samples = position->getTimeInSamples())
+    hostSamples = *samples;
+  else if (ppq && bpm && *bpm > 0.0) // assumes a constant tempo
+    hostSamples = static_cast<int64_t>(
+        std::llround(*ppq * 60.0 / *bpm * currentSampleRate.load()));
+  else
+    hostPositionKnown = false;
+  if (hostPositionKnown) {
+    if (hostSamples < lastHostPosition - 1000)
+      reset = true;
+    lastHostPosition = hostSamples;
+  }
+  if (wasHostPlaying && !hostPlaying)
+    reset = true;
+  wasHostPlaying = hostPlaying;
+  hostPlayingFlag = hostPlaying;
+  hostPositionSamples = lastHostPosition;
+  return reset;
+}
+
+void BackingTrackTriggerProcessor::trackLateJoin(const juce::MidiBuffer &midi,
+                                                 int numSamples,
+                                                 const CueSet *cues,
+                                                 int trigNote,
+                                                 bool noteOffStops,
+                                                 bool retrig, int nextNote) {
+  if (stopRequest.exchange(false))
+    lateJoinPending = false;
+  if (triggerRequest.exchange(false)) {
+    lateJoinPending = true;
+    lateJoinKey = kStartOffsetKey;
+    lateJoinElapsed = 0;
+  }
+
+  for (const auto metadata : midi) {
+    const auto msg = metadata.getMessage();
+    if (msg.getNoteNumber() == nextNote) { // steps at the next block
+      if (msg.isNoteOn() && msg.getVelocity() > 0) {
+        setlistAdvanceRequest = true;
+        lateJoinPending = false;
+      }
+      continue;
+    }
+    const int key = keyForNote(cues, msg.getNoteNumber(), trigNote);
+    if (key == kNoKey)
+      continue;
+
+    if (msg.isNoteOn() && msg.getVelocity() > 0) {
+      if (wasHostPlaying)
+        lastTriggerHostPosition = lastHostPosition + metadata.samplePosition;
+      // Evicted audio is wanted now; the budget thread picks this up.
+      if (evictedFlag.load())
+        rehydrateRequest = true;
+      if (!lateJoinPending || retrig || key != lateJoinKey) {
+        lateJoinPending = true;
+        lateJoinKey = key;
+        lateJoinElapsed = -juce::jlimit(0, numSamples, metadata.samplePosition);
+      }
+    } else if (msg.isNoteOff() || msg.isNoteOn()) {
+      if (noteOffStops && key == lateJoinKey)
+        lateJoinPending = false;
+    }
+  }
+
+  if (lateJoinPending)
+    lateJoinElapsed += numSamples;
+}
+
 //==============================================================================
 bool BackingTrackTriggerProcessor::hasEditor() const { return true; }
 
 juce::AudioProcessorEditor *BackingTrackTriggerProcessor::createEditor() {
+  editorOpen = true;
+  requestResident();
   return new BackingTrackTriggerEditor(*this);
 }
 
+void BackingTrackTriggerProcessor::editorBeingDeleted(
+    juce::AudioProcessorEditor *editor) noexcept {
+  editorOpen = false;
+  AudioProcessor::editorBeingDeleted(editor);
+}
+
 //==============================================================================
 void BackingTrackTriggerProcessor::triggerPlayback() { triggerRequest = true; }
 void BackingTrackTriggerProcessor::stopPlayback() { stopRequest = true; }
 
 //==============================================================================
-void BackingTrackTriggerProcessor::resampleInto(
+namespace {
+constexpr int kLoadChunk = 65536; // samples between cancel / progress checks
+constexpr float kReadShare = 0.8f; // of a load's progress (resampling: rest)
+
+void setLoadProgress(JobScheduler::Job *job, float readFraction,
+                     float resampleFraction) {
+  if (job != nullptr)
+    job->setProgress(kReadShare * readFraction +
+                     (1.0f - kReadShare) * resampleFraction);
+}
+
+bool isCancelled(const JobScheduler::Job *job) {
+  return job != nullptr && job->isCancelled();
+}
+} // namespace
+
+bool BackingTrackTriggerProcessor::resampleInto(
     const juce::AudioBuffer<float> &src, double srcRate,
-    juce::AudioBuffer<float> &dst, double dstRate) {
+    juce::AudioBuffer<float> &dst, double dstRate, JobScheduler::Job *job,
+    bool bestQuality) {
   const int numChannels = src.getNumChannels();
   const int srcLen = src.getNumSamples();
 
   if (std::abs(srcRate - dstRate) < 0.5 || srcLen == 0) {
     dst = src; // straight copy
-    return;
+    return true;
   }
 
   const double ratio = srcRate / dstRate; // input samples per output sample
   const int dstLen =
       static_cast<int>(std::ceil(srcLen * dstRate / srcRate));
   dst.setSize(numChannels, dstLen);
+  PageLock::adviseHugePages(dst);
+
+  if (bestQuality)
+    return SincResampler::process(
+        src, srcRate, dst, dstRate, [job] { return isCancelled(job); },
+        [job](float fraction) { setLoadProgress(job, 1.0f, fraction); });
 
+  // In chunks, so a cancelled load stops promptly; the interpolator carries
+  // its state across calls, so the result is the same as one long call.
   for (int ch = 0; ch < numChannels; ++ch) {
     juce::LagrangeInterpolator interp;
     interp.reset();
-    interp.process(ratio, src.getReadPointer(ch), dst.getWritePointer(ch),
-                   dstLen);
+    const float *in = src.getReadPointer(ch);
+    float *out = dst.getWritePointer(ch);
+    for (int pos = 0; pos < dstLen; pos += kLoadChunk) {
+      if (isCancelled(job))
+        return false;
+      const int len = juce::jmin(kLoadChunk, dstLen - pos);
+      in += interp.process(ratio, in, out + pos, len);
+      setLoadProgress(job, 1.0f,
+                      static_cast<float>(ch * dstLen + pos + len) /
+                          static_cast<float>(numChannels * dstLen));
+    }
   }
+  return true;
 }
 
-void BackingTrackTriggerProcessor::prepareForRate(SampleBuffer &s,
-                                                  double hostRate) {
+bool BackingTrackTriggerProcessor::prepareForRate(SampleBuffer &s,
+                                                  double hostRate,
+                                                  JobScheduler::Job *job,
+                                                  bool bestQuality) {
   s.playbackSampleRate = hostRate;
   if (std::abs(s.sourceSampleRate - hostRate) > 0.5) {
-    resampleInto(s.source, s.sourceSampleRate, s.audio, hostRate);
     s.wasResampled = true;
-  } else {
-    s.audio = s.source;
-    s.wasResampled = false;
+    s.bestQuality = bestQuality;
+    return resampleInto(s.source, s.sourceSampleRate, s.audio, hostRate, job,
+                        bestQuality);
   }
+  s.audio.setSize(s.source.getNumChannels(), s.source.getNumSamples());
+  PageLock::adviseHugePages(s.audio);
+  for (int ch = 0; ch < s.source.getNumChannels(); ++ch)
+    s.audio.copyFrom(ch, 0, s.source, ch, 0, s.source.getNumSamples());
+  s.wasResampled = false;
+  s.bestQuality = false;
+  setLoadProgress(job, 1.0f, 1.0f);
+  return true;
 }
 
 SampleBuffer::Ptr BackingTrackTriggerProcessor::createSampleFromReader(
     juce::AudioFormatReader &reader, const juce::String &name,
-    const juce::String &path) const {
+    const juce::String &path, JobScheduler::Job *job) const {
   auto s = SampleBuffer::Ptr(new SampleBuffer());
   s->name = name;
   s->fullPath = path;
@@ -399,23 +1362,76 @@ SampleBuffer::Ptr BackingTrackTriggerProcessor::createSampleFromReader(
 
   const int len = static_cast<int>(reader.lengthInSamples);
   s->source.setSize(static_cast<int>(reader.numChannels), len);
-  reader.read(&s->source, 0, len, 0, true, true);
+  for (int pos = 0; pos < len; pos += kLoadChunk) {
+    if (isCancelled(job))
+      return nullptr;
+    const int n = juce::jmin(kLoadChunk, len - pos);
+    reader.read(&s->source, pos, n, pos, true, true);
+    setLoadProgress(job, static_cast<float>(pos + n) / static_cast<float>(len),
+                    0.0f);
+  }
+  s->createDerivedData();
   return s;
 }
 
-void BackingTrackTriggerProcessor::publishSample(SampleBuffer::Ptr newSample) {
-  if (newSample != nullptr)
+SampleBuffer::Ptr
+BackingTrackTriggerProcessor::readSampleFile(const juce::File &file,
+                                             JobScheduler::Job *job,
+                                             ReadFor what) {
+  auto in =
+      std::make_unique<IoScheduler::Stream>(*io, file, getReadDeadline(what));
+  if (!in->openedOk())
+    in = nullptr;
+  auto reader =
+      formats->createReaderFor(std::move(in), file.getFileExtension());
+  if (reader == nullptr) {
+    DBG("Failed to load sample: " + file.getFullPathName());
+    return nullptr;
+  }
+  auto s = createSampleFromReader(*reader, file.getFileName(),
+                                  file.getFullPathName(), job);
+  if (s == nullptr)
+    return nullptr;
+  s->fileSize = file.getSize();
+  s->fileModTimeMs = file.getLastModificationTime().toMilliseconds();
+  s->getContentHash(); // here, not on the host's thread at the next save
+  return s;
+}
+
+void BackingTrackTriggerProcessor::publishSample(SampleBuffer::Ptr newSample,
+                                                 bool keepCueHeads) {
+  const juce::ScopedLock sl(poolLock);
+  CueSet::Ptr cues;
+  if (newSample != nullptr) {
     samplePool.add(newSample);
+    // The same track compressed keeps the heads it had.
+    CueSet::Ptr previous;
+    if (newSample->compressed != nullptr) {
+      SampleBuffer::Ptr old;
+      {
+        const juce::SpinLock::ScopedLockType lock(sampleLock);
+        old = currentSample;
+        previous = currentCues;
+      }
+      if (old == nullptr ||
+          old->getContentHash() != newSample->getContentHash())
+        previous = nullptr;
+    }
+    cues = buildCues(newSample.get(), previous.get());
+    cuePool.add(cues);
+  }
+  stream.setSource(newSample != nullptr ? newSample->compressed : nullptr);
   {
     const juce::SpinLock::ScopedLockType lock(sampleLock);
     currentSample = newSample;
+    if (!keepCueHeads)
+      currentCues = cues;
   }
+  ++sampleGeneration;
   freeUnusedSamples();
-
-  if (onSampleChanged)
-    onSampleChanged();
 }
 
+// Caller holds poolLock.
 void BackingTrackTriggerProcessor::freeUnusedSamples() {
   for (int i = samplePool.size(); --i >= 0;) {
     SampleBuffer::Ptr held(samplePool[i]);
@@ -423,116 +1439,1198 @@ void BackingTrackTriggerProcessor::freeUnusedSamples() {
     if (held->getReferenceCount() == 2)
       samplePool.remove(i);
   }
+  for (int i = cuePool.size(); --i >= 0;) {
+    CueSet::Ptr held(cuePool[i]);
+    if (held->getReferenceCount() == 2)
+      cuePool.remove(i);
+  }
+}
+
+// Caller holds poolLock. Without decoded audio (evicted or compressed), heads
+// are carried over from `previous` where they still apply.
+CueSet::Ptr
+BackingTrackTriggerProcessor::buildCues(const SampleBuffer *sample,
+                                        const CueSet *previous) const {
+  const auto cues = getCues();
+  const double offsetSeconds = startOffsetParam->load() / 1000.0;
+  if (sample != nullptr && sample->compressed != nullptr) {
+    CompressedAudio::Reader reader(*sample->compressed);
+    return new CueSet(cues, offsetSeconds, nullptr,
+                      sample->playbackSampleRate, previous, &reader);
+  }
+  if (sample != nullptr)
+    return new CueSet(cues, offsetSeconds, &sample->audio,
+                      sample->playbackSampleRate);
+  if (previous != nullptr)
+    return new CueSet(cues, offsetSeconds, nullptr, previous->getSampleRate(),
+                      previous);
+  return nullptr;
+}
+
+void BackingTrackTriggerProcessor::rebuildCues() {
+  const juce::ScopedLock sl(poolLock);
+  SampleBuffer::Ptr sample;
+  CueSet::Ptr previous;
+  {
+    const juce::SpinLock::ScopedLockType lock(sampleLock);
+    sample = currentSample;
+    previous = currentCues;
+  }
+  auto cues = buildCues(sample.get(), previous.get());
+  if (cues == nullptr) // nothing loaded, or a load has yet to publish
+    return;
+  cuePool.add(cues);
+  {
+    const juce::SpinLock::ScopedLockType lock(sampleLock);
+    currentCues = cues;
+  }
+  freeUnusedSamples();
+}
+
+//==============================================================================
+std::vector<CueSet::Cue> BackingTrackTriggerProcessor::getCues() const {
+  const juce::ScopedLock sl(cueLock);
+  return cueList;
+}
+
+bool BackingTrackTriggerProcessor::setCue(int note, double offsetSeconds,
+                                          const juce::String &name) {
+  if (note < 0 || note > 127)
+    return false;
+  {
+    const juce::ScopedLock sl(cueLock);
+    auto it = std::find_if(cueList.begin(), cueList.end(),
+                           [note](const auto &c) { return c.note == note; });
+    if (it == cueList.end()) {
+      if (static_cast<int>(cueList.size()) >= CueSet::kMaxCues)
+        return false;
+      it = cueList.insert(cueList.end(), CueSet::Cue{});
+    }
+    it->note = note;
+    it->offsetSeconds = juce::jmax(0.0, offsetSeconds);
+    it->name = name;
+    std::stable_sort(cueList.begin(), cueList.end(),
+                     [](const auto &a, const auto &b) {
+                       return a.offsetSeconds < b.offsetSeconds;
+                     });
+  }
+  ++cueGeneration;
+  rebuildCues();
+  return true;
+}
+
+void BackingTrackTriggerProcessor::removeCue(int note) {
+  {
+    const juce::ScopedLock sl(cueLock);
+    const auto it = std::remove_if(
+        cueList.begin(), cueList.end(),
+        [note](const auto &c) { return c.note == note; });
+    if (it == cueList.end())
+      return;
+    cueList.erase(it, cueList.end());
+  }
+  ++cueGeneration;
+  rebuildCues();
+}
+
+void BackingTrackTriggerProcessor::clearCues() {
+  {
+    const juce::ScopedLock sl(cueLock);
+    if (cueList.empty())
+      return;
+    cueList.clear();
+  }
+  ++cueGeneration;
+  rebuildCues();
+}
+
+void BackingTrackTriggerProcessor::setCueList(std::vector<CueSet::Cue> cues) {
+  {
+    const juce::ScopedLock sl(cueLock);
+    cueList = std::move(cues);
+  }
+  ++cueGeneration;
+}
+
+namespace {
+constexpr double kEditorReadMs = 1000.0; // read deadlines, from now
+constexpr double kBackgroundReadMs = 60000.0;
+
+// Fills in a sample's waveform peaks, from the sidecar cache if this audio has
+// been seen before, otherwise by scanning `source` (and then caching). Audio
+// with no cheap key is scanned every time.
+void scanPeaks(SampleBuffer &sample, JobScheduler::Job &job, IoScheduler &io,
+               const IoScheduler::Deadline &deadline) {
+  auto &peaks = *sample.peaks;
+  if (peaks.isComplete())
+    return;
+
+  const auto key = sample.getPeaksKey();
+  const auto cacheFile = WaveformPeaks::getCacheFile(key);
+  if (key != 0) {
+    IoScheduler::Stream in(io, cacheFile, deadline);
+    if (in.openedOk() && peaks.load(in, key))
+      return;
+  }
+
+  const bool finished = peaks.compute(sample.source, [&] {
+    job.setProgress(static_cast<float>(peaks.getNumReady()) /
+                    static_cast<float>(juce::jmax(1, peaks.getNumPeaks())));
+    return job.isCancelled();
+  });
+  if (finished && key != 0)
+    peaks.saveToFile(cacheFile, key);
+}
+} // namespace
+
+void BackingTrackTriggerProcessor::startBackgroundJobs(
+    const SampleBuffer::Ptr &sample) {
+  if (sample == nullptr)
+    return;
+  // Peaks are on screen, so they go first; the analysis splits its envelope
+  // pass into sub-jobs, so a long track doesn't hold up a worker long.
+  if (sample->peaks != nullptr)
+    jobs.schedule("Waveform peaks", JobScheduler::Priority::normal,
+                  [this, sample](JobScheduler::Job &job) {
+                    scanPeaks(*sample, job, *io,
+                              getReadDeadline(ReadFor::background));
+                  });
+  if (sample->analysis != nullptr)
+    jobs.schedule("Audio analysis", JobScheduler::Priority::normal,
+                  [sample](JobScheduler::Job &job) {
+                    if (!sample->analysis->isReady())
+                      sample->analysis->analyse(sample->source,
+                                                sample->sourceSampleRate,
+                                                job.getStopCheck());
+                  });
+  startEmbedEncode(sample);
+}
+
+void BackingTrackTriggerProcessor::startEmbedEncode(
+    const SampleBuffer::Ptr &sample) {
+  // Encodes for embedding so getStateInformation() finds it ready.
+  const auto settings = getEmbedSettings();
+  if (!embedSample.load() || sample == nullptr ||
+      sample->embedded == nullptr || sample->embedded->hasEncoded(settings))
+    return;
+  if (sample->source.getNumSamples() == 0) { // compressed: decode it first
+    decodeRequest = true;
+    memoryBudget->poke();
+    return;
+  }
+  jobs.schedule("Embed encode", JobScheduler::Priority::background,
+                [sample, settings](JobScheduler::Job &job) {
+                  sample->embedded->getOrEncode(
+                      sample->source, sample->sourceSampleRate,
+                      sample->sourceBitsPerSample, settings,
+                      job.getStopCheck());
+                });
 }
 
 void BackingTrackTriggerProcessor::loadSample(const juce::File &file) {
-  std::unique_ptr<juce::AudioFormatReader> reader(
-      formatManager.createReaderFor(file));
-  if (reader == nullptr) {
-    DBG("Failed to load sample: " + file.getFullPathName());
+  loadTrack(file, 0.0f, {}); // the old offset and cues were for the old track
+}
+
+void BackingTrackTriggerProcessor::loadTrack(const juce::File &file,
+                                             float startOffsetMs,
+                                             std::vector<CueSet::Cue> cues) {
+  const auto generation = beginLoad(true); // cancels any load in flight
+  setParamValue(ids::startOffset, startOffsetMs);
+  setCueList(std::move(cues));
+
+  startLoadJob(generation, "Load " + file.getFileName(),
+               [this, file](JobScheduler::Job &job) {
+                 return readSampleFile(file, &job);
+               });
+}
+
+void BackingTrackTriggerProcessor::clearSample() {
+  beginLoad(false);
+  publishSample(nullptr);
+}
+
+juce::uint32 BackingTrackTriggerProcessor::beginLoad(bool willLoad) {
+  const juce::ScopedLock sl(loadLock);
+  jobs.cancel(loadJob);
+  loadJob = nullptr;
+  loadingFlag = willLoad;
+  restoringHash = 0;
+  evictedSample = nullptr; // whatever was evicted is being replaced
+  evictedFlag = false;
+  return ++loadGeneration;
+}
+
+float BackingTrackTriggerProcessor::getLoadProgress() const {
+  const juce::ScopedLock sl(loadLock);
+  return loadJob != nullptr ? loadJob->getProgress() : 0.0f;
+}
+
+void BackingTrackTriggerProcessor::restoreSampleAsync(
+    EmbeddedAudio::Blob audio, const juce::String &path,
+    const juce::String &name, juce::uint64 hash) {
+  const auto generation = beginLoad(true);
+  {
+    const juce::ScopedLock sl(loadLock);
+    restoringHash = hash;
+  }
+  publishSample(nullptr); // nothing stale plays while the new audio loads
+
+  startLoadJob(generation, "Restore " + name,
+               [this, audio, path, name, hash](JobScheduler::Job &job) {
+                 SampleBuffer::Ptr s;
+                 if (audio != nullptr) {
+                   s = decodeEmbeddedSample(
+                       audio->getData(), audio->getSize(),
+                       name.isNotEmpty() ? name : juce::String("Embedded"),
+                       &job);
+                   if (s != nullptr) {
+                     s->fullPath = path;
+                     // The blob is exactly what the next save would write.
+                     s->embedded->adopt(audio, getEmbedSettings());
+                     // Under the hash it was saved with, so restoring the
+                     // same state again (undo, A/B) matches even when the
+                     // blob is a lossy copy.
+                     if (hash != 0)
+                       s->setContentHash(hash);
+                     else
+                       s->getContentHash();
+                   }
+                 }
+                 if (s == nullptr && path.isNotEmpty() && !job.isCancelled()) {
+                   juce::File file(path);
+                   if (file.existsAsFile())
+                     s = readSampleFile(file, &job);
+                 }
+                 return s;
+               });
+}
+
+void BackingTrackTriggerProcessor::startLoadJob(
+    juce::uint32 generation, const juce::String &name,
+    std::function<SampleBuffer::Ptr(JobScheduler::Job &)> load) {
+  const juce::ScopedLock sl(loadLock);
+  if (generation != loadGeneration)
+    return;
+
+  loadJob = jobs.schedule(
+      name, JobScheduler::Priority::interactive,
+      [this, generation, load](JobScheduler::Job &job) {
+        auto s = load(job);
+        if (s != nullptr && !prepareForRate(*s, currentSampleRate.load(), &job,
+                                            offlineFlag.load()))
+          s = nullptr;
+        // Even a cancelled load reports back, so the loading flag clears if
+        // nothing newer took over.
+        finishLoad(generation, job.isCancelled() ? nullptr : s);
+      });
+}
+
+void BackingTrackTriggerProcessor::finishLoad(juce::uint32 generation,
+                                              SampleBuffer::Ptr sample) {
+  const juce::ScopedLock sl(loadLock);
+  if (generation != loadGeneration)
+    return; // a newer load or restore has started since
+  if (setlistSwapped.load()) {
+    // The audio thread has stepped to the preloaded track, which replaces
+    // whatever this was loading. Nothing is loading any more; the message
+    // thread settles the rest of the step.
+    loadJob = nullptr;
+    loadingFlag = false;
+    loadFinished.signal();
     return;
   }
 
-  auto s = createSampleFromReader(*reader, file.getFileName(),
-                                  file.getFullPathName());
-  prepareForRate(*s, currentSampleRate.load());
+  if (sample != nullptr) {
+    // The host may have changed rate while we were decoding.
+    const double rate = currentSampleRate.load();
+    if (std::abs(sample->playbackSampleRate - rate) > 0.5)
+      prepareForRate(*sample, rate, nullptr, offlineFlag.load());
+    publishSample(sample);
+    startBackgroundJobs(sample);
+    evictedSample = nullptr;
+    evictedFlag = false;
+    // Starts the budget's thread on the first load, and locks the new audio
+    // (if enabled) without waiting for a tick.
+    memoryBudget->poke();
+  } else if (evictedSample != nullptr || isCompressed()) {
+    lastRehydrateFailMs = juce::Time::getMillisecondCounterHiRes();
+  }
+  loadJob = nullptr;
+  loadingFlag = false;
+  loadFinished.signal();
+}
 
-  setParamValue(ids::startOffset, 0.0f);
-  publishSample(s);
+//==============================================================================
+namespace {
+constexpr double kMinIdleMs = 2000.0;      // before a sample may be evicted
+constexpr double kRehydrateRetryMs = 5000.0;
+constexpr double kRehydrateLookaheadSeconds = 20.0;
+
+// Rehydrating from the file is only exact if it hasn't changed since.
+bool canReloadFromFile(const SampleBuffer &s) {
+  if (s.fullPath.isEmpty())
+    return false;
+  const juce::File file(s.fullPath);
+  return file.existsAsFile() && file.getSize() == s.fileSize &&
+         file.getLastModificationTime().toMilliseconds() == s.fileModTimeMs;
 }
 
-void BackingTrackTriggerProcessor::clearSample() { publishSample(nullptr); }
+// A FLAC copy of the sample already in memory, if there is one.
+EmbeddedAudio::Blob getLosslessCopy(const SampleBuffer &s) {
+  EmbeddedAudio::Settings used;
+  if (s.embedded != nullptr)
+    if (auto blob = s.embedded->getEncoded(&used))
+      if (used.codec == EmbeddedAudio::Codec::flac)
+        return blob;
+  return s.lossless != nullptr ? s.lossless->getEncoded() : nullptr;
+}
+
+// The playback audio as FLAC. Unresampled, that is a FLAC copy of the source,
+// so one already in memory (or the FLAC file itself) serves as it is;
+// otherwise it is encoded, at 24 bits after resampling.
+CompressedAudio::Ptr compressAudio(const SampleBuffer &s,
+                                   JobScheduler::Job &job, IoScheduler &io,
+                                   const IoScheduler::Deadline &deadline) {
+  const int channels = s.audio.getNumChannels();
+  const int frames = s.audio.getNumSamples();
+  const double rate = s.playbackSampleRate;
+  if (!s.wasResampled) {
+    if (auto c = CompressedAudio::fromFlac(getLosslessCopy(s), channels,
+                                           frames, rate))
+      return c;
+    const juce::File file(s.fullPath);
+    if (canReloadFromFile(s) && file.hasFileExtension("flac")) {
+      IoScheduler::Stream in(io, file, deadline);
+      juce::MemoryBlock data;
+      if (in.openedOk() && static_cast<juce::int64>(in.readIntoMemoryBlock(
+                               data)) == in.getTotalLength())
+        if (auto c = CompressedAudio::fromFlac(
+                std::make_shared<const juce::MemoryBlock>(std::move(data)),
+                channels, frames, rate))
+          return c;
+    }
+  }
+  const int bits =
+      s.wasResampled ? 24 : juce::jlimit(16, 24, s.sourceBitsPerSample);
+  return CompressedAudio::encode(s.audio, rate, bits, job.getStopCheck());
+}
+} // namespace
+
+juce::int64 BackingTrackTriggerProcessor::getResidentBytes() const {
+  // The pool also holds buffers the audio thread or a job still has.
+  const juce::ScopedLock sl(poolLock);
+  juce::int64 bytes = 0;
+  for (auto *s : samplePool)
+    bytes += s->getAudioBytes();
+  for (auto *c : cuePool)
+    bytes += c->getHeadBytes();
+  return bytes + stream.getBytes();
+}
+
+bool BackingTrackTriggerProcessor::isNeededSoon() const {
+  if (!hostPlayingFlag.load())
+    return false;
+  const auto trigger = lastTriggerHostPosition.load();
+  if (trigger < 0)
+    return true; // no idea where the note is, so it could come any moment
+  const auto position = hostPositionSamples.load();
+  const auto lookahead = static_cast<int64_t>(kRehydrateLookaheadSeconds *
+                                              currentSampleRate.load());
+  return position >= trigger - lookahead && position <= trigger;
+}
+
+double BackingTrackTriggerProcessor::getReadDeadlineMs(ReadFor what) const {
+  const double now = juce::Time::getMillisecondCounterHiRes();
+  if (what == ReadFor::background)
+    return now + (editorOpen.load() ? kEditorReadMs : kBackgroundReadMs);
+  if (what == ReadFor::preload) { // wanted when the track playing now runs out
+    if (setlistAdvanceRequest.load())
+      return now;
+    const auto sample = getSample();
+    if (!playingFlag.load() || sample == nullptr)
+      return now + kBackgroundReadMs;
+    const auto left = static_cast<double>(sample->getNumFrames() -
+                                          getPlayheadSnapshot().position);
+    return now + juce::jlimit(0.0, kBackgroundReadMs,
+                              left / sample->playbackSampleRate * 1000.0);
+  }
+
+  // A note waiting to join late, a voice playing from its cue heads or a
+  // bounce waiting to start: the audio is already late.
+  if (waitingForAudio.load() || playingFlag.load() || offlineFlag.load())
+    return now;
+  double deadline = now + kBackgroundReadMs;
+  if (editorOpen.load())
+    deadline = now + kEditorReadMs;
+  if (hostPlayingFlag.load()) { // by the time the score reaches the note
+    const auto trigger = lastTriggerHostPosition.load();
+    const auto position = hostPositionSamples.load();
+    if (trigger < 0)
+      return now; // it could come any moment
+    if (trigger >= position)
+      deadline = juce::jmin(
+          deadline, now + static_cast<double>(trigger - position) /
+                              currentSampleRate.load() * 1000.0);
+  }
+  return deadline;
+}
+
+bool BackingTrackTriggerProcessor::canEvict() const {
+  // No jobs either: they hold the buffers, and evict() may have started one
+  // to prepare.
+  return getSample() != nullptr && !loadingFlag.load() && !playingFlag.load() &&
+         !editorOpen.load() && !offlineFlag.load() && !isNeededSoon() &&
+         jobs.getNumActive() == 0 &&
+         juce::Time::getMillisecondCounterHiRes() - lastActiveMs.load() >=
+             kMinIdleMs;
+}
+
+juce::int64 BackingTrackTriggerProcessor::evict() {
+  const juce::ScopedLock sl(loadLock);
+  auto cur = getSample();
+  if (cur == nullptr || loadingFlag.load() || playingFlag.load())
+    return 0;
+  cur->getContentHash(); // the shell below keeps the identity
+
+  // Saving while evicted writes the embedded blob, so it must exist; and
+  // there has to be an exact way back. Make what's missing first.
+  const auto settings = getEmbedSettings();
+  const bool needsEmbed =
+      embedSample.load() && !cur->embedded->hasEncoded(settings);
+  const bool needsCopy =
+      !canReloadFromFile(*cur) && getLosslessCopy(*cur) == nullptr;
+  if ((needsEmbed || needsCopy) && cur->compressed != nullptr)
+    return 0; // nothing to encode them from; it stays compressed
+  if (needsEmbed || needsCopy) {
+    EmbeddedAudio::Settings copySettings;
+    copySettings.compressionLevel = 1; // fast; it only lives in memory
+    jobs.schedule("Prepare eviction", JobScheduler::Priority::background,
+                  [cur, settings, needsEmbed, needsCopy,
+                   copySettings](JobScheduler::Job &job) {
+                    if (needsEmbed)
+                      cur->embedded->getOrEncode(
+                          cur->source, cur->sourceSampleRate,
+                          cur->sourceBitsPerSample, settings,
+                          job.getStopCheck());
+                    if (needsCopy && !job.isCancelled())
+                      cur->lossless->getOrEncode(
+                          cur->source, cur->sourceSampleRate,
+                          cur->sourceBitsPerSample, copySettings,
+                          job.getStopCheck());
+                  });
+    return 0;
+  }
+
+  auto shell = SampleBuffer::Ptr(new SampleBuffer());
+  shell->copyMetadataFrom(*cur);
+  const auto bytes = cur->getAudioBytes();
+  cur = nullptr;
+
+  evictedSample = shell;
+  evictedFlag = true;
+  pageLock.release();
+  publishSample(nullptr, true);
+  return bytes;
+}
+
+void BackingTrackTriggerProcessor::updateResidency() {
+  const double now = juce::Time::getMillisecondCounterHiRes();
+  const bool neededSoon = isNeededSoon();
+  if (playingFlag.load() || editorOpen.load() || loadingFlag.load() ||
+      neededSoon)
+    lastActiveMs = now;
+
+  // A step the audio thread has taken, or asked for, is settled on the
+  // message thread. The audio thread can't post messages itself.
+  if (setlistSwapped.load() || setlistAdvanceRequest.load())
+    triggerAsyncUpdate();
+  updatePageLock();
+  {
+    // Buffers the audio thread or a job let go of since the last publish.
+    const juce::ScopedLock sl(poolLock);
+    freeUnusedSamples();
+  }
+
+  // The start offset's head follows the parameter.
+  CueSet::Ptr cues;
+  {
+    const juce::SpinLock::ScopedLockType lock(sampleLock);
+    cues = currentCues;
+  }
+  if (cues != nullptr && cues->getStartEntry().offsetSeconds !=
+                             startOffsetParam->load() / 1000.0)
+    rebuildCues();
+
+  const bool requested = rehydrateRequest.exchange(false);
+  if (evictedFlag.load() && !loadingFlag.load() &&
+      (requested || ((editorOpen.load() || neededSoon) &&
+                     now - lastRehydrateFailMs.load() >= kRehydrateRetryMs)))
+    rehydrate();
+  updateStorage();
+}
+
+void BackingTrackTriggerProcessor::updatePageLock() {
+  auto sample = getSample();
+  if (sample == nullptr || sample->audio.getNumSamples() == 0 ||
+      !memoryBudget->isPlaybackLockEnabled()) {
+    pageLock.release();
+    return;
+  }
+  // The window follows the voice while it plays, else waits at the offset.
+  const auto offset = currentOffsetSamples(sample->playbackSampleRate,
+                                           sample->audio.getNumSamples());
+  const auto position =
+      playingFlag.load() ? getPlayheadSnapshot().position : offset;
+  const bool looping = loopParam->load() > 0.5f;
+  pageLock.update(sample->audio, sample.get(), position,
+                  looping ? offset : -1, memoryBudget->getLockWindowBytes());
+}
+
+void BackingTrackTriggerProcessor::requestResident() {
+  // Compressed audio is decoded by updateStorage() whenever it is wanted.
+  if (evictedFlag.load())
+    rehydrateRequest = true;
+  else if (!isCompressed())
+    return;
+  memoryBudget->poke();
+}
+
+void BackingTrackTriggerProcessor::rehydrate() {
+  // One lock throughout, so a load from the message thread can't slip in
+  // between and be cancelled by this one.
+  const juce::ScopedLock sl(loadLock);
+  auto shell = evictedSample;
+  if (shell == nullptr || loadingFlag.load())
+    return;
+
+  const auto generation = beginLoad(true);
+  evictedSample = shell;
+  evictedFlag = true;
+  restoringHash = shell->getContentHash();
+
+  startLoadJob(generation, "Reload " + shell->name,
+               [this, shell](JobScheduler::Job &job) {
+                 return reloadEvicted(*shell, job);
+               });
+}
+
+void BackingTrackTriggerProcessor::updateStorage() {
+  // Compressed storage applies to idle tracks; offline renders decode.
+  const bool compact =
+      memoryBudget->isCompressedStorageEnabled() && !offlineFlag.load();
+  const juce::ScopedLock sl(loadLock);
+  auto cur = getSample();
+  if (compressedFrom != nullptr && (compressedFrom != cur || !compact)) {
+    compressedFrom = nullptr; // made for a track that has moved on
+    compressedSample = nullptr;
+  }
+  if (cur == nullptr || loadingFlag.load())
+    return;
+
+  if (cur->compressed != nullptr) {
+    if ((!compact || decodeRequest.load()) &&
+        juce::Time::getMillisecondCounterHiRes() - lastRehydrateFailMs.load() >=
+            kRehydrateRetryMs) {
+      decodeRequest = false;
+      decompress(cur);
+    }
+    return;
+  }
+  decodeRequest = false;
+  if (!compact || playingFlag.load())
+    return;
+
+  if (compressedSample != nullptr) {
+    auto compressed = compressedSample;
+    compressedFrom = nullptr;
+    compressedSample = nullptr;
+    cur = nullptr;
+    pageLock.release(); // it holds the decoded audio
+    publishSample(compressed);
+  } else if (jobs.getNumActive() == 0) {
+    compress(cur);
+  }
+}
+
+// Caller holds loadLock.
+void BackingTrackTriggerProcessor::compress(const SampleBuffer::Ptr &cur) {
+  cur->getContentHash(); // the compressed copy keeps the identity
+
+  // As for eviction: saving writes the embedded blob, and there has to be an
+  // exact way back to the source. Make what's missing first.
+  const auto settings = getEmbedSettings();
+  const bool needsEmbed =
+      embedSample.load() && !cur->embedded->hasEncoded(settings);
+  const bool needsCopy = cur->wasResampled && !canReloadFromFile(*cur) &&
+                         getLosslessCopy(*cur) == nullptr;
+  jobs.schedule(
+      "Compress " + cur->name, JobScheduler::Priority::background,
+      [this, cur, settings, needsEmbed, needsCopy](JobScheduler::Job &job) {
+        if (needsEmbed)
+          cur->embedded->getOrEncode(cur->source, cur->sourceSampleRate,
+                                     cur->sourceBitsPerSample, settings,
+                                     job.getStopCheck());
+        if (needsCopy && !job.isCancelled()) {
+          EmbeddedAudio::Settings copySettings;
+          copySettings.compressionLevel = 1; // fast; it only lives in memory
+          cur->lossless->getOrEncode(cur->source, cur->sourceSampleRate,
+                                     cur->sourceBitsPerSample, copySettings,
+                                     job.getStopCheck());
+        }
+        auto compressed =
+            job.isCancelled()
+                ? nullptr
+                : compressAudio(*cur, job, *io,
+                                getReadDeadline(ReadFor::background));
+        if (compressed == nullptr)
+          return;
+
+        auto s = SampleBuffer::Ptr(new SampleBuffer());
+        s->copyMetadataFrom(*cur);
+        s->playbackSampleRate = cur->playbackSampleRate;
+        s->wasResampled = cur->wasResampled;
+        s->bestQuality = cur->bestQuality;
+        s->compressed = compressed;
+        // Swapped in by updateStorage() once the track is idle.
+        const juce::ScopedLock sl(loadLock);
+        if (getSample() == cur) {
+          compressedFrom = cur;
+          compressedSample = s;
+          memoryBudget->poke();
+        }
+      });
+}
+
+// Caller holds loadLock. The compressed track plays on meanwhile.
+void BackingTrackTriggerProcessor::decompress(const SampleBuffer::Ptr &cur) {
+  const auto generation = beginLoad(true);
+  restoringHash = cur->getContentHash();
+  startLoadJob(generation, "Decode " + cur->name,
+               [this, cur](JobScheduler::Job &job) {
+                 return reloadEvicted(*cur, job);
+               });
+}
+
+SampleBuffer::Ptr
+BackingTrackTriggerProcessor::reloadEvicted(const SampleBuffer &shell,
+                                            JobScheduler::Job &job) {
+  SampleBuffer::Ptr s;
+  if (canReloadFromFile(shell)) {
+    s = readSampleFile(juce::File(shell.fullPath), &job);
+    if (s != nullptr && s->getContentHash() != shell.getContentHash())
+      s = nullptr;
+  }
+  if (s == nullptr && !job.isCancelled())
+    if (auto blob = getLosslessCopy(shell))
+      s = decodeEmbeddedSample(blob->getData(), blob->getSize(), shell.name,
+                               &job);
+  // Compressed at the source rate, it is a FLAC copy of the source too.
+  if (s == nullptr && !job.isCancelled() && shell.compressed != nullptr &&
+      std::abs(shell.compressed->getSampleRate() - shell.sourceSampleRate) <
+          0.5) {
+    const auto &blob = shell.compressed->getBlob();
+    s = decodeEmbeddedSample(blob->getData(), blob->getSize(), shell.name,
+                             &job);
+  }
+  if (s == nullptr)
+    return nullptr;
+
+  // Same audio as before: keep its identity, peaks, analysis and encodings.
+  s->copyMetadataFrom(shell);
+  return s;
+}
+
+SampleBuffer::Ptr BackingTrackTriggerProcessor::getSampleOrEvicted() const {
+  if (auto s = getSample())
+    return s;
+  const juce::ScopedLock sl(loadLock);
+  return evictedSample;
+}
+
+//==============================================================================
+void BackingTrackTriggerProcessor::setSetlist(
+    const juce::Array<juce::File> &files) {
+  updateSetlist(); // settle a step the audio thread has just taken
+  {
+    const juce::ScopedLock sl(setlistLock);
+    setlist.clear();
+    for (const auto &file : files)
+      setlist.push_back({file, 0.0f, {}});
+    setlistIndex = -1;
+  }
+  setlistAdvanceRequest = false;
+  if (files.isEmpty())
+    updateSetlist();
+  else
+    selectSetlistEntry(0);
+}
+
+juce::Array<juce::File> BackingTrackTriggerProcessor::getSetlist() const {
+  const juce::ScopedLock sl(setlistLock);
+  juce::Array<juce::File> files;
+  for (const auto &entry : setlist)
+    files.add(entry.file);
+  return files;
+}
+
+int BackingTrackTriggerProcessor::getSetlistPosition() const {
+  const juce::ScopedLock sl(setlistLock);
+  // Already playing the preloaded track, before updateSetlist() catches up.
+  return setlistSwapped.load() ? preloadIndex : setlistIndex;
+}
+
+void BackingTrackTriggerProcessor::selectSetlistEntry(int index) {
+  updateSetlist();
+  SetlistEntry entry;
+  SampleBuffer::Ptr ready;
+  {
+    const juce::ScopedLock sl(setlistLock);
+    if (index < 0 || index >= static_cast<int>(setlist.size()))
+      return;
+    storeSetlistEntry();
+    setlistIndex = index;
+    entry = setlist[static_cast<size_t>(index)];
+    if (index == preloadIndex) {
+      const juce::SpinLock::ScopedLockType lock(sampleLock);
+      ready = nextSample;
+    }
+  }
+  setlistAdvanceRequest = false;
+
+  if (ready != nullptr) {
+    // Already preloaded: publish it like a finished load.
+    const auto generation = beginLoad(true);
+    setParamValue(ids::startOffset, entry.startOffsetMs);
+    setCueList(std::move(entry.cues));
+    finishLoad(generation, ready);
+  } else {
+    loadTrack(entry.file, entry.startOffsetMs, std::move(entry.cues));
+  }
+  updateSetlist();
+}
+
+// Caller holds setlistLock.
+void BackingTrackTriggerProcessor::storeSetlistEntry() {
+  if (setlistIndex < 0 || setlistIndex >= static_cast<int>(setlist.size()))
+    return;
+  auto &entry = setlist[static_cast<size_t>(setlistIndex)];
+  entry.startOffsetMs = startOffsetParam->load();
+  entry.cues = getCues();
+}
+
+void BackingTrackTriggerProcessor::setSetlistNextNote(int note) {
+  setlistNextNote = juce::jlimit(-1, 127, note);
+}
+
+void BackingTrackTriggerProcessor::setSetlistAutoAdvance(bool shouldAdvance) {
+  setlistAutoAdvance = shouldAdvance;
+}
+
+bool BackingTrackTriggerProcessor::swapInNextTrack(SampleBuffer::Ptr &data,
+                                                   CueSet::Ptr &cues) {
+  {
+    const juce::SpinLock::ScopedTryLockType lock(sampleLock);
+    if (!lock.isLocked() || nextSample == nullptr ||
+        std::abs(nextSample->playbackSampleRate - currentSampleRate.load()) >
+            0.5)
+      return false;
+    // Only pointers change hands: the pools keep both tracks alive, and
+    // freeUnusedSamples() reclaims the old one on another thread.
+    setlistSwapped = true;
+    currentSample = nextSample;
+    currentCues = nextCues;
+    nextSample = nullptr;
+    nextCues = nullptr;
+    data = currentSample;
+    cues = currentCues;
+  }
+  nextTrackReady = false;
+  setlistAdvanceRequest = false;
+  ++sampleGeneration;
+  lateJoinPending = false;
+  headRanOut = false;
+  return true;
+}
+
+void BackingTrackTriggerProcessor::updateSetlist() {
+  if (!juce::MessageManager::existsAndIsCurrentThread()) {
+    triggerAsyncUpdate();
+    return;
+  }
+
+  if (setlistSwapped.load()) {
+    // The audio thread has stepped to the preloaded track. Whatever was
+    // loading or evicted for the old one no longer matters. The old track
+    // keeps its start offset and cues, and the new one gets its own back.
+    beginLoad(false);
+    loadFinished.signal();
+    SetlistEntry entry;
+    {
+      const juce::ScopedLock sl(setlistLock);
+      storeSetlistEntry();
+      setlistIndex = preloadIndex;
+      preloadIndex = -1;
+      preloadJob = nullptr;
+      if (setlistIndex >= 0 && setlistIndex < static_cast<int>(setlist.size()))
+        entry = setlist[static_cast<size_t>(setlistIndex)];
+    }
+    setlistSwapped = false;
+    setParamValue(ids::startOffset, entry.startOffsetMs);
+    setCueList(std::move(entry.cues));
+    rebuildCues();
+  }
+
+  int loadNow = -1;
+  {
+    const juce::ScopedLock sl(setlistLock);
+    const int next =
+        setlistIndex >= 0 && setlistIndex + 1 < static_cast<int>(setlist.size())
+            ? setlistIndex + 1
+            : -1;
+
+    // A preload of another entry, or for another host rate, is no use.
+    SampleBuffer::Ptr ready;
+    {
+      const juce::SpinLock::ScopedLockType lock(sampleLock);
+      ready = nextSample;
+    }
+    if (preloadIndex != next ||
+        (ready != nullptr && std::abs(ready->playbackSampleRate -
+                                      currentSampleRate.load()) > 0.5)) {
+      jobs.cancel(preloadJob);
+      preloadJob = nullptr;
+      preloadIndex = -1;
+      dropNextTrack();
+    }
+
+    if (next >= 0 && preloadIndex != next) {
+      preloadIndex = next;
+      const auto file = setlist[static_cast<size_t>(next)].file;
+      preloadJob = jobs.schedule(
+          "Preload " + file.getFileName(), JobScheduler::Priority::background,
+          [this, file, next](JobScheduler::Job &job) {
+            auto s = readSampleFile(file, &job, ReadFor::preload);
+            if (s != nullptr &&
+                !prepareForRate(*s, currentSampleRate.load(), &job,
+                                offlineFlag.load()))
+              s = nullptr;
+            finishPreload(next, job.isCancelled() ? nullptr : s);
+          });
+    }
+
+    // A step with nothing preloaded to take (the file couldn't be read, or
+    // this is the last track) falls back to an ordinary load.
+    if (setlistAdvanceRequest.load() && !nextTrackReady.load() &&
+        (preloadJob == nullptr || preloadJob->isFinished())) {
+      setlistAdvanceRequest = false;
+      loadNow = next;
+    }
+  }
+  if (loadNow >= 0)
+    selectSetlistEntry(loadNow);
+}
+
+void BackingTrackTriggerProcessor::handleAsyncUpdate() { updateSetlist(); }
+
+void BackingTrackTriggerProcessor::finishPreload(int index,
+                                                 SampleBuffer::Ptr sample) {
+  if (sample == nullptr) {
+    // A step waiting on it falls back to an ordinary load.
+    if (setlistAdvanceRequest.load())
+      triggerAsyncUpdate();
+    return;
+  }
+  // The host may have changed rate while we were decoding.
+  const double rate = currentSampleRate.load();
+  if (std::abs(sample->playbackSampleRate - rate) > 0.5)
+    prepareForRate(*sample, rate, nullptr, offlineFlag.load());
+  // The track's own offset and cues, so it plays right from the swap on.
+  SetlistEntry entry;
+  {
+    const juce::ScopedLock sl(setlistLock);
+    if (index >= 0 && index < static_cast<int>(setlist.size()))
+      entry = setlist[static_cast<size_t>(index)];
+  }
+  CueSet::Ptr cues(new CueSet(entry.cues, entry.startOffsetMs / 1000.0,
+                              &sample->audio, rate));
+
+  const juce::ScopedLock sl(setlistLock);
+  if (index != preloadIndex)
+    return; // the setlist has moved on
+  {
+    const juce::ScopedLock pl(poolLock);
+    samplePool.add(sample);
+    cuePool.add(cues);
+    const juce::SpinLock::ScopedLockType lock(sampleLock);
+    nextSample = sample;
+    nextCues = cues;
+  }
+  nextTrackReady = true;
+  startBackgroundJobs(sample);
+}
+
+// Caller holds setlistLock. The pools free what is dropped here.
+void BackingTrackTriggerProcessor::dropNextTrack() {
+  {
+    const juce::SpinLock::ScopedLockType lock(sampleLock);
+    nextSample = nullptr;
+    nextCues = nullptr;
+  }
+  nextTrackReady = false;
+}
 
 //==============================================================================
-juce::MemoryBlock
-BackingTrackTriggerProcessor::encodeSampleToFlac(const SampleBuffer &s) const {
-  juce::MemoryBlock block;
-  if (s.source.getNumSamples() == 0)
-    return block;
-
-  juce::FlacAudioFormat flac;
-  auto stream = std::make_unique<juce::MemoryOutputStream>(block, false);
-  const int bits = juce::jlimit(16, 24, s.sourceBitsPerSample);
-
-  std::unique_ptr<juce::AudioFormatWriter> writer(flac.createWriterFor(
-      stream.get(), s.sourceSampleRate,
-      static_cast<unsigned int>(s.source.getNumChannels()), bits, {}, 5));
-
-  if (writer != nullptr) {
-    stream.release(); // writer now owns the stream
-    writer->writeFromAudioSampleBuffer(s.source, 0, s.source.getNumSamples());
-  }
-  return block;
-}
-
-SampleBuffer::Ptr BackingTrackTriggerProcessor::decodeSampleFromFlac(
-    const void *data, size_t size, const juce::String &name) const {
-  juce::FlacAudioFormat flac;
-  auto stream = std::make_unique<juce::MemoryInputStream>(data, size, false);
-  std::unique_ptr<juce::AudioFormatReader> reader(
-      flac.createReaderFor(stream.release(), true));
-  if (reader == nullptr)
+SampleBuffer::Ptr BackingTrackTriggerProcessor::decodeEmbeddedSample(
+    const void *data, size_t size, const juce::String &name,
+    JobScheduler::Job *job) const {
+  auto s = SampleBuffer::Ptr(new SampleBuffer());
+  if (!EmbeddedAudio::decode(
+          data, size, s->source, s->sourceSampleRate, s->sourceBitsPerSample,
+          [job] { return isCancelled(job); },
+          [job](float fraction) { setLoadProgress(job, fraction, 0.0f); }))
     return nullptr;
 
-  return createSampleFromReader(*reader, name, {});
+  s->name = name;
+  s->sourceNumChannels = s->source.getNumChannels();
+  s->createDerivedData();
+  return s;
+}
+
+void BackingTrackTriggerProcessor::setEmbedEnabled(bool shouldEmbed) {
+  embedSample = shouldEmbed;
+  startEmbedEncode(getSample());
+  requestResident(); // an evicted sample can't be encoded
+}
+
+EmbeddedAudio::Settings BackingTrackTriggerProcessor::getEmbedSettings() const {
+  EmbeddedAudio::Settings settings;
+  settings.compressionLevel = embedCompression.load();
+  settings.numThreads = embedThreads.load();
+  settings.codec = embedCodec.load();
+  settings.vorbisQuality = embedQuality.load();
+  return settings;
+}
+
+void BackingTrackTriggerProcessor::setEmbedSettings(
+    const EmbeddedAudio::Settings &settings) {
+  embedCompression = juce::jlimit(0, 8, settings.compressionLevel);
+  embedThreads = juce::jmax(0, settings.numThreads);
+  embedCodec = settings.codec;
+  embedQuality = juce::jlimit(0, 10, settings.vorbisQuality);
+  startEmbedEncode(getSample());
+  requestResident();
 }
 
 //==============================================================================
+namespace {
+juce::ValueTree cuesToTree(const std::vector<CueSet::Cue> &cues) {
+  juce::ValueTree tree("Cues");
+  for (const auto &cue : cues) {
+    juce::ValueTree child("Cue");
+    child.setProperty("note", cue.note, nullptr);
+    child.setProperty("offset", cue.offsetSeconds, nullptr); // seconds
+    child.setProperty("name", cue.name, nullptr);
+    tree.appendChild(child, nullptr);
+  }
+  return tree;
+}
+
+std::vector<CueSet::Cue> cuesFromTree(const juce::ValueTree &tree) {
+  std::vector<CueSet::Cue> cues;
+  for (const auto &child : tree)
+    if (child.hasType("Cue") &&
+        static_cast<int>(cues.size()) < CueSet::kMaxCues)
+      cues.push_back({juce::jlimit(0, 127, static_cast<int>(
+                                               child.getProperty("note", 60))),
+                      juce::jmax(0.0, static_cast<double>(
+                                          child.getProperty("offset", 0.0))),
+                      child.getProperty("name", "").toString()});
+  return cues;
+}
+} // namespace
+
 void BackingTrackTriggerProcessor::getStateInformation(
     juce::MemoryBlock &destData) {
+  updateSetlist(); // so the saved position matches the track playing
   auto state = apvts.copyState();
   const bool embed = embedSample.load();
   state.setProperty("embedSample", embed, nullptr);
+  state.setProperty("embedCompression", embedCompression.load(), nullptr);
+  state.setProperty("embedThreads", embedThreads.load(), nullptr);
+  // Informational: decoding recognises the codec from the data itself.
+  state.setProperty("embedCodec",
+                    embedCodec.load() == EmbeddedAudio::Codec::oggVorbis
+                        ? "vorbis"
+                        : "flac",
+                    nullptr);
+  state.setProperty("embedQuality", embedQuality.load(), nullptr);
+
+  state.appendChild(cuesToTree(getCues()), nullptr);
+
+  juce::ValueTree setlistTree("Setlist");
+  {
+    const juce::ScopedLock sl(setlistLock);
+    storeSetlistEntry(); // the current track's offset and cues are live
+    setlistTree.setProperty("position", setlistIndex, nullptr);
+    for (const auto &entry : setlist) {
+      juce::ValueTree child("Track");
+      child.setProperty("path", entry.file.getFullPathName(), nullptr);
+      child.setProperty("startOffset",
+                        static_cast<double>(entry.startOffsetMs), nullptr);
+      if (!entry.cues.empty())
+        child.appendChild(cuesToTree(entry.cues), nullptr);
+      setlistTree.appendChild(child, nullptr);
+    }
+  }
+  setlistTree.setProperty("nextNote", setlistNextNote.load(), nullptr);
+  setlistTree.setProperty("autoAdvance", setlistAutoAdvance.load(), nullptr);
+  state.appendChild(setlistTree, nullptr);
 
-  if (auto cur = getSample()) {
+  EmbeddedAudio::Blob audio;
+  if (auto cur = getSampleOrEvicted()) {
     state.setProperty("samplePath", cur->fullPath, nullptr);
     state.setProperty("sampleName", cur->name, nullptr);
+    // Identify the audio so restoring this state over itself (undo, A/B,
+    // session reload) can skip the reload; see isSampleCurrent().
+    state.setProperty("sampleHash",
+                      static_cast<juce::int64>(cur->getContentHash()), nullptr);
+    if (cur->fullPath.isNotEmpty()) {
+      state.setProperty("sampleFileSize", cur->fileSize, nullptr);
+      state.setProperty("sampleFileTime", cur->fileModTimeMs, nullptr);
+    }
 
-    if (embed) {
-      auto flac = encodeSampleToFlac(*cur);
-      if (flac.getSize() > 0)
-        state.setProperty("sampleFlac", juce::var(flac), nullptr);
+    // Normally already encoded by the background job; if that job is still
+    // running this waits for it rather than encoding a second time. Evicted
+    // audio writes whichever encoding it kept.
+    if (embed && cur->embedded != nullptr) {
+      if (cur->source.getNumSamples() > 0)
+        audio = cur->embedded->getOrEncode(cur->source, cur->sourceSampleRate,
+                                           cur->sourceBitsPerSample,
+                                           getEmbedSettings(), nullptr);
+      else
+        audio = cur->embedded->getEncoded();
+      if (audio == nullptr)
+        audio = getLosslessCopy(*cur);
     }
   }
 
-  juce::MemoryOutputStream stream(destData, false);
-  state.writeToStream(stream);
+  StateFormat::write(state, audio.get(), destData);
 }
 
 void BackingTrackTriggerProcessor::setStateInformation(const void *data,
                                                        int sizeInBytes) {
-  auto tree =
-      juce::ValueTree::readFromData(data, static_cast<size_t>(sizeInBytes));
-  if (!tree.isValid())
+  StateFormat::Contents contents;
+  if (!StateFormat::read(data, static_cast<size_t>(sizeInBytes), contents))
     return;
 
+  auto &tree = contents.header;
   embedSample = static_cast<bool>(tree.getProperty("embedSample", false));
+  const EmbeddedAudio::Settings defaults;
+  embedCompression = juce::jlimit(
+      0, 8, static_cast<int>(tree.getProperty("embedCompression",
+                                              defaults.compressionLevel)));
+  embedThreads = juce::jmax(
+      0, static_cast<int>(tree.getProperty("embedThreads", defaults.numThreads)));
+  embedCodec = tree.getProperty("embedCodec", "flac").toString() == "vorbis"
+                   ? EmbeddedAudio::Codec::oggVorbis
+                   : EmbeddedAudio::Codec::flac;
+  embedQuality = juce::jlimit(
+      0, 10, static_cast<int>(tree.getProperty("embedQuality",
+                                               defaults.vorbisQuality)));
   const juce::String path = tree.getProperty("samplePath", "").toString();
   const juce::String name = tree.getProperty("sampleName", "").toString();
 
-  // Restore the sample first. loadSample() resets the start-offset parameter,
-  // so we must apply the saved parameter values (replaceState) *afterwards*.
-  bool restored = false;
-  if (tree.hasProperty("sampleFlac")) {
-    if (auto *mb = tree.getProperty("sampleFlac").getBinaryData()) {
-      auto displayName = name.isNotEmpty() ? name : juce::String("Embedded");
-      if (auto s = decodeSampleFromFlac(mb->getData(), mb->getSize(),
-                                        displayName)) {
-        s->fullPath = path;
-        prepareForRate(*s, currentSampleRate.load());
-        publishSample(s);
-        restored = true;
-      }
-    }
+  // The audio chunk lives in the host's buffer, which is only valid during
+  // this call; this copy is also what the embed cache keeps.
+  EmbeddedAudio::Blob audio;
+  if (contents.audio != nullptr)
+    audio = std::make_shared<const juce::MemoryBlock>(contents.audio,
+                                                      contents.audioSize);
+
+  // A 2.0.x state carries the audio as a property; don't keep it in the
+  // parameter tree. Nor the cues, which live in cueList.
+  tree.removeProperty("sampleFlac", nullptr);
+  const auto cueTree = tree.getChildWithName("Cues");
+  auto cues = cuesFromTree(cueTree);
+  tree.removeChild(cueTree, nullptr);
+
+  // The setlist itself; the track playing is restored like any other.
+  std::vector<SetlistEntry> entries;
+  const auto setlistTree = tree.getChildWithName("Setlist");
+  for (const auto &child : setlistTree)
+    if (child.hasType("Track"))
+      entries.push_back(
+          {juce::File(child.getProperty("path", "").toString()),
+           static_cast<float>(
+               static_cast<double>(child.getProperty("startOffset", 0.0))),
+           cuesFromTree(child.getChildWithName("Cues"))});
+  {
+    const juce::ScopedLock sl(setlistLock);
+    setlist = std::move(entries);
+    setlistIndex = juce::jlimit(
+        -1, static_cast<int>(setlist.size()) - 1,
+        static_cast<int>(setlistTree.getProperty("position", -1)));
+    // Any preload, or a step the audio thread took, was for the old list.
+    jobs.cancel(preloadJob);
+    preloadJob = nullptr;
+    preloadIndex = -1;
+    dropNextTrack();
+    setlistSwapped = false;
+  }
+  setlistAdvanceRequest = false;
+  setSetlistNextNote(
+      static_cast<int>(setlistTree.getProperty("nextNote", -1)));
+  setlistAutoAdvance =
+      static_cast<bool>(setlistTree.getProperty("autoAdvance", false));
+  tree.removeChild(setlistTree, nullptr);
+
+  // Parameters apply immediately; the audio follows from a background job so
+  // the host isn't blocked on decoding and resampling - unless it's the audio
+  // we already have, in which case this is just a parameter change.
+  const bool reload = (audio != nullptr || path.isNotEmpty()) &&
+                      !isSampleCurrent(tree, audio != nullptr);
+  const auto hash = static_cast<juce::uint64>(
+      static_cast<juce::int64>(tree.getProperty("sampleHash", 0)));
+  apvts.replaceState(tree);
+  {
+    const juce::ScopedLock sl(cueLock);
+    cueList = std::move(cues);
   }
+  ++cueGeneration;
+  if (reload)
+    restoreSampleAsync(std::move(audio), path, name, hash);
+  else
+    rebuildCues();
+  updateSetlist(); // preloads the entry after the restored one
+}
 
-  if (!restored && path.isNotEmpty()) {
-    juce::File file(path);
-    if (file.existsAsFile())
-      loadSample(file);
+bool BackingTrackTriggerProcessor::isSampleCurrent(const juce::ValueTree &state,
+                                                   bool hasEmbeddedAudio) {
+  const auto hash = static_cast<juce::uint64>(
+      static_cast<juce::int64>(state.getProperty("sampleHash", 0)));
+  if (hash == 0)
+    return false; // saved by 2.0.x
+
+  {
+    // Same audio as a restore that's still running: let it finish.
+    const juce::ScopedLock sl(loadLock);
+    if (loadingFlag.load() && restoringHash == hash)
+      return true;
   }
 
-  apvts.replaceState(tree);
+  auto cur = getSampleOrEvicted();
+  if (cur == nullptr || cur->getContentHash() != hash)
+    return false;
+  if (hasEmbeddedAudio)
+    return true;
+
+  // By path: only if the file hasn't changed on disk since it was saved.
+  const juce::File file(cur->fullPath);
+  return cur->fullPath == state.getProperty("samplePath").toString() &&
+         file.getSize() ==
+             static_cast<juce::int64>(state.getProperty("sampleFileSize", -1)) &&
+         file.getLastModificationTime().toMilliseconds() ==
+             static_cast<juce::int64>(state.getProperty("sampleFileTime", -1));
 }
 
 //==============================================================================
@@ -554,15 +2652,24 @@ double BackingTrackTriggerProcessor::getStartOffsetSeconds() const {
 
 void BackingTrackTriggerProcessor::setStartOffsetFromProgress(float progress) {
   auto s = getSample();
-  if (s == nullptr || s->audio.getNumSamples() == 0)
+  if (s == nullptr || s->getNumFrames() == 0)
     return;
 
   progress = juce::jlimit(0.0f, 1.0f, progress);
-  const double lenSec = s->audio.getNumSamples() / s->playbackSampleRate;
+  const double lenSec = s->getNumFrames() / s->playbackSampleRate;
   setParamValue(ids::startOffset,
                 static_cast<float>(progress * lenSec * 1000.0));
 }
 
+bool BackingTrackTriggerProcessor::autoTrimStartOffset() {
+  auto s = getSample();
+  if (s == nullptr || s->analysis == nullptr || !s->analysis->isReady())
+    return false;
+
+  setStartOffsetSeconds(s->analysis->getAutoTrimSeconds());
+  return true;
+}
+
 //==============================================================================
 SampleBuffer::Ptr BackingTrackTriggerProcessor::getSample() const {
   const juce::SpinLock::ScopedLockType lock(sampleLock);
@@ -571,7 +2678,7 @@ SampleBuffer::Ptr BackingTrackTriggerProcessor::getSample() const {
 
 bool BackingTrackTriggerProcessor::hasSampleLoaded() const {
   auto s = getSample();
-  return s != nullptr && s->audio.getNumSamples() > 0;
+  return s != nullptr && s->getNumFrames() > 0;
 }
 
 juce::String BackingTrackTriggerProcessor::getSampleName() const {
@@ -581,17 +2688,56 @@ juce::String BackingTrackTriggerProcessor::getSampleName() const {
 
 double BackingTrackTriggerProcessor::getSampleLengthSeconds() const {
   auto s = getSample();
-  if (s == nullptr || s->audio.getNumSamples() == 0)
+  if (s == nullptr || s->getNumFrames() == 0)
     return 0.0;
-  return s->audio.getNumSamples() / s->playbackSampleRate;
+  return s->getNumFrames() / s->playbackSampleRate;
 }
 
 float BackingTrackTriggerProcessor::getPlaybackProgress() const {
   auto s = getSample();
-  if (s == nullptr || s->audio.getNumSamples() == 0)
+  if (s == nullptr || s->getNumFrames() == 0)
     return 0.0f;
-  return static_cast<float>(publishedPos.load()) /
-         static_cast<float>(s->audio.getNumSamples());
+  const double pos =
+      getPlayheadPosition(juce::Time::getMillisecondCounterHiRes());
+  return static_cast<float>(pos / s->getNumFrames());
+}
+
+void BackingTrackTriggerProcessor::publishPlayhead(int64_t position,
+                                                   int blockSize) {
+  const auto seq = playheadSeq.load(std::memory_order_relaxed);
+  playheadSeq.store(seq + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  playheadPos.store(position, std::memory_order_relaxed);
+  playheadTimeMs.store(juce::Time::getMillisecondCounterHiRes(),
+                       std::memory_order_relaxed);
+  playheadBlockSize.store(blockSize, std::memory_order_relaxed);
+  playheadSeq.store(seq + 2, std::memory_order_release);
+}
+
+BackingTrackTriggerProcessor::PlayheadSnapshot
+BackingTrackTriggerProcessor::getPlayheadSnapshot() const {
+  PlayheadSnapshot snap;
+  for (;;) {
+    const auto before = playheadSeq.load(std::memory_order_acquire);
+    snap.position = playheadPos.load(std::memory_order_relaxed);
+    snap.timeMs = playheadTimeMs.load(std::memory_order_relaxed);
+    snap.blockSize = playheadBlockSize.load(std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if ((before & 1) == 0 &&
+        before == playheadSeq.load(std::memory_order_relaxed))
+      return snap;
+  }
+}
+
+double BackingTrackTriggerProcessor::getPlayheadPosition(double nowMs) const {
+  const auto snap = getPlayheadSnapshot();
+  if (!playingFlag.load())
+    return static_cast<double>(snap.position);
+
+  const double elapsed =
+      (nowMs - snap.timeMs) * 0.001 * currentSampleRate.load();
+  return static_cast<double>(snap.position) +
+         juce::jlimit(0.0, 2.0 * snap.blockSize, elapsed);
 }
 
 double BackingTrackTriggerProcessor::getOriginalSampleRate() const {
@@ -609,6 +2755,11 @@ int BackingTrackTriggerProcessor::getOriginalBitsPerSample() const {
   return s != nullptr ? s->sourceBitsPerSample : 16;
 }
 
+bool BackingTrackTriggerProcessor::isCompressed() const {
+  auto s = getSample();
+  return s != nullptr && s->compressed != nullptr;
+}
+
 bool BackingTrackTriggerProcessor::isResampled() const {
   auto s = getSample();
   return s != nullptr && s->wasResampled;
@@ -1,5 +1,16 @@
 #pragma once
 
+#include "AudioAnalysis.h"
+#include "CompressedAudio.h"
+#include "CueSet.h"
+#include "EmbeddedAudio.h"
+#include "FormatRegistry.h"
+#include "IoScheduler.h"
+#include "JobScheduler.h"
+#include "MemoryBudget.h"
+#include "PageLock.h"
+#include "StreamBuffer.h"
+#include "WaveformPeaks.h"
 #include <atomic>
 #include <juce_audio_formats/juce_audio_formats.h>
 #include <juce_audio_processors/juce_audio_processors.h>
@@ -8,17 +19,29 @@
 /**
  * Immutable, reference-counted container for a loaded sample.
  *
- * The message thread builds a fresh SampleBuffer and hands it to the audio
- * thread by swapping a pointer under a spin lock. Because the object is
- * reference counted, the audio thread can keep a SampleBuffer alive for the
- * duration of a processBlock() call even if the message thread swaps in a new
- * one mid-render. Old buffers are reclaimed on the message thread, so the
- * audio thread never allocates or frees memory.
+ * A load job builds a fresh SampleBuffer and hands it to the audio thread by
+ * swapping a pointer under a spin lock. Because the object is reference
+ * counted, the audio thread can keep a SampleBuffer alive for the duration of
+ * a processBlock() call even if a new one is swapped in mid-render. Old
+ * buffers are reclaimed by whoever publishes the next one, so the audio thread
+ * never allocates or frees memory.
  *
  *  - `source` holds the original audio at its native sample rate. It is the
  *    canonical copy: we resample from it (never from already-resampled data)
  *    and embed it when saving a portable project.
- *  - `audio` holds the playback-ready copy, resampled to the host rate.
+ *  - `audio` holds the playback-ready copy, resampled to the host rate (with
+ *    the windowed-sinc resampler once an offline render asks for it).
+ *  - `peaks` is the waveform overview, filled in by a background job. It is
+ *    computed from `source`, so it is shared by every rate-specific copy.
+ *  - `analysis` holds silence / onset / tempo results, also computed in the
+ *    background from `source` and shared the same way.
+ *  - `embedded` caches the compressed copy written into the plugin state.
+ *  - `lossless` is a FLAC copy made before the decoded audio is evicted to
+ *    stay within the memory budget, when neither the file on disk nor
+ *    `embedded` can bring it back exactly.
+ *  - `compressed` stands in for `source` and `audio`, which are then empty,
+ *    in the budget's compressed storage mode: the playback audio as FLAC,
+ *    which the audio thread plays through a StreamBuffer.
  */
 class SampleBuffer : public juce::ReferenceCountedObject {
 public:
@@ -32,9 +55,50 @@ public:
   int sourceBitsPerSample = 16;
   double playbackSampleRate = 44100.0;
   bool wasResampled = false;
+  bool bestQuality = false; // resampled with SincResampler
 
   juce::String name;     // display name (file name)
   juce::String fullPath; // original full path (may be empty for embedded)
+  juce::int64 fileSize = 0;      // of fullPath when it was read
+  juce::int64 fileModTimeMs = 0; // ditto
+
+  WaveformPeaks::Ptr peaks;
+  SampleAnalysis::Ptr analysis;
+  EmbeddedAudio::Ptr embedded;
+  EmbeddedAudio::Ptr lossless;
+  CompressedAudio::Ptr compressed;
+
+  // Attaches empty peak / analysis / embed caches sized for `source` (call
+  // once `source` has been filled).
+  void createDerivedData();
+
+  // Length of the playback audio, decoded or compressed.
+  int getNumFrames() const noexcept;
+
+  // Memory held by `source` and `audio`, or by `compressed`.
+  juce::int64 getAudioBytes() const;
+
+  // Hash of `source` (and its format), computed on first use and cached.
+  // Loads compute it on their background job, so on the host's thread this
+  // only reads the cache. Safe to call from any thread except the audio
+  // thread.
+  juce::uint64 getContentHash() const;
+
+  // Names `source` by the hash of the audio it was decoded from, without
+  // reading it: a lossy copy never hashes the same as its original.
+  void setContentHash(juce::uint64 hash) noexcept;
+
+  // Names the audio for the peaks cache without reading it: the file's path,
+  // size and modification time, else a hash of the embedded blob it was
+  // restored from. 0 if neither is known.
+  juce::uint64 getPeaksKey() const;
+
+  // Copies everything except the audio (used when re-preparing the same
+  // source for a new host rate).
+  void copyMetadataFrom(const SampleBuffer &other);
+
+private:
+  mutable std::atomic<juce::uint64> contentHash{0}; // 0 = not computed yet
 };
 
 //==============================================================================
@@ -46,7 +110,9 @@ public:
  * triggering, click-free fades, looping, gain, and portable (embeddable)
  * project state.
  */
-class BackingTrackTriggerProcessor : public juce::AudioProcessor {
+class BackingTrackTriggerProcessor : public juce::AudioProcessor,
+                                     private MemoryBudget::Client,
+                                     private juce::AsyncUpdater {
 public:
   BackingTrackTriggerProcessor();
   ~BackingTrackTriggerProcessor() override;
@@ -57,9 +123,18 @@ public:
   bool isBusesLayoutSupported(const BusesLayout &layouts) const override;
   void processBlock(juce::AudioBuffer<float> &, juce::MidiBuffer &) override;
 
+  // Offline bounces (the host's non-realtime mode) trade latency for
+  // completeness: processBlock() may block, so it waits for audio that is
+  // still loading or evicted instead of joining late, and resamples with the
+  // windowed-sinc resampler before rendering. It also skips the editor's
+  // playhead and meter updates, and the audio is never evicted meanwhile.
+  void setNonRealtime(bool isNonRealtime) noexcept override;
+
   //==============================================================================
   juce::AudioProcessorEditor *createEditor() override;
   bool hasEditor() const override;
+  void
+  editorBeingDeleted(juce::AudioProcessorEditor *editor) noexcept override;
 
   //==============================================================================
   const juce::String getName() const override;
@@ -81,23 +156,132 @@ public:
 
   //==============================================================================
   // Sample management (call from the message thread only).
+  // loadSample() returns at once: the file is read and resampled by a
+  // background job, and the previous sample keeps playing until it's ready.
+  // Starting another load (or a restore, or clearSample()) cancels one that
+  // is still running. A new file starts with no start offset and no cues.
   void loadSample(const juce::File &file);
   void clearSample();
 
+  // True while a loadSample() or setStateInformation() is still bringing in
+  // the audio in the background. Parameters are already applied by then. If a
+  // restore leaves no audio loaded, a note that arrives meanwhile is
+  // remembered: once the audio is ready, playback starts where it would have
+  // been had the audio been there all along ("late join"), with the usual
+  // fade-in. Note-off (with Note-Off Stops), Stop, or the host transport
+  // stopping cancels it.
+  bool isLoading() const { return loadingFlag.load(); }
+  // 0..1 progress of the load in flight (meaningful while isLoading()).
+  float getLoadProgress() const;
+
+  // True while the decoded audio is evicted to keep all instances within the
+  // shared memory budget. It is brought back in the background when playback
+  // is about to reach the trigger note, when a note arrives (which then joins
+  // late, as above), or when the editor opens. Saving works as usual meanwhile.
+  bool isEvicted() const { return evictedFlag.load(); }
+  MemoryBudget &getMemoryBudget() { return *memoryBudget; }
+
+  // True while the track is held compressed in RAM: the budget's compressed
+  // storage mode swaps it in once the track has sat idle. It plays as usual,
+  // decoded a few seconds ahead of the voice by a shared background thread.
+  // Turning the mode off, an offline render, or a change to the embed
+  // settings decodes it again in the background.
+  bool isCompressed() const;
+  // Times the voice found nothing decoded where it was (it skipped ahead in
+  // silence and faded back in), since prepareToPlay().
+  int getStreamUnderruns() const { return streamUnderruns.load(); }
+
+  // With the budget's playback lock on, the audio from the playhead (or start
+  // offset) forward is kept prefaulted and locked in RAM; see PageLock.
+  PageLock::Stats getPageLockStats() const { return pageLock.getStats(); }
+
   // Manual transport (thread-safe; takes effect at the next block).
   void triggerPlayback();
   void stopPlayback();
 
+  // Cues (call from the message thread only): up to CueSet::kMaxCues entry
+  // points into the track, each fired by its own MIDI note, which takes
+  // precedence over the trigger note. Firing one while another plays
+  // crossfades to it. Cues are saved with the parameters.
+  std::vector<CueSet::Cue> getCues() const; // in track order
+  // Adds a cue, or moves the one on `note`. Returns false if the list is full.
+  bool setCue(int note, double offsetSeconds, const juce::String &name = {});
+  void removeCue(int note);
+  void clearCues();
+  // Bumped on every change to the cues; the editor polls it.
+  juce::uint32 getCueGeneration() const { return cueGeneration.load(); }
+
+  // Setlist (call from the message thread only): an ordered list of tracks
+  // for one instance to step through. While a track is current, the next one
+  // is decoded and prepared in the background, so moving on to it is instant:
+  // on the next-track note (once a playing track has faded out), or, with
+  // auto-advance, gaplessly as the current track ends. The swap happens on
+  // the audio thread, and the track it replaces is freed elsewhere. Each track
+  // keeps its own start offset and cues, which come back whenever it is
+  // current again; a new list starts with none. The list (as paths, with each
+  // track's offset and cues) and the settings are saved with the project.
+  void setSetlist(const juce::Array<juce::File> &files); // loads the first
+  juce::Array<juce::File> getSetlist() const;
+  int getSetlistPosition() const; // of the current track; -1 = no setlist
+  void selectSetlistEntry(int index); // instant if it is the preloaded one
+  bool isNextTrackReady() const { return nextTrackReady.load(); }
+  int getSetlistNextNote() const { return setlistNextNote.load(); }
+  void setSetlistNextNote(int note); // -1 = none
+  bool isSetlistAutoAdvance() const { return setlistAutoAdvance.load(); }
+  void setSetlistAutoAdvance(bool shouldAdvance);
+
   //==============================================================================
   // Thread-safe queries for the editor.
   SampleBuffer::Ptr getSample() const;
   bool hasSampleLoaded() const;
+  // Bumped every time a different sample (or none) is published; the editor
+  // polls it to refresh itself.
+  juce::uint32 getSampleGeneration() const { return sampleGeneration.load(); }
   juce::String getSampleName() const;
   double getSampleLengthSeconds() const;
   bool isPlaying() const { return playingFlag.load(); }
   float getPlaybackProgress() const; // 0..1 within the loaded buffer
+
+  // Where the voice was at the end of the last rendered block, and when that
+  // block was rendered (Time::getMillisecondCounterHiRes()).
+  struct PlayheadSnapshot {
+    int64_t position = 0; // in playback samples
+    double timeMs = 0.0;
+    int blockSize = 0;
+  };
+  PlayheadSnapshot getPlayheadSnapshot() const;
+  // The playhead extrapolated to `nowMs`, in playback samples. Moves smoothly
+  // between audio blocks but never runs more than two blocks ahead.
+  double getPlayheadPosition(double nowMs) const;
   float getOutputLevel() const { return outputLevel.load(); }
 
+  // How closely playback follows the host's timeline. A voice started while
+  // the host plays (with Follow Transport on) should be wherever the host
+  // position has moved to since the trigger; each block measures the drift
+  // from that. Small drift is closed by playing up to 0.5% fast or slow,
+  // inaudibly; more than 20 ms (a skipped section, say) by a short crossfaded
+  // jump.
+  struct SyncStats {
+    bool tracking = false;   // a voice is following the host position
+    double driftMs = 0.0;    // at the last block; positive = playback ahead
+    double maxDriftMs = 0.0; // largest |drift| since prepareToPlay()
+    int corrections = 0;     // times the speed was adjusted to close a gap
+    int jumps = 0;           // crossfaded jumps
+  };
+  SyncStats getSyncStats() const;
+
+  // Varispeed: with the "varispeed" parameter on, the track plays at the
+  // host tempo over its own ("trackTempo", or the detected tempo when that is
+  // 0), between half and double speed, pitch following. A tempo change
+  // glides over about 50 ms. The ratio in use, 1 when off:
+  double getPlaybackRatio() const { return playbackRatio.load(); }
+
+  // Loudness normalization: with "normalize" on, the gain is offset by the
+  // difference between "targetLoudness" and the track's integrated loudness
+  // (from its analysis), up to +-24 dB, and a boost stops where the true peak
+  // would pass -1 dBTP. The offset in use, 0 when off or not yet analysed:
+  double getNormalizeGainDb() const;
+
   double getOriginalSampleRate() const;
   int getOriginalNumChannels() const;
   int getOriginalBitsPerSample() const;
@@ -109,52 +293,229 @@ public:
   double getStartOffsetSeconds() const;
   void setStartOffsetFromProgress(float progress0to1);
 
-  // Embed-in-project toggle (not an automatable parameter).
+  // Moves the start offset to just before the first detected onset. Returns
+  // false (and changes nothing) until the sample's analysis has finished.
+  bool autoTrimStartOffset();
+
+  // Embed-in-project toggle (not an automatable parameter). Turning it on
+  // starts encoding in the background so the next save doesn't have to.
   bool isEmbedEnabled() const { return embedSample.load(); }
-  void setEmbedEnabled(bool shouldEmbed) { embedSample = shouldEmbed; }
+  void setEmbedEnabled(bool shouldEmbed);
+
+  // Codec (lossless FLAC or compact, lossy Ogg Vorbis), its compression level
+  // or quality, and encoder threads for embedding (saved with the project).
+  // Changing them re-encodes in the background.
+  EmbeddedAudio::Settings getEmbedSettings() const;
+  void setEmbedSettings(const EmbeddedAudio::Settings &settings);
+
+  // The resampler that loads go through: `dst` is resized to hold `src` at
+  // `dstRate`. Returns false if `job` is cancelled part-way. `bestQuality`
+  // uses SincResampler instead of the (much faster) Lagrange interpolator.
+  // (Public for the benchmark tool.)
+  static bool resampleInto(const juce::AudioBuffer<float> &src, double srcRate,
+                           juce::AudioBuffer<float> &dst, double dstRate,
+                           JobScheduler::Job *job = nullptr,
+                           bool bestQuality = false);
 
   juce::AudioProcessorValueTreeState apvts;
 
-  // Notifies the editor (if any) that the loaded sample changed.
-  std::function<void()> onSampleChanged;
-
 private:
   //==============================================================================
   enum class PlayState { Idle, Playing, FadingOut };
 
   static juce::AudioProcessorValueTreeState::ParameterLayout createLayout();
 
-  void renderSegment(juce::AudioBuffer<float> &out, int startSample,
-                     int numSamples, const SampleBuffer &data, int64_t offset,
-                     bool looping, int fadeOutSamples);
-
-  void startVoice(int64_t offset, int sampleLen);
+  // Renders from `audio`, which starts `base` samples into a track that ends
+  // at `trackEnd`: the track itself, a cue head, or a stream window. Audio
+  // that stops short of `trackEnd` is left a few samples early, with the
+  // voice still playing. A crossfade reads its old side from `jumpAudio`
+  // (starting `jumpBase` in) if given, else from `audio`.
+  // Returns how many samples it rendered before the voice went idle or left
+  // the audio.
+  int renderSegment(juce::AudioBuffer<float> &out, int startSample,
+                    int numSamples, const juce::AudioBuffer<float> &audio,
+                    int64_t base, int64_t trackEnd, int64_t loopStart,
+                    bool looping, int fadeOutSamples,
+                    const juce::AudioBuffer<float> *jumpAudio = nullptr,
+                    int64_t jumpBase = 0);
+  // The same for a compressed track, from the stream's windows or the
+  // voice's head, and through silence where neither has the audio yet.
+  int renderStream(juce::AudioBuffer<float> &out, int startSample,
+                   int numSamples, const CueSet *cues, int64_t end,
+                   int64_t offset, double sr, bool looping, int fadeOutSamples);
+
+  void startVoice(int64_t position, int64_t sampleLen, int blockOffset,
+                  int key, bool crossfade = false);
+  void followHost(double sr, int sampleLen, int64_t offset, bool looping,
+                  bool followTransport, int numSamples);
   void beginFadeOut();
-
-  // Build / resample / publish helpers (message thread).
-  static void resampleInto(const juce::AudioBuffer<float> &src, double srcRate,
-                           juce::AudioBuffer<float> &dst, double dstRate);
-  static void prepareForRate(SampleBuffer &s, double hostRate);
+  void updateTempoRatio(const SampleBuffer *data, double sr, int numSamples);
+  double normalizeGainDbFor(const SampleBuffer *data) const;
+
+  // Build / resample / publish helpers. The long-running ones take an
+  // optional job to check for cancellation and report progress to, and give
+  // up (returning false / nullptr) when it is cancelled.
+  static bool prepareForRate(SampleBuffer &s, double hostRate,
+                             JobScheduler::Job *job = nullptr,
+                             bool bestQuality = false);
   SampleBuffer::Ptr createSampleFromReader(juce::AudioFormatReader &reader,
                                            const juce::String &name,
-                                           const juce::String &path) const;
-  void publishSample(SampleBuffer::Ptr newSample);
+                                           const juce::String &path,
+                                           JobScheduler::Job *job) const;
+  // What a file read is for, which sets its deadline on the I/O scheduler:
+  // the track itself, the setlist's next one (wanted when this one ends), or
+  // a cache or copy nothing waits for but an open editor.
+  enum class ReadFor { track, preload, background };
+  double getReadDeadlineMs(ReadFor what) const;
+  IoScheduler::Deadline getReadDeadline(ReadFor what) const {
+    return [this, what] { return getReadDeadlineMs(what); };
+  }
+  SampleBuffer::Ptr readSampleFile(const juce::File &file,
+                                   JobScheduler::Job *job,
+                                   ReadFor what = ReadFor::track);
+  // Also rebuilds the cue heads from the new audio, unless `keepCueHeads`
+  // (an eviction: the heads are what still plays).
+  void publishSample(SampleBuffer::Ptr newSample, bool keepCueHeads = false);
   void freeUnusedSamples();
+  // loadSample() for a track that comes with its own start offset and cues.
+  void loadTrack(const juce::File &file, float startOffsetMs,
+                 std::vector<CueSet::Cue> cues);
+  // Replaces the cue list. The caller rebuilds the heads, or publishes a
+  // sample, which does.
+  void setCueList(std::vector<CueSet::Cue> cues);
+  void rebuildCues();
+  CueSet::Ptr buildCues(const SampleBuffer *sample,
+                        const CueSet *previous) const;
+  static int64_t voiceStartFor(const CueSet *cues, int key, int64_t offset,
+                               double sr);
+  static const CueSet::Entry *headFor(const CueSet *cues, int key,
+                                      int64_t offset, double sr);
+  bool isSampleCurrent(const juce::ValueTree &state, bool hasEmbeddedAudio);
+  void restoreSampleAsync(EmbeddedAudio::Blob audio, const juce::String &path,
+                          const juce::String &name, juce::uint64 hash);
+  void startLoadJob(juce::uint32 generation, const juce::String &name,
+                    std::function<SampleBuffer::Ptr(JobScheduler::Job &)> load);
+  void finishLoad(juce::uint32 generation, SampleBuffer::Ptr sample);
+  juce::uint32 beginLoad(bool willLoad);
+  bool hostTransportReset();
+  void prepareOfflineBlock();
+  void trackLateJoin(const juce::MidiBuffer &midi, int numSamples,
+                     const CueSet *cues, int trigNote, bool noteOffStops,
+                     bool retrig, int nextNote);
+  void startBackgroundJobs(const SampleBuffer::Ptr &sample);
+  void startEmbedEncode(const SampleBuffer::Ptr &sample);
   int64_t currentOffsetSamples(double sr, int sampleLen) const;
   void setParamValue(const juce::String &id, float value);
-
-  // Embedding (FLAC, original sample rate).
-  juce::MemoryBlock encodeSampleToFlac(const SampleBuffer &s) const;
-  SampleBuffer::Ptr decodeSampleFromFlac(const void *data, size_t size,
-                                         const juce::String &name) const;
+  void publishPlayhead(int64_t position, int blockSize);
+
+  // MemoryBudget::Client (called on the budget's thread).
+  juce::int64 getResidentBytes() const override;
+  double getLastActiveTimeMs() const override { return lastActiveMs.load(); }
+  bool canEvict() const override;
+  juce::int64 evict() override;
+  void updateResidency() override;
+
+  bool isNeededSoon() const;
+  void updatePageLock();
+  void requestResident();
+  void updateStorage();
+  void compress(const SampleBuffer::Ptr &sample);
+  void decompress(const SampleBuffer::Ptr &sample);
+  void rehydrate();
+  SampleBuffer::Ptr reloadEvicted(const SampleBuffer &shell,
+                                  JobScheduler::Job &job);
+  SampleBuffer::Ptr getSampleOrEvicted() const;
+
+  // Setlist helpers. updateSetlist() sets parameters and may start a load,
+  // so it runs on the message thread: called from elsewhere (the budget's
+  // thread polls it), it posts itself there.
+  bool swapInNextTrack(SampleBuffer::Ptr &data, CueSet::Ptr &cues);
+  void updateSetlist();
+  void handleAsyncUpdate() override;
+  void storeSetlistEntry(); // caller holds setlistLock
+  void finishPreload(int index, SampleBuffer::Ptr sample);
+  void dropNextTrack();
+
+  // Embedding (FLAC / Ogg Vorbis, original sample rate).
+  SampleBuffer::Ptr decodeEmbeddedSample(const void *data, size_t size,
+                                         const juce::String &name,
+                                         JobScheduler::Job *job) const;
 
   //==============================================================================
-  juce::AudioFormatManager formatManager;
+  juce::SharedResourcePointer<FormatRegistry> formats;
+  juce::SharedResourcePointer<IoScheduler> io;
 
-  // RT-safe current-sample handoff.
+  // RT-safe current-sample handoff. Samples may be published from the
+  // message thread or from a background restore.
   juce::SpinLock sampleLock;
   SampleBuffer::Ptr currentSample;                      // guarded by sampleLock
-  juce::ReferenceCountedArray<SampleBuffer> samplePool; // message thread owns
+  juce::CriticalSection poolLock;
+  juce::ReferenceCountedArray<SampleBuffer> samplePool; // guarded by poolLock
+  std::atomic<juce::uint32> sampleGeneration{0};
+
+  // Cues: the list as edited, and the set built from it for the audio thread
+  // (handed over and reclaimed like the sample).
+  mutable juce::CriticalSection cueLock;
+  std::vector<CueSet::Cue> cueList;            // guarded by cueLock
+  CueSet::Ptr currentCues;                     // guarded by sampleLock
+  juce::ReferenceCountedArray<CueSet> cuePool; // guarded by poolLock
+  std::atomic<juce::uint32> cueGeneration{0};
+
+  // Setlist. The track after the current one is preloaded into nextSample;
+  // the audio thread swaps it in and flags setlistSwapped, and
+  // updateSetlist() brings everything else up to date.
+  struct SetlistEntry {
+    juce::File file;
+    // As the track had them when it was last current.
+    float startOffsetMs = 0.0f;
+    std::vector<CueSet::Cue> cues;
+  };
+  juce::CriticalSection setlistLock;
+  std::vector<SetlistEntry> setlist; // guarded by setlistLock
+  int setlistIndex = -1;             // guarded by setlistLock
+  int preloadIndex = -1;             // guarded by setlistLock
+  JobScheduler::Job::Ptr preloadJob; // guarded by setlistLock
+  SampleBuffer::Ptr nextSample;      // guarded by sampleLock
+  CueSet::Ptr nextCues;              // guarded by sampleLock
+  std::atomic<bool> nextTrackReady{false};
+  std::atomic<bool> setlistSwapped{false};
+  std::atomic<bool> setlistAdvanceRequest{false}; // until it can swap
+  std::atomic<int> setlistNextNote{-1};
+  std::atomic<bool> setlistAutoAdvance{false};
+
+  // Background loads: each load bumps the generation and cancels the job of
+  // the previous one, and a load only publishes if nothing newer has started
+  // since.
+  juce::CriticalSection loadLock;
+  juce::uint32 loadGeneration = 0; // guarded by loadLock
+  juce::uint64 restoringHash = 0;  // guarded by loadLock, 0 = unknown
+  JobScheduler::Job::Ptr loadJob;  // guarded by loadLock
+  std::atomic<bool> loadingFlag{false};
+  juce::WaitableEvent loadFinished; // signalled by finishLoad()
+  std::atomic<bool> offlineFlag{false}; // the host's non-realtime mode
+  // The analysis an offline render last waited for (so a cancelled one is
+  // waited for once, not every block). Rendering thread only.
+  SampleAnalysis::Ptr offlineAnalysis;
+
+  // Memory budget. While evicted, currentSample is null and evictedSample
+  // keeps everything but the decoded audio (name, path, hash, caches).
+  juce::SharedResourcePointer<MemoryBudget> memoryBudget;
+  SampleBuffer::Ptr evictedSample; // guarded by loadLock
+  std::atomic<bool> evictedFlag{false};
+  std::atomic<bool> rehydrateRequest{false};
+  std::atomic<bool> editorOpen{false};
+  std::atomic<bool> waitingForAudio{false}; // a late join is pending
+  std::atomic<double> lastActiveMs{0.0};
+  std::atomic<double> lastRehydrateFailMs{0.0};
+  PageLock pageLock; // updated on the budget's thread only
+
+  // Compressed storage. A finished background compress waits in
+  // compressedSample (made from compressedFrom) until the track is idle.
+  StreamBuffer stream;
+  SampleBuffer::Ptr compressedFrom;   // guarded by loadLock
+  SampleBuffer::Ptr compressedSample; // guarded by loadLock
+  std::atomic<bool> decodeRequest{false};
+  std::atomic<int> streamUnderruns{0};
 
   // Cached raw parameter pointers (lock-free reads on the audio thread).
   std::atomic<float> *gainParam = nullptr;
@@ -166,6 +527,10 @@ private:
   std::atomic<float> *fadeOutParam = nullptr;
   std::atomic<float> *retriggerParam = nullptr;
   std::atomic<float> *followTransportParam = nullptr;
+  std::atomic<float> *varispeedParam = nullptr;
+  std::atomic<float> *trackTempoParam = nullptr;
+  std::atomic<float> *normalizeParam = nullptr;
+  std::atomic<float> *targetLoudnessParam = nullptr;
 
   // Audio-thread playback state.
   PlayState playState = PlayState::Idle;
@@ -175,22 +540,68 @@ private:
   float fadeInInc = 1.0f;  // per-sample, recomputed each block
   float fadeOutInc = 1.0f;
   juce::SmoothedValue<float> gainSmoothed;
+  bool lateJoinPending = false; // a note arrived while loading
+  int64_t lateJoinElapsed = 0;  // samples since that note
+  int lateJoinKey = -1;         // and which entry point it fired
+  int voiceKey = -1;            // entry point of the voice: a cue note, or -1
+  bool headRanOut = false;      // the voice played its cue head to the end
+  int64_t renderedSamples = 0;  // since prepareToPlay()
+  int64_t blockStartClock = 0;  // renderedSamples at the start of the block
+  int64_t voiceStartClock = 0;  // ... when the voice started
+
+  // Host sync (see SyncStats). The voice belongs at anchorVoicePos plus
+  // however far the host has moved since anchorHostPos, times anchorRatio.
+  bool syncAnchored = false;
+  int64_t anchorHostPos = 0;
+  double anchorVoicePos = 0.0;
+  double anchorRatio = 1.0; // the tempo ratio since the anchor
+  double playPhase = 0.0;   // fraction of a sample past playPos
+  double playSpeed = 1.0;   // source samples per output sample
+  double tempoRatio = 1.0;  // varispeed's share of playSpeed
+  double hostBpm = 0.0;     // from the play head, 0 = unknown
+  int64_t jumpFromPos = 0;  // where a crossfaded jump left from
+  int jumpRemaining = 0;    // samples of its crossfade still to go
+  int jumpLength = 1;
 
   // Published to the editor.
   std::atomic<bool> playingFlag{false};
-  std::atomic<int64_t> publishedPos{0};
+  // Playhead snapshot, written by the audio thread under a sequence counter
+  // (odd while a write is in progress) so readers see a consistent pair.
+  std::atomic<juce::uint32> playheadSeq{0};
+  std::atomic<int64_t> playheadPos{0};
+  std::atomic<double> playheadTimeMs{0.0};
+  std::atomic<int> playheadBlockSize{0};
   std::atomic<float> outputLevel{0.0f};
 
   // Message -> audio transport requests.
   std::atomic<bool> triggerRequest{false};
   std::atomic<bool> stopRequest{false};
 
-  // Host transport tracking.
+  // Host transport tracking. The atomics let the memory budget see where
+  // the host is relative to the last trigger note.
   std::atomic<double> currentSampleRate{44100.0};
   int64_t lastHostPosition = 0;
+  bool hostPositionKnown = false; // from timeInSamples, or PPQ and tempo
   bool wasHostPlaying = false;
+  std::atomic<bool> hostPlayingFlag{false};
+  std::atomic<int64_t> hostPositionSamples{0};
+  std::atomic<int64_t> lastTriggerHostPosition{-1}; // -1 = not seen yet
+  std::atomic<bool> syncTracking{false};
+  std::atomic<double> syncDriftMs{0.0};
+  std::atomic<double> syncMaxDriftMs{0.0};
+  std::atomic<int> syncCorrections{0};
+  std::atomic<int> syncJumps{0};
+  std::atomic<double> playbackRatio{1.0};
 
   std::atomic<bool> embedSample{false};
+  std::atomic<int> embedCompression{EmbeddedAudio::Settings{}.compressionLevel};
+  std::atomic<int> embedThreads{EmbeddedAudio::Settings{}.numThreads};
+  std::atomic<EmbeddedAudio::Codec> embedCodec{EmbeddedAudio::Settings{}.codec};
+  std::atomic<int> embedQuality{EmbeddedAudio::Settings{}.vorbisQuality};
+
+  // Loading, peak scanning and other per-sample work that must stay off the
+  // message and audio threads, on the workers shared by all instances.
+  JobGroup jobs;
 
   JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(BackingTrackTriggerProcessor)
 };
@@ -0,0 +1,198 @@
+#include "SincResampler.h"
+#include "JobScheduler.h"
+#include <atomic>
+#include <cmath>
+#include <numeric>
+#include <vector>
+
+namespace {
+constexpr int kZeroCrossings = 64;      // each side of the kernel's centre
+constexpr double kCutoff = 0.94;        // of the lower Nyquist frequency
+constexpr int kMaxPhases = 4096;        // else evaluate the kernel per tap
+constexpr int kMaxTableSize = 1 << 22;  // coefficients in a phase table
+constexpr int kKernelResolution = 512;  // table steps per zero crossing
+constexpr int kChunk = 16384; // output samples between cancel / progress checks
+
+// sinc(x) under a Blackman-Harris window reaching zero at kZeroCrossings.
+double kernel(double x) {
+  x = std::abs(x);
+  if (x >= kZeroCrossings)
+    return 0.0;
+  const double u = juce::MathConstants<double>::pi * x / kZeroCrossings;
+  const double window = 0.35875 + 0.48829 * std::cos(u) +
+                        0.14128 * std::cos(2.0 * u) +
+                        0.01168 * std::cos(3.0 * u);
+  if (x < 1.0e-9)
+    return window;
+  const double px = juce::MathConstants<double>::pi * x;
+  return std::sin(px) / px * window;
+}
+
+// kernel() tabulated for the per-tap path, with a guard entry for the
+// interpolation.
+const std::vector<float> &getKernelTable() {
+  static const std::vector<float> table = [] {
+    std::vector<float> t(kZeroCrossings * kKernelResolution + 2, 0.0f);
+    for (size_t i = 0; i + 2 < t.size(); ++i)
+      t[i] = static_cast<float>(
+          kernel(static_cast<double>(i) / kKernelResolution));
+    return t;
+  }();
+  return table;
+}
+
+// Eight independent accumulators, which the compiler can keep in one vector
+// register.
+float dotProduct(const float *a, const float *b, int n) {
+  float acc[8] = {};
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+    for (int k = 0; k < 8; ++k)
+      acc[k] += a[i + k] * b[i + k];
+
+  float total = 0.0f;
+  for (auto v : acc)
+    total += v;
+  for (; i < n; ++i)
+    total += a[i] * b[i];
+  return total;
+}
+
+bool isWholeNumber(double x) { return std::abs(x - std::round(x)) < 1.0e-9; }
+
+struct Converter {
+  double ratio = 1.0;  // input samples per output sample
+  double cutoff = 1.0; // relative to the input Nyquist frequency
+  int halfTaps = 1;    // taps either side of the output position
+  int taps = 2;
+
+  // Phase table: output n sits at input (n * step) / numPhases, so its
+  // phase is (n * step) % numPhases. Empty when the rates don't allow it.
+  juce::int64 step = 0;
+  int numPhases = 0;
+  std::vector<float> coefficients; // numPhases rows of `taps`
+
+  Converter(double srcRate, double dstRate) {
+    ratio = srcRate / dstRate;
+    cutoff = kCutoff * juce::jmin(1.0, dstRate / srcRate);
+    halfTaps = static_cast<int>(std::ceil(kZeroCrossings / cutoff)) + 1;
+    taps = 2 * halfTaps;
+
+    if (!isWholeNumber(srcRate) || !isWholeNumber(dstRate))
+      return;
+    const auto src = static_cast<juce::int64>(std::round(srcRate));
+    const auto dst = static_cast<juce::int64>(std::round(dstRate));
+    const auto divisor = std::gcd(src, dst);
+    if (dst / divisor > kMaxPhases ||
+        dst / divisor * taps > static_cast<juce::int64>(kMaxTableSize))
+      return;
+
+    step = src / divisor;
+    numPhases = static_cast<int>(dst / divisor);
+    coefficients.resize(static_cast<size_t>(numPhases * taps));
+    for (int p = 0; p < numPhases; ++p)
+      for (int j = 0; j < taps; ++j) {
+        // Distance from the output position to tap j, in input samples.
+        const double d = static_cast<double>(p) / numPhases + halfTaps - 1 - j;
+        coefficients[static_cast<size_t>(p * taps + j)] =
+            static_cast<float>(cutoff * kernel(d * cutoff));
+      }
+  }
+
+  void run(const float *in, int inLen, float *out, int first, int last) const {
+    if (numPhases > 0)
+      runTable(in, inLen, out, first, last);
+    else
+      runDirect(in, inLen, out, first, last);
+  }
+
+  void runTable(const float *in, int inLen, float *out, int first,
+                int last) const {
+    for (int n = first; n < last; ++n) {
+      const juce::int64 position = n * step;
+      const int phase = static_cast<int>(position % numPhases);
+      const int start = static_cast<int>(position / numPhases) - halfTaps + 1;
+      const float *c = coefficients.data() + phase * taps;
+      if (start >= 0 && start + taps <= inLen) {
+        out[n] = dotProduct(c, in + start, taps);
+      } else {
+        // Near either end: the source is silent beyond it.
+        const int j0 = juce::jmax(0, -start);
+        const int j1 = juce::jmin(taps, inLen - start);
+        out[n] = j1 > j0 ? dotProduct(c + j0, in + start + j0, j1 - j0) : 0.0f;
+      }
+    }
+  }
+
+  void runDirect(const float *in, int inLen, float *out, int first,
+                 int last) const {
+    const auto &table = getKernelTable();
+    const float scale = static_cast<float>(cutoff * kKernelResolution);
+    const int limit = kZeroCrossings * kKernelResolution;
+    auto weight = [&](float distance) {
+      const float pos = distance * scale;
+      const int i = static_cast<int>(pos);
+      if (i >= limit)
+        return 0.0f;
+      const float f = pos - static_cast<float>(i);
+      return table[static_cast<size_t>(i)] +
+             f * (table[static_cast<size_t>(i) + 1] -
+                  table[static_cast<size_t>(i)]);
+    };
+
+    for (int n = first; n < last; ++n) {
+      const double t = n * ratio;
+      const int centre = static_cast<int>(t);
+      const float frac = static_cast<float>(t - centre);
+      float sum = 0.0f;
+      // Taps at and before the output position, then after it.
+      for (int m = 0; m < halfTaps && centre - m >= 0; ++m)
+        if (centre - m < inLen)
+          sum += in[centre - m] * weight(frac + static_cast<float>(m));
+      for (int m = 1; m <= halfTaps && centre + m < inLen; ++m)
+        sum += in[centre + m] * weight(static_cast<float>(m) - frac);
+      out[n] = sum * static_cast<float>(cutoff);
+    }
+  }
+};
+} // namespace
+
+//==============================================================================
+bool SincResampler::process(const juce::AudioBuffer<float> &src,
+                            double srcRate, juce::AudioBuffer<float> &dst,
+                            double dstRate,
+                            const std::function<bool()> &shouldStop,
+                            const std::function<void(float)> &progress) {
+  const int numChannels = juce::jmin(src.getNumChannels(),
+                                     dst.getNumChannels());
+  const int srcLen = src.getNumSamples();
+  const int dstLen = dst.getNumSamples();
+  if (numChannels == 0 || dstLen == 0)
+    return true;
+
+  const Converter converter(srcRate, dstRate);
+  const int numTasks = juce::jlimit(1, 8, juce::SystemStats::getNumCpus());
+  const int perTask = (dstLen + numTasks - 1) / numTasks;
+  const auto total = static_cast<juce::int64>(dstLen) * numChannels;
+  std::atomic<juce::int64> done{0};
+  std::atomic<bool> stopped{false};
+
+  JobScheduler::runInParallel(numTasks, [&](int task) {
+    const int first = task * perTask;
+    const int last = juce::jmin(dstLen, first + perTask);
+    for (int pos = first; pos < last; pos += kChunk) {
+      if (stopped.load() || (shouldStop && shouldStop())) {
+        stopped = true;
+        return;
+      }
+      const int end = juce::jmin(last, pos + kChunk);
+      for (int ch = 0; ch < numChannels; ++ch)
+        converter.run(src.getReadPointer(ch), srcLen, dst.getWritePointer(ch),
+                      pos, end);
+      const auto n = done += static_cast<juce::int64>(end - pos) * numChannels;
+      if (progress)
+        progress(static_cast<float>(n) / static_cast<float>(total));
+    }
+  });
+  return !stopped.load();
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <functional>
+#include <juce_audio_basics/juce_audio_basics.h>
+
+//==============================================================================
+/**
+ * Windowed-sinc sample-rate conversion, for when quality matters more than
+ * speed (offline renders).
+ *
+ * The kernel is a sinc under a Blackman-Harris window, 64 zero crossings each
+ * side, low-passing just below the lower of the two Nyquist frequencies. The
+ * passband is flat to within 1e-5, and images / aliases are more than 100 dB
+ * down. There is no delay: output sample n is the source evaluated at
+ * exactly n * srcRate / dstRate. Rates with a small common divisor (all the
+ * usual ones) use a precomputed table per output phase; others evaluate the
+ * kernel per tap, several times slower.
+ *
+ * Much slower than the Lagrange interpolator loads use, so the work is split
+ * across cores.
+ */
+namespace SincResampler {
+// Fills `dst`, which must already have the channels of `src` and the length
+// of `src` at `dstRate`. Returns false if `shouldStop` cancelled it.
+// `shouldStop` and `progress` (0..1) may be called from several threads at
+// once.
+bool process(const juce::AudioBuffer<float> &src, double srcRate,
+             juce::AudioBuffer<float> &dst, double dstRate,
+             const std::function<bool()> &shouldStop = nullptr,
+             const std::function<void(float)> &progress = nullptr);
+} // namespace SincResampler
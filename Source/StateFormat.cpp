@@ -0,0 +1,79 @@
+#include "StateFormat.h"
+#include <cstring>
+
+namespace {
+constexpr char kStateMagic[4] = {'B', 'T', 'T', 'S'};
+constexpr char kAudioChunkId[4] = {'A', 'U', 'D', 'I'};
+constexpr size_t kChunkHeaderSize = 4 + 8;
+} // namespace
+
+void StateFormat::write(const juce::ValueTree &header,
+                        const juce::MemoryBlock *audio,
+                        juce::MemoryBlock &dest) {
+  juce::MemoryOutputStream headerStream;
+  header.writeToStream(headerStream);
+
+  const size_t audioSize = audio != nullptr ? audio->getSize() : 0;
+  const size_t total = 4 + 4 + 4 + headerStream.getDataSize() +
+                       (audioSize > 0 ? kChunkHeaderSize + audioSize : 0);
+
+  // Size the block once up front so the stream never has to grow it.
+  dest.setSize(total);
+  juce::MemoryOutputStream out(dest, false);
+  out.write(kStateMagic, 4);
+  out.writeInt(currentVersion);
+  out.writeInt(static_cast<int>(headerStream.getDataSize()));
+  out.write(headerStream.getData(), headerStream.getDataSize());
+
+  if (audioSize > 0) {
+    out.write(kAudioChunkId, 4);
+    out.writeInt64(static_cast<juce::int64>(audioSize));
+    out.write(audio->getData(), audioSize);
+  }
+}
+
+bool StateFormat::read(const void *data, size_t size, Contents &out) {
+  const auto *bytes = static_cast<const char *>(data);
+
+  if (size < 12 || std::memcmp(bytes, kStateMagic, 4) != 0) {
+    // 2.0.x: the whole state is one ValueTree.
+    out.header = juce::ValueTree::readFromData(data, size);
+    if (!out.header.isValid())
+      return false;
+    if (auto *mb = out.header.getProperty("sampleFlac").getBinaryData()) {
+      out.audio = mb->getData();
+      out.audioSize = mb->getSize();
+    }
+    return true;
+  }
+
+  juce::MemoryInputStream in(data, size, false);
+  in.skipNextBytes(4);
+  const int version = in.readInt();
+  const int headerSize = in.readInt();
+  if (version < 1 || version > currentVersion || headerSize < 0 ||
+      static_cast<size_t>(headerSize) > size - 12)
+    return false;
+
+  out.header = juce::ValueTree::readFromData(bytes + 12,
+                                             static_cast<size_t>(headerSize));
+  if (!out.header.isValid())
+    return false;
+
+  size_t pos = 12 + static_cast<size_t>(headerSize);
+  while (size - pos >= kChunkHeaderSize) {
+    const char *id = bytes + pos;
+    in.setPosition(static_cast<juce::int64>(pos + 4));
+    const auto chunkSize = in.readInt64();
+    pos += kChunkHeaderSize;
+    if (chunkSize < 0 || static_cast<juce::uint64>(chunkSize) > size - pos)
+      return false;
+
+    if (std::memcmp(id, kAudioChunkId, 4) == 0) {
+      out.audio = bytes + pos;
+      out.audioSize = static_cast<size_t>(chunkSize);
+    }
+    pos += static_cast<size_t>(chunkSize);
+  }
+  return true;
+}
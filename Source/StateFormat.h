@@ -0,0 +1,37 @@
+#pragma once
+
+#include <juce_data_structures/juce_data_structures.h>
+
+//==============================================================================
+/**
+ * Layout of the plugin's saved state.
+ *
+ * Current format (little endian):
+ *   "BTTS" | int32 version | int32 headerSize | ValueTree header |
+ *   chunk* where chunk = char[4] id | int64 size | payload
+ *
+ * The header holds the parameters and settings (a few hundred bytes). Bulk
+ * data goes into chunks that are written straight from their owners and read
+ * in place from the host's buffer, so a large embedded track is never copied
+ * through a juce::var. Readers skip chunk ids they don't know.
+ *
+ * States saved by 2.0.x are a bare ValueTree with the audio in a "sampleFlac"
+ * property; read() still accepts them.
+ */
+namespace StateFormat {
+constexpr int currentVersion = 1;
+
+struct Contents {
+  juce::ValueTree header;
+  const void *audio = nullptr; // embedded audio blob, if any
+  size_t audioSize = 0;
+};
+
+// Writes `header` followed by an embedded-audio chunk when `audio` is set.
+void write(const juce::ValueTree &header, const juce::MemoryBlock *audio,
+           juce::MemoryBlock &dest);
+
+// Parses either format. `out.audio` points into `data` (or, for the old
+// format, into `out.header`), so both must outlive any use of it.
+bool read(const void *data, size_t size, Contents &out);
+} // namespace StateFormat
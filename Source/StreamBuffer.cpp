@@ -0,0 +1,217 @@
+#include "StreamBuffer.h"
+#include <algorithm>
+#include <vector>
+
+namespace {
+constexpr int kPollMs = 5; // well under the time a window takes to play
+} // namespace
+
+//==============================================================================
+// One thread serves every StreamBuffer in the process: decoding ahead is a
+// few milliseconds of work every few seconds per playing track.
+class StreamBuffer::Decoder : public juce::Thread {
+public:
+  Decoder() : juce::Thread("BTT stream decoder") {
+    startThread(juce::Thread::Priority::high);
+  }
+  ~Decoder() override { stopThread(-1); }
+
+  void add(StreamBuffer *s) {
+    const juce::ScopedLock sl(lock);
+    streams.push_back(s);
+  }
+  // Waits for a pass that is serving `s` to finish.
+  void remove(StreamBuffer *s) {
+    const juce::ScopedLock sl(lock);
+    streams.erase(std::remove(streams.begin(), streams.end(), s),
+                  streams.end());
+  }
+
+  void run() override {
+    while (!threadShouldExit()) {
+      {
+        const juce::ScopedLock sl(lock);
+        for (auto *s : streams)
+          s->service();
+      }
+      wait(kPollMs);
+    }
+  }
+
+private:
+  juce::CriticalSection lock;
+  std::vector<StreamBuffer *> streams; // guarded by lock
+};
+
+//==============================================================================
+StreamBuffer::StreamBuffer() = default;
+
+StreamBuffer::~StreamBuffer() {
+  const juce::ScopedLock sl(decoderLock);
+  if (decoder != nullptr)
+    (*decoder)->remove(this);
+}
+
+void StreamBuffer::setSource(CompressedAudio::Ptr newSource) {
+  const bool any = newSource != nullptr;
+  {
+    const juce::ScopedLock sl(sourceLock);
+    if (source == newSource)
+      return;
+    source = std::move(newSource);
+  }
+  // Not under sourceLock: a decoder pass takes it while holding its own.
+  const juce::ScopedLock sl(decoderLock);
+  if (decoder == nullptr) {
+    if (!any)
+      return;
+    decoder = std::make_unique<juce::SharedResourcePointer<Decoder>>();
+    (*decoder)->add(this);
+  }
+  (*decoder)->notify();
+}
+
+//==============================================================================
+void StreamBuffer::beginBlock(const CompressedAudio *src,
+                              juce::int64 position) noexcept {
+  blockId = src != nullptr ? src->getId() : 0;
+  playingId.store(blockId);
+  if (blockId == 0)
+    return;
+  playPosition.store(position);
+  for (int i = 0; i < 2; ++i) {
+    int expected = kReady;
+    pinned[i] = windows[i].state.compare_exchange_strong(expected, kPinned);
+  }
+}
+
+void StreamBuffer::endBlock() noexcept {
+  for (int i = 0; i < 2; ++i)
+    if (pinned[i]) {
+      pinned[i] = false;
+      windows[i].state.store(kReady);
+    }
+}
+
+const juce::AudioBuffer<float> *
+StreamBuffer::find(juce::int64 position, juce::int64 &base) const noexcept {
+  const Window *best = nullptr;
+  for (int i = 0; i < 2; ++i) {
+    const auto &w = windows[i];
+    if (!pinned[i] || w.sourceId != blockId)
+      continue;
+    const auto at = position - w.start;
+    const int length = w.audio.getNumSamples();
+    if ((at >= 1 || w.start == 0) &&
+        (at + kGuard < length || (w.reachesEnd && at < length)) &&
+        (best == nullptr ||
+         w.start + length > best->start + best->audio.getNumSamples()))
+      best = &w;
+  }
+  if (best == nullptr)
+    return nullptr;
+  base = best->start;
+  return &best->audio;
+}
+
+//==============================================================================
+void StreamBuffer::service() {
+  CompressedAudio::Ptr src;
+  {
+    const juce::ScopedLock sl(sourceLock);
+    src = source;
+  }
+  if (src != decoding) {
+    reader = nullptr;
+    decoding = src;
+    if (src != nullptr)
+      reader = std::make_unique<CompressedAudio::Reader>(*src);
+  }
+
+  if (src == nullptr) { // let go of the windows once they are unpinned
+    for (auto &w : windows) {
+      int expected = kReady;
+      if (w.capacity > 0 &&
+          (w.state.compare_exchange_strong(expected, kEmpty) ||
+           expected == kEmpty)) {
+        w.audio.setSize(0, 0);
+        w.capacity = 0;
+      }
+    }
+    updateBytes();
+    return;
+  }
+
+  // Nothing to do until the audio thread is on this track.
+  const auto id = src->getId();
+  if (playingId.load() != id)
+    return;
+  const auto position = playPosition.load();
+  const auto rate = src->getSampleRate();
+  const auto hop = static_cast<juce::int64>(kWindowSeconds * rate) / 2;
+  const auto behind = static_cast<juce::int64>(kBehindSeconds * rate);
+
+  // The window playback is in (the one reaching further, if both hold it).
+  int current = -1;
+  for (int i = 0; i < 2; ++i)
+    if (holds(windows[i], id, position) &&
+        (current < 0 || windows[i].start > windows[current].start))
+      current = i;
+
+  if (current < 0) { // a jump, or a new track: start again around it
+    const int target = windows[0].state.load() == kPinned ? 1 : 0;
+    fill(windows[target], juce::jmax<juce::int64>(0, position - behind));
+    return;
+  }
+
+  // Refill the other window a hop on, once the voice is far enough into this
+  // one not to need the audio behind it.
+  const auto &w = windows[current];
+  auto &other = windows[1 - current];
+  const auto next = w.start + hop;
+  if (w.reachesEnd || position < w.start + behind ||
+      (other.sourceId == id && other.start == next &&
+       other.state.load() >= kReady))
+    return;
+  fill(other, next);
+}
+
+bool StreamBuffer::holds(const Window &w, juce::uint32 id,
+                         juce::int64 position) const {
+  return w.state.load() >= kReady && w.sourceId == id &&
+         position >= w.start && position < w.start + w.audio.getNumSamples();
+}
+
+void StreamBuffer::fill(Window &w, juce::int64 start) {
+  int expected = kReady;
+  if (!w.state.compare_exchange_strong(expected, kFilling)) {
+    expected = kEmpty;
+    if (!w.state.compare_exchange_strong(expected, kFilling))
+      return; // pinned for a block; next time round
+  }
+
+  const auto &src = reader->getAudio();
+  const int channels = src.getNumChannels();
+  const int size = static_cast<int>(kWindowSeconds * src.getSampleRate());
+  const int length = static_cast<int>(
+      juce::jlimit<juce::int64>(0, size, src.getNumFrames() - start));
+  if (w.audio.getNumChannels() != channels || w.capacity < size) {
+    w.audio.setSize(channels, size);
+    w.capacity = size;
+  }
+  w.audio.setSize(channels, length, false, false, true);
+  w.sourceId = src.getId();
+  w.start = start;
+  w.reachesEnd = start + length >= src.getNumFrames();
+  const bool ok = length > 0 && reader->read(w.audio, 0, start, length);
+  w.state.store(ok ? kReady : kEmpty);
+  updateBytes();
+}
+
+void StreamBuffer::updateBytes() {
+  juce::int64 bytes = 0;
+  for (const auto &w : windows)
+    bytes += static_cast<juce::int64>(w.audio.getNumChannels()) * w.capacity *
+             static_cast<juce::int64>(sizeof(float));
+  windowBytes = bytes;
+}
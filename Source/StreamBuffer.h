@@ -0,0 +1,107 @@
+#pragma once
+
+#include "CompressedAudio.h"
+#include <atomic>
+#include <memory>
+
+//==============================================================================
+/**
+ * The decoded stretch of a compressed track (see CompressedAudio) that the
+ * audio thread plays from.
+ *
+ * Two windows of kWindowSeconds are decoded by a background thread shared by
+ * every instance, the second starting half a window after the first. Once the
+ * voice has moved into the later one, the earlier one is refilled further on,
+ * so the next few seconds are always decoded ahead of playback. A little
+ * audio is kept behind the play position for short jumps back (a crossfade, a
+ * sync correction). A jump anywhere else waits on the decoder for a moment;
+ * the entry points themselves play from the cue heads meanwhile (see CueSet).
+ *
+ * The audio thread never waits. It pins the windows it may read for the
+ * length of a block (a compare-and-swap each), and the decoder only refills a
+ * window nobody has pinned. It reports where it is through an atomic that the
+ * decoder polls, since waking a thread would mean a system call.
+ *
+ * The decoder thread is started by the first buffer given a source, so
+ * instances that never stream a track don't pay for it.
+ */
+class StreamBuffer {
+public:
+  static constexpr double kWindowSeconds = 6.0;
+  static constexpr double kBehindSeconds = 0.25; // kept behind the voice
+  // Frames a window must reach past the read position, for the interpolator.
+  static constexpr int kGuard = 4;
+
+  StreamBuffer();
+  ~StreamBuffer();
+
+  // The track to decode, or nullptr. Any thread but the audio thread.
+  void setSource(CompressedAudio::Ptr newSource);
+  // Memory held by the windows.
+  juce::int64 getBytes() const noexcept { return windowBytes.load(); }
+
+  // Audio thread --------------------------------------------------------------
+  // Pins the windows decoded from `source` (nullptr = none) for a block, and
+  // tells the decoder where playback is, or would start from.
+  void beginBlock(const CompressedAudio *source, juce::int64 position) noexcept;
+  // Unpins them.
+  void endBlock() noexcept;
+  // A pinned window holding the track from just before `position` to kGuard
+  // frames past it (or to the end of the track), with `base` set to the frame
+  // it starts at. nullptr if none does.
+  const juce::AudioBuffer<float> *find(juce::int64 position,
+                                       juce::int64 &base) const noexcept;
+
+  class ScopedBlock {
+  public:
+    ScopedBlock(StreamBuffer &s, const CompressedAudio *source,
+                juce::int64 position) noexcept
+        : stream(s) {
+      stream.beginBlock(source, position);
+    }
+    ~ScopedBlock() { stream.endBlock(); }
+
+  private:
+    StreamBuffer &stream;
+    JUCE_DECLARE_NON_COPYABLE(ScopedBlock)
+  };
+
+private:
+  class Decoder;
+  enum WindowState { kEmpty, kFilling, kReady, kPinned };
+
+  struct Window {
+    std::atomic<int> state{kEmpty};
+    // Written by the decoder while kFilling, read by anyone once kReady.
+    juce::AudioBuffer<float> audio;
+    juce::uint32 sourceId = 0;
+    juce::int64 start = 0;
+    bool reachesEnd = false; // holds the last frame of the track
+    int capacity = 0;        // frames allocated (decoder only)
+  };
+
+  // Decoder thread.
+  void service();
+  bool holds(const Window &w, juce::uint32 id, juce::int64 position) const;
+  void fill(Window &w, juce::int64 start);
+  void updateBytes();
+
+  juce::CriticalSection sourceLock;
+  CompressedAudio::Ptr source; // guarded by sourceLock
+
+  CompressedAudio::Ptr decoding; // decoder thread only, with `reader`
+  std::unique_ptr<CompressedAudio::Reader> reader;
+  Window windows[2];
+  std::atomic<juce::int64> windowBytes{0};
+
+  std::atomic<juce::uint32> playingId{0};
+  std::atomic<juce::int64> playPosition{0};
+  juce::uint32 blockId = 0;         // audio thread only
+  bool pinned[2] = {false, false}; // ditto
+
+  juce::CriticalSection decoderLock;
+  // guarded by decoderLock; null until the first source
+  std::unique_ptr<juce::SharedResourcePointer<Decoder>> decoder;
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(StreamBuffer)
+};
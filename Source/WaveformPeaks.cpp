@@ -0,0 +1,118 @@
+#include "WaveformPeaks.h"
+
+namespace {
+// Sidecar layout (little endian):
+//   "BTTP" | int32 version | int32 samplesPerPeak | int32 numSourceSamples |
+//   int64 key | int32 numPeaks | uint8 peaks[numPeaks]
+constexpr char kPeakFileMagic[4] = {'B', 'T', 'T', 'P'};
+constexpr int kPeakFileVersion = 2; // 1 was keyed by a hash of the audio
+constexpr int kPeaksPerChunk = 1024; // progress granularity while scanning
+} // namespace
+
+WaveformPeaks::WaveformPeaks(int numSamples)
+    : numSourceSamples(juce::jmax(0, numSamples)),
+      peaks(static_cast<size_t>((numSourceSamples + samplesPerPeak - 1) /
+                                samplesPerPeak),
+            0) {}
+
+float WaveformPeaks::getMaxInRange(int first, int last) const noexcept {
+  first = juce::jmax(0, first);
+  last = juce::jmin(last, getNumReady());
+
+  juce::uint8 maxVal = 0;
+  for (int i = first; i < last; ++i)
+    maxVal = juce::jmax(maxVal, peaks[static_cast<size_t>(i)]);
+  return static_cast<float>(maxVal) / 255.0f;
+}
+
+bool WaveformPeaks::compute(const juce::AudioBuffer<float> &source,
+                            const std::function<bool()> &shouldStop) {
+  const int numChannels = source.getNumChannels();
+  const int numSamples = juce::jmin(numSourceSamples, source.getNumSamples());
+  const int numPeaks = getNumPeaks();
+
+  for (int first = getNumReady(); first < numPeaks; first += kPeaksPerChunk) {
+    if (shouldStop())
+      return false;
+
+    const int last = juce::jmin(first + kPeaksPerChunk, numPeaks);
+    for (int i = first; i < last; ++i) {
+      const int start = i * samplesPerPeak;
+      const int len = juce::jmin(samplesPerPeak, numSamples - start);
+
+      float magnitude = 0.0f;
+      for (int ch = 0; ch < numChannels && len > 0; ++ch) {
+        const auto range = juce::FloatVectorOperations::findMinAndMax(
+            source.getReadPointer(ch, start), len);
+        magnitude = juce::jmax(magnitude, -range.getStart(), range.getEnd());
+      }
+
+      // Round up so quiet-but-not-silent material stays visible.
+      peaks[static_cast<size_t>(i)] = static_cast<juce::uint8>(
+          juce::jlimit(0, 255, static_cast<int>(std::ceil(magnitude * 255.0f))));
+    }
+    numReady.store(last, std::memory_order_release);
+  }
+  return true;
+}
+
+bool WaveformPeaks::loadFromFile(const juce::File &file, juce::uint64 key) {
+  juce::FileInputStream in(file);
+  return in.openedOk() && load(in, key);
+}
+
+bool WaveformPeaks::load(juce::InputStream &in, juce::uint64 key) {
+  char magic[4] = {};
+  if (in.read(magic, 4) != 4 || std::memcmp(magic, kPeakFileMagic, 4) != 0)
+    return false;
+
+  if (in.readInt() != kPeakFileVersion || in.readInt() != samplesPerPeak ||
+      in.readInt() != numSourceSamples ||
+      static_cast<juce::uint64>(in.readInt64()) != key ||
+      in.readInt() != getNumPeaks())
+    return false;
+
+  const int numPeaks = getNumPeaks();
+  if (in.read(peaks.data(), numPeaks) != numPeaks)
+    return false;
+
+  numReady.store(numPeaks, std::memory_order_release);
+  return true;
+}
+
+bool WaveformPeaks::saveToFile(const juce::File &file,
+                               juce::uint64 key) const {
+  if (!isComplete() || !file.getParentDirectory().createDirectory().wasOk())
+    return false;
+
+  // Write to a temporary first so a concurrent reader (another instance
+  // opening the same track) never sees a half-written file.
+  juce::TemporaryFile temp(file);
+  {
+    juce::FileOutputStream out(temp.getFile());
+    if (!out.openedOk())
+      return false;
+
+    out.write(kPeakFileMagic, 4);
+    out.writeInt(kPeakFileVersion);
+    out.writeInt(samplesPerPeak);
+    out.writeInt(numSourceSamples);
+    out.writeInt64(static_cast<juce::int64>(key));
+    out.writeInt(getNumPeaks());
+    out.write(peaks.data(), peaks.size());
+    out.flush();
+  }
+  return temp.overwriteTargetFileWithTemporary();
+}
+
+juce::File WaveformPeaks::getCacheFile(juce::uint64 key) {
+  auto dir = juce::File::getSpecialLocation(
+      juce::File::userApplicationDataDirectory);
+#if JUCE_MAC
+  dir = dir.getChildFile("Caches");
+#endif
+  return dir.getChildFile("BackingTrackTrigger")
+      .getChildFile("Peaks")
+      .getChildFile(juce::String::toHexString(static_cast<juce::int64>(key)) +
+                    ".peaks");
+}
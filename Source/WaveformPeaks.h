@@ -0,0 +1,56 @@
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <juce_audio_formats/juce_audio_formats.h>
+
+//==============================================================================
+/**
+ * Overview peaks for a loaded sample: one byte per `samplesPerPeak` source
+ * frames, holding the largest magnitude across all channels.
+ *
+ * Peaks are filled in from the start of the track by a background job, so the
+ * waveform can be drawn while they are still being computed: getNumReady()
+ * only ever grows, and every peak below it is final. Finished peaks are written
+ * to a small versioned sidecar file in the cache directory, keyed by where the
+ * audio came from (see SampleBuffer::getPeaksKey()), so reopening the same
+ * track skips the scan entirely.
+ */
+class WaveformPeaks : public juce::ReferenceCountedObject {
+public:
+  using Ptr = juce::ReferenceCountedObjectPtr<WaveformPeaks>;
+
+  static constexpr int samplesPerPeak = 256;
+
+  explicit WaveformPeaks(int numSourceSamples);
+
+  int getNumPeaks() const noexcept { return static_cast<int>(peaks.size()); }
+  int getNumReady() const noexcept {
+    return numReady.load(std::memory_order_acquire);
+  }
+  bool isComplete() const noexcept { return getNumReady() == getNumPeaks(); }
+
+  // Largest magnitude (0..1) over peaks [first, last). Peaks that are not
+  // ready yet read as silence.
+  float getMaxInRange(int first, int last) const noexcept;
+
+  // Background side -----------------------------------------------------------
+  // Scans `source` from the first peak not yet computed. Returns false if
+  // `shouldStop` asked it to give up part-way.
+  bool compute(const juce::AudioBuffer<float> &source,
+               const std::function<bool()> &shouldStop);
+
+  bool loadFromFile(const juce::File &file, juce::uint64 key);
+  bool load(juce::InputStream &in, juce::uint64 key);
+  bool saveToFile(const juce::File &file, juce::uint64 key) const;
+
+  // Where the sidecar for a given key lives.
+  static juce::File getCacheFile(juce::uint64 key);
+
+private:
+  const int numSourceSamples;
+  std::vector<juce::uint8> peaks;
+  std::atomic<int> numReady{0};
+
+  JUCE_DECLARE_NON_COPYABLE_WITH_LEAK_DETECTOR(WaveformPeaks)
+};
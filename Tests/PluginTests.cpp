@@ -7,11 +7,37 @@
 //  - gain parameter scales the output
 //  - state round-trip by file path
 //  - state round-trip with embedded audio (survives the source file vanishing)
+//  - background embed encoding, its reuse, and the multi-segment format
+//  - chunked state format, and restoring 2.0.x ValueTree states
+//  - asynchronous state restore and notes that arrive while it runs
+//  - the job scheduler and its forked sub-jobs, and cancelling a load that
+//    is superseded
+//  - memory budget eviction, and bringing the audio back on a note
+//  - the page-locked playback window
+//  - real-time safety: processBlock() never allocates, locks or blocks
+//  - restoring a state over the same audio skips the reload
+//  - background waveform peaks and their sidecar cache
+//  - playhead extrapolation between audio blocks
+//  - silence / onset / tempo analysis and auto-trim
+//  - loudness (LUFS, true peak, DC offset) and normalization
+//  - offline (non-realtime) rendering and windowed-sinc resampling
+//  - following the host position: drift correction and crossfaded jumps
+//  - cues: their own notes, saving them, and playing from their heads
+//  - setlists: preloading the next track, gapless steps, per-track offsets
+//    and cues
+//  - varispeed: following the host tempo, gliding, and staying in sync
+//  - compressed storage: streaming a FLAC track ahead of the playhead
+//  - instantiation: many instances, and no threads until one is used
+//  - the shared I/O scheduler: deadline order, coalescing and streams
 //
 // Built only when BTT_BUILD_TESTS=ON. Returns non-zero if any check fails.
 
 #include "../Source/PluginProcessor.h"
+#include "../Source/StateFormat.h"
+#include "RealtimeChecker.h"
 #include <juce_audio_utils/juce_audio_utils.h>
+#include <algorithm>
+#include <thread>
 
 namespace {
 int failures = 0;
@@ -26,10 +52,13 @@ void check(bool condition, const juce::String &what) {
 }
 
 // Write a stereo sine sweep to a WAV file at the given rate; return the file.
-juce::File makeTestWav(double sampleRate, double seconds) {
+// Files that live alongside another at the same rate need their own `tag`,
+// or they overwrite (and later delete) its file.
+juce::File makeTestWav(double sampleRate, double seconds,
+                       const juce::String &tag = {}) {
   auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
                   .getChildFile("btt_test_" + juce::String((int)sampleRate) +
-                                ".wav");
+                                (tag.isEmpty() ? "" : "_" + tag) + ".wav");
   file.deleteFile();
 
   const int numSamples = (int)(sampleRate * seconds);
@@ -53,6 +82,70 @@ juce::File makeTestWav(double sampleRate, double seconds) {
   return file;
 }
 
+// Write a mono click track: `leadIn` seconds of silence, then 20 ms tone
+// bursts every beat at `bpm` until `seconds`.
+juce::File makeClickTrackWav(double sampleRate, double seconds, double leadIn,
+                             double bpm) {
+  auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                  .getChildFile("btt_test_clicks.wav");
+  file.deleteFile();
+
+  const int numSamples = (int)(sampleRate * seconds);
+  const int clickLen = (int)(sampleRate * 0.02);
+  juce::AudioBuffer<float> clicks(1, numSamples);
+  clicks.clear();
+  for (double t = leadIn; t < seconds; t += 60.0 / bpm) {
+    const int start = (int)(t * sampleRate);
+    for (int i = 0; i < clickLen && start + i < numSamples; ++i)
+      clicks.setSample(0, start + i,
+                       0.8f * std::sin(juce::MathConstants<float>::twoPi *
+                                       1000.0f * (float)i / (float)sampleRate));
+  }
+
+  juce::WavAudioFormat wav;
+  if (auto *os = file.createOutputStream().release()) {
+    std::unique_ptr<juce::AudioFormatWriter> writer(
+        wav.createWriterFor(os, sampleRate, 1, 16, {}, 0));
+    if (writer != nullptr)
+      writer->writeFromAudioSampleBuffer(clicks, 0, numSamples);
+    else
+      delete os;
+  }
+  return file;
+}
+
+// Polls `condition` until it holds or `timeoutMs` elapses.
+bool waitFor(const std::function<bool()> &condition, int timeoutMs = 5000) {
+  const auto deadline = juce::Time::getMillisecondCounter() + (juce::uint32)timeoutMs;
+  while (!condition()) {
+    if (juce::Time::getMillisecondCounter() > deadline)
+      return false;
+    juce::Thread::sleep(5);
+  }
+  return true;
+}
+
+// Waits for a background loadSample() / setStateInformation() to finish.
+bool waitUntilLoaded(const BackingTrackTriggerProcessor &p) {
+  return waitFor([&] { return !p.isLoading(); }, 10000);
+}
+
+// A host transport the tests can move between blocks.
+struct TestPlayHead : public juce::AudioPlayHead {
+  juce::Optional<PositionInfo> getPosition() const override {
+    PositionInfo info;
+    info.setIsPlaying(playing);
+    info.setTimeInSamples(timeInSamples);
+    if (bpm > 0.0)
+      info.setBpm(bpm);
+    return info;
+  }
+
+  bool playing = false;
+  juce::int64 timeInSamples = 0;
+  double bpm = 0.0; // 0 = not reported
+};
+
 // Render `numBlocks` blocks, triggering a note in the first block. Returns the
 // peak magnitude seen across all blocks and flags any non-finite sample.
 float renderTriggered(BackingTrackTriggerProcessor &p, double rate,
@@ -85,6 +178,8 @@ float renderTriggered(BackingTrackTriggerProcessor &p, double rate,
 int main() {
   juce::ScopedJuceInitialiser_GUI juceInit;
   juce::Logger::writeToLog("=== BackingTrackTrigger unit tests ===");
+  // The budget tests change its settings: keep the user's file out of it.
+  MemoryBudget::setSettingsFileEnabled(false);
 
   const double hostRate = 44100.0;
   const int blockSize = 512;
@@ -95,6 +190,7 @@ int main() {
     BackingTrackTriggerProcessor p;
     p.prepareToPlay(hostRate, blockSize);
     p.loadSample(wav48);
+    waitUntilLoaded(p);
 
     check(p.hasSampleLoaded(), "sample loads");
     check(std::abs(p.getOriginalSampleRate() - 48000.0) < 1.0,
@@ -109,6 +205,7 @@ int main() {
     BackingTrackTriggerProcessor p;
     p.prepareToPlay(hostRate, blockSize);
     p.loadSample(wav48);
+    waitUntilLoaded(p);
 
     bool finite = false;
     const float peak = renderTriggered(p, hostRate, blockSize, 8, finite);
@@ -123,6 +220,7 @@ int main() {
     BackingTrackTriggerProcessor p;
     p.prepareToPlay(hostRate, blockSize);
     p.loadSample(wav48);
+    waitUntilLoaded(p);
 
     if (auto *gain = p.apvts.getParameter("gain"))
       gain->setValueNotifyingHost(
@@ -137,6 +235,7 @@ int main() {
     BackingTrackTriggerProcessor p2;
     p2.prepareToPlay(hostRate, blockSize);
     p2.loadSample(wav48);
+    waitUntilLoaded(p2);
     const float loud = renderTriggered(p2, hostRate, blockSize, 8, finite);
 
     check(quiet < loud, "-12 dB gain is quieter than 0 dB");
@@ -147,6 +246,7 @@ int main() {
     BackingTrackTriggerProcessor a;
     a.prepareToPlay(hostRate, blockSize);
     a.loadSample(wav48);
+    waitUntilLoaded(a);
     a.setStartOffsetSeconds(0.25);
 
     juce::MemoryBlock state;
@@ -155,6 +255,7 @@ int main() {
     BackingTrackTriggerProcessor b;
     b.prepareToPlay(hostRate, blockSize);
     b.setStateInformation(state.getData(), (int)state.getSize());
+    waitUntilLoaded(b);
 
     check(b.hasSampleLoaded(), "state restore reloads sample from path");
     check(std::abs(b.getStartOffsetSeconds() - 0.25) < 0.01,
@@ -168,6 +269,7 @@ int main() {
     BackingTrackTriggerProcessor a;
     a.prepareToPlay(hostRate, blockSize);
     a.loadSample(wavTemp);
+    waitUntilLoaded(a);
     a.setEmbedEnabled(true);
 
     juce::MemoryBlock state;
@@ -178,6 +280,7 @@ int main() {
     BackingTrackTriggerProcessor b;
     b.prepareToPlay(hostRate, blockSize);
     b.setStateInformation(state.getData(), (int)state.getSize());
+    waitUntilLoaded(b);
 
     check(b.hasSampleLoaded(),
           "embedded audio restores even after the source file is deleted");
@@ -187,6 +290,1339 @@ int main() {
     check(peak > 0.1f && finite, "embedded sample plays back correctly");
   }
 
+  // --- Background embed encoding ---------------------------------------------
+  {
+    BackingTrackTriggerProcessor a;
+    a.prepareToPlay(hostRate, blockSize);
+    a.loadSample(wav48);
+    waitUntilLoaded(a);
+    a.setEmbedSettings({8, 1});
+    a.setEmbedEnabled(true);
+
+    auto sample = a.getSample();
+    check(sample != nullptr && sample->embedded != nullptr &&
+              waitFor([&] {
+                return sample->embedded->hasEncoded(a.getEmbedSettings());
+              }),
+          "enabling embed encodes in the background");
+
+    juce::MemoryBlock first, second;
+    a.getStateInformation(first);
+    a.getStateInformation(second);
+    check(first == second, "repeated saves reuse the cached encoding");
+
+    BackingTrackTriggerProcessor b;
+    b.prepareToPlay(hostRate, blockSize);
+    b.setStateInformation(first.getData(), (int)first.getSize());
+    waitUntilLoaded(b);
+    check(b.getEmbedSettings() == a.getEmbedSettings(),
+          "embed settings survive the state round-trip");
+    auto restored = b.getSample();
+    check(restored != nullptr && restored->embedded != nullptr &&
+              restored->embedded->hasEncoded(b.getEmbedSettings()),
+          "restored embedded audio is not re-encoded");
+
+    // Long enough to be split into segments and encoded in parallel.
+    const double rate = 8000.0;
+    juce::AudioBuffer<float> longTone(2, (int)(rate * 35.0));
+    for (int ch = 0; ch < 2; ++ch)
+      for (int i = 0; i < longTone.getNumSamples(); ++i)
+        longTone.setSample(ch, i,
+                           0.5f * std::sin((float)i * 0.05f + (float)ch));
+
+    const auto plain = EmbeddedAudio::encode(longTone, rate, 16, {}, nullptr);
+    check(plain.getSize() > 4 && std::memcmp(plain.getData(), "fLaC", 4) == 0,
+          "default settings write a plain FLAC stream");
+
+    const auto blob =
+        EmbeddedAudio::encode(longTone, rate, 16, {5, 3}, nullptr);
+    check(blob.getSize() > 4 && std::memcmp(blob.getData(), "BTTC", 4) == 0,
+          "multi-threaded encoding writes the segmented format");
+
+    juce::AudioBuffer<float> decoded;
+    double decodedRate = 0.0;
+    int decodedBits = 0;
+    const bool ok = EmbeddedAudio::decode(blob.getData(), blob.getSize(),
+                                          decoded, decodedRate, decodedBits);
+    float maxError = 0.0f;
+    if (ok && decoded.getNumSamples() == longTone.getNumSamples())
+      for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < decoded.getNumSamples(); ++i)
+          maxError = juce::jmax(maxError, std::abs(decoded.getSample(ch, i) -
+                                                   longTone.getSample(ch, i)));
+    check(ok && decodedRate == rate &&
+              decoded.getNumSamples() == longTone.getNumSamples() &&
+              maxError < 1.0e-4f,
+          "segmented encoding decodes back to the same audio");
+  }
+
+  // --- Compact (Ogg Vorbis) embedding ----------------------------------------
+  {
+    const double rate = 44100.0;
+    juce::AudioBuffer<float> tone(2, (int)(rate * 5.0));
+    for (int ch = 0; ch < 2; ++ch)
+      for (int i = 0; i < tone.getNumSamples(); ++i)
+        tone.setSample(ch, i, 0.5f * std::sin((float)i * 0.05f + (float)ch));
+
+    EmbeddedAudio::Settings vorbis;
+    vorbis.numThreads = 1;
+    vorbis.codec = EmbeddedAudio::Codec::oggVorbis;
+    const auto lossy = EmbeddedAudio::encode(tone, rate, 16, vorbis, nullptr);
+    const auto lossless =
+        EmbeddedAudio::encode(tone, rate, 16, {5, 1}, nullptr);
+    check(lossy.getSize() > 4 && std::memcmp(lossy.getData(), "OggS", 4) == 0 &&
+              lossy.getSize() < lossless.getSize(),
+          "Vorbis embedding writes a smaller Ogg stream than FLAC");
+
+    juce::AudioBuffer<float> decoded;
+    double decodedRate = 0.0;
+    int decodedBits = 0;
+    const bool ok = EmbeddedAudio::decode(lossy.getData(), lossy.getSize(),
+                                          decoded, decodedRate, decodedBits);
+    double errorEnergy = 0.0;
+    const int n = juce::jmin(decoded.getNumSamples(), tone.getNumSamples());
+    for (int ch = 0; ok && ch < 2; ++ch)
+      for (int i = 0; i < n; ++i) {
+        const double e = decoded.getSample(ch, i) - tone.getSample(ch, i);
+        errorEnergy += e * e;
+      }
+    const double rmsError = std::sqrt(errorEnergy / juce::jmax(1, 2 * n));
+    check(ok && decodedRate == rate &&
+              decoded.getNumSamples() == tone.getNumSamples() &&
+              rmsError < 0.02,
+          "Vorbis embedding decodes to a close copy of the audio");
+
+    BackingTrackTriggerProcessor a;
+    a.prepareToPlay(hostRate, blockSize);
+    a.loadSample(wav48);
+    waitUntilLoaded(a);
+    a.setEmbedSettings(vorbis);
+    a.setEmbedEnabled(true);
+    juce::MemoryBlock state;
+    a.getStateInformation(state);
+
+    BackingTrackTriggerProcessor b;
+    b.prepareToPlay(hostRate, blockSize);
+    b.setStateInformation(state.getData(), (int)state.getSize());
+    waitUntilLoaded(b);
+    auto restored = b.getSample();
+    check(b.getEmbedSettings() == vorbis && restored != nullptr &&
+              restored->embedded->hasEncoded(vorbis),
+          "the embed codec is saved and a Vorbis state restores");
+
+    // The decoded audio isn't the original, but it keeps the saved hash.
+    b.setStateInformation(state.getData(), (int)state.getSize());
+    check(!b.isLoading() && b.getSample() == restored,
+          "restoring the same Vorbis state again doesn't decode it again");
+
+    bool finite = false;
+    const float peak = renderTriggered(b, hostRate, blockSize, 4, finite);
+    check(peak > 0.1f && finite, "Vorbis-embedded sample plays back");
+  }
+
+  // --- Chunked state format + 2.0.x compatibility ---------------------------
+  {
+    BackingTrackTriggerProcessor a;
+    a.prepareToPlay(hostRate, blockSize);
+    a.loadSample(wav48);
+    waitUntilLoaded(a);
+    a.setEmbedEnabled(true);
+    a.setStartOffsetSeconds(0.25);
+
+    juce::MemoryBlock state;
+    a.getStateInformation(state);
+    check(state.getSize() > 4 && std::memcmp(state.getData(), "BTTS", 4) == 0,
+          "state is written in the chunked format");
+
+    // A state as 2.0.x wrote it: one ValueTree with the FLAC as a property.
+    auto sample = a.getSample();
+    auto legacyTree = a.apvts.copyState();
+    legacyTree.setProperty("embedSample", true, nullptr);
+    legacyTree.setProperty("sampleName", "legacy.wav", nullptr);
+    if (sample != nullptr)
+      legacyTree.setProperty(
+          "sampleFlac",
+          juce::var(EmbeddedAudio::encode(sample->source,
+                                          sample->sourceSampleRate, 16,
+                                          {5, 1}, nullptr)),
+          nullptr);
+    juce::MemoryOutputStream legacy;
+    legacyTree.writeToStream(legacy);
+
+    BackingTrackTriggerProcessor b;
+    b.prepareToPlay(hostRate, blockSize);
+    b.setStateInformation(legacy.getData(), (int)legacy.getDataSize());
+    waitUntilLoaded(b);
+    check(b.hasSampleLoaded() && b.getSampleName() == "legacy.wav" &&
+              std::abs(b.getStartOffsetSeconds() - 0.25) < 0.01,
+          "2.0.x ValueTree states still restore");
+
+    BackingTrackTriggerProcessor c;
+    c.prepareToPlay(hostRate, blockSize);
+    c.setStateInformation(state.getData(), (int)state.getSize() / 2);
+    check(!c.hasSampleLoaded(), "a truncated state is rejected");
+  }
+
+  // --- Asynchronous restore + late join --------------------------------------
+  {
+    auto longWav = makeTestWav(48000.0, 60.0, "long");
+    juce::MemoryBlock state;
+    {
+      BackingTrackTriggerProcessor a;
+      a.prepareToPlay(hostRate, blockSize);
+      a.loadSample(longWav);
+      waitUntilLoaded(a);
+      a.setEmbedEnabled(true);
+      a.setStartOffsetSeconds(0.5);
+      a.getStateInformation(state);
+    }
+    longWav.deleteFile();
+
+    BackingTrackTriggerProcessor b;
+    b.prepareToPlay(hostRate, blockSize);
+    b.setStateInformation(state.getData(), (int)state.getSize());
+    check(b.isLoading() && !b.hasSampleLoaded(),
+          "setStateInformation returns before the audio is decoded");
+    check(std::abs(b.getStartOffsetSeconds() - 0.5) < 0.01,
+          "parameters are applied immediately");
+
+    // A note during loading: render until the audio arrives, then one more.
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    int blocks = 0;
+    bool playedAfterLoad = false;
+    const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+    while (!playedAfterLoad && juce::Time::getMillisecondCounter() < deadline) {
+      const bool loadedBefore = b.hasSampleLoaded();
+      juce::MidiBuffer midi;
+      if (blocks == 0)
+        midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8)100), 0);
+      buffer.clear();
+      b.processBlock(buffer, midi);
+      ++blocks;
+      playedAfterLoad = loadedBefore;
+      if (!loadedBefore)
+        juce::Thread::sleep(1);
+    }
+    check(playedAfterLoad && blocks > 2, "audio arrives after a few blocks");
+    check(b.isPlaying() && b.getPlayheadSnapshot().position ==
+                               (int64_t)(0.5 * hostRate) +
+                                   (int64_t)blocks * blockSize,
+          "a note sent while loading joins late, in sync with the score");
+  }
+
+  // --- Job scheduler: priorities, cancellation, progress --------------------
+  {
+    JobScheduler scheduler(1);
+    juce::WaitableEvent gate(true);
+    scheduler.schedule("gate", JobScheduler::Priority::interactive,
+                       [&](JobScheduler::Job &) { gate.wait(); });
+    waitFor([&] { return scheduler.getNumQueued() == 0; });
+
+    juce::StringArray order;
+    auto record = [&](const char *name) {
+      return [&order, name](JobScheduler::Job &job) {
+        order.add(name);
+        job.setProgress(1.0f);
+      };
+    };
+    auto low = scheduler.schedule("low", JobScheduler::Priority::background,
+                                  record("low"));
+    scheduler.schedule("normal", JobScheduler::Priority::normal,
+                       record("normal"));
+    auto dropped = scheduler.schedule(
+        "dropped", JobScheduler::Priority::interactive, record("dropped"));
+    scheduler.schedule("high", JobScheduler::Priority::interactive,
+                       record("high"));
+    scheduler.cancel(dropped);
+    check(dropped->isFinished(), "cancelling a queued job drops it at once");
+
+    gate.signal();
+    check(low->waitUntilFinished(5000) &&
+              order.joinIntoString(",") == "high,normal,low" &&
+              low->getProgress() == 1.0f,
+          "jobs run by priority and report progress");
+
+    auto spinning = scheduler.schedule(
+        "spin", JobScheduler::Priority::normal, [](JobScheduler::Job &job) {
+          while (!job.isCancelled())
+            juce::Thread::sleep(1);
+        });
+    waitFor([&] { return scheduler.getNumQueued() == 0; });
+    scheduler.cancel(spinning);
+    check(spinning->waitUntilFinished(5000),
+          "a running job stops when cancelled");
+
+    // Jobs that fork more pieces than there are workers, all at once.
+    JobGroup group;
+    std::vector<std::atomic<int>> runs(4 * 16);
+    juce::ReferenceCountedArray<JobScheduler::Job> forking;
+    for (int j = 0; j < 4; ++j)
+      forking.add(group.schedule(
+          "fork", JobScheduler::Priority::normal,
+          [&runs, j](JobScheduler::Job &) {
+            JobScheduler::runInParallel(
+                16, [&runs, j](int i) { ++runs[(size_t)(j * 16 + i)]; });
+          }));
+    bool allDone = true;
+    for (auto *job : forking)
+      allDone = job->waitUntilFinished(5000) && allDone;
+    check(allDone && std::all_of(runs.begin(), runs.end(),
+                                 [](const auto &n) { return n == 1; }),
+          "forked pieces run once each, without starving the pool");
+  }
+
+  // --- A superseded load is cancelled, not finished and thrown away ---------
+  {
+    auto longWav = makeTestWav(32000.0, 120.0);
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    const auto generation = p.getSampleGeneration();
+
+    const auto started = juce::Time::getMillisecondCounterHiRes();
+    p.loadSample(longWav);
+    check(p.isLoading() && !p.hasSampleLoaded(),
+          "loadSample returns before the file is read");
+    p.loadSample(wav48);
+    waitUntilLoaded(p);
+    const auto elapsedMs = juce::Time::getMillisecondCounterHiRes() - started;
+
+    check(p.getSampleName() == wav48.getFileName() &&
+              p.getSampleGeneration() == generation + 1,
+          "only the newest load is published");
+    juce::Logger::writeToLog("  (superseded load + new load took " +
+                             juce::String(elapsedMs, 1) + " ms)");
+    longWav.deleteFile();
+  }
+
+  // --- Memory budget: idle audio is evicted and comes back when needed -------
+  {
+    auto tempWav = makeTestWav(48000.0, 2.0, "evict");
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(tempWav);
+    waitUntilLoaded(p);
+    const auto hash = p.getSample()->getContentHash();
+    const juce::AudioBuffer<float> original(p.getSample()->source);
+    // Neither the file nor an embedded copy can bring it back, so eviction
+    // first has to keep a lossless copy in memory.
+    tempWav.deleteFile();
+
+    auto &budget = p.getMemoryBudget();
+    const auto oldSetting = budget.getLimitSetting();
+    budget.setLimitSetting(1); // everything idle has to go
+    check(waitFor([&] { return p.isEvicted(); }, 15000) &&
+              !p.hasSampleLoaded(),
+          "idle audio is evicted when over the memory budget");
+
+    juce::MemoryBlock state;
+    p.getStateInformation(state);
+    StateFormat::Contents saved;
+    check(StateFormat::read(state.getData(), state.getSize(), saved) &&
+              saved.header.getProperty("sampleName").toString() ==
+                  tempWav.getFileName() &&
+              (juce::uint64)(juce::int64)saved.header.getProperty(
+                  "sampleHash") == hash,
+          "an evicted sample is still saved");
+
+    // A note while evicted brings the audio back and joins late.
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    int blocks = 0;
+    const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+    while (!p.hasSampleLoaded() &&
+           juce::Time::getMillisecondCounter() < deadline) {
+      juce::MidiBuffer midi;
+      if (blocks++ == 0)
+        midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8)100), 0);
+      buffer.clear();
+      p.processBlock(buffer, midi);
+      juce::Thread::sleep(1);
+    }
+    buffer.clear();
+    juce::MidiBuffer none;
+    p.processBlock(buffer, none);
+    bool identical = p.hasSampleLoaded() && !p.isEvicted() &&
+                     p.getSample()->source.getNumSamples() ==
+                         original.getNumSamples();
+    for (int ch = 0; identical && ch < original.getNumChannels(); ++ch)
+      identical = std::memcmp(p.getSample()->source.getReadPointer(ch),
+                              original.getReadPointer(ch),
+                              sizeof(float) *
+                                  (size_t)original.getNumSamples()) == 0;
+    check(identical, "a note rehydrates the exact audio");
+    check(p.isPlaying(), "the note that woke it joins late");
+
+    budget.setLimitSetting(oldSetting);
+  }
+
+  // --- Playback memory lock: a prefaulted window ahead of the playhead ------
+  {
+    constexpr juce::int64 window = 1 << 20;
+    const juce::int64 slack = 4 * juce::SystemStats::getPageSize();
+    SampleBuffer::Ptr big(new SampleBuffer());
+    big->audio.setSize(2, 48000 * 30);
+    PageLock lock;
+    lock.update(big->audio, big.get(), 0, -1, window);
+    const auto first = lock.getStats();
+    check(first.windowBytes >= window && first.windowBytes <= window + slack &&
+              (first.lockedBytes == first.windowBytes || first.lockRefused),
+          "the locked window stays within its limit");
+    lock.update(big->audio, big.get(), 48000 * 30 - 1000, 0, window);
+    check(lock.getStats().windowBytes >= window,
+          "near the end, a looping window wraps to the loop start");
+    lock.release();
+    check(lock.getStats().lockedBytes == 0 && big->getReferenceCount() == 1,
+          "release unlocks and lets go of the sample");
+
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(wav48);
+    waitUntilLoaded(p);
+    auto &budget = p.getMemoryBudget();
+    const bool wasLocking = budget.isPlaybackLockEnabled();
+    budget.setPlaybackLockEnabled(true);
+    check(waitFor([&] { return p.getPageLockStats().windowBytes > 0; }),
+          "turning the lock on prefaults the loaded audio");
+    budget.setPlaybackLockEnabled(false);
+    check(waitFor([&] { return p.getPageLockStats().windowBytes == 0; }),
+          "turning it off unlocks it again");
+    budget.setPlaybackLockEnabled(wasLocking);
+  }
+
+  // --- Repeated restores of the same audio are parameter-only ---------------
+  {
+    BackingTrackTriggerProcessor a;
+    a.prepareToPlay(hostRate, blockSize);
+    a.loadSample(wav48);
+    waitUntilLoaded(a);
+    a.setEmbedEnabled(true);
+
+    juce::MemoryBlock before;
+    a.getStateInformation(before);
+    const auto loaded = a.getSample();
+
+    if (auto *gain = a.apvts.getParameter("gain"))
+      gain->setValueNotifyingHost(
+          a.apvts.getParameterRange("gain").convertTo0to1(-12.0f));
+
+    // "Undo" the gain change.
+    a.setStateInformation(before.getData(), (int)before.getSize());
+    check(!a.isLoading() && a.getSample() == loaded,
+          "undo over embedded audio reuses the loaded sample");
+    check(std::abs(a.apvts.getRawParameterValue("gain")->load()) < 0.01f,
+          "undo still restores the parameters");
+
+    // By path: reused while the file is unchanged, reloaded once it changes.
+    a.setEmbedEnabled(false);
+    juce::MemoryBlock byPath;
+    a.getStateInformation(byPath);
+    a.setStateInformation(byPath.getData(), (int)byPath.getSize());
+    check(!a.isLoading() && a.getSample() == loaded,
+          "path state over the unchanged file reuses the loaded sample");
+
+    wav48.setLastModificationTime(juce::Time::getCurrentTime() +
+                                  juce::RelativeTime::hours(1));
+    a.setStateInformation(byPath.getData(), (int)byPath.getSize());
+    waitUntilLoaded(a);
+    check(a.hasSampleLoaded() && a.getSample() != loaded,
+          "a file modified since the save is reloaded");
+  }
+
+  // --- Background waveform peaks + sidecar cache -----------------------------
+  {
+    BackingTrackTriggerProcessor a;
+    a.prepareToPlay(hostRate, blockSize);
+    a.loadSample(wav48);
+    waitUntilLoaded(a);
+
+    auto sample = a.getSample();
+    check(sample != nullptr && sample->peaks != nullptr,
+          "loaded sample has a peak overview");
+
+    if (sample != nullptr && sample->peaks != nullptr) {
+      const auto &peaks = *sample->peaks;
+      check(waitFor([&] { return peaks.isComplete(); }),
+            "peaks are computed in the background");
+      check(peaks.getNumPeaks() ==
+                (sample->source.getNumSamples() +
+                 WaveformPeaks::samplesPerPeak - 1) /
+                    WaveformPeaks::samplesPerPeak,
+            "one peak per block of source samples");
+      check(std::abs(peaks.getMaxInRange(0, peaks.getNumPeaks()) - 0.5f) <
+                0.02f,
+            "peak level matches the 0.5 amplitude test tone");
+
+      const auto key = sample->getPeaksKey();
+      check(key != 0, "a loaded file has a peaks key without hashing audio");
+      const auto cacheFile = WaveformPeaks::getCacheFile(key);
+      check(waitFor([&] { return cacheFile.existsAsFile(); }),
+            "finished peaks are written to the sidecar cache");
+
+      WaveformPeaks reloaded(sample->source.getNumSamples());
+      check(reloaded.loadFromFile(cacheFile, key) && reloaded.isComplete(),
+            "sidecar peaks reload for the same audio");
+      check(!reloaded.loadFromFile(cacheFile, key + 1),
+            "sidecar is rejected for different audio");
+      cacheFile.deleteFile();
+    }
+  }
+
+  // --- Real-time safety of processBlock() ----------------------------------
+  {
+    juce::Logger::writeToLog("  (real-time checks: " +
+                             juce::String(RealtimeChecker::getCoverage()) +
+                             ")");
+    // The checker has to notice a violation for its silence to mean much.
+    RealtimeChecker::resetViolations();
+    {
+      RealtimeChecker::ScopedAudioThread audioThread(false);
+      const juce::String allocates("built on the heap " +
+                                   juce::String(blockSize));
+      juce::ignoreUnused(allocates);
+    }
+    check(std::strcmp(RealtimeChecker::getCoverage(), "off") == 0 ||
+              RealtimeChecker::getViolationCount() > 0,
+          "the real-time checker catches an allocation");
+    RealtimeChecker::resetViolations();
+
+    TestPlayHead playHead;
+    BackingTrackTriggerProcessor p;
+    p.setPlayHead(&playHead);
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(wav48);
+    waitUntilLoaded(p);
+
+    // Automation as the processor sees it: the raw values change under it.
+    // (JUCE's own listener callbacks around host automation aren't ours.)
+    auto *gain = p.apvts.getRawParameterValue("gain");
+    auto *loop = p.apvts.getRawParameterValue("loop");
+    auto *offset = p.apvts.getRawParameterValue("startOffset");
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize(1024);
+    int automation = 0;
+    auto render = [&](int numBlocks, bool noteOn, bool noteOff) {
+      for (int b = 0; b < numBlocks; ++b) {
+        midi.clear();
+        if (b == 0 && noteOn)
+          midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8)100),
+                        blockSize / 3);
+        if (b == 0 && noteOff)
+          midi.addEvent(juce::MidiMessage::noteOff(1, 60), blockSize / 2);
+        {
+          RealtimeChecker::ScopedAudioThread audioThread;
+          gain->store((float)(++automation % 24) - 18.0f);
+          p.processBlock(buffer, midi);
+        }
+        if (playHead.playing)
+          playHead.timeInSamples += blockSize;
+      }
+    };
+
+    render(20, true, false); // trigger
+    loop->store(1.0f);
+    offset->store(250.0f);
+    render(200, true, false); // loops the 1 s sample a couple of times
+    render(5, false, true);   // note-off (doesn't stop: noteOffStops is off)
+    loop->store(0.0f);
+
+    playHead.playing = true; // transport: play, rewind, stop
+    render(20, true, false);
+    playHead.timeInSamples = 0;
+    render(5, false, false);
+    playHead.playing = false;
+    render(5, true, false);
+
+    p.triggerPlayback(); // manual transport
+    render(5, false, false);
+    p.stopPlayback();
+    render(5, false, false);
+
+    // Sample swaps while playing: a new load, a clear, and a load again.
+    p.triggerPlayback();
+    p.loadSample(wav48);
+    const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+    while (p.isLoading() && juce::Time::getMillisecondCounter() < deadline)
+      render(1, false, false);
+    render(5, true, false);
+    p.clearSample();
+    render(5, true, false);
+    p.loadSample(wav48);
+    while (p.isLoading() && juce::Time::getMillisecondCounter() < deadline)
+      render(1, true, false);
+    render(20, false, false);
+
+    check(RealtimeChecker::getViolationCount() == 0,
+          "processBlock never allocates, locks or blocks (triggering, "
+          "looping, automation, transport changes, sample swaps)");
+    p.setPlayHead(nullptr);
+  }
+
+  // --- Playhead extrapolation ------------------------------------------------
+  {
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(wav48);
+    waitUntilLoaded(p);
+
+    bool finite = false;
+    renderTriggered(p, hostRate, blockSize, 4, finite);
+
+    const auto snap = p.getPlayheadSnapshot();
+    check(snap.position == 4 * blockSize && snap.blockSize == blockSize,
+          "audio thread publishes position and block size");
+
+    const double in10ms = p.getPlayheadPosition(snap.timeMs + 10.0);
+    check(std::abs(in10ms - ((double)snap.position + hostRate * 0.01)) < 1.0,
+          "playhead advances at the sample rate between blocks");
+    check(p.getPlayheadPosition(snap.timeMs + 10000.0) <=
+              (double)snap.position + 2.0 * blockSize,
+          "extrapolation never runs more than two blocks ahead");
+    check(p.getPlayheadPosition(snap.timeMs - 5.0) == (double)snap.position,
+          "playhead never moves backwards past the published position");
+  }
+
+  // --- Analysis: silence, onsets, tempo, auto-trim ---------------------------
+  {
+    const auto clicks = makeClickTrackWav(44100.0, 8.0, 0.5, 120.0);
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(clicks);
+    waitUntilLoaded(p);
+
+    auto sample = p.getSample();
+    check(sample != nullptr && sample->analysis != nullptr &&
+              sample->analysis->waitUntilReady(5000),
+          "analysis runs in the background after load");
+
+    if (sample != nullptr && sample->analysis != nullptr &&
+        sample->analysis->isReady()) {
+      const auto &r = sample->analysis->getResults();
+      check(std::abs(r.firstSoundSeconds - 0.5) < 0.02,
+            "leading silence is detected");
+      check(std::abs(r.firstOnsetSeconds - 0.5) < 0.02 &&
+                r.onsets.size() == 15,
+            "one onset per click, starting after the silence");
+      check(std::abs(r.bpm - 120.0) < 1.0, "tempo estimate is 120 BPM");
+      check(std::abs(sample->analysis->findNearestSnapPoint(2.03, 0.05) -
+                     2.0) < 0.02,
+            "clicks near a beat snap onto it");
+      check(sample->analysis->findNearestSnapPoint(2.25, 0.05) < 0.0,
+            "clicks between beats do not snap");
+
+      check(p.autoTrimStartOffset() &&
+                std::abs(p.getStartOffsetSeconds() - 0.49) < 0.02,
+            "auto-trim moves the offset to just before the first onset");
+    }
+    clicks.deleteFile();
+  }
+
+  // --- Loudness: integrated LUFS, true peak, DC, normalization --------------
+  {
+    const double rate = 48000.0;
+    const int length = (int)(rate * 10.0);
+    auto analyse = [&](const std::function<float(int, int)> &signal) {
+      juce::AudioBuffer<float> audio(2, length);
+      for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < length; ++i)
+          audio.setSample(ch, i, signal(ch, i));
+      SampleAnalysis analysis;
+      analysis.analyse(audio, rate, [] { return false; });
+      return analysis.getResults();
+    };
+    auto sine = [&](double hz, double amplitude, double phase, int i) {
+      return (float)(amplitude *
+                     std::sin(juce::MathConstants<double>::twoPi * hz * i /
+                                  rate +
+                              phase));
+    };
+
+    // BS.1770's calibration: a 997 Hz sine at -20 dBFS in both channels.
+    const auto reference =
+        analyse([&](int, int i) { return sine(997.0, 0.1, 0.0, i); });
+    check(std::abs(reference.loudnessLufs + 20.0) < 0.05 &&
+              std::abs(reference.truePeakDb + 20.0) < 0.05 &&
+              reference.dcOffset < 1.0e-4,
+          "a -20 dBFS 997 Hz sine measures -20 LUFS");
+
+    // At a quarter of the rate and 45 degrees, every sample misses the
+    // crests by 3 dB; the oversampled peak finds them.
+    const auto between = analyse(
+        [&](int, int i) { return sine(12000.0, 0.5, 0.25 * 3.14159265, i); });
+    check(std::abs(between.truePeakDb + 6.02) < 0.2,
+          "the true peak is found between samples");
+
+    const auto offset = analyse([&](int ch, int i) {
+      return sine(997.0, 0.1, 0.0, i) + (ch == 1 ? 0.05f : 0.0f);
+    });
+    check(std::abs(offset.dcOffset - 0.05) < 1.0e-4 &&
+              std::abs(offset.loudnessLufs + 20.0) < 0.05,
+          "a DC offset is measured, and the loudness filter ignores it");
+
+    // 5 s at -20 dBFS, 5 s at -50: the quiet half is gated out.
+    const auto gated = analyse([&](int, int i) {
+      return sine(997.0, i < length / 2 ? 0.1 : 0.00316, 0.0, i);
+    });
+    const auto silent = analyse([](int, int) { return 0.0f; });
+    check(std::abs(gated.loudnessLufs + 20.0) < 0.2 &&
+              silent.loudnessLufs == SampleAnalysis::kNoLoudness,
+          "quiet passages and silence are gated");
+
+    // Normalization: a 440 Hz sine at -6 dBFS is about -6.7 LUFS.
+    auto tone = makeTestWav(hostRate, 4.0);
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(tone);
+    waitUntilLoaded(p);
+    auto sample = p.getSample();
+    check(sample != nullptr && sample->analysis->waitUntilReady(5000) &&
+              std::abs(sample->analysis->getResults().loudnessLufs + 6.70) <
+                  0.05,
+          "the loudness is measured after load");
+    auto setParam = [&](const juce::String &id, float value) {
+      p.apvts.getParameter(id)->setValueNotifyingHost(
+          p.apvts.getParameterRange(id).convertTo0to1(value));
+    };
+    check(p.getNormalizeGainDb() == 0.0, "normalization is off by default");
+    setParam("normalize", 1.0f);
+    setParam("targetLoudness", -20.0f);
+    const double normalizeDb = p.getNormalizeGainDb();
+    check(std::abs(normalizeDb -
+                   (-20.0 - sample->analysis->getResults().loudnessLufs)) <
+              0.05,
+          "normalization makes up the difference to the target");
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    float level = 0.0f;
+    for (int b = 0; b < 40; ++b) {
+      juce::MidiBuffer midi;
+      if (b == 0)
+        midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8)100), 0);
+      buffer.clear();
+      p.processBlock(buffer, midi);
+      if (b >= 20) // past the fade-in and the gain glide
+        level = juce::jmax(level, buffer.getMagnitude(0, 0, blockSize));
+    }
+    check(std::abs(level - 0.5f * juce::Decibels::decibelsToGain(
+                                      (float)normalizeDb)) < 0.005f,
+          "the output is at the normalized level");
+
+    // Short clicks are quiet for their peaks: a boost stops where the true
+    // peak would pass -1 dBTP.
+    p.stopPlayback();
+    const auto clicks = makeClickTrackWav(44100.0, 8.0, 0.5, 120.0);
+    p.loadSample(clicks);
+    waitUntilLoaded(p);
+    sample = p.getSample();
+    setParam("targetLoudness", -6.0f);
+    if (sample != nullptr && sample->analysis->waitUntilReady(5000)) {
+      const auto &r = sample->analysis->getResults();
+      check(-6.0 - r.loudnessLufs > -1.0 - r.truePeakDb &&
+                std::abs(p.getNormalizeGainDb() - (-1.0 - r.truePeakDb)) <
+                    1.0e-6,
+            "a boost stops short of clipping the true peak");
+    } else {
+      check(false, "a boost stops short of clipping the true peak");
+    }
+    clicks.deleteFile();
+    tone.deleteFile();
+  }
+
+  // --- Offline rendering: waits for audio, best-quality resampling ---------
+  {
+    BackingTrackTriggerProcessor p;
+    p.setNonRealtime(true);
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(wav48); // still loading when the first block arrives
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8)100), 0);
+    p.processBlock(buffer, midi);
+    check(!p.isLoading() && p.isPlaying() &&
+              buffer.getMagnitude(0, blockSize) > 0.1f,
+          "an offline block waits for the load instead of joining late");
+    auto sample = p.getSample();
+    check(sample != nullptr && sample->wasResampled && sample->bestQuality,
+          "offline rendering uses the windowed-sinc resampler");
+
+    // A 1 kHz sine at 44.1 kHz against the exact one at 48 kHz.
+    const auto sine = [](float *d, int n, double freq, double rate) {
+      for (int i = 0; i < n; ++i)
+        d[i] = 0.5f * (float)std::sin(juce::MathConstants<double>::twoPi *
+                                      freq * i / rate);
+    };
+    juce::AudioBuffer<float> src(1, 44100), dst, exact(1, 48000);
+    sine(src.getWritePointer(0), 44100, 1000.0, 44100.0);
+    sine(exact.getWritePointer(0), 48000, 1000.0, 48000.0);
+    BackingTrackTriggerProcessor::resampleInto(src, 44100.0, dst, 48000.0,
+                                               nullptr, true);
+    float error = 0.0f;
+    for (int i = 4800; i < 43200 && dst.getNumSamples() == 48000; ++i)
+      error = juce::jmax(error, std::abs(dst.getSample(0, i) -
+                                         exact.getSample(0, i)));
+    check(dst.getNumSamples() == 48000 && error < 1.0e-4f,
+          "windowed-sinc resampling is accurate and adds no delay");
+
+    // 23 kHz fits at 48 kHz but not at 44.1: it must go, not alias.
+    juce::AudioBuffer<float> high(1, 48000);
+    sine(high.getWritePointer(0), 48000, 23000.0, 48000.0);
+    BackingTrackTriggerProcessor::resampleInto(high, 48000.0, dst, 44100.0,
+                                               nullptr, true);
+    check(dst.getRMSLevel(0, 4410, 35280) < 1.0e-4f,
+          "content above the new Nyquist frequency is filtered out");
+  }
+
+  // --- Host sync: drift is measured and corrected ---------------------------
+  {
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(wav48);
+    waitUntilLoaded(p);
+    if (auto *loop = p.apvts.getParameter("loop"))
+      loop->setValueNotifyingHost(1.0f);
+
+    TestPlayHead playHead;
+    playHead.playing = true;
+    p.setPlayHead(&playHead);
+
+    // Plays blocks as a host would, its position moving `hostSpeed` times as
+    // fast as the audio. The largest step between samples shows any click:
+    // the 440 Hz tone alone never steps more than about 0.03.
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize(1024);
+    double hostPos = 0.0;
+    float last = 0.0f, maxStep = 0.0f;
+    auto play = [&](int numBlocks, double hostSpeed, bool trigger) {
+      for (int b = 0; b < numBlocks; ++b) {
+        midi.clear();
+        if (trigger && b == 0)
+          midi.addEvent(juce::MidiMessage::noteOn(1, 60, (juce::uint8)100), 0);
+        playHead.timeInSamples = (juce::int64)std::llround(hostPos);
+        buffer.clear();
+        {
+          RealtimeChecker::ScopedAudioThread audioThread;
+          p.processBlock(buffer, midi);
+        }
+        for (int i = 0; i < blockSize; ++i) {
+          const float v = buffer.getSample(0, i);
+          maxStep = juce::jmax(maxStep, std::abs(v - last));
+          last = v;
+        }
+        hostPos += blockSize * hostSpeed;
+      }
+    };
+
+    RealtimeChecker::resetViolations();
+    play(50, 1.0, true);
+    auto stats = p.getSyncStats();
+    check(stats.tracking && stats.driftMs == 0.0 && stats.corrections == 0 &&
+              stats.jumps == 0,
+          "a voice started by the host follows it with no drift");
+
+    hostPos += blockSize; // the host drops a block
+    play(1, 1.0, false);
+    stats = p.getSyncStats();
+    check(stats.maxDriftMs > 11.0 && stats.corrections == 1,
+          "a dropped host block is measured as drift");
+    play(250, 1.0, false);
+    stats = p.getSyncStats();
+    check(std::abs(stats.driftMs) < 0.05 && stats.jumps == 0,
+          "small drift is closed by a slight change of speed");
+
+    hostPos += 11025 + 50; // the host skips a quarter second
+    play(10, 1.0, false);
+    stats = p.getSyncStats();
+    check(stats.jumps == 1 && std::abs(stats.driftMs) < 0.01,
+          "large drift is corrected by a jump");
+    check(maxStep < 0.1f, "corrections and jumps do not click");
+
+    play(400, 1.002, false); // a host running 0.2% fast
+    stats = p.getSyncStats();
+    check(stats.jumps == 1 && std::abs(stats.driftMs) < 0.5,
+          "a varispeeding host is followed without jumps");
+
+    if (auto *follow = p.apvts.getParameter("followTransport"))
+      follow->setValueNotifyingHost(0.0f);
+    play(1, 1.0, false);
+    check(!p.getSyncStats().tracking && p.isPlaying(),
+          "without Follow Transport playback runs free");
+    check(RealtimeChecker::getViolationCount() == 0,
+          "drift correction and jumps never allocate, lock or block");
+    p.setPlayHead(nullptr);
+  }
+
+  // --- Cues: each note starts its own entry point --------------------------
+  {
+    auto cueWav = makeTestWav(22050.0, 6.0);
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(cueWav);
+    waitUntilLoaded(p);
+
+    check(p.setCue(72, 3.0, "Chorus") && p.setCue(74, 1.0) &&
+              p.getCues().size() == 2 && p.getCues()[0].note == 74,
+          "cues are added and kept in track order");
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    auto playNote = [&](int note) {
+      juce::MidiBuffer midi;
+      if (note >= 0)
+        midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8)100), 0);
+      buffer.clear();
+      p.processBlock(buffer, midi);
+      return buffer.getMagnitude(0, blockSize);
+    };
+    const juce::int64 cueStart = (juce::int64)(3.0 * hostRate);
+
+    playNote(72);
+    check(p.getPlayheadSnapshot().position == cueStart + blockSize,
+          "a cue note starts at its cue, not the start offset");
+    playNote(60);
+    check(p.getPlayheadSnapshot().position == blockSize,
+          "other notes still start at the start offset");
+
+    juce::MemoryBlock state;
+    p.getStateInformation(state);
+    {
+      BackingTrackTriggerProcessor restored;
+      restored.prepareToPlay(hostRate, blockSize);
+      restored.setStateInformation(state.getData(), (int)state.getSize());
+      waitUntilLoaded(restored);
+      const auto cues = restored.getCues();
+      check(cues.size() == 2 && cues[1].note == 72 &&
+                cues[1].offsetSeconds == 3.0 && cues[1].name == "Chorus",
+            "cues are saved and restored");
+    }
+
+    // Evicted, a cue plays from its head at once and carries on into the
+    // track once that is back, without losing its place.
+    p.stopPlayback();
+    for (int b = 0; b < 20; ++b)
+      playNote(-1);
+    auto &budget = p.getMemoryBudget();
+    const auto oldSetting = budget.getLimitSetting();
+    budget.setLimitSetting(1);
+    check(waitFor([&] { return p.isEvicted(); }, 15000),
+          "the track is evicted while idle");
+
+    check(playNote(72) > 0.1f && p.isPlaying(),
+          "an evicted cue is audible in the block its note arrives");
+    int blocks = 1;
+    const auto deadline = juce::Time::getMillisecondCounter() + 10000;
+    while (!p.hasSampleLoaded() &&
+           juce::Time::getMillisecondCounter() < deadline) {
+      playNote(-1);
+      ++blocks;
+      juce::Thread::sleep(1);
+    }
+    playNote(-1);
+    ++blocks;
+    check(p.hasSampleLoaded() && p.isPlaying() &&
+              p.getPlayheadSnapshot().position ==
+                  cueStart + (juce::int64)blocks * blockSize,
+          "the cue carries on into the reloaded track in time");
+
+    budget.setLimitSetting(oldSetting);
+    p.removeCue(72);
+    playNote(72);
+    check(p.getCues().size() == 1 &&
+              p.getPlayheadSnapshot().position == blockSize,
+          "a removed cue's note falls back to the start offset");
+    cueWav.deleteFile();
+  }
+
+  // --- Setlist: the next track is preloaded and follows without a gap -------
+  {
+    auto first = makeTestWav(22050.0, 1.0);
+    auto second = makeTestWav(32000.0, 1.0);
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.setSetlist({first, second});
+    waitUntilLoaded(p);
+    check(p.getSetlistPosition() == 0 && p.hasSampleLoaded() &&
+              waitFor([&] { return p.isNextTrackReady(); }),
+          "the first track loads and the second is preloaded");
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize(1024);
+    auto playNote = [&](int note) {
+      midi.clear();
+      if (note >= 0)
+        midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8)100), 0);
+      buffer.clear();
+      RealtimeChecker::ScopedAudioThread audioThread;
+      p.processBlock(buffer, midi);
+    };
+    RealtimeChecker::resetViolations();
+
+    p.setStartOffsetSeconds(0.25);
+    p.setCue(72, 0.5, "Bridge");
+    const auto generation = p.getSampleGeneration();
+    p.setSetlistNextNote(61);
+    playNote(61);
+    check(p.getSetlistPosition() == 1 && !p.isLoading() &&
+              p.getSampleGeneration() != generation && !p.isPlaying(),
+          "the next-track note steps at once while idle, with no load");
+    juce::MemoryBlock settled;
+    p.getStateInformation(settled); // settles the step, as the host would
+    check(p.getStartOffsetSeconds() == 0.0 && p.getCues().empty(),
+          "a track stepped to has its own start offset and cues");
+    p.setStartOffsetSeconds(0.1);
+
+    // Back to the first; the second is preloaded again. With auto-advance it
+    // takes over on the sample after the first ends.
+    p.selectSetlistEntry(0);
+    check(std::abs(p.getStartOffsetSeconds() - 0.25) < 1.0e-3 &&
+              p.getCues().size() == 1 && p.getCues()[0].note == 72,
+          "going back to a track brings back its start offset and cues");
+    waitUntilLoaded(p);
+    check(waitFor([&] { return p.isNextTrackReady(); }),
+          "choosing an entry preloads the one after it");
+    p.setSetlistAutoAdvance(true);
+    int longestQuiet = 0, quiet = 0;
+    const int blocks = (int)(1.5 * hostRate) / blockSize;
+    for (int b = 0; b < blocks; ++b) {
+      playNote(b == 0 ? 60 : -1);
+      for (int i = 0; i < blockSize; ++i) {
+        quiet = std::abs(buffer.getSample(0, i)) < 1.0e-3f ? quiet + 1 : 0;
+        longestQuiet = juce::jmax(longestQuiet, quiet);
+      }
+    }
+    check(p.isPlaying() && p.getSetlistPosition() == 1 && longestQuiet < 16,
+          "auto-advance plays the next track without a gap");
+    check(waitFor([&] { return !p.isNextTrackReady(); }) &&
+              p.getSetlist().size() == 2,
+          "nothing is preloaded after the last track");
+    check(RealtimeChecker::getViolationCount() == 0,
+          "stepping and auto-advancing never allocate, lock or block on the "
+          "audio thread");
+
+    juce::MemoryBlock state;
+    p.getStateInformation(state);
+    check(std::abs(p.getStartOffsetSeconds() - 0.1) < 1.0e-3 &&
+              p.getCues().empty(),
+          "auto-advance brings back the next track's own start offset");
+    {
+      BackingTrackTriggerProcessor restored;
+      restored.prepareToPlay(hostRate, blockSize);
+      restored.setStateInformation(state.getData(), (int)state.getSize());
+      waitUntilLoaded(restored);
+      check(restored.getSetlist().size() == 2 &&
+                restored.getSetlistPosition() == 1 &&
+                restored.getSetlistNextNote() == 61 &&
+                restored.isSetlistAutoAdvance(),
+            "the setlist is saved and restored");
+      restored.selectSetlistEntry(0);
+      check(std::abs(restored.getStartOffsetSeconds() - 0.25) < 1.0e-3 &&
+                restored.getCues().size() == 1,
+            "each track's start offset and cues are saved with the setlist");
+    }
+    first.deleteFile();
+    second.deleteFile();
+  }
+
+  // --- Varispeed: the host tempo over the track's sets the speed ------------
+  {
+    auto tone = makeTestWav(22050.0, 8.0);
+    BackingTrackTriggerProcessor p;
+    TestPlayHead playHead;
+    playHead.bpm = 120.0;
+    p.setPlayHead(&playHead);
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(tone);
+    waitUntilLoaded(p);
+    auto setParam = [&](const juce::String &id, float value) {
+      auto *param = p.apvts.getParameter(id);
+      param->setValueNotifyingHost(
+          p.apvts.getParameterRange(id).convertTo0to1(value));
+    };
+    setParam("varispeed", 1.0f);
+    setParam("trackTempo", 100.0f);
+
+    juce::AudioBuffer<float> buffer(2, blockSize);
+    juce::MidiBuffer midi;
+    midi.ensureSize(1024);
+    auto render = [&](int note) {
+      midi.clear();
+      if (note >= 0)
+        midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8)100), 0);
+      buffer.clear();
+      {
+        RealtimeChecker::ScopedAudioThread audioThread;
+        p.processBlock(buffer, midi);
+      }
+      playHead.timeInSamples += blockSize;
+    };
+    RealtimeChecker::resetViolations();
+
+    // Zero crossings over half a second: a 440 Hz tone at 1.2x has 1056.
+    render(60);
+    for (int b = 0; b < 10; ++b)
+      render(-1);
+    int crossings = 0;
+    float last = 0.0f;
+    bool allFinite = true;
+    const int measured = (int)(0.5 * hostRate) / blockSize;
+    for (int b = 0; b < measured; ++b) {
+      render(-1);
+      for (int i = 0; i < blockSize; ++i) {
+        const float v = buffer.getSample(0, i);
+        allFinite = allFinite && std::isfinite(v);
+        if ((v >= 0.0f) != (last >= 0.0f))
+          ++crossings;
+        last = v;
+      }
+    }
+    const double expected = 2.0 * 440.0 * 1.2 * measured * blockSize / hostRate;
+    check(std::abs(p.getPlaybackRatio() - 1.2) < 1.0e-9 &&
+              std::abs((double)p.getPlayheadSnapshot().position -
+                       1.2 * (11 + measured) * blockSize) < 2.0,
+          "varispeed plays at host tempo / track tempo");
+    check(allFinite && std::abs(crossings - expected) < expected * 0.01,
+          "pitch follows the speed");
+
+    // A tempo change glides rather than steps.
+    playHead.bpm = 90.0;
+    render(-1);
+    const double gliding = p.getPlaybackRatio();
+    for (int b = 0; b < 60; ++b)
+      render(-1);
+    check(gliding < 1.2 && gliding > 0.9 &&
+              std::abs(p.getPlaybackRatio() - 0.9) < 1.0e-9,
+          "a tempo change glides to the new ratio");
+
+    // With the host playing, the voice keeps to the host position scaled by
+    // the ratio: a tempo change mid-way leaves no drift.
+    p.stopPlayback();
+    for (int b = 0; b < 4; ++b)
+      render(-1);
+    playHead.playing = true;
+    playHead.bpm = 120.0;
+    render(60);
+    for (int b = 0; b < 40; ++b) {
+      if (b == 20)
+        playHead.bpm = 110.0;
+      render(-1);
+    }
+    const auto sync = p.getSyncStats();
+    check(sync.tracking && std::abs(sync.driftMs) < 0.1 && sync.jumps == 0,
+          "varispeed stays locked to the host timeline");
+
+    setParam("varispeed", 0.0f);
+    for (int b = 0; b < 60; ++b)
+      render(-1);
+    check(p.getPlaybackRatio() == 1.0, "turning varispeed off restores 1x");
+    check(RealtimeChecker::getViolationCount() == 0,
+          "varispeed, glides and resampled rendering never allocate, lock or "
+          "block");
+    p.setPlayHead(nullptr);
+    tone.deleteFile();
+  }
+
+  // --- Compressed storage: idle audio kept as FLAC and streamed -----------
+  {
+    auto tone = makeTestWav(hostRate, 10.0);
+    BackingTrackTriggerProcessor p;
+    p.prepareToPlay(hostRate, blockSize);
+    p.loadSample(tone);
+    waitUntilLoaded(p);
+    p.apvts.getRawParameterValue("loop")->store(1.0f);
+    const auto hash = p.getSample()->getContentHash();
+    const juce::AudioBuffer<float> original(p.getSample()->source);
+    const juce::int64 decodedBytes = p.getSample()->getAudioBytes();
+    check(p.setCue(72, 7.5), "a cue is set before compressing");
+
+    // 12 s from the start, through the loop point, a block at a time with a
+    // host-like pause between blocks for the decoder to run in.
+    const int numBlocks = (int)(12.0 * hostRate) / blockSize;
+    auto render = [&](int note) {
+      juce::AudioBuffer<float> result(2, numBlocks * blockSize);
+      juce::AudioBuffer<float> buffer(2, blockSize);
+      juce::MidiBuffer midi;
+      midi.ensureSize(1024);
+      for (int b = -4; b < numBlocks; ++b) { // a few idle blocks first
+        midi.clear();
+        if (b == 0)
+          midi.addEvent(juce::MidiMessage::noteOn(1, note, (juce::uint8)100),
+                        0);
+        {
+          RealtimeChecker::ScopedAudioThread audioThread;
+          p.processBlock(buffer, midi);
+        }
+        if (b >= 0)
+          for (int ch = 0; ch < 2; ++ch)
+            result.copyFrom(ch, b * blockSize, buffer, ch, 0, blockSize);
+        juce::Thread::sleep(1);
+      }
+      p.stopPlayback();
+      return result;
+    };
+    const auto reference = render(60);
+    const auto cueReference = render(72);
+
+    auto &budget = p.getMemoryBudget();
+    const bool wasCompressing = budget.isCompressedStorageEnabled();
+    budget.setCompressedStorageEnabled(true);
+    check(waitFor([&] { return p.isCompressed(); }, 15000) &&
+              p.hasSampleLoaded() &&
+              p.getSample()->compressed->getCompressedBytes() * 3 <
+                  decodedBytes,
+          "an idle track is kept compressed, in a third of the memory");
+
+    juce::MemoryBlock state;
+    p.getStateInformation(state);
+    StateFormat::Contents saved;
+    check(StateFormat::read(state.getData(), state.getSize(), saved) &&
+              (juce::uint64)(juce::int64)saved.header.getProperty(
+                  "sampleHash") == hash,
+          "a compressed track is still saved");
+
+    RealtimeChecker::resetViolations();
+    auto maxDifference = [](const juce::AudioBuffer<float> &a,
+                            const juce::AudioBuffer<float> &b) {
+      float worst = 0.0f;
+      for (int ch = 0; ch < 2; ++ch)
+        for (int i = 0; i < a.getNumSamples(); ++i)
+          worst = juce::jmax(worst,
+                             std::abs(a.getSample(ch, i) - b.getSample(ch, i)));
+      return worst;
+    };
+    check(maxDifference(render(60), reference) < 1.0e-5f &&
+              maxDifference(render(72), cueReference) < 1.0e-5f,
+          "streaming from the compressed track sounds the same, loop and "
+          "cue included");
+    check(p.getStreamUnderruns() == 0,
+          "the stream stays ahead of the playhead");
+    check(RealtimeChecker::getViolationCount() == 0,
+          "streaming never allocates, locks or blocks on the audio thread");
+
+    budget.setCompressedStorageEnabled(false);
+    check(waitFor([&] { return !p.isCompressed() && !p.isLoading(); },
+                  15000),
+          "turning the mode off decodes the track again");
+    bool identical = p.getSample() != nullptr &&
+                     p.getSample()->source.getNumSamples() ==
+                         original.getNumSamples();
+    for (int ch = 0; identical && ch < original.getNumChannels(); ++ch)
+      identical = std::memcmp(p.getSample()->source.getReadPointer(ch),
+                              original.getReadPointer(ch),
+                              sizeof(float) *
+                                  (size_t)original.getNumSamples()) == 0;
+    check(identical, "the decoded audio is exactly the original");
+
+    budget.setCompressedStorageEnabled(wasCompressing);
+    tone.deleteFile();
+  }
+
+  // --- Instantiation: many instances, no threads until one is used --------
+  {
+    using SharedScheduler = juce::SharedResourcePointer<JobScheduler>;
+    check(!SharedScheduler::getSharedObjectWithoutCreating().has_value(),
+          "no job scheduler is left once its instances are gone");
+
+    juce::MemoryBlock empty;
+    BackingTrackTriggerProcessor().getStateInformation(empty);
+    const int numInstances = 200;
+    std::vector<std::unique_ptr<BackingTrackTriggerProcessor>> instances;
+    const double start = juce::Time::getMillisecondCounterHiRes();
+    for (int i = 0; i < numInstances; ++i) {
+      instances.push_back(std::make_unique<BackingTrackTriggerProcessor>());
+      instances.back()->setStateInformation(empty.getData(),
+                                            (int)empty.getSize());
+    }
+    const double perInstanceMs =
+        (juce::Time::getMillisecondCounterHiRes() - start) / numInstances;
+    check(!SharedScheduler::getSharedObjectWithoutCreating().has_value(),
+          "instances restoring an empty state start no worker threads");
+    // Loose enough for a debug build; the benchmark has the real figure.
+    check(perInstanceMs < 5.0,
+          "an instance constructs and restores an empty state quickly (" +
+              juce::String(perInstanceMs, 3) + " ms)");
+
+    auto &first = *instances.front();
+    first.prepareToPlay(hostRate, blockSize);
+    first.loadSample(wav48);
+    waitUntilLoaded(first);
+    check(first.hasSampleLoaded() &&
+              SharedScheduler::getSharedObjectWithoutCreating().has_value(),
+          "the first load starts the shared workers");
+  }
+
+  // --- I/O scheduler: deadlines, coalescing, buffered streams --------------
+  {
+    auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                    .getChildFile("btt_test_io.bin");
+    juce::MemoryBlock contents(1 << 20);
+    for (int i = 0; i < (int)contents.getSize(); ++i)
+      contents[i] = (char)(i * 7 + i / 4099);
+    file.replaceWithData(contents.getData(), contents.getSize());
+    auto matches = [&](const char *data, juce::int64 from, int n) {
+      return std::memcmp(data, (const char *)contents.getData() + from,
+                         (size_t)n) == 0;
+    };
+
+    IoScheduler io;
+    io.setPaused(true);
+    const double now = juce::Time::getMillisecondCounterHiRes();
+    // Two reads into one buffer, so whichever is served last wins: the urgent
+    // one is queued after the background ones but must go first. The second
+    // background read follows on from the first.
+    std::vector<char> shared(4096), adjacent(4096);
+    int lateGot = 0, adjacentGot = 0, urgentGot = 0;
+    std::thread late([&] {
+      lateGot = io.read(file, 0, shared.data(), 4096, now + 60000.0);
+    });
+    waitFor([&] { return io.getNumQueued() == 1; });
+    std::thread next([&] {
+      adjacentGot = io.read(file, 4096, adjacent.data(), 4096, now + 60000.0);
+    });
+    waitFor([&] { return io.getNumQueued() == 2; });
+    std::thread urgent([&] {
+      urgentGot = io.read(file, 512 * 1024, shared.data(), 4096, now);
+    });
+    waitFor([&] { return io.getNumQueued() == 3; });
+    io.setPaused(false);
+    late.join();
+    next.join();
+    urgent.join();
+    check(lateGot == 4096 && urgentGot == 4096 &&
+              matches(shared.data(), 0, 4096),
+          "the read due soonest is served first");
+    check(adjacentGot == 4096 && matches(adjacent.data(), 4096, 4096) &&
+              io.getStats().reads == 2 && io.getStats().coalesced == 1,
+          "adjacent reads of a file are coalesced into one");
+
+    IoScheduler::Stream in(
+        io, file, [] { return juce::Time::getMillisecondCounterHiRes(); });
+    std::vector<char> got(contents.getSize());
+    bool exact = in.openedOk() &&
+                 in.getTotalLength() == (juce::int64)contents.getSize() &&
+                 in.read(got.data(), 1000) == 1000 &&
+                 matches(got.data(), 0, 1000);
+    in.setPosition(700000);
+    exact = exact && in.read(got.data(), 5000) == 5000 &&
+            matches(got.data(), 700000, 5000);
+    in.setPosition(10);
+    exact = exact && in.read(got.data(), 300) == 300 &&
+            matches(got.data(), 10, 300);
+    in.setPosition(0);
+    exact = exact && in.read(got.data(), (int)got.size()) == (int)got.size() &&
+            matches(got.data(), 0, (int)got.size()) && in.isExhausted();
+    check(exact, "a stream reads its file exactly through seeks and big reads");
+    const int readahead = io.getReadaheadBytes(now);
+    check(io.getStats().bytesPerMs > 0.0 &&
+              readahead >= IoScheduler::kMinReadahead &&
+              readahead <= IoScheduler::kMaxReadahead,
+          "readahead is sized from the measured throughput");
+    check(!IoScheduler::Stream(io, file.getSiblingFile("btt_test_none"), {})
+               .openedOk(),
+          "a missing file doesn't open");
+    file.deleteFile();
+  }
+
   wav48.deleteFile();
 
   juce::Logger::writeToLog(failures == 0
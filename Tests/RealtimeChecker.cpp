@@ -0,0 +1,322 @@
+// The wrappers below replace C library functions, which the fortified inline
+// versions of read() / open() would clash with.
+#undef _FORTIFY_SOURCE
+
+#include "RealtimeChecker.h"
+#include <juce_core/juce_core.h>
+#include <atomic>
+#include <cerrno>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+
+#ifndef BTT_RT_CHECKS
+#define BTT_RT_CHECKS 0
+#endif
+
+#if BTT_RT_CHECKS && defined(__GLIBC__)
+#define BTT_RT_WRAP_LIBC 1
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#else
+#define BTT_RT_WRAP_LIBC 0
+#endif
+
+namespace {
+constexpr int kMaxReports = 10; // stack traces printed; the count goes on
+
+std::atomic<int> violations{0};
+thread_local bool audioThread = false;
+thread_local bool reporting = true;
+thread_local bool inReport = false; // the report itself allocates
+
+void violation(const char *what) {
+  if (!audioThread || inReport)
+    return;
+  inReport = true;
+  const int n = ++violations;
+  if (reporting && n <= kMaxReports)
+    std::fprintf(stderr, "RT violation: %s on the audio thread\n%s\n", what,
+                 juce::SystemStats::getStackBacktrace().toRawUTF8());
+  inReport = false;
+}
+} // namespace
+
+namespace RealtimeChecker {
+
+ScopedAudioThread::ScopedAudioThread(bool report)
+    : wasAudioThread(audioThread), wasReporting(reporting) {
+  reporting = report;
+  audioThread = BTT_RT_CHECKS != 0;
+}
+
+ScopedAudioThread::~ScopedAudioThread() {
+  audioThread = wasAudioThread;
+  reporting = wasReporting;
+}
+
+int getViolationCount() { return violations.load(); }
+void resetViolations() { violations = 0; }
+
+const char *getCoverage() {
+#if BTT_RT_WRAP_LIBC
+  return "full";
+#elif BTT_RT_CHECKS
+  return "new/delete only";
+#else
+  return "off";
+#endif
+}
+
+} // namespace RealtimeChecker
+
+#if BTT_RT_WRAP_LIBC
+//==============================================================================
+// glibc: these definitions in the executable take precedence over libc's for
+// every library in the process. Allocation forwards to glibc's internal entry
+// points; everything else to the next definition (libc / libpthread).
+extern "C" {
+void *__libc_malloc(size_t);
+void *__libc_calloc(size_t, size_t);
+void *__libc_realloc(void *, size_t);
+void *__libc_memalign(size_t, size_t);
+void __libc_free(void *);
+
+void *malloc(size_t size) noexcept {
+  violation("malloc");
+  return __libc_malloc(size);
+}
+
+void *calloc(size_t count, size_t size) noexcept {
+  violation("calloc");
+  return __libc_calloc(count, size);
+}
+
+void *realloc(void *ptr, size_t size) noexcept {
+  violation("realloc");
+  return __libc_realloc(ptr, size);
+}
+
+void free(void *ptr) noexcept {
+  if (ptr != nullptr)
+    violation("free");
+  __libc_free(ptr);
+}
+
+void *memalign(size_t alignment, size_t size) noexcept {
+  violation("memalign");
+  return __libc_memalign(alignment, size);
+}
+
+void *aligned_alloc(size_t alignment, size_t size) noexcept {
+  violation("aligned_alloc");
+  return __libc_memalign(alignment, size);
+}
+
+int posix_memalign(void **result, size_t alignment, size_t size) noexcept {
+  violation("posix_memalign");
+  if (alignment < sizeof(void *) || (alignment & (alignment - 1)) != 0)
+    return EINVAL;
+  *result = __libc_memalign(alignment, size);
+  return *result != nullptr ? 0 : ENOMEM;
+}
+} // extern "C"
+
+// Looks up the definition these wrappers hide, once.
+#define BTT_NEXT(name)                                                         \
+  static const auto next = reinterpret_cast<decltype(&name)>(                  \
+      dlsym(RTLD_NEXT, #name))
+
+extern "C" {
+int pthread_mutex_lock(pthread_mutex_t *mutex) noexcept {
+  violation("pthread_mutex_lock");
+  BTT_NEXT(pthread_mutex_lock);
+  return next(mutex);
+}
+
+int pthread_cond_wait(pthread_cond_t *cond, pthread_mutex_t *mutex) {
+  violation("pthread_cond_wait");
+  BTT_NEXT(pthread_cond_wait);
+  return next(cond, mutex);
+}
+
+int pthread_cond_timedwait(pthread_cond_t *cond, pthread_mutex_t *mutex,
+                           const timespec *abstime) {
+  violation("pthread_cond_timedwait");
+  BTT_NEXT(pthread_cond_timedwait);
+  return next(cond, mutex, abstime);
+}
+
+int pthread_rwlock_rdlock(pthread_rwlock_t *rwlock) noexcept {
+  violation("pthread_rwlock_rdlock");
+  BTT_NEXT(pthread_rwlock_rdlock);
+  return next(rwlock);
+}
+
+int pthread_rwlock_wrlock(pthread_rwlock_t *rwlock) noexcept {
+  violation("pthread_rwlock_wrlock");
+  BTT_NEXT(pthread_rwlock_wrlock);
+  return next(rwlock);
+}
+
+int pthread_rwlock_timedrdlock(pthread_rwlock_t *rwlock,
+                               const timespec *abstime) noexcept {
+  violation("pthread_rwlock_timedrdlock");
+  BTT_NEXT(pthread_rwlock_timedrdlock);
+  return next(rwlock, abstime);
+}
+
+int pthread_rwlock_timedwrlock(pthread_rwlock_t *rwlock,
+                               const timespec *abstime) noexcept {
+  violation("pthread_rwlock_timedwrlock");
+  BTT_NEXT(pthread_rwlock_timedwrlock);
+  return next(rwlock, abstime);
+}
+
+int sem_wait(sem_t *sem) {
+  violation("sem_wait");
+  BTT_NEXT(sem_wait);
+  return next(sem);
+}
+
+int sem_timedwait(sem_t *sem, const timespec *abstime) {
+  violation("sem_timedwait");
+  BTT_NEXT(sem_timedwait);
+  return next(sem, abstime);
+}
+
+int sched_yield() noexcept {
+  violation("sched_yield (spin-lock contention?)");
+  BTT_NEXT(sched_yield);
+  return next();
+}
+
+int nanosleep(const timespec *duration, timespec *remaining) {
+  violation("nanosleep");
+  BTT_NEXT(nanosleep);
+  return next(duration, remaining);
+}
+
+int clock_nanosleep(clockid_t clock, int flags, const timespec *duration,
+                    timespec *remaining) {
+  violation("clock_nanosleep");
+  BTT_NEXT(clock_nanosleep);
+  return next(clock, flags, duration, remaining);
+}
+
+int usleep(useconds_t micros) {
+  violation("usleep");
+  BTT_NEXT(usleep);
+  return next(micros);
+}
+
+// The mode argument is only there when the flags create a file.
+static mode_t openMode(int flags, va_list args) {
+  if ((flags & O_CREAT) != 0 || (flags & O_TMPFILE) == O_TMPFILE)
+    return static_cast<mode_t>(va_arg(args, unsigned int));
+  return 0;
+}
+
+int open(const char *path, int flags, ...) {
+  violation("open");
+  BTT_NEXT(open);
+  va_list args;
+  va_start(args, flags);
+  const mode_t mode = openMode(flags, args);
+  va_end(args);
+  return next(path, flags, mode);
+}
+
+int open64(const char *path, int flags, ...) {
+  violation("open64");
+  BTT_NEXT(open64);
+  va_list args;
+  va_start(args, flags);
+  const mode_t mode = openMode(flags, args);
+  va_end(args);
+  return next(path, flags, mode);
+}
+
+int openat(int dirfd, const char *path, int flags, ...) {
+  violation("openat");
+  BTT_NEXT(openat);
+  va_list args;
+  va_start(args, flags);
+  const mode_t mode = openMode(flags, args);
+  va_end(args);
+  return next(dirfd, path, flags, mode);
+}
+
+ssize_t read(int fd, void *buffer, size_t size) {
+  violation("read");
+  BTT_NEXT(read);
+  return next(fd, buffer, size);
+}
+
+ssize_t pread(int fd, void *buffer, size_t size, off_t offset) {
+  violation("pread");
+  BTT_NEXT(pread);
+  return next(fd, buffer, size, offset);
+}
+
+ssize_t pread64(int fd, void *buffer, size_t size, off64_t offset) {
+  violation("pread64");
+  BTT_NEXT(pread64);
+  return next(fd, buffer, size, offset);
+}
+
+ssize_t write(int fd, const void *buffer, size_t size) {
+  violation("write");
+  BTT_NEXT(write);
+  return next(fd, buffer, size);
+}
+
+int poll(pollfd *fds, nfds_t count, int timeoutMs) {
+  violation("poll");
+  BTT_NEXT(poll);
+  return next(fds, count, timeoutMs);
+}
+} // extern "C"
+
+#undef BTT_NEXT
+
+#elif BTT_RT_CHECKS
+//==============================================================================
+// Elsewhere: C++ allocation only.
+void *operator new(std::size_t size) {
+  violation("operator new");
+  if (auto *p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  violation("operator new");
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept {
+  if (ptr != nullptr)
+    violation("operator delete");
+  std::free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept { operator delete(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { operator delete(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept {
+  operator delete(ptr);
+}
+#endif
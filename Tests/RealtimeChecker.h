@@ -0,0 +1,47 @@
+#pragma once
+
+// Real-time safety checks for the test build.
+//
+// While a ScopedAudioThread is alive, the current thread counts as the audio
+// thread. Anything it does that can block goes on record as a violation, with
+// a stack trace printed to stderr:
+//  - heap allocation or release,
+//  - locking a mutex or waiting on a condition / semaphore,
+//  - yielding (what a contended juce::SpinLock does) or sleeping,
+//  - file and socket I/O.
+// Try-locks are allowed: they never wait.
+//
+// The hooks need BTT_RT_CHECKS (on by default for the tests; turn it off for
+// sanitizer builds, which replace malloc themselves). On Linux they wrap the
+// C library directly, so JUCE's own allocations and locks are caught too.
+// Elsewhere only C++ new / delete are checked; see getCoverage(). CI runs the
+// tests on Linux for that reason.
+//
+// What the Linux hooks don't see: calls glibc makes to its own internal
+// aliases (stdio's fopen / fread, for one), raw futexes (std::atomic::wait),
+// the clock-selecting waits (pthread_mutex_timedlock / _clocklock,
+// pthread_cond_clockwait, sem_clockwait), readv / preadv, mmap and page
+// faults.
+
+namespace RealtimeChecker {
+
+class ScopedAudioThread {
+public:
+  // `report` = false counts violations without printing (for self-tests).
+  explicit ScopedAudioThread(bool report = true);
+  ~ScopedAudioThread();
+
+  ScopedAudioThread(const ScopedAudioThread &) = delete;
+  ScopedAudioThread &operator=(const ScopedAudioThread &) = delete;
+
+private:
+  bool wasAudioThread, wasReporting;
+};
+
+int getViolationCount();
+void resetViolations();
+
+// "full", "new/delete only" or "off".
+const char *getCoverage();
+
+} // namespace RealtimeChecker
@@ -0,0 +1,548 @@
+// Microbenchmarks for the hot and the slow paths, with JSON output so two
+// builds can be compared.
+// Usage: BackingTrackTriggerBench [--quick] [--out results.json]
+//                                 [--max-instantiate-ms ms]
+//
+// Covers constructing instances (as a host opening a big project does),
+// processBlock() (ns per host sample, by block size, sample channel count,
+// playback state and number of instances), loadSample() per file format,
+// resampleInto() per rate pair, get/setStateInformation() with and without
+// embedded audio, and WaveformDisplay::paint() per zoom level.
+// Every figure is the median of several runs after a warm-up. Progress goes
+// to stderr; the JSON to stdout unless --out is given. With
+// --max-instantiate-ms it exits non-zero if the median instance (construction
+// plus an empty setStateInformation()) takes longer. Only the median: the
+// 99th percentile is mostly the machine's scheduling noise.
+
+#include "../Source/PluginEditor.h"
+#include "../Source/PluginProcessor.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <juce_audio_utils/juce_audio_utils.h>
+
+using Clock = std::chrono::steady_clock;
+
+static double elapsedNs(Clock::time_point since) {
+  return (double)std::chrono::duration_cast<std::chrono::nanoseconds>(
+             Clock::now() - since)
+      .count();
+}
+
+static double median(std::vector<double> values) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  const size_t mid = values.size() / 2;
+  return values.size() % 2 != 0 ? values[mid]
+                                : 0.5 * (values[mid - 1] + values[mid]);
+}
+
+// The value below which `fraction` of `values` lie.
+static double percentile(std::vector<double> values, double fraction) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  const auto at = (size_t)(fraction * (double)(values.size() - 1) + 0.5);
+  return values[std::min(at, values.size() - 1)];
+}
+
+// Runs `fn` once to warm up, then `runs` times; the median in milliseconds.
+template <typename Fn> static double medianMs(int runs, Fn &&fn) {
+  fn();
+  std::vector<double> times;
+  for (int i = 0; i < runs; ++i) {
+    const auto start = Clock::now();
+    fn();
+    times.push_back(elapsedNs(start) / 1.0e6);
+  }
+  return median(times);
+}
+
+static void waitUntilLoaded(const BackingTrackTriggerProcessor &p) {
+  while (p.isLoading()) // the file is read in the background
+    juce::Thread::sleep(1);
+}
+
+//==============================================================================
+struct Results {
+  juce::Array<juce::var> entries;
+
+  juce::DynamicObject &add(const juce::String &group, const juce::String &name,
+                           double value, const juce::String &unit) {
+    auto *entry = new juce::DynamicObject();
+    entry->setProperty("group", group);
+    entry->setProperty("name", name);
+    entry->setProperty("value", value);
+    entry->setProperty("unit", unit);
+    entries.add(juce::var(entry));
+    juce::Logger::writeToLog(group + " / " + name + ": " +
+                             juce::String(value, 3) + " " + unit);
+    return *entry;
+  }
+};
+
+//==============================================================================
+// Hundreds of instances, each constructed and given an empty state, kept
+// alive as a host keeps a project's plugins. Runs first, so "first instance"
+// includes creating what instances share. Returns the median.
+static double runInstantiate(Results &results, bool quick) {
+  const int numInstances = quick ? 100 : 500;
+  juce::MemoryBlock empty;
+  std::vector<double> times;
+  std::vector<std::unique_ptr<BackingTrackTriggerProcessor>> instances;
+  for (int i = 0; i < numInstances; ++i) {
+    auto start = Clock::now();
+    auto p = std::make_unique<BackingTrackTriggerProcessor>();
+    double ns = elapsedNs(start);
+    if (i == 0) // the state a new instance saves, not timed
+      p->getStateInformation(empty);
+    start = Clock::now();
+    p->setStateInformation(empty.getData(), (int)empty.getSize());
+    ns += elapsedNs(start);
+    times.push_back(ns / 1.0e6);
+    instances.push_back(std::move(p));
+  }
+  const auto start = Clock::now();
+  instances.clear();
+  const double destroyMs = elapsedNs(start) / 1.0e6 / numInstances;
+
+  const double firstMs = times.front();
+  times.erase(times.begin());
+  results.add("instantiate", "first instance", firstMs, "ms");
+  results.add("instantiate", "median", median(times), "ms")
+      .setProperty("instances", numInstances);
+  results.add("instantiate", "p99", percentile(times, 0.99), "ms")
+      .setProperty("instances", numInstances);
+  results.add("instantiate", "destroy", destroyMs, "ms");
+  return median(times);
+}
+
+//==============================================================================
+// Test audio: a couple of partials under an envelope, plus a little noise so
+// lossless codecs can't cheat. Deterministic, so runs stay comparable.
+static juce::AudioBuffer<float> makeAudio(int numChannels, double sampleRate,
+                                          double seconds) {
+  const int n = (int)(sampleRate * seconds);
+  juce::AudioBuffer<float> audio(numChannels, n);
+  juce::Random random(42);
+  for (int ch = 0; ch < numChannels; ++ch) {
+    auto *d = audio.getWritePointer(ch);
+    for (int i = 0; i < n; ++i) {
+      const float t = (float)i / (float)sampleRate;
+      const float env = 0.3f + 0.6f * std::abs(std::sin(t * 1.3f));
+      d[i] = env * 0.6f *
+                 (std::sin(juce::MathConstants<float>::twoPi * 220.0f * t) +
+                  0.4f * std::sin(juce::MathConstants<float>::twoPi *
+                                  (440.0f + 3.0f * (float)ch) * t)) +
+             0.02f * (random.nextFloat() - 0.5f);
+    }
+  }
+  return audio;
+}
+
+static juce::File writeAudioFile(juce::AudioFormat &format,
+                                 const juce::String &name,
+                                 const juce::AudioBuffer<float> &audio,
+                                 double sampleRate) {
+  auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                  .getChildFile("btt_bench_" + name +
+                                format.getFileExtensions()[0]);
+  file.deleteFile();
+  if (auto *os = file.createOutputStream().release()) {
+    // Each codec at its middle quality setting.
+    const auto qualities = format.getQualityOptions();
+    std::unique_ptr<juce::AudioFormatWriter> w(format.createWriterFor(
+        os, sampleRate, (unsigned int)audio.getNumChannels(), 16, {},
+        qualities.isEmpty() ? 0 : qualities.size() / 2));
+    if (w != nullptr)
+      w->writeFromAudioSampleBuffer(audio, 0, audio.getNumSamples());
+    else
+      delete os;
+  }
+  return file;
+}
+
+static void setParam(BackingTrackTriggerProcessor &p, const juce::String &id,
+                     float value) {
+  if (auto *param = p.apvts.getParameter(id))
+    param->setValueNotifyingHost(
+        p.apvts.getParameterRange(id).convertTo0to1(value));
+}
+
+//==============================================================================
+// processBlock(): `voices` instances (one voice each) rendered in turn, as a
+// host with that many tracks would. The figure is the time per host sample
+// for all of them together. "varispeed" plays at 1.05x, the host at 126 BPM
+// over a 120 BPM track, against "playing" at 1x.
+enum class PlayMode { idle, playing, looping, fading, varispeed };
+
+// Reports a tempo, for varispeed.
+struct BenchPlayHead : public juce::AudioPlayHead {
+  juce::Optional<PositionInfo> getPosition() const override {
+    PositionInfo info;
+    info.setBpm(126.0);
+    return info;
+  }
+};
+
+static const char *getModeName(PlayMode mode) {
+  switch (mode) {
+  case PlayMode::idle:
+    return "idle";
+  case PlayMode::playing:
+    return "playing";
+  case PlayMode::looping:
+    return "looping";
+  case PlayMode::fading:
+    return "fading";
+  case PlayMode::varispeed:
+    return "varispeed";
+  }
+  return "";
+}
+
+static double benchProcessBlock(const juce::File &sample, int blockSize,
+                                int voices, PlayMode mode, int roundMs,
+                                int rounds) {
+  constexpr double rate = 48000.0;
+  BenchPlayHead playHead;
+  std::vector<std::unique_ptr<BackingTrackTriggerProcessor>> procs;
+  for (int v = 0; v < voices; ++v) {
+    auto p = std::make_unique<BackingTrackTriggerProcessor>();
+    p->setPlayHead(&playHead);
+    p->prepareToPlay(rate, blockSize);
+    p->loadSample(sample);
+    waitUntilLoaded(*p);
+    setParam(*p, "loop", mode == PlayMode::looping ? 1.0f : 0.0f);
+    // Longest fade-in, restarted every half second: always mid-fade.
+    setParam(*p, "fadeIn", mode == PlayMode::fading ? 2000.0f : 3.0f);
+    setParam(*p, "varispeed", mode == PlayMode::varispeed ? 1.0f : 0.0f);
+    setParam(*p, "trackTempo", 120.0f);
+    if (mode != PlayMode::idle)
+      p->triggerPlayback();
+    procs.push_back(std::move(p));
+  }
+
+  juce::AudioBuffer<float> buffer(2, blockSize);
+  juce::MidiBuffer midi;
+  const int blocksPerChunk = juce::jmax(1, (int)(rate * 0.5) / blockSize);
+
+  auto renderChunk = [&] {
+    for (int b = 0; b < blocksPerChunk; ++b)
+      for (auto &p : procs) {
+        buffer.clear();
+        p->processBlock(buffer, midi);
+      }
+  };
+  auto keepState = [&] {
+    for (auto &p : procs)
+      if (mode == PlayMode::fading ||
+          ((mode == PlayMode::playing || mode == PlayMode::varispeed) &&
+           !p->isPlaying()))
+        p->triggerPlayback();
+  };
+
+  renderChunk(); // warm-up
+  std::vector<double> nsPerSample;
+  for (int r = 0; r < rounds; ++r) {
+    double ns = 0.0;
+    juce::int64 samples = 0;
+    while (ns < roundMs * 1.0e6) {
+      keepState();
+      const auto start = Clock::now();
+      renderChunk();
+      ns += elapsedNs(start);
+      samples += (juce::int64)blocksPerChunk * blockSize;
+    }
+    nsPerSample.push_back(ns / (double)samples);
+  }
+  return median(nsPerSample);
+}
+
+static void runProcessBlock(Results &results, bool quick) {
+  const juce::Array<int> blockSizes =
+      quick ? juce::Array<int>{64, 512}
+            : juce::Array<int>{32, 64, 128, 256, 512, 1024, 2048};
+  const juce::Array<int> voiceCounts =
+      quick ? juce::Array<int>{1, 8} : juce::Array<int>{1, 8, 32};
+  const int roundMs = quick ? 20 : 60;
+  const int rounds = quick ? 3 : 5;
+
+  juce::WavAudioFormat wav;
+  for (int channels : {1, 2}) {
+    const auto file =
+        writeAudioFile(wav, channels == 1 ? "mono" : "stereo",
+                       makeAudio(channels, 48000.0, 10.0), 48000.0);
+    for (auto mode : {PlayMode::idle, PlayMode::playing, PlayMode::looping,
+                      PlayMode::fading, PlayMode::varispeed})
+      for (int voices : voiceCounts)
+        for (int blockSize : blockSizes) {
+          // 32 instances at every block size adds little; keep one.
+          if (voices > 8 && blockSize != 512)
+            continue;
+          const auto ns = benchProcessBlock(file, blockSize, voices, mode,
+                                            roundMs, rounds);
+          auto &entry = results.add(
+              "processBlock",
+              juce::String(getModeName(mode)) + " " +
+                  (channels == 1 ? "mono" : "stereo") + " x" +
+                  juce::String(voices) + " @" + juce::String(blockSize),
+              ns, "ns/sample");
+          entry.setProperty("blockSize", blockSize);
+          entry.setProperty("channels", channels);
+          entry.setProperty("state", getModeName(mode));
+          entry.setProperty("voices", voices);
+        }
+    file.deleteFile();
+  }
+}
+
+//==============================================================================
+static void runLoad(Results &results, bool quick) {
+  const double seconds = quick ? 10.0 : 60.0;
+  const int runs = quick ? 3 : 5;
+  const auto audio = makeAudio(2, 48000.0, seconds);
+
+  juce::WavAudioFormat wav;
+  juce::AiffAudioFormat aiff;
+  juce::FlacAudioFormat flac;
+  juce::OggVorbisAudioFormat ogg;
+  const std::pair<const char *, juce::AudioFormat *> formats[] = {
+      {"wav", &wav}, {"aiff", &aiff}, {"flac", &flac}, {"ogg", &ogg}};
+
+  for (const auto &format : formats) {
+    const auto file = writeAudioFile(*format.second, "load", audio, 48000.0);
+    // At the file's own rate, then with a resample on top.
+    for (double hostRate : {48000.0, 44100.0}) {
+      BackingTrackTriggerProcessor p;
+      p.prepareToPlay(hostRate, 512);
+      const auto ms = medianMs(runs, [&] {
+        p.loadSample(file);
+        waitUntilLoaded(p);
+      });
+      auto &entry = results.add(
+          "loadSample",
+          juce::String(format.first) +
+              (hostRate == 48000.0 ? "" : " -> 44.1 kHz"),
+          ms, "ms");
+      entry.setProperty("format", format.first);
+      entry.setProperty("seconds", seconds);
+      entry.setProperty("hostRate", hostRate);
+      entry.setProperty("fileBytes", file.getSize());
+    }
+    file.deleteFile();
+  }
+}
+
+//==============================================================================
+static void runResample(Results &results, bool quick) {
+  const double seconds = quick ? 5.0 : 20.0;
+  const int runs = quick ? 3 : 5;
+  const std::pair<double, double> pairs[] = {{44100.0, 48000.0},
+                                             {48000.0, 44100.0},
+                                             {96000.0, 48000.0},
+                                             {48000.0, 96000.0},
+                                             {22050.0, 48000.0}};
+
+  for (const auto &rates : pairs) {
+    const auto src = makeAudio(2, rates.first, seconds);
+    // Live loads (Lagrange), then offline renders (windowed sinc).
+    for (bool bestQuality : {false, true}) {
+      juce::AudioBuffer<float> dst;
+      const auto ms = medianMs(runs, [&] {
+        BackingTrackTriggerProcessor::resampleInto(
+            src, rates.first, dst, rates.second, nullptr, bestQuality);
+      });
+      const auto ns = ms * 1.0e6 / (double)(dst.getNumSamples() * 2);
+      auto &entry = results.add(
+          "resampleInto",
+          juce::String(rates.first / 1000.0, 2) + " -> " +
+              juce::String(rates.second / 1000.0, 2) + " kHz" +
+              (bestQuality ? " (best)" : ""),
+          ns, "ns/sample");
+      entry.setProperty("srcRate", rates.first);
+      entry.setProperty("dstRate", rates.second);
+      entry.setProperty("bestQuality", bestQuality);
+    }
+  }
+}
+
+//==============================================================================
+// Project state for a loaded stereo track: saved without audio (a path),
+// with FLAC, and with Vorbis. "first save" includes the encode that turning
+// embedding on starts; later saves reuse its result.
+static void runState(Results &results, bool quick) {
+  const double seconds = quick ? 10.0 : 60.0;
+  const int runs = quick ? 3 : 5;
+  juce::WavAudioFormat wav;
+  const auto file =
+      writeAudioFile(wav, "state", makeAudio(2, 48000.0, seconds), 48000.0);
+
+  struct Variant {
+    const char *name;
+    bool embed;
+    EmbeddedAudio::Codec codec;
+  };
+  const Variant variants[] = {{"path only", false, EmbeddedAudio::Codec::flac},
+                              {"flac", true, EmbeddedAudio::Codec::flac},
+                              {"vorbis", true,
+                               EmbeddedAudio::Codec::oggVorbis}};
+
+  for (const auto &variant : variants) {
+    auto makeLoaded = [&] {
+      auto p = std::make_unique<BackingTrackTriggerProcessor>();
+      p->prepareToPlay(48000.0, 512);
+      p->loadSample(file);
+      waitUntilLoaded(*p);
+      auto settings = p->getEmbedSettings();
+      settings.codec = variant.codec;
+      p->setEmbedSettings(settings);
+      return p;
+    };
+
+    juce::MemoryBlock state;
+    if (variant.embed) {
+      std::vector<double> times;
+      for (int i = 0; i < runs; ++i) {
+        auto p = makeLoaded();
+        const auto start = Clock::now();
+        p->setEmbedEnabled(true);
+        state.reset();
+        p->getStateInformation(state);
+        times.push_back(elapsedNs(start) / 1.0e6);
+      }
+      results.add("getStateInformation",
+                  juce::String(variant.name) + " (first save)", median(times),
+                  "ms");
+    }
+
+    auto p = makeLoaded();
+    p->setEmbedEnabled(variant.embed);
+    const auto getMs = medianMs(runs * 4, [&] {
+      state.reset();
+      p->getStateInformation(state);
+    });
+    auto &entry = results.add("getStateInformation", variant.name, getMs, "ms");
+    entry.setProperty("bytes", (juce::int64)state.getSize());
+    entry.setProperty("seconds", seconds);
+
+    const auto setMs = medianMs(runs, [&] {
+      BackingTrackTriggerProcessor restored;
+      restored.prepareToPlay(48000.0, 512);
+      restored.setStateInformation(state.getData(), (int)state.getSize());
+      waitUntilLoaded(restored);
+    });
+    results.add("setStateInformation", variant.name, setMs, "ms")
+        .setProperty("bytes", (juce::int64)state.getSize());
+  }
+  file.deleteFile();
+}
+
+//==============================================================================
+// The waveform view at the editor's size. "cold" rebuilds the cached layer
+// (a new sample, zoom or scroll); "warm" is a playhead-only repaint.
+static void runPaint(Results &results, bool quick) {
+  const int runs = quick ? 5 : 20;
+  juce::WavAudioFormat wav;
+  const auto file =
+      writeAudioFile(wav, "paint", makeAudio(2, 48000.0, 180.0), 48000.0);
+
+  BackingTrackTriggerProcessor p;
+  p.prepareToPlay(48000.0, 512);
+  p.loadSample(file);
+  waitUntilLoaded(p);
+  if (auto sample = p.getSample())
+    while ((sample->peaks != nullptr && !sample->peaks->isComplete()) ||
+           (sample->analysis != nullptr && !sample->analysis->isReady()))
+      juce::Thread::sleep(5);
+
+  WaveformDisplay display(p);
+  display.setBounds(0, 0, 680, 200);
+  juce::Image image(juce::Image::ARGB, display.getWidth(),
+                    display.getHeight(), true);
+  juce::Graphics g(image);
+
+  for (float zoom : {1.0f, 4.0f, 16.0f, 64.0f}) {
+    display.setZoom(zoom);
+    display.setViewOffset(0.5f);
+    const auto coldMs = medianMs(runs, [&] {
+      display.sampleChanged();
+      display.paintEntireComponent(g, false);
+    });
+    const auto warmMs =
+        medianMs(runs * 5, [&] { display.paintEntireComponent(g, false); });
+
+    const auto name = "zoom " + juce::String(zoom, 0) + "x";
+    results.add("WaveformDisplay::paint", name + " cold", coldMs, "ms")
+        .setProperty("zoom", (double)zoom);
+    results.add("WaveformDisplay::paint", name + " warm", warmMs, "ms")
+        .setProperty("zoom", (double)zoom);
+  }
+  file.deleteFile();
+}
+
+//==============================================================================
+int main(int argc, char *argv[]) {
+  juce::ScopedJuceInitialiser_GUI juceInit;
+
+  bool quick = false;
+  juce::File out;
+  double maxInstantiateMs = 0.0; // 0 = no limit
+  for (int i = 1; i < argc; ++i) {
+    const juce::String arg(argv[i]);
+    if (arg == "--quick")
+      quick = true;
+    else if (arg == "--out" && i + 1 < argc)
+      out = juce::File::getCurrentWorkingDirectory().getChildFile(argv[++i]);
+    else if (arg == "--max-instantiate-ms" && i + 1 < argc)
+      maxInstantiateMs = juce::String(argv[++i]).getDoubleValue();
+    else {
+      std::fprintf(stderr, "Usage: BackingTrackTriggerBench [--quick] "
+                           "[--out file] [--max-instantiate-ms ms]\n");
+      return 1;
+    }
+  }
+
+  Results results;
+  const double instantiateMs = runInstantiate(results, quick);
+  runProcessBlock(results, quick);
+  runLoad(results, quick);
+  runResample(results, quick);
+  runState(results, quick);
+  runPaint(results, quick);
+
+  auto *root = new juce::DynamicObject();
+  juce::var json(root);
+  root->setProperty("benchmark", "BackingTrackTriggerBench");
+  root->setProperty("version", 1); // of this format
+  root->setProperty("quick", quick);
+  root->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+  root->setProperty("juce", juce::SystemStats::getJUCEVersion());
+  root->setProperty("os", juce::SystemStats::getOperatingSystemName());
+  root->setProperty("cpu", juce::SystemStats::getCpuModel());
+  root->setProperty("cores", juce::SystemStats::getNumPhysicalCpus());
+#if JUCE_DEBUG
+  root->setProperty("build", "debug");
+#else
+  root->setProperty("build", "release");
+#endif
+  root->setProperty("results", juce::var(results.entries));
+
+  const auto text = juce::JSON::toString(json);
+  if (out == juce::File()) {
+    std::printf("%s\n", text.toRawUTF8());
+  } else if (!out.replaceWithText(text)) {
+    std::fprintf(stderr, "Couldn't write %s\n",
+                 out.getFullPathName().toRawUTF8());
+    return 1;
+  }
+
+  if (maxInstantiateMs > 0.0 && instantiateMs > maxInstantiateMs) {
+    std::fprintf(stderr,
+                 "REGRESSION instantiate: median %.3f ms, limit %.3f ms\n",
+                 instantiateMs, maxInstantiateMs);
+    return 2;
+  }
+  return 0;
+}
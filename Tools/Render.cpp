@@ -0,0 +1,307 @@
+// Bounces backing tracks offline: the plugin, triggered by a Standard MIDI
+// File, rendered through its own processBlock() as fast as the CPU allows.
+// Usage: BackingTrackTriggerRender [options] <input> <score.mid> <output> ...
+//
+//   <input>   an audio file, or saved plugin state (getStateInformation()
+//             data, e.g. a host's plugin chunk exported to a file)
+//   <output>  .wav or .flac
+//
+// Repeat the three arguments to render several jobs, --parallel at a time.
+// Options:
+//   --rate <Hz>      sample rate to render at (default 48000)
+//   --block <n>      block size (default 8192)
+//   --bits <16|24>   output bit depth (default 24)
+//   --tail <s>       longest the track may keep playing after the score ends
+//                    (default 600; a loop with no note-off stops there)
+//   --parallel <n>   jobs rendered at once (default: one per CPU core)
+//
+// Useful for rehearsal mixes and QA without a DAW.
+
+#include "../Source/PluginProcessor.h"
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <juce_audio_utils/juce_audio_utils.h>
+#include <thread>
+
+struct RenderSettings {
+  double sampleRate = 48000.0;
+  int blockSize = 8192;
+  int bitsPerSample = 24;
+  double tailSeconds = 600.0;
+  int parallel = 0; // 0 = one per core
+};
+
+struct RenderJob {
+  juce::File input, score, output;
+
+  // Filled in by renderJob().
+  juce::String error; // empty on success
+  double audioSeconds = 0.0, wallSeconds = 0.0;
+};
+
+// The transport of the bounce: playing from zero.
+struct RenderPlayHead : public juce::AudioPlayHead {
+  juce::Optional<PositionInfo> getPosition() const override {
+    PositionInfo info;
+    info.setIsPlaying(true);
+    info.setTimeInSamples(timeInSamples);
+    info.setTimeInSeconds((double)timeInSamples / sampleRate);
+    return info;
+  }
+
+  juce::int64 timeInSamples = 0;
+  double sampleRate = 48000.0;
+};
+
+//==============================================================================
+static bool readScore(const juce::File &file, juce::MidiMessageSequence &events,
+                      juce::String &error) {
+  juce::FileInputStream stream(file);
+  juce::MidiFile midi;
+  if (!stream.openedOk() || !midi.readFrom(stream)) {
+    error = "can't read " + file.getFullPathName() + " as a MIDI file";
+    return false;
+  }
+  midi.convertTimestampTicksToSeconds();
+
+  // Every track's channel messages, in time order.
+  for (int t = 0; t < midi.getNumTracks(); ++t)
+    for (const auto *holder : *midi.getTrack(t))
+      if (!holder->message.isMetaEvent())
+        events.addEvent(holder->message);
+  events.sort();
+
+  if (events.getNumEvents() == 0) {
+    error = file.getFileName() + " has no MIDI events";
+    return false;
+  }
+  return true;
+}
+
+static bool loadInput(BackingTrackTriggerProcessor &p, const juce::File &file,
+                      juce::String &error) {
+  juce::AudioFormatManager formats;
+  formats.registerBasicFormats();
+
+  if (formats.findFormatForFileExtension(file.getFileExtension()) != nullptr) {
+    p.loadSample(file);
+  } else {
+    juce::MemoryBlock state;
+    if (!file.loadFileAsData(state)) {
+      error = "can't read " + file.getFullPathName();
+      return false;
+    }
+    p.setStateInformation(state.getData(), (int)state.getSize());
+  }
+
+  while (p.isLoading()) // the audio is read in the background
+    juce::Thread::sleep(1);
+  if (!p.hasSampleLoaded()) {
+    error = "no audio could be loaded from " + file.getFullPathName();
+    return false;
+  }
+  return true;
+}
+
+static std::unique_ptr<juce::AudioFormatWriter>
+createWriter(const juce::File &file, const RenderSettings &settings,
+             juce::String &error) {
+  std::unique_ptr<juce::AudioFormat> format;
+  if (file.hasFileExtension("wav"))
+    format = std::make_unique<juce::WavAudioFormat>();
+  else if (file.hasFileExtension("flac"))
+    format = std::make_unique<juce::FlacAudioFormat>();
+  else {
+    error = file.getFileName() + ": the output must be .wav or .flac";
+    return nullptr;
+  }
+
+  file.deleteFile();
+  auto stream = file.createOutputStream();
+  if (stream == nullptr) {
+    error = "can't write " + file.getFullPathName();
+    return nullptr;
+  }
+  std::unique_ptr<juce::AudioFormatWriter> writer(format->createWriterFor(
+      stream.get(), settings.sampleRate, 2, settings.bitsPerSample, {}, 0));
+  if (writer == nullptr) {
+    error = "can't encode " + file.getFileName() + " at these settings";
+    return nullptr;
+  }
+  stream.release(); // the writer owns it now
+  return writer;
+}
+
+//==============================================================================
+// Renders one job. Each job has its own processor, set up and driven from a
+// single thread (standing in for the host's message and audio threads).
+static void renderJob(RenderJob &job, const RenderSettings &settings) {
+  const auto startMs = juce::Time::getMillisecondCounterHiRes();
+
+  juce::MidiMessageSequence score;
+  if (!readScore(job.score, score, job.error))
+    return;
+
+  BackingTrackTriggerProcessor p;
+  p.setNonRealtime(true);
+  p.prepareToPlay(settings.sampleRate, settings.blockSize);
+  if (!loadInput(p, job.input, job.error))
+    return;
+
+  auto writer = createWriter(job.output, settings, job.error);
+  if (writer == nullptr)
+    return;
+
+  RenderPlayHead playHead;
+  playHead.sampleRate = settings.sampleRate;
+  p.setPlayHead(&playHead);
+
+  const auto toSamples = [&](double seconds) {
+    return (juce::int64)std::llround(seconds * settings.sampleRate);
+  };
+  const juce::int64 scoreEnd = toSamples(score.getEndTime()) + 1;
+  const juce::int64 limit = scoreEnd + toSamples(settings.tailSeconds);
+
+  juce::AudioBuffer<float> buffer(2, settings.blockSize);
+  juce::MidiBuffer midi;
+  int nextEvent = 0;
+  juce::int64 position = 0;
+
+  // Until the score is over and the track has stopped (or hit the tail).
+  while (position < scoreEnd || (p.isPlaying() && position < limit)) {
+    const int n = settings.blockSize;
+    midi.clear();
+    for (; nextEvent < score.getNumEvents(); ++nextEvent) {
+      const auto &message = score.getEventPointer(nextEvent)->message;
+      const auto time = toSamples(message.getTimeStamp());
+      if (time >= position + n)
+        break;
+      midi.addEvent(message, (int)juce::jmax<juce::int64>(0, time - position));
+    }
+
+    playHead.timeInSamples = position;
+    buffer.clear();
+    p.processBlock(buffer, midi);
+    if (!writer->writeFromAudioSampleBuffer(buffer, 0, n)) {
+      job.error = "writing " + job.output.getFullPathName() + " failed";
+      break;
+    }
+    position += n;
+  }
+
+  p.setPlayHead(nullptr);
+  p.releaseResources();
+  writer = nullptr; // finishes the file
+
+  job.audioSeconds = (double)position / settings.sampleRate;
+  job.wallSeconds =
+      (juce::Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+}
+
+static void printUsage() {
+  std::fprintf(stderr,
+               "Usage: BackingTrackTriggerRender [--rate Hz] [--block n] "
+               "[--bits 16|24]\n"
+               "         [--tail s] [--parallel n] "
+               "<input> <score.mid> <output.wav|flac> ...\n");
+}
+
+//==============================================================================
+int main(int argc, char *argv[]) {
+  juce::ScopedJuceInitialiser_GUI juceInit;
+
+  RenderSettings settings;
+  juce::StringArray positional;
+  for (int i = 1; i < argc; ++i) {
+    const juce::String arg(argv[i]);
+    if (!arg.startsWith("--")) {
+      positional.add(arg);
+      continue;
+    }
+    if (i + 1 >= argc) {
+      printUsage();
+      return 1;
+    }
+    const juce::String value(argv[++i]);
+    if (arg == "--rate")
+      settings.sampleRate = value.getDoubleValue();
+    else if (arg == "--block")
+      settings.blockSize = value.getIntValue();
+    else if (arg == "--bits")
+      settings.bitsPerSample = value.getIntValue();
+    else if (arg == "--tail")
+      settings.tailSeconds = value.getDoubleValue();
+    else if (arg == "--parallel")
+      settings.parallel = value.getIntValue();
+    else {
+      printUsage();
+      return 1;
+    }
+  }
+
+  if (positional.isEmpty() || positional.size() % 3 != 0 ||
+      settings.sampleRate < 8000.0 || settings.blockSize < 1 ||
+      (settings.bitsPerSample != 16 && settings.bitsPerSample != 24) ||
+      settings.tailSeconds < 0.0) {
+    printUsage();
+    return 1;
+  }
+
+  const auto cwd = juce::File::getCurrentWorkingDirectory();
+  std::vector<RenderJob> jobs((size_t)(positional.size() / 3));
+  for (size_t j = 0; j < jobs.size(); ++j) {
+    jobs[j].input = cwd.getChildFile(positional[(int)j * 3]);
+    jobs[j].score = cwd.getChildFile(positional[(int)j * 3 + 1]);
+    jobs[j].output = cwd.getChildFile(positional[(int)j * 3 + 2]);
+  }
+
+  const int numThreads = juce::jlimit(
+      1, (int)jobs.size(),
+      settings.parallel > 0 ? settings.parallel
+                            : juce::SystemStats::getNumCpus());
+  const auto startMs = juce::Time::getMillisecondCounterHiRes();
+
+  // Workers take the next job until none are left.
+  std::atomic<size_t> next{0};
+  auto work = [&] {
+    for (size_t j = next++; j < jobs.size(); j = next++) {
+      renderJob(jobs[j], settings);
+      const auto &job = jobs[j];
+      if (job.error.isNotEmpty())
+        juce::Logger::writeToLog("FAILED " + job.output.getFileName() + ": " +
+                                 job.error);
+      else
+        juce::Logger::writeToLog(
+            "Rendered " + job.output.getFullPathName() + ": " +
+            juce::String(job.audioSeconds, 1) + " s in " +
+            juce::String(job.wallSeconds, 2) + " s (" +
+            juce::String(job.audioSeconds / job.wallSeconds, 1) +
+            "x real time)");
+    }
+  };
+  std::vector<std::thread> workers;
+  for (int t = 1; t < numThreads; ++t)
+    workers.emplace_back(work);
+  work();
+  for (auto &worker : workers)
+    worker.join();
+
+  const auto wallSeconds =
+      (juce::Time::getMillisecondCounterHiRes() - startMs) / 1000.0;
+  double audioSeconds = 0.0;
+  int failed = 0;
+  for (const auto &job : jobs) {
+    audioSeconds += job.audioSeconds;
+    failed += job.error.isNotEmpty() ? 1 : 0;
+  }
+  if (jobs.size() > 1)
+    juce::Logger::writeToLog(
+        juce::String((int)jobs.size() - failed) + " of " +
+        juce::String((int)jobs.size()) + " jobs, " +
+        juce::String(audioSeconds, 1) + " s of audio in " +
+        juce::String(wallSeconds, 2) + " s on " + juce::String(numThreads) +
+        " threads (" + juce::String(audioSeconds / wallSeconds, 1) +
+        "x real time)");
+  return failed == 0 ? 0 : 1;
+}
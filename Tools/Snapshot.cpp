@@ -1,12 +1,66 @@
-// Renders the plugin editor to a PNG offline (no audio device, no window).
+// Renders the plugin editor to a PNG offline (no audio device, no window),
+// or, with --bench, times its painting.
 // Usage: BackingTrackTriggerSnapshot <output.png>
+//        BackingTrackTriggerSnapshot --bench [--quick] [--out results.json]
+//                                    [--baseline baseline.json]
 //
 // Useful for documentation and for eyeballing UI changes in CI.
+//
+// The paint benchmark loads synthetic tracks from 1 s to 2 h and paints the
+// whole editor and the WaveformDisplay on its own at several sizes and zoom
+// levels. Each configuration is painted "static" (nothing changed since the
+// last frame) and "scrolling" (the view pans every frame, sweeping from the
+// start of the track to the end). It reports the median and 99th-percentile
+// paint time and the heap allocations (operator new) per frame, as JSON in
+// the benchmark tool's format. It exits non-zero if a long track paints much
+// slower than a short one at the same settings, or if anything is well
+// behind --baseline (the JSON of an earlier run).
 
 #include "../Source/PluginEditor.h"
 #include "../Source/PluginProcessor.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
 #include <juce_audio_utils/juce_audio_utils.h>
+#include <map>
+#include <new>
+
+//==============================================================================
+// Allocation counting: operator new on the thread that paints, while a
+// frame is being measured. The peak and analysis workers don't count.
+namespace {
+thread_local bool countAllocations = false;
+std::atomic<juce::int64> allocations{0};
+} // namespace
+
+void *operator new(std::size_t size) {
+  if (countAllocations)
+    ++allocations;
+  if (auto *p = std::malloc(size == 0 ? 1 : size))
+    return p;
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  if (countAllocations)
+    ++allocations;
+  return std::malloc(size == 0 ? 1 : size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &tag) noexcept {
+  return operator new(size, tag);
+}
+
+void operator delete(void *ptr) noexcept { std::free(ptr); }
+void operator delete[](void *ptr) noexcept { std::free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { std::free(ptr); }
 
+//==============================================================================
 static juce::File makeDemoWav() {
   auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
                   .getChildFile("btt_snapshot_demo.wav");
@@ -39,21 +93,18 @@ static juce::File makeDemoWav() {
   return file;
 }
 
-int main(int argc, char *argv[]) {
-  juce::ScopedJuceInitialiser_GUI juceInit;
-
-  const juce::File out(argc > 1 ? juce::String(argv[1])
-                                : juce::String("editor.png"));
-
+static int writeSnapshot(const juce::File &out) {
   BackingTrackTriggerProcessor processor;
   processor.prepareToPlay(44100.0, 512);
 
   auto wav = makeDemoWav();
   processor.loadSample(wav);
+  while (processor.isLoading()) // the file is read in the background
+    juce::Thread::sleep(5);
   processor.setStartOffsetSeconds(0.42);
 
   std::unique_ptr<juce::AudioProcessorEditor> editor(processor.createEditor());
-  editor->setSize(700, 560);
+  editor->setSize(700, 586);
 
   auto image = editor->createComponentSnapshot(editor->getLocalBounds());
 
@@ -68,3 +119,350 @@ int main(int argc, char *argv[]) {
   wav.deleteFile();
   return 0;
 }
+
+//==============================================================================
+// Paint benchmark.
+namespace {
+constexpr double kTrackRate = 8000.0; // mono: keeps a 2 h track to ~230 MB
+constexpr double kMaxLengthScaling = 3.0; // longest track vs 1 s, per config
+constexpr double kNoiseFloorMs = 0.25;    // differences below this are noise
+constexpr double kBaselineTolerance = 1.5;
+constexpr int kReadyTimeoutMs = 300000;
+} // namespace
+
+using Clock = std::chrono::steady_clock;
+
+// A long, deterministic track, written a chunk at a time.
+static juce::File makeTrack(double seconds) {
+  auto file = juce::File::getSpecialLocation(juce::File::tempDirectory)
+                  .getChildFile("btt_paint_" + juce::String((int)seconds) +
+                                "s.wav");
+  file.deleteFile();
+
+  juce::WavAudioFormat wav;
+  auto *os = file.createOutputStream().release();
+  std::unique_ptr<juce::AudioFormatWriter> w(
+      os != nullptr ? wav.createWriterFor(os, kTrackRate, 1, 16, {}, 0)
+                    : nullptr);
+  if (w == nullptr) {
+    delete os;
+    return file;
+  }
+
+  const auto total = (juce::int64)(kTrackRate * seconds);
+  juce::AudioBuffer<float> chunk(1, 1 << 20);
+  juce::Random random(42);
+  for (juce::int64 pos = 0; pos < total; pos += chunk.getNumSamples()) {
+    const int n = (int)juce::jmin<juce::int64>(chunk.getNumSamples(),
+                                               total - pos);
+    auto *d = chunk.getWritePointer(0);
+    for (int i = 0; i < n; ++i) {
+      const double t = (double)(pos + i) / kTrackRate;
+      const float env = 0.3f + 0.6f * (float)std::abs(std::sin(t * 1.3));
+      d[i] = env * 0.7f *
+                 (float)std::sin(juce::MathConstants<double>::twoPi * 220.0 *
+                                 t) +
+             0.02f * (random.nextFloat() - 0.5f);
+    }
+    w->writeFromAudioSampleBuffer(chunk, 0, n);
+  }
+  return file;
+}
+
+static juce::String describeLength(double seconds) {
+  if (seconds >= 3600.0)
+    return juce::String(seconds / 3600.0, 0) + " h";
+  if (seconds >= 60.0)
+    return juce::String(seconds / 60.0, 0) + " min";
+  return juce::String(seconds, 0) + " s";
+}
+
+static double percentile(std::vector<double> values, double p) {
+  if (values.empty())
+    return 0.0;
+  std::sort(values.begin(), values.end());
+  const auto i = (size_t)std::ceil(p * (double)values.size()) - 1;
+  return values[juce::jmin(values.size() - 1, i)];
+}
+
+struct FrameStats {
+  double medianMs = 0.0, p99Ms = 0.0, allocsPerFrame = 0.0;
+};
+
+// Paints `component` `frames` times into an image of its size, calling
+// `beforeFrame(f)` (untimed) before each.
+template <typename Fn>
+static FrameStats measureFrames(juce::Component &component, int frames,
+                                Fn &&beforeFrame) {
+  juce::Image image(juce::Image::ARGB, component.getWidth(),
+                    component.getHeight(), true);
+  juce::Graphics g(image);
+
+  beforeFrame(0);
+  component.paintEntireComponent(g, false); // warm-up
+
+  std::vector<double> times;
+  juce::int64 allocated = 0;
+  for (int f = 0; f < frames; ++f) {
+    beforeFrame(f);
+    allocations = 0;
+    countAllocations = true;
+    const auto start = Clock::now();
+    component.paintEntireComponent(g, false);
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        Clock::now() - start)
+                        .count();
+    countAllocations = false;
+    allocated += allocations.load();
+    times.push_back((double)ns / 1.0e6);
+  }
+
+  FrameStats stats;
+  stats.medianMs = percentile(times, 0.5);
+  stats.p99Ms = percentile(times, 0.99);
+  stats.allocsPerFrame = (double)allocated / frames;
+  return stats;
+}
+
+struct PaintBench {
+  bool quick = false;
+  juce::Array<juce::var> entries;
+  // Median per configuration and track length, for the length check.
+  std::map<juce::String, std::map<double, double>> byConfig;
+
+  void add(const juce::String &config, double seconds,
+           const FrameStats &stats, juce::DynamicObject *props) {
+    props->setProperty("group", "paint");
+    props->setProperty("name", config + ", " + describeLength(seconds));
+    props->setProperty("value", stats.medianMs);
+    props->setProperty("unit", "ms");
+    props->setProperty("p99Ms", stats.p99Ms);
+    props->setProperty("allocsPerFrame", stats.allocsPerFrame);
+    props->setProperty("seconds", seconds);
+    entries.add(juce::var(props));
+    byConfig[config][seconds] = stats.medianMs;
+    juce::Logger::writeToLog(
+        "paint / " + config + ", " + describeLength(seconds) + ": median " +
+        juce::String(stats.medianMs, 3) + " ms, p99 " +
+        juce::String(stats.p99Ms, 3) + " ms, " +
+        juce::String(stats.allocsPerFrame, 1) + " allocs/frame");
+  }
+
+  // Every size / zoom / scenario of one component.
+  void run(juce::Component &component, WaveformDisplay &display,
+           const juce::String &target, double seconds,
+           const juce::Array<juce::Rectangle<int>> &sizes,
+           const juce::Array<float> &zooms) {
+    const int frames = quick ? 30 : 120;
+    for (const auto &size : sizes)
+      for (float zoom : zooms)
+        for (bool scrolling : {false, true}) {
+          component.setBounds(size);
+          display.setZoom(zoom);
+          display.setViewOffset(0.5f);
+          const auto stats =
+              measureFrames(component, frames, [&](int f) {
+                if (scrolling)
+                  display.setViewOffset((float)f / (float)(frames - 1));
+              });
+
+          const auto config = target + " " + juce::String(size.getWidth()) +
+                              "x" + juce::String(size.getHeight()) +
+                              " zoom " + juce::String(zoom, 0) + "x " +
+                              (scrolling ? "scrolling" : "static");
+          auto *props = new juce::DynamicObject();
+          props->setProperty("target", target);
+          props->setProperty("width", size.getWidth());
+          props->setProperty("height", size.getHeight());
+          props->setProperty("zoom", (double)zoom);
+          props->setProperty("scenario", scrolling ? "scrolling" : "static");
+          add(config, seconds, stats, props);
+        }
+  }
+};
+
+static WaveformDisplay *findWaveformDisplay(juce::Component &parent) {
+  for (int i = 0; i < parent.getNumChildComponents(); ++i)
+    if (auto *display =
+            dynamic_cast<WaveformDisplay *>(parent.getChildComponent(i)))
+      return display;
+  return nullptr;
+}
+
+static bool waitUntilReady(const BackingTrackTriggerProcessor &p) {
+  const auto deadline =
+      juce::Time::getMillisecondCounter() + (juce::uint32)kReadyTimeoutMs;
+  auto ready = [&] {
+    if (p.isLoading())
+      return false;
+    auto sample = p.getSample();
+    return sample != nullptr &&
+           (sample->peaks == nullptr || sample->peaks->isComplete()) &&
+           (sample->analysis == nullptr || sample->analysis->isReady());
+  };
+  while (!ready()) {
+    if (juce::Time::getMillisecondCounter() > deadline)
+      return false;
+    juce::Thread::sleep(10);
+  }
+  return true;
+}
+
+// The regressions: the longest track against the shortest, per
+// configuration, and every entry against the baseline's.
+static juce::StringArray findRegressions(const PaintBench &bench,
+                                         const juce::var &baseline) {
+  juce::StringArray problems;
+  for (const auto &config : bench.byConfig) {
+    const auto &times = config.second;
+    if (times.size() < 2)
+      continue;
+    const double shortMs = times.begin()->second;
+    const double longMs = times.rbegin()->second;
+    if (longMs > shortMs * kMaxLengthScaling &&
+        longMs - shortMs > kNoiseFloorMs)
+      problems.add(config.first + ": " +
+                   describeLength(times.rbegin()->first) + " paints in " +
+                   juce::String(longMs, 3) + " ms, " +
+                   describeLength(times.begin()->first) + " in " +
+                   juce::String(shortMs, 3) + " ms");
+  }
+
+  std::map<juce::String, const juce::DynamicObject *> previous;
+  if (auto *list = baseline["results"].getArray())
+    for (const auto &entry : *list)
+      if (auto *obj = entry.getDynamicObject())
+        previous[obj->getProperty("name").toString()] = obj;
+
+  for (const auto &entry : bench.entries) {
+    const auto name = entry["name"].toString();
+    const auto found = previous.find(name);
+    if (found == previous.end())
+      continue;
+    const double was = found->second->getProperty("value");
+    const double now = entry["value"];
+    if (now > was * kBaselineTolerance && now - was > kNoiseFloorMs)
+      problems.add(name + ": " + juce::String(now, 3) + " ms, was " +
+                   juce::String(was, 3) + " ms");
+    const double allocsWas = found->second->getProperty("allocsPerFrame");
+    const double allocsNow = entry["allocsPerFrame"];
+    if (allocsNow > allocsWas * kBaselineTolerance + 1.0)
+      problems.add(name + ": " + juce::String(allocsNow, 1) +
+                   " allocations per frame, was " +
+                   juce::String(allocsWas, 1));
+  }
+  return problems;
+}
+
+static int runPaintBench(bool quick, const juce::File &out,
+                         const juce::File &baselineFile) {
+  juce::var baseline;
+  if (baselineFile != juce::File()) {
+    baseline = juce::JSON::parse(baselineFile.loadFileAsString());
+    if (baseline["results"].getArray() == nullptr) {
+      std::fprintf(stderr, "Can't read %s\n",
+                   baselineFile.getFullPathName().toRawUTF8());
+      return 1;
+    }
+  }
+
+  PaintBench bench;
+  bench.quick = quick;
+  const juce::Array<double> lengths =
+      quick ? juce::Array<double>{1.0, 600.0, 7200.0}
+            : juce::Array<double>{1.0, 60.0, 600.0, 3600.0, 7200.0};
+
+  for (double seconds : lengths) {
+    auto file = makeTrack(seconds);
+    BackingTrackTriggerProcessor processor;
+    processor.prepareToPlay(kTrackRate, 512);
+    // The editor stays open so the memory budget never evicts the track.
+    std::unique_ptr<juce::AudioProcessorEditor> editor(
+        processor.createEditor());
+    processor.loadSample(file);
+    if (!waitUntilReady(processor)) {
+      std::fprintf(stderr, "%s didn't load\n",
+                   describeLength(seconds).toRawUTF8());
+      return 1;
+    }
+    processor.setStartOffsetSeconds(seconds * 0.1);
+
+    if (auto *display = findWaveformDisplay(*editor))
+      bench.run(*editor, *display, "editor", seconds,
+                {{0, 0, 700, 586}, {0, 0, 1400, 1172}}, {1.0f, 200.0f});
+
+    WaveformDisplay display(processor);
+    bench.run(display, display, "waveform", seconds,
+              quick ? juce::Array<juce::Rectangle<int>>{{0, 0, 680, 200}}
+                    : juce::Array<juce::Rectangle<int>>{{0, 0, 680, 200},
+                                                        {0, 0, 1920, 400}},
+              {1.0f, 16.0f, 200.0f});
+
+    editor = nullptr;
+    file.deleteFile();
+  }
+
+  auto *root = new juce::DynamicObject();
+  juce::var json(root);
+  root->setProperty("benchmark", "BackingTrackTriggerSnapshot --bench");
+  root->setProperty("version", 1); // of this format
+  root->setProperty("quick", quick);
+  root->setProperty("time", juce::Time::getCurrentTime().toISO8601(true));
+  root->setProperty("juce", juce::SystemStats::getJUCEVersion());
+  root->setProperty("os", juce::SystemStats::getOperatingSystemName());
+  root->setProperty("cpu", juce::SystemStats::getCpuModel());
+#if JUCE_DEBUG
+  root->setProperty("build", "debug");
+#else
+  root->setProperty("build", "release");
+#endif
+  root->setProperty("results", juce::var(bench.entries));
+
+  const auto text = juce::JSON::toString(json);
+  if (out == juce::File()) {
+    std::printf("%s\n", text.toRawUTF8());
+  } else if (!out.replaceWithText(text)) {
+    std::fprintf(stderr, "Couldn't write %s\n",
+                 out.getFullPathName().toRawUTF8());
+    return 1;
+  }
+
+  const auto problems = findRegressions(bench, baseline);
+  for (const auto &problem : problems)
+    std::fprintf(stderr, "REGRESSION %s\n", problem.toRawUTF8());
+  return problems.isEmpty() ? 0 : 2;
+}
+
+//==============================================================================
+int main(int argc, char *argv[]) {
+  juce::ScopedJuceInitialiser_GUI juceInit;
+  const auto cwd = juce::File::getCurrentWorkingDirectory();
+
+  bool bench = false, quick = false;
+  juce::File out, baseline, png;
+  for (int i = 1; i < argc; ++i) {
+    const juce::String arg(argv[i]);
+    if (arg == "--bench")
+      bench = true;
+    else if (arg == "--quick")
+      quick = true;
+    else if (arg == "--out" && i + 1 < argc)
+      out = cwd.getChildFile(argv[++i]);
+    else if (arg == "--baseline" && i + 1 < argc)
+      baseline = cwd.getChildFile(argv[++i]);
+    else if (!arg.startsWith("--") && png == juce::File())
+      png = cwd.getChildFile(arg);
+    else {
+      std::fprintf(stderr,
+                   "Usage: BackingTrackTriggerSnapshot <output.png>\n"
+                   "       BackingTrackTriggerSnapshot --bench [--quick] "
+                   "[--out file] [--baseline file]\n");
+      return 1;
+    }
+  }
+
+  if (bench)
+    return runPaintBench(quick, out, baseline);
+  return writeSnapshot(png != juce::File() ? png
+                                           : cwd.getChildFile("editor.png"));
+}